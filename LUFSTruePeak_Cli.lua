@@ -0,0 +1,131 @@
+-- Headless command line analyzer, benchmark and loudness meter library: LufsProcessor and true peak 
+-- without GUI, audio device or plugin code, so that they build on Linux servers too
+solution "LUFSTruePeak_Cli"
+if ( _ACTION == "gmake" ) then
+    -- ThreadSanitizer: LUFSTruePeak_Cli --self-test runs the threaded tests with data race detection
+    configurations { "Debug", "Release", "ThreadSanitizer" }
+else
+    configurations { "Debug", "Release" }
+end
+
+if ( _ACTION == "vs2012" ) then
+    location "build/vs2012"
+elseif ( _ACTION == "xcode4" ) then
+    location "build/xcode4"
+elseif ( _ACTION == "gmake" ) then
+    location "build/gmake"
+else
+    location "build/todo_set_platform"
+end
+
+    includedirs { 
+        "source", 
+        "extern/juce", 
+    }
+    objdir "build/temp_cli"
+    platforms "x64"
+    targetdir "build/bin"
+
+function headlessProject( name, projectKind, projectFiles )
+    project( name )
+        kind( projectKind )
+        language "C++"
+
+        files { 
+            "source/AudioProcessing.h", 
+            "source/AudioProcessing.cpp", 
+            "source/AudioStreamReader.h", 
+            "source/AudioStreamReader.cpp", 
+            "source/LufsChannelLayout.h", 
+            "source/LufsChannelLayout.cpp", 
+            "source/LufsHistoryIndex.h", 
+            "source/LufsHistoryIndex.cpp", 
+            "source/LufsHistoryPyramid.h", 
+            "source/LufsHistoryPyramid.cpp", 
+            "source/LufsProcessor.h", 
+            "source/LufsProcessor.cpp", 
+            "source/LufsSessionLog.h", 
+            "source/LufsSessionLog.cpp", 
+            "extern/juce/modules/juce_audio_basics/juce_audio_basics.cpp",
+            "extern/juce/modules/juce_audio_formats/juce_audio_formats.cpp",
+            "extern/juce/modules/juce_core/juce_core.cpp",
+        }
+        files( projectFiles )
+
+        defines { 
+            "LUFS_TRUEPEAK_CLI",
+        }
+
+if ( _ACTION == "vs2012" ) then
+        flags { "StaticRuntime", "Unicode", "NoRuntimeChecks" }
+        defines { "LUFS_TRUEPEAK_WINDOWS" }
+elseif ( _ACTION == "xcode4" ) then
+        flags { "StaticRuntime", "Unicode" }
+        defines { "LUFS_TRUEPEAK_MACOS" }
+        links { 
+            "AudioToolBox.framework", 
+            "CoreAudio.framework", 
+            "Foundation.framework", 
+            "IOKit.framework", 
+            "Carbon.framework", 
+        }
+elseif ( _ACTION == "gmake" ) then
+        buildoptions { "-std=c++11" }
+        defines { "LINUX" }
+        links { "pthread", "dl", "rt" }
+end
+
+        configuration "Debug"
+            defines "DEBUG"
+            flags { "Symbols", "ExtraWarnings", }
+
+        configuration "Release"
+            defines "NDEBUG"
+            flags "Optimize"
+
+        configuration "ThreadSanitizer"
+            defines "NDEBUG"
+            flags "Symbols"
+            buildoptions { "-O1", "-fsanitize=thread" }
+            linkoptions { "-fsanitize=thread" }
+end
+
+-- file analyzer
+headlessProject( "LUFSTruePeak_Cli_x64", "ConsoleApp", { 
+    "source/LufsAnalysisThread.h", 
+    "source/LufsAnalysisThread.cpp", 
+    "source/LufsFileAnalyzer.h", 
+    "source/LufsFileAnalyzer.cpp", 
+    "source/LufsCommandLine.cpp", 
+} )
+
+-- benchmark of each processing stage
+headlessProject( "LUFSTruePeak_Benchmark_x64", "ConsoleApp", { 
+    "source/LufsTextExporter.h", 
+    "source/LufsTextExporter.cpp", 
+    "source/LufsBenchmark.cpp", 
+} )
+
+-- loudness meter library with C interface (source/LufsMeter.h), to embed in other programs; 
+-- C++ programs monitoring many streams can also use source/LufsStreamEngine.h
+headlessProject( "LUFSTruePeak_Core_x64", "StaticLib", { 
+    "source/LufsMeter.h", 
+    "source/LufsMeter.cpp", 
+    "source/LufsStreamEngine.h", 
+    "source/LufsStreamEngine.cpp", 
+} )
+if ( _ACTION == "gmake" ) then
+    configuration {}
+        buildoptions { "-fPIC" }
+end
+
+-- same library as a shared library, only exporting the C interface
+headlessProject( "LUFSTruePeak_CoreShared_x64", "SharedLib", { 
+    "source/LufsMeter.h", 
+    "source/LufsMeter.cpp", 
+} )
+    configuration {}
+        defines { "LUFS_METER_BUILDING_SHARED" }
+if ( _ACTION == "gmake" or _ACTION == "xcode4" ) then
+        buildoptions { "-fvisibility=hidden" }
+end
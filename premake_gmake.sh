@@ -0,0 +1,4 @@
+#!/bin/sh
+# Linux command line analyzer: then run make -C build/gmake config=release64
+# (config=threadsanitizer64 to run LUFSTruePeak_Cli --self-test under ThreadSanitizer)
+premake4 --file=LUFSTruePeak_Cli.lua gmake
@@ -26,6 +26,20 @@
 #define JUCE_DONT_ASSERT_ON_GLSL_COMPILE_ERROR 1
 #define JUCE_ENABLE_REPAINT_DEBUGGING 0
 
+#if defined ( LUFS_TRUEPEAK_CLI )
+
+// command line analyzer: no GUI, audio device or plugin modules, runs on headless servers
+#define JUCE_MODULE_AVAILABLE_juce_audio_basics          1
+#define JUCE_MODULE_AVAILABLE_juce_audio_formats         1
+#define JUCE_MODULE_AVAILABLE_juce_core                  1
+
+#if defined ( __linux__ )
+// bundled libFLAC declares its own lround, which conflicts with recent glibc math headers
+#define JUCE_USE_FLAC 0
+#endif
+
+#else // defined ( LUFS_TRUEPEAK_CLI )
+
 #define JUCE_MODULE_AVAILABLE_juce_audio_basics          1
 #define JUCE_MODULE_AVAILABLE_juce_audio_devices         1
 #define JUCE_MODULE_AVAILABLE_juce_audio_formats         1
@@ -42,6 +56,8 @@
 #define JUCE_MODULE_AVAILABLE_juce_opengl                0
 #define JUCE_MODULE_AVAILABLE_juce_video                 0
 
+#endif // defined ( LUFS_TRUEPEAK_CLI )
+
 #ifdef LUFS_TRUEPEAK_USING_ASIO
 #define JUCE_ASIO 1
 #endif 
@@ -58,12 +74,13 @@
 #define JucePlugin_VersionCode            0x10103
 #define JucePlugin_VersionString          "1.1.3"
 
-#define LUFS_TP_MAX_NB_CHANNELS 6
+#define LUFS_TP_MAX_NB_CHANNELS 16 // plugin buses, up to 9.1.6
+#define LUFS_TP_DEFAULT_NB_CHANNELS 6 // 5.1: application inputs, plugin bus until prepareToPlay
 
 #if defined ( LUFS_TRUEPEAK_PLUGIN )
 
-#if defined ( LUFS_TRUEPEAK_APPLICATION )
-#error ( "Either LUFS_TRUEPEAK_PLUGIN or LUFS_TRUEPEAK_APPLICATION must be defined" )
+#if defined ( LUFS_TRUEPEAK_APPLICATION ) || defined ( LUFS_TRUEPEAK_CLI )
+#error ( "Either LUFS_TRUEPEAK_PLUGIN, LUFS_TRUEPEAK_APPLICATION or LUFS_TRUEPEAK_CLI must be defined" )
 #endif 
 
 #define JUCE_VST3_CAN_REPLACE_VST2 0
@@ -115,7 +132,8 @@ to disable this if you want your VST2 + 3 versions to use different IDs and not
 #else
     #define JucePlugin_MaxNumInputChannels    LUFS_TP_MAX_NB_CHANNELS
     #define JucePlugin_MaxNumOutputChannels   LUFS_TP_MAX_NB_CHANNELS
-    #define JucePlugin_PreferredChannelConfigurations  {1, 1}, {2, 2}, {3, 3}, {4, 4}, {5, 5}, {6, 6}
+    #define JucePlugin_PreferredChannelConfigurations  {1, 1}, {2, 2}, {3, 3}, {4, 4}, {5, 5}, {6, 6}, {7, 7}, {8, 8}, \
+                                                       {9, 9}, {10, 10}, {11, 11}, {12, 12}, {13, 13}, {14, 14}, {15, 15}, {16, 16}
 #endif 
 
 #define JucePlugin_IsSynth                0
@@ -148,8 +166,8 @@ to disable this if you want your VST2 + 3 versions to use different IDs and not
 
 #else // defined ( LUFS_TRUEPEAK_PLUGIN )
 
-#if !defined ( LUFS_TRUEPEAK_APPLICATION )
-#error ( "Either LUFS_TRUEPEAK_PLUGIN or LUFS_TRUEPEAK_APPLICATION must be defined" )
+#if defined ( LUFS_TRUEPEAK_APPLICATION ) == defined ( LUFS_TRUEPEAK_CLI )
+#error ( "Either LUFS_TRUEPEAK_PLUGIN, LUFS_TRUEPEAK_APPLICATION or LUFS_TRUEPEAK_CLI must be defined" )
 #endif 
 
 #endif // defined ( LUFS_TRUEPEAK_PLUGIN )
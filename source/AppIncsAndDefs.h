@@ -25,6 +25,14 @@
 
 #include "AppConfig.h"
 
+#if defined ( LUFS_TRUEPEAK_CLI )
+
+#include "modules/juce_audio_basics/juce_audio_basics.h"
+#include "modules/juce_audio_formats/juce_audio_formats.h"
+#include "modules/juce_core/juce_core.h"
+
+#else // defined ( LUFS_TRUEPEAK_CLI )
+
 #include "modules/juce_audio_basics/juce_audio_basics.h"
 #include "modules/juce_audio_devices/juce_audio_devices.h"
 #include "modules/juce_audio_formats/juce_audio_formats.h"
@@ -36,6 +44,8 @@
 #include "modules/juce_gui_basics/juce_gui_basics.h"
 #include "modules/juce_gui_extra/juce_gui_extra.h"
 
+#endif // defined ( LUFS_TRUEPEAK_CLI )
+
 //#define TESTCOLORS
 
 #define DEFAULT_MIN_VOLUME ( -100.f )
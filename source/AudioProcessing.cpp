@@ -27,6 +27,22 @@
 #include "AppIncsAndDefs.h"
 
 #include "AudioProcessing.h"
+#include "AudioStreamReader.h"
+
+#if JUCE_INTEL
+ #include <emmintrin.h>
+ #include <immintrin.h>
+ #if JUCE_MSVC
+  #include <intrin.h>
+  #define LUFS_TARGET_AVX
+ #else
+  #define LUFS_TARGET_AVX __attribute__(( target( "avx" ) ))
+ #endif
+#endif
+
+#if LUFS_NEON
+ #include <arm_neon.h>
+#endif
 
 const float filterPhase0[] =
 {
@@ -60,6 +76,23 @@ const float * filterPhaseArray[] = { filterPhase0, filterPhase1, filterPhase2, f
 
 const int numCoeffs = sizeof(filterPhase0) / sizeof(float);
 
+// source = last history samples then chunk, and history = last history samples of source,
+// so that filters processing chunks one by one get the samples preceding each chunk
+static void prependHistory( juce::AudioSampleBuffer & history, const juce::AudioSampleBuffer & chunk, juce::AudioSampleBuffer & source )
+{
+    const int historySize = history.getNumSamples();
+    const int numSamples = historySize + chunk.getNumSamples();
+
+    source.setSize( chunk.getNumChannels(), numSamples, false, false, true );
+
+    for ( int ch = 0 ; ch < chunk.getNumChannels() ; ++ch )
+    {
+        source.copyFrom( ch, 0, history, ch, 0, historySize );
+        source.copyFrom( ch, historySize, chunk, ch, 0, chunk.getNumSamples() );
+        history.copyFrom( ch, 0, source, ch, numSamples - historySize, historySize );
+    }
+}
+
 void AudioProcessing::TestOversampling( const juce::File & input )
 {
     juce::AudioFormatManager audioFormatManager;
@@ -69,14 +102,6 @@ void AudioProcessing::TestOversampling( const juce::File & input )
 
     if ( reader != nullptr )
     {
-        // read file
-        juce::AudioSampleBuffer origin( (int)reader->numChannels, (int)reader->lengthInSamples );
-        reader->read( &origin, 0, (int)reader->lengthInSamples, 0, true, true );
-
-        // Use polyphase FIR filter with coefficients for upsampling 4 times at 48KHz
-        juce::AudioSampleBuffer output;
-        polyphase4( origin, output );
-
         juce::String outputName = input.getFullPathName().substring(0, input.getFullPathName().length() - 4);
         juce::File outputFile( outputName + "_polyphase4.wav" );
         juce::FileOutputStream * outputStream = new juce::FileOutputStream( outputFile );
@@ -89,7 +114,23 @@ void AudioProcessing::TestOversampling( const juce::File & input )
 
         if ( writer != nullptr )
         {
-            writer->writeFromAudioSampleBuffer( output, 0, output.getNumSamples() );
+            // read file by chunks, numCoeffs - 1 previous samples are processed again with each chunk
+            AudioStreamReader streamReader( *reader );
+            juce::AudioSampleBuffer history( (int)reader->numChannels, numCoeffs - 1 );
+            history.clear();
+
+            juce::AudioSampleBuffer origin;
+            juce::AudioSampleBuffer output;
+
+            while ( const juce::AudioSampleBuffer * chunk = streamReader.readNextChunk() )
+            {
+                prependHistory( history, *chunk, origin );
+
+                // Use polyphase FIR filter with coefficients for upsampling 4 times at 48KHz
+                polyphase4( origin, output );
+
+                writer->writeFromAudioSampleBuffer( output, 4 * history.getNumSamples(), 4 * chunk->getNumSamples() );
+            }
             
             delete writer;
         }
@@ -111,12 +152,17 @@ float AudioProcessing::ProcessTruePeak( const juce::File & input )
 
     if ( reader != nullptr )
     {
-        // read file
-        juce::AudioSampleBuffer buffer( (int)reader->numChannels, (int)reader->lengthInSamples );
-        reader->read( &buffer, 0, (int)reader->lengthInSamples, 0, true, true );
-
+        // read file by chunks, value is the same as if the file was processed at once
         AudioProcessing::TruePeak truePeak;
-        TruePeak::LinearValue value = truePeak.process(buffer);
+        truePeak.beginValue( (int)reader->numChannels );
+
+        {
+            AudioStreamReader streamReader( *reader );
+            while ( const juce::AudioSampleBuffer * chunk = streamReader.readNextChunk() )
+                truePeak.addToValue( *chunk );
+        }
+
+        const TruePeak::LinearValue & value = truePeak.getValue();
 
         for (int i = 0 ; i < (int)reader->numChannels ; ++i)
         {
@@ -141,24 +187,20 @@ float AudioProcessing::ProcessTruePeak( const juce::File & input, const int buff
 
     if ( reader != nullptr )
     {
-        // read file
-        juce::AudioSampleBuffer buffer( (int)reader->numChannels, (int)reader->lengthInSamples );
-        reader->read( &buffer, 0, (int)reader->lengthInSamples, 0, true, true );
-
         AudioProcessing::TruePeak truePeak;
 
-        int offset = 0;
-        while (offset + bufferSize < (int)reader->lengthInSamples)
         {
-            juce::AudioSampleBuffer calcBuffer( buffer.getArrayOfWritePointers(), reader->numChannels, offset, bufferSize );
-
-            TruePeak::LinearValue value = truePeak.process(calcBuffer);
-            offset += bufferSize;
-
-            for (int i = 0 ; i < (int)reader->numChannels ; ++i)
+            // read file by bufferSize chunks
+            AudioStreamReader streamReader( *reader, bufferSize );
+            while ( const juce::AudioSampleBuffer * chunk = streamReader.readNextChunk() )
             {
-                if (truePeakValue < value.m_channelArray[i])
-                    truePeakValue = value.m_channelArray[i];
+                const TruePeak::LinearValue & value = truePeak.process( *chunk );
+
+                for (int i = 0 ; i < (int)reader->numChannels ; ++i)
+                {
+                    if (truePeakValue < value.m_channelArray[i])
+                        truePeakValue = value.m_channelArray[i];
+                }
             }
         }
 
@@ -245,70 +287,999 @@ float AudioProcessing::polyphase4ComputeSum( const float * input, int offset, in
 }
 
 
-AudioProcessing::TruePeak::TruePeak()
+/**
+    Polyphase4 abs max kernels.
+
+    Input samples are not bounds checked: the 11 samples before input[0] are read.
+    Each output sample is the sum for j = 0..11 of input[i-j] * coefficient[j], summed in
+    increasing j order in every kernel so that results stay identical to polyphase4ComputeSum
+    (when the compiler doesn't contract multiply and add).
+
+    Vectorized kernels compute 4 (SSE2, NEON) or 8 (AVX) consecutive input samples at once,
+    with one accumulator per polyphase filter: each input load is shared by the 4 phases.
+*/
+float AudioProcessing::polyphase4AbsMaxScalar( const float * input, int numSamples, float currentMax )
 {
+    for ( int i = 0 ; i < numSamples ; ++i )
+    {
+        for ( int phase = 0 ; phase < 4 ; ++phase )
+        {
+            const float * coefficients = filterPhaseArray[ phase ];
+
+            float sum = 0.f;
+            for ( int j = 0 ; j < numCoeffs ; ++j )
+                sum += ( input[ i - j ] * coefficients[ j ] );
 
+            const float absSample = fabs( sum );
+            if ( absSample > currentMax )
+                currentMax = absSample;
+        }
+    }
+
+    return currentMax;
 }
 
-AudioProcessing::TruePeak::LinearValue AudioProcessing::TruePeak::process( const juce::AudioSampleBuffer & buffer )
+#if JUCE_INTEL
+
+float AudioProcessing::polyphase4AbsMaxSse2( const float * input, int numSamples, float currentMax )
 {
-    if (m_inputs.getNumSamples() >= numCoeffs)
+    const __m128 absMask = _mm_castsi128_ps( _mm_set1_epi32( 0x7fffffff ) );
+    __m128 max = _mm_set1_ps( currentMax );
+
+    const int vectorizedSize = numSamples & ~3;
+
+    for ( int i = 0 ; i < vectorizedSize ; i += 4 )
     {
-        // we have enough data from a previous process 
+        __m128 sum0 = _mm_setzero_ps();
+        __m128 sum1 = _mm_setzero_ps();
+        __m128 sum2 = _mm_setzero_ps();
+        __m128 sum3 = _mm_setzero_ps();
 
-        for ( int ch = 0 ; ch < buffer.getNumChannels() ; ++ch )
+        for ( int j = 0 ; j < numCoeffs ; ++j )
         {
-            m_inputs.copyFrom( ch, 0, &m_inputs.getArrayOfReadPointers()[ch][m_inputs.getNumSamples() - numCoeffs], numCoeffs );
+            const __m128 x = _mm_loadu_ps( &input[ i - j ] );
+            sum0 = _mm_add_ps( sum0, _mm_mul_ps( x, _mm_set1_ps( filterPhase0[ j ] ) ) );
+            sum1 = _mm_add_ps( sum1, _mm_mul_ps( x, _mm_set1_ps( filterPhase1[ j ] ) ) );
+            sum2 = _mm_add_ps( sum2, _mm_mul_ps( x, _mm_set1_ps( filterPhase2[ j ] ) ) );
+            sum3 = _mm_add_ps( sum3, _mm_mul_ps( x, _mm_set1_ps( filterPhase3[ j ] ) ) );
         }
 
-        // resize if necessary
-        if ( m_inputs.getNumSamples() != numCoeffs + buffer.getNumSamples() )
-            m_inputs.setSize( buffer.getNumChannels(), numCoeffs + buffer.getNumSamples(), true, false, true );
+        max = _mm_max_ps( max, _mm_and_ps( sum0, absMask ) );
+        max = _mm_max_ps( max, _mm_and_ps( sum1, absMask ) );
+        max = _mm_max_ps( max, _mm_and_ps( sum2, absMask ) );
+        max = _mm_max_ps( max, _mm_and_ps( sum3, absMask ) );
     }
-    else
+
+    max = _mm_max_ps( max, _mm_shuffle_ps( max, max, _MM_SHUFFLE( 1, 0, 3, 2 ) ) );
+    max = _mm_max_ps( max, _mm_shuffle_ps( max, max, _MM_SHUFFLE( 2, 3, 0, 1 ) ) );
+    currentMax = _mm_cvtss_f32( max );
+
+    return polyphase4AbsMaxScalar( input + vectorizedSize, numSamples - vectorizedSize, currentMax );
+}
+
+LUFS_TARGET_AVX float AudioProcessing::polyphase4AbsMaxAvx( const float * input, int numSamples, float currentMax )
+{
+    const __m256 absMask = _mm256_castsi256_ps( _mm256_set1_epi32( 0x7fffffff ) );
+    __m256 max = _mm256_set1_ps( currentMax );
+
+    const int vectorizedSize = numSamples & ~7;
+
+    for ( int i = 0 ; i < vectorizedSize ; i += 8 )
     {
-        // setSize clears buffer content too
+        __m256 sum0 = _mm256_setzero_ps();
+        __m256 sum1 = _mm256_setzero_ps();
+        __m256 sum2 = _mm256_setzero_ps();
+        __m256 sum3 = _mm256_setzero_ps();
 
-        m_inputs.setSize( buffer.getNumChannels(), numCoeffs + buffer.getNumSamples(), false, true );
+        for ( int j = 0 ; j < numCoeffs ; ++j )
+        {
+            const __m256 x = _mm256_loadu_ps( &input[ i - j ] );
+            sum0 = _mm256_add_ps( sum0, _mm256_mul_ps( x, _mm256_set1_ps( filterPhase0[ j ] ) ) );
+            sum1 = _mm256_add_ps( sum1, _mm256_mul_ps( x, _mm256_set1_ps( filterPhase1[ j ] ) ) );
+            sum2 = _mm256_add_ps( sum2, _mm256_mul_ps( x, _mm256_set1_ps( filterPhase2[ j ] ) ) );
+            sum3 = _mm256_add_ps( sum3, _mm256_mul_ps( x, _mm256_set1_ps( filterPhase3[ j ] ) ) );
+        }
+
+        max = _mm256_max_ps( max, _mm256_and_ps( sum0, absMask ) );
+        max = _mm256_max_ps( max, _mm256_and_ps( sum1, absMask ) );
+        max = _mm256_max_ps( max, _mm256_and_ps( sum2, absMask ) );
+        max = _mm256_max_ps( max, _mm256_and_ps( sum3, absMask ) );
     }
 
-    // copy buffer to inputs with numCoefs offset
-    for ( int ch = 0 ; ch < buffer.getNumChannels() ; ++ch )
+    __m128 max128 = _mm_max_ps( _mm256_castps256_ps128( max ), _mm256_extractf128_ps( max, 1 ) );
+    max128 = _mm_max_ps( max128, _mm_shuffle_ps( max128, max128, _MM_SHUFFLE( 1, 0, 3, 2 ) ) );
+    max128 = _mm_max_ps( max128, _mm_shuffle_ps( max128, max128, _MM_SHUFFLE( 2, 3, 0, 1 ) ) );
+    currentMax = _mm_cvtss_f32( max128 );
+
+    // avoid AVX to SSE transition penalty in the scalar tail
+    _mm256_zeroupper();
+
+    return polyphase4AbsMaxScalar( input + vectorizedSize, numSamples - vectorizedSize, currentMax );
+}
+
+static bool isAvxAvailable()
+{
+#if JUCE_MSVC
+    int info[ 4 ];
+    __cpuid( info, 1 );
+
+    const bool osUsesXSave = ( info[ 2 ] & ( 1 << 27 ) ) != 0;
+    const bool cpuHasAvx = ( info[ 2 ] & ( 1 << 28 ) ) != 0;
+
+    // check that the OS saves ymm registers
+    return osUsesXSave && cpuHasAvx && ( ( _xgetbv( 0 ) & 6 ) == 6 );
+#else
+    return __builtin_cpu_supports( "avx" ) != 0;
+#endif
+}
+
+#endif // JUCE_INTEL
+
+#if LUFS_NEON
+
+float AudioProcessing::polyphase4AbsMaxNeon( const float * input, int numSamples, float currentMax )
+{
+    float32x4_t max = vdupq_n_f32( currentMax );
+
+    const int vectorizedSize = numSamples & ~3;
+
+    for ( int i = 0 ; i < vectorizedSize ; i += 4 )
     {
-        m_inputs.copyFrom( ch, numCoeffs, buffer, ch, 0, buffer.getNumSamples() );
+        float32x4_t sum0 = vdupq_n_f32( 0.f );
+        float32x4_t sum1 = vdupq_n_f32( 0.f );
+        float32x4_t sum2 = vdupq_n_f32( 0.f );
+        float32x4_t sum3 = vdupq_n_f32( 0.f );
+
+        for ( int j = 0 ; j < numCoeffs ; ++j )
+        {
+            const float32x4_t x = vld1q_f32( &input[ i - j ] );
+            sum0 = vaddq_f32( sum0, vmulq_n_f32( x, filterPhase0[ j ] ) );
+            sum1 = vaddq_f32( sum1, vmulq_n_f32( x, filterPhase1[ j ] ) );
+            sum2 = vaddq_f32( sum2, vmulq_n_f32( x, filterPhase2[ j ] ) );
+            sum3 = vaddq_f32( sum3, vmulq_n_f32( x, filterPhase3[ j ] ) );
+        }
+
+        max = vmaxq_f32( max, vabsq_f32( sum0 ) );
+        max = vmaxq_f32( max, vabsq_f32( sum1 ) );
+        max = vmaxq_f32( max, vabsq_f32( sum2 ) );
+        max = vmaxq_f32( max, vabsq_f32( sum3 ) );
     }
 
-    return processPolyphase4AbsMax( m_inputs );
+    float32x2_t max2 = vpmax_f32( vget_low_f32( max ), vget_high_f32( max ) );
+    max2 = vpmax_f32( max2, max2 );
+    currentMax = vget_lane_f32( max2, 0 );
+
+    return polyphase4AbsMaxScalar( input + vectorizedSize, numSamples - vectorizedSize, currentMax );
 }
 
-void AudioProcessing::TruePeak::reset()
+#endif
+
+AudioProcessing::Polyphase4AbsMaxKernel AudioProcessing::getPolyphase4AbsMaxKernel()
 {
-    m_inputs.setSize(0, 0);
+#if JUCE_INTEL
+    if ( isAvxAvailable() )
+        return polyphase4AbsMaxAvx;
+
+    if ( juce::SystemStats::hasSSE2() )
+        return polyphase4AbsMaxSse2;
+#elif LUFS_NEON
+    return polyphase4AbsMaxNeon;
+#endif
+
+    return polyphase4AbsMaxScalar;
 }
 
-AudioProcessing::TruePeak::LinearValue AudioProcessing::TruePeak::processPolyphase4AbsMax( const juce::AudioSampleBuffer & buffer )
+bool AudioProcessing::TestPolyphase4Kernels()
 {
-    LinearValue value;
+    juce::Array<Polyphase4AbsMaxKernel> kernels;
+    juce::StringArray kernelNames;
 
-    int sampleSize = buffer.getNumSamples();
+    kernels.add( polyphase4AbsMaxScalar );
+    kernelNames.add( "scalar" );
+#if JUCE_INTEL
+    if ( juce::SystemStats::hasSSE2() )
+    {
+        kernels.add( polyphase4AbsMaxSse2 );
+        kernelNames.add( "SSE2" );
+    }
+    if ( isAvxAvailable() )
+    {
+        kernels.add( polyphase4AbsMaxAvx );
+        kernelNames.add( "AVX" );
+    }
+#elif LUFS_NEON
+    kernels.add( polyphase4AbsMaxNeon );
+    kernelNames.add( "NEON" );
+#endif
 
-    for ( int ch = 0 ; ch < buffer.getNumChannels() ; ++ch )
+    juce::Random random( 0x1770 );
+    bool success = true;
+
+    for ( int test = 0 ; test < 64 ; ++test )
     {
-        const float * input = buffer.getArrayOfReadPointers()[ ch ];
+        // odd sizes check the vectorized kernels tails
+        const int sampleSize = 1 + random.nextInt( 2000 );
+        const float gain = ( test & 1 ) ? 1.f : 0.001f;
+
+        // left zero padding, as in TruePeak::m_history first call
+        juce::HeapBlock<float> data( numCoeffs - 1 + sampleSize, true );
+        float * input = data + numCoeffs - 1;
+        for ( int i = 0 ; i < sampleSize ; ++i )
+            input[ i ] = gain * ( 2.f * random.nextFloat() - 1.f );
 
         for ( int i = 0 ; i < sampleSize ; ++i )
         {
-            for ( int j = 0 ; j < 4 ; ++j ) // number of polyphase filters
+            // reference value and error bound for sample i
+            float referenceMax = 0.f;
+            float errorBound = 0.f;
+            for ( int phase = 0 ; phase < 4 ; ++phase )
             {
-                float absSample = fabs( polyphase4ComputeSum( input, i, buffer.getNumSamples(), filterPhaseArray[j], numCoeffs ) );
+                const float absSample = fabs( polyphase4ComputeSum( input, i, sampleSize, filterPhaseArray[ phase ], numCoeffs ) );
+                if ( absSample > referenceMax )
+                    referenceMax = absSample;
+
+                float absSum = 0.f;
+                for ( int j = 0 ; j < numCoeffs && j <= i ; ++j )
+                    absSum += fabs( input[ i - j ] * filterPhaseArray[ phase ][ j ] );
+                errorBound = juce::jmax( errorBound, numCoeffs * std::numeric_limits<float>::epsilon() * absSum );
+            }
+
+            for ( int k = 0 ; k < kernels.size() ; ++k )
+            {
+                // one sample at a time checks each output, then whole signal checks vectorized loops
+                const float kernelMax = kernels[ k ]( input + i, 1, 0.f );
+                if ( fabs( kernelMax - referenceMax ) > errorBound )
+                {
+                    DBG( juce::String( "TestPolyphase4Kernels: " ) + kernelNames[ k ] + " differs at sample " + juce::String( i ) );
+                    success = false;
+                }
+            }
+        }
+
+        float referenceMax = 0.f;
+        for ( int i = 0 ; i < sampleSize ; ++i )
+            referenceMax = polyphase4AbsMaxScalar( input + i, 1, referenceMax );
+
+        for ( int k = 0 ; k < kernels.size() ; ++k )
+        {
+            const float kernelMax = kernels[ k ]( input, sampleSize, 0.f );
+            if ( fabs( kernelMax - referenceMax ) > numCoeffs * std::numeric_limits<float>::epsilon() * referenceMax )
+            {
+                DBG( juce::String( "TestPolyphase4Kernels: " ) + kernelNames[ k ] + " max differs for size " + juce::String( sampleSize ) );
+                success = false;
+            }
+        }
+    }
+
+    return success;
+}
+
+
+AudioProcessing::TruePeak::TruePeak()
+    : m_polyphase4AbsMaxKernel( getPolyphase4AbsMaxKernel() )
+{
+    jassert( historySize == numCoeffs );
+
+}
+
+const AudioProcessing::TruePeak::LinearValue & AudioProcessing::TruePeak::process( const juce::AudioSampleBuffer & buffer )
+{
+    beginValue( buffer.getNumChannels() );
+    addToValue( buffer );
+
+    return m_value;
+}
+
+void AudioProcessing::TruePeak::beginValue( const int numChannels )
+{
+    prepare( numChannels );
+
+    m_value.m_numChannels = numChannels;
+    for ( int ch = 0 ; ch < numChannels ; ++ch )
+    {
+        m_value.m_channelArray[ ch ] = processHistoryAbsMax( m_history.getReadPointer( ch ), m_polyphase4AbsMaxKernel );
+    }
+}
+
+void AudioProcessing::TruePeak::addToValue( const juce::AudioSampleBuffer & buffer )
+{
+    prepare( buffer.getNumChannels() );
+
+    // channels added since beginValue start from zero
+    while ( m_value.m_numChannels < buffer.getNumChannels() )
+        m_value.m_channelArray[ m_value.m_numChannels++ ] = 0.f;
+
+    for ( int ch = 0 ; ch < buffer.getNumChannels() ; ++ch )
+    {
+        float & value = m_value.m_channelArray[ ch ];
+        value = processChannelAbsMax( m_history.getWritePointer( ch ), buffer.getReadPointer( ch ), buffer.getNumSamples(), value, m_polyphase4AbsMaxKernel );
+    }
+}
+
+void AudioProcessing::TruePeak::reset()
+{
+    // previous samples are zeros, as at first call; called on the audio thread, storage is kept
+    m_history.clear();
+}
+
+void AudioProcessing::TruePeak::prepare( const int numChannels )
+{
+    if ( m_history.getNumChannels() < numChannels )
+    {
+        // first call (or new channels): previous samples are zeros
+        m_history.setSize( numChannels, numCoeffs, true, true );
+        m_value.m_channelArray.realloc( (size_t)numChannels );
+    }
+}
+
+/**
+    Computes polyphase4 abs max of history samples.
+
+    Values are the same as if history and next input were copied in a single buffer, which is
+    what was done before: first history samples are processed again with bounds checking.
+*/
+float AudioProcessing::TruePeak::processHistoryAbsMax( const float * history, Polyphase4AbsMaxKernel kernel )
+{
+    float maxValue = 0.f;
+
+    // first history samples don't have numCoeffs - 1 samples before them
+    for ( int i = 0 ; i < numCoeffs - 1 ; ++i )
+    {
+        for ( int j = 0 ; j < 4 ; ++j ) // number of polyphase filters
+        {
+            float absSample = fabs( polyphase4ComputeSum( history, i, numCoeffs, filterPhaseArray[j], numCoeffs ) );
+
+            if ( absSample > maxValue )
+                maxValue = absSample;
+        }
+    }
+
+    // last history sample
+    return kernel( history + numCoeffs - 1, 1, maxValue );
+}
+
+/**
+    Computes polyphase4 abs max of input samples following history, and keeps the last numCoeffs samples in history.
+*/
+float AudioProcessing::TruePeak::processChannelAbsMax( float * history, const float * input, const int sampleSize, float maxValue, 
+                                                       Polyphase4AbsMaxKernel kernel )
+{
+    // first input samples: their previous samples are spread between history and input
+    const int junctionInputSize = juce::jmin( numCoeffs - 1, sampleSize );
+    float junction[ 2 * numCoeffs ];
+    memcpy( junction, history, numCoeffs * sizeof( float ) );
+    memcpy( junction + numCoeffs, input, junctionInputSize * sizeof( float ) );
+
+    maxValue = kernel( junction + numCoeffs, junctionInputSize, maxValue );
+
+    // other input samples are processed in place
+    if ( sampleSize > junctionInputSize )
+        maxValue = kernel( input + junctionInputSize, sampleSize - junctionInputSize, maxValue );
+
+    // keep last numCoeffs samples for next call
+    if ( sampleSize >= numCoeffs )
+    {
+        memcpy( history, input + sampleSize - numCoeffs, numCoeffs * sizeof( float ) );
+    }
+    else
+    {
+        memmove( history, history + sampleSize, ( numCoeffs - sampleSize ) * sizeof( float ) );
+        memcpy( history + numCoeffs - sampleSize, input, sampleSize * sizeof( float ) );
+    }
+
+    return maxValue;
+}
+
+/**
+    K-weighting kernels.
+
+    Both stages are computed for each sample before the next one: the high pass input history is 
+    the shelf output history. Each stage sums its terms in BiquadProcessor::process order, so that 
+    results stay identical to two BiquadProcessor passes (when the compiler doesn't contract multiply and add).
+
+    Vectorized kernels process 4 (SSE2, NEON) or 8 (AVX) channels in lanes: 4 samples of each channel 
+    are loaded and transposed so that each vector holds one sample of every channel, then transposed 
+    back after filtering. Missing channels are processed as silence and not stored.
+*/
+void AudioProcessing::kWeightingScalar( const BiquadCoefficients & shelf, const BiquadCoefficients & highPass, KWeightingFilterBank::State & state, const int firstChannel, 
+                                        const float * const * input, float * const * output, const int numChannels, const int numSamples )
+{
+    for ( int ch = 0 ; ch < numChannels ; ++ch )
+    {
+        const int stateIndex = firstChannel + ch;
+        float x1 = state.m_x1[ stateIndex ];
+        float x2 = state.m_x2[ stateIndex ];
+        float s1 = state.m_s1[ stateIndex ];
+        float s2 = state.m_s2[ stateIndex ];
+        float y1 = state.m_y1[ stateIndex ];
+        float y2 = state.m_y2[ stateIndex ];
+
+        const float * in = input[ ch ];
+        float * out = output[ ch ];
+
+        for ( int i = 0 ; i < numSamples ; ++i )
+        {
+            const float x = in[ i ];
+
+            float s = x * shelf.m_b0;
+            s += x1 * shelf.m_b1;
+            s += x2 * shelf.m_b2;
+            s += s1 * shelf.m_a1;
+            s += s2 * shelf.m_a2;
+
+            float y = s * highPass.m_b0;
+            y += s1 * highPass.m_b1;
+            y += s2 * highPass.m_b2;
+            y += y1 * highPass.m_a1;
+            y += y2 * highPass.m_a2;
+
+            x2 = x1;
+            x1 = x;
+            s2 = s1;
+            s1 = s;
+            y2 = y1;
+            y1 = y;
+
+            out[ i ] = y;
+        }
+
+        state.m_x1[ stateIndex ] = x1;
+        state.m_x2[ stateIndex ] = x2;
+        state.m_s1[ stateIndex ] = s1;
+        state.m_s2[ stateIndex ] = s2;
+        state.m_y1[ stateIndex ] = y1;
+        state.m_y2[ stateIndex ] = y2;
+    }
+}
+
+#if JUCE_INTEL || LUFS_NEON
+
+// processes last samples that don't fill vectors
+static void kWeightingTail( AudioProcessing::KWeightingFilterBank::Kernel scalarKernel, const AudioProcessing::BiquadCoefficients & shelf, const AudioProcessing::BiquadCoefficients & highPass, 
+                            AudioProcessing::KWeightingFilterBank::State & state, const int firstChannel, const float * const * input, float * const * output, 
+                            const int numChannels, const int offset, const int numSamples )
+{
+    const float * tailInput[ AudioProcessing::KWeightingFilterBank::stateChannels ];
+    float * tailOutput[ AudioProcessing::KWeightingFilterBank::stateChannels ];
+    for ( int ch = 0 ; ch < numChannels ; ++ch )
+    {
+        tailInput[ ch ] = input[ ch ] + offset;
+        tailOutput[ ch ] = output[ ch ] + offset;
+    }
+
+    scalarKernel( shelf, highPass, state, firstChannel, tailInput, tailOutput, numChannels, numSamples - offset );
+}
+
+#endif
+
+#if JUCE_INTEL
+
+// one sample of both stages for 4 channels; z holds x1, x2, s1, s2, y1, y2
+static inline __m128 kWeightingStepSse2( const __m128 * c, const __m128 x, __m128 * z )
+{
+    __m128 s = _mm_mul_ps( x, c[0] );
+    s = _mm_add_ps( s, _mm_mul_ps( z[0], c[1] ) );
+    s = _mm_add_ps( s, _mm_mul_ps( z[1], c[2] ) );
+    s = _mm_add_ps( s, _mm_mul_ps( z[2], c[3] ) );
+    s = _mm_add_ps( s, _mm_mul_ps( z[3], c[4] ) );
+
+    __m128 y = _mm_mul_ps( s, c[5] );
+    y = _mm_add_ps( y, _mm_mul_ps( z[2], c[6] ) );
+    y = _mm_add_ps( y, _mm_mul_ps( z[3], c[7] ) );
+    y = _mm_add_ps( y, _mm_mul_ps( z[4], c[8] ) );
+    y = _mm_add_ps( y, _mm_mul_ps( z[5], c[9] ) );
+
+    z[1] = z[0];
+    z[0] = x;
+    z[3] = z[2];
+    z[2] = s;
+    z[5] = z[4];
+    z[4] = y;
+
+    return y;
+}
+
+void AudioProcessing::kWeightingSse2( const BiquadCoefficients & shelf, const BiquadCoefficients & highPass, KWeightingFilterBank::State & state, const int firstChannel, 
+                                      const float * const * input, float * const * output, const int numChannels, const int numSamples )
+{
+    jassert( numChannels <= 4 );
+
+    const __m128 c[10] = 
+    {
+        _mm_set1_ps( shelf.m_b0 ), _mm_set1_ps( shelf.m_b1 ), _mm_set1_ps( shelf.m_b2 ), _mm_set1_ps( shelf.m_a1 ), _mm_set1_ps( shelf.m_a2 ),
+        _mm_set1_ps( highPass.m_b0 ), _mm_set1_ps( highPass.m_b1 ), _mm_set1_ps( highPass.m_b2 ), _mm_set1_ps( highPass.m_a1 ), _mm_set1_ps( highPass.m_a2 )
+    };
+
+    __m128 z[6] = 
+    {
+        _mm_loadu_ps( state.m_x1 + firstChannel ), _mm_loadu_ps( state.m_x2 + firstChannel ), 
+        _mm_loadu_ps( state.m_s1 + firstChannel ), _mm_loadu_ps( state.m_s2 + firstChannel ), 
+        _mm_loadu_ps( state.m_y1 + firstChannel ), _mm_loadu_ps( state.m_y2 + firstChannel )
+    };
+
+    const int vectorizedSize = numSamples & ~3;
+
+    for ( int i = 0 ; i < vectorizedSize ; i += 4 )
+    {
+        // v[ch] holds samples i to i + 3 of channel ch, then sample i + ch of the 4 channels
+        __m128 v[4];
+        for ( int ch = 0 ; ch < 4 ; ++ch )
+            v[ch] = ch < numChannels ? _mm_loadu_ps( input[ ch ] + i ) : _mm_setzero_ps();
+
+        _MM_TRANSPOSE4_PS( v[0], v[1], v[2], v[3] );
+
+        v[0] = kWeightingStepSse2( c, v[0], z );
+        v[1] = kWeightingStepSse2( c, v[1], z );
+        v[2] = kWeightingStepSse2( c, v[2], z );
+        v[3] = kWeightingStepSse2( c, v[3], z );
+
+        _MM_TRANSPOSE4_PS( v[0], v[1], v[2], v[3] );
+
+        for ( int ch = 0 ; ch < numChannels ; ++ch )
+            _mm_storeu_ps( output[ ch ] + i, v[ch] );
+    }
+
+    _mm_storeu_ps( state.m_x1 + firstChannel, z[0] );
+    _mm_storeu_ps( state.m_x2 + firstChannel, z[1] );
+    _mm_storeu_ps( state.m_s1 + firstChannel, z[2] );
+    _mm_storeu_ps( state.m_s2 + firstChannel, z[3] );
+    _mm_storeu_ps( state.m_y1 + firstChannel, z[4] );
+    _mm_storeu_ps( state.m_y2 + firstChannel, z[5] );
+
+    kWeightingTail( kWeightingScalar, shelf, highPass, state, firstChannel, input, output, numChannels, vectorizedSize, numSamples );
+}
+
+// one sample of both stages for 8 channels; z holds x1, x2, s1, s2, y1, y2
+static LUFS_TARGET_AVX inline __m256 kWeightingStepAvx( const __m256 * c, const __m256 x, __m256 * z )
+{
+    __m256 s = _mm256_mul_ps( x, c[0] );
+    s = _mm256_add_ps( s, _mm256_mul_ps( z[0], c[1] ) );
+    s = _mm256_add_ps( s, _mm256_mul_ps( z[1], c[2] ) );
+    s = _mm256_add_ps( s, _mm256_mul_ps( z[2], c[3] ) );
+    s = _mm256_add_ps( s, _mm256_mul_ps( z[3], c[4] ) );
+
+    __m256 y = _mm256_mul_ps( s, c[5] );
+    y = _mm256_add_ps( y, _mm256_mul_ps( z[2], c[6] ) );
+    y = _mm256_add_ps( y, _mm256_mul_ps( z[3], c[7] ) );
+    y = _mm256_add_ps( y, _mm256_mul_ps( z[4], c[8] ) );
+    y = _mm256_add_ps( y, _mm256_mul_ps( z[5], c[9] ) );
+
+    z[1] = z[0];
+    z[0] = x;
+    z[3] = z[2];
+    z[2] = s;
+    z[5] = z[4];
+    z[4] = y;
+
+    return y;
+}
+
+LUFS_TARGET_AVX void AudioProcessing::kWeightingAvx( const BiquadCoefficients & shelf, const BiquadCoefficients & highPass, KWeightingFilterBank::State & state, const int firstChannel, 
+                                                     const float * const * input, float * const * output, const int numChannels, const int numSamples )
+{
+    jassert( numChannels <= 8 );
+
+    const __m256 c[10] = 
+    {
+        _mm256_set1_ps( shelf.m_b0 ), _mm256_set1_ps( shelf.m_b1 ), _mm256_set1_ps( shelf.m_b2 ), _mm256_set1_ps( shelf.m_a1 ), _mm256_set1_ps( shelf.m_a2 ),
+        _mm256_set1_ps( highPass.m_b0 ), _mm256_set1_ps( highPass.m_b1 ), _mm256_set1_ps( highPass.m_b2 ), _mm256_set1_ps( highPass.m_a1 ), _mm256_set1_ps( highPass.m_a2 )
+    };
+
+    __m256 z[6] = 
+    {
+        _mm256_loadu_ps( state.m_x1 + firstChannel ), _mm256_loadu_ps( state.m_x2 + firstChannel ), 
+        _mm256_loadu_ps( state.m_s1 + firstChannel ), _mm256_loadu_ps( state.m_s2 + firstChannel ), 
+        _mm256_loadu_ps( state.m_y1 + firstChannel ), _mm256_loadu_ps( state.m_y2 + firstChannel )
+    };
+
+    const int vectorizedSize = numSamples & ~3;
+
+    for ( int i = 0 ; i < vectorizedSize ; i += 4 )
+    {
+        // channels 0 to 3 and 4 to 7 are transposed separately, then joined in 8 lanes
+        __m128 low[4];
+        __m128 high[4];
+        for ( int ch = 0 ; ch < 4 ; ++ch )
+        {
+            low[ch] = ch < numChannels ? _mm_loadu_ps( input[ ch ] + i ) : _mm_setzero_ps();
+            high[ch] = ch + 4 < numChannels ? _mm_loadu_ps( input[ ch + 4 ] + i ) : _mm_setzero_ps();
+        }
+
+        _MM_TRANSPOSE4_PS( low[0], low[1], low[2], low[3] );
+        _MM_TRANSPOSE4_PS( high[0], high[1], high[2], high[3] );
+
+        for ( int sample = 0 ; sample < 4 ; ++sample )
+        {
+            const __m256 x = _mm256_insertf128_ps( _mm256_castps128_ps256( low[ sample ] ), high[ sample ], 1 );
+            const __m256 y = kWeightingStepAvx( c, x, z );
+            low[ sample ] = _mm256_castps256_ps128( y );
+            high[ sample ] = _mm256_extractf128_ps( y, 1 );
+        }
+
+        _MM_TRANSPOSE4_PS( low[0], low[1], low[2], low[3] );
+        _MM_TRANSPOSE4_PS( high[0], high[1], high[2], high[3] );
+
+        for ( int ch = 0 ; ch < numChannels ; ++ch )
+            _mm_storeu_ps( output[ ch ] + i, ch < 4 ? low[ ch ] : high[ ch - 4 ] );
+    }
+
+    _mm256_storeu_ps( state.m_x1 + firstChannel, z[0] );
+    _mm256_storeu_ps( state.m_x2 + firstChannel, z[1] );
+    _mm256_storeu_ps( state.m_s1 + firstChannel, z[2] );
+    _mm256_storeu_ps( state.m_s2 + firstChannel, z[3] );
+    _mm256_storeu_ps( state.m_y1 + firstChannel, z[4] );
+    _mm256_storeu_ps( state.m_y2 + firstChannel, z[5] );
+
+    // avoid AVX to SSE transition penalty in the scalar tail
+    _mm256_zeroupper();
+
+    kWeightingTail( kWeightingScalar, shelf, highPass, state, firstChannel, input, output, numChannels, vectorizedSize, numSamples );
+}
+
+#endif // JUCE_INTEL
+
+#if LUFS_NEON
+
+// one sample of both stages for 4 channels; z holds x1, x2, s1, s2, y1, y2
+static inline float32x4_t kWeightingStepNeon( const float32x4_t * c, const float32x4_t x, float32x4_t * z )
+{
+    float32x4_t s = vmulq_f32( x, c[0] );
+    s = vaddq_f32( s, vmulq_f32( z[0], c[1] ) );
+    s = vaddq_f32( s, vmulq_f32( z[1], c[2] ) );
+    s = vaddq_f32( s, vmulq_f32( z[2], c[3] ) );
+    s = vaddq_f32( s, vmulq_f32( z[3], c[4] ) );
+
+    float32x4_t y = vmulq_f32( s, c[5] );
+    y = vaddq_f32( y, vmulq_f32( z[2], c[6] ) );
+    y = vaddq_f32( y, vmulq_f32( z[3], c[7] ) );
+    y = vaddq_f32( y, vmulq_f32( z[4], c[8] ) );
+    y = vaddq_f32( y, vmulq_f32( z[5], c[9] ) );
+
+    z[1] = z[0];
+    z[0] = x;
+    z[3] = z[2];
+    z[2] = s;
+    z[5] = z[4];
+    z[4] = y;
+
+    return y;
+}
+
+static inline void transpose4Neon( float32x4_t * v )
+{
+    const float32x4x2_t t01 = vtrnq_f32( v[0], v[1] );
+    const float32x4x2_t t23 = vtrnq_f32( v[2], v[3] );
+    v[0] = vcombine_f32( vget_low_f32( t01.val[0] ), vget_low_f32( t23.val[0] ) );
+    v[1] = vcombine_f32( vget_low_f32( t01.val[1] ), vget_low_f32( t23.val[1] ) );
+    v[2] = vcombine_f32( vget_high_f32( t01.val[0] ), vget_high_f32( t23.val[0] ) );
+    v[3] = vcombine_f32( vget_high_f32( t01.val[1] ), vget_high_f32( t23.val[1] ) );
+}
+
+void AudioProcessing::kWeightingNeon( const BiquadCoefficients & shelf, const BiquadCoefficients & highPass, KWeightingFilterBank::State & state, const int firstChannel, 
+                                      const float * const * input, float * const * output, const int numChannels, const int numSamples )
+{
+    jassert( numChannels <= 4 );
+
+    const float32x4_t c[10] = 
+    {
+        vdupq_n_f32( shelf.m_b0 ), vdupq_n_f32( shelf.m_b1 ), vdupq_n_f32( shelf.m_b2 ), vdupq_n_f32( shelf.m_a1 ), vdupq_n_f32( shelf.m_a2 ),
+        vdupq_n_f32( highPass.m_b0 ), vdupq_n_f32( highPass.m_b1 ), vdupq_n_f32( highPass.m_b2 ), vdupq_n_f32( highPass.m_a1 ), vdupq_n_f32( highPass.m_a2 )
+    };
+
+    float32x4_t z[6] = 
+    {
+        vld1q_f32( state.m_x1 + firstChannel ), vld1q_f32( state.m_x2 + firstChannel ), 
+        vld1q_f32( state.m_s1 + firstChannel ), vld1q_f32( state.m_s2 + firstChannel ), 
+        vld1q_f32( state.m_y1 + firstChannel ), vld1q_f32( state.m_y2 + firstChannel )
+    };
+
+    const int vectorizedSize = numSamples & ~3;
+
+    for ( int i = 0 ; i < vectorizedSize ; i += 4 )
+    {
+        float32x4_t v[4];
+        for ( int ch = 0 ; ch < 4 ; ++ch )
+            v[ch] = ch < numChannels ? vld1q_f32( input[ ch ] + i ) : vdupq_n_f32( 0.f );
+
+        transpose4Neon( v );
+
+        v[0] = kWeightingStepNeon( c, v[0], z );
+        v[1] = kWeightingStepNeon( c, v[1], z );
+        v[2] = kWeightingStepNeon( c, v[2], z );
+        v[3] = kWeightingStepNeon( c, v[3], z );
+
+        transpose4Neon( v );
+
+        for ( int ch = 0 ; ch < numChannels ; ++ch )
+            vst1q_f32( output[ ch ] + i, v[ch] );
+    }
+
+    vst1q_f32( state.m_x1 + firstChannel, z[0] );
+    vst1q_f32( state.m_x2 + firstChannel, z[1] );
+    vst1q_f32( state.m_s1 + firstChannel, z[2] );
+    vst1q_f32( state.m_s2 + firstChannel, z[3] );
+    vst1q_f32( state.m_y1 + firstChannel, z[4] );
+    vst1q_f32( state.m_y2 + firstChannel, z[5] );
+
+    kWeightingTail( kWeightingScalar, shelf, highPass, state, firstChannel, input, output, numChannels, vectorizedSize, numSamples );
+}
+
+#endif
+
+AudioProcessing::KWeightingFilterBank::Kernel AudioProcessing::getKWeightingKernel( int & lanes )
+{
+#if JUCE_INTEL
+    if ( isAvxAvailable() )
+    {
+        lanes = 8;
+        return kWeightingAvx;
+    }
+
+    if ( juce::SystemStats::hasSSE2() )
+    {
+        lanes = 4;
+        return kWeightingSse2;
+    }
+#elif LUFS_NEON
+    lanes = 4;
+    return kWeightingNeon;
+#endif
 
-                if ( absSample > value.m_channelArray[ch] )
-                    value.m_channelArray[ch] = absSample;
+    lanes = KWeightingFilterBank::stateChannels;
+    return kWeightingScalar;
+}
+
+// reference biquad pass, as BiquadProcessor::process; history holds x1, x2, y1, y2
+static void processBiquadReference( const AudioProcessing::BiquadCoefficients & c, float * history, float * data, const int sampleSize )
+{
+    for ( int i = 0 ; i < sampleSize ; ++i )
+    {
+        const float x = data[ i ];
+
+        float y = x * c.m_b0;
+        y += history[0] * c.m_b1;
+        y += history[1] * c.m_b2;
+        y += history[2] * c.m_a1;
+        y += history[3] * c.m_a2;
+
+        history[1] = history[0];
+        history[0] = x;
+        history[3] = history[2];
+        history[2] = y;
+
+        data[ i ] = y;
+    }
+}
+
+bool AudioProcessing::TestKWeightingKernels( const BiquadCoefficients & shelf, const BiquadCoefficients & highPass )
+{
+    juce::Array<KWeightingFilterBank::Kernel> kernels;
+    juce::Array<int> kernelLanes;
+    juce::StringArray kernelNames;
+
+    kernels.add( kWeightingScalar );
+    kernelLanes.add( KWeightingFilterBank::stateChannels );
+    kernelNames.add( "scalar" );
+#if JUCE_INTEL
+    if ( juce::SystemStats::hasSSE2() )
+    {
+        kernels.add( kWeightingSse2 );
+        kernelLanes.add( 4 );
+        kernelNames.add( "SSE2" );
+    }
+    if ( isAvxAvailable() )
+    {
+        kernels.add( kWeightingAvx );
+        kernelLanes.add( 8 );
+        kernelNames.add( "AVX" );
+    }
+#elif LUFS_NEON
+    kernels.add( kWeightingNeon );
+    kernelLanes.add( 4 );
+    kernelNames.add( "NEON" );
+#endif
+
+    juce::Random random( 0x1770 );
+    bool success = true;
+
+    for ( int k = 0 ; k < kernels.size() ; ++k )
+    {
+        for ( int test = 0 ; test < 16 ; ++test )
+        {
+            const int numChannels = 1 + test % KWeightingFilterBank::stateChannels;
+            const float gain = ( test & 1 ) ? 1.f : 0.001f;
+
+            float shelfHistory[ KWeightingFilterBank::stateChannels ][ 4 ] = { { 0.f } };
+            float highPassHistory[ KWeightingFilterBank::stateChannels ][ 4 ] = { { 0.f } };
+
+            KWeightingFilterBank::State state;
+            memset( &state, 0, sizeof( state ) );
+
+            // consecutive calls of odd sizes check state and vectorized kernels tails
+            for ( int call = 0 ; call < 16 ; ++call )
+            {
+                const int sampleSize = 1 + random.nextInt( 700 );
+                juce::AudioSampleBuffer reference( numChannels, sampleSize );
+                juce::AudioSampleBuffer output( numChannels, sampleSize );
+
+                for ( int ch = 0 ; ch < numChannels ; ++ch )
+                {
+                    float * data = reference.getWritePointer( ch );
+                    for ( int i = 0 ; i < sampleSize ; ++i )
+                        data[ i ] = gain * ( 2.f * random.nextFloat() - 1.f );
+
+                    output.copyFrom( ch, 0, reference, ch, 0, sampleSize );
+
+                    processBiquadReference( shelf, shelfHistory[ ch ], data, sampleSize );
+                    processBiquadReference( highPass, highPassHistory[ ch ], data, sampleSize );
+                }
+
+                // in place, by groups of lanes
+                for ( int firstChannel = 0 ; firstChannel < numChannels ; firstChannel += kernelLanes[ k ] )
+                {
+                    const int laneChannels = juce::jmin( kernelLanes[ k ], numChannels - firstChannel );
+                    kernels[ k ]( shelf, highPass, state, firstChannel, output.getArrayOfReadPointers() + firstChannel, output.getArrayOfWritePointers() + firstChannel, laneChannels, sampleSize );
+                }
+
+                for ( int ch = 0 ; ch < numChannels ; ++ch )
+                {
+                    for ( int i = 0 ; i < sampleSize ; ++i )
+                    {
+                        const float referenceSample = reference.getReadPointer( ch )[ i ];
+                        if ( fabs( output.getReadPointer( ch )[ i ] - referenceSample ) > 8.f * std::numeric_limits<float>::epsilon() * ( gain + fabs( referenceSample ) ) )
+                        {
+                            DBG( juce::String( "TestKWeightingKernels: " ) + kernelNames[ k ] + " differs for channel " + juce::String( ch ) + " at sample " + juce::String( i ) );
+                            success = false;
+                            break;
+                        }
+                    }
+                }
             }
         }
     }
 
-    return value;
+    return success;
+}
+
+
+const float AudioProcessing::KWeightingFilterBank::silenceThreshold = 1e-15f;
+
+AudioProcessing::KWeightingFilterBank::KWeightingFilterBank( const int numChannels )
+    : m_numChannels( 0 )
+    , m_numStates( 0 )
+    , m_kernel( getKWeightingKernel( m_kernelLanes ) )
+    , m_denormalProtection( true )
+{
+    // kernel calls never span two states
+    jassert( ( stateChannels % m_kernelLanes ) == 0 );
+
+    const BiquadCoefficients identity = { 1.f, 0.f, 0.f, 0.f, 0.f };
+    m_shelf = identity;
+    m_highPass = identity;
+    setNumChannels( numChannels );
+}
+
+void AudioProcessing::KWeightingFilterBank::setNumChannels( const int numChannels )
+{
+    m_numChannels = numChannels;
+    m_numStates = ( numChannels + stateChannels - 1 ) / stateChannels;
+    m_states.malloc( (size_t)juce::jmax( 1, m_numStates ) );
+    reset();
+}
+
+void AudioProcessing::KWeightingFilterBank::setCoefficients( const BiquadCoefficients & shelf, const BiquadCoefficients & highPass )
+{
+    m_shelf = shelf;
+    m_highPass = highPass;
+    reset();
+}
+
+void AudioProcessing::KWeightingFilterBank::process( const juce::AudioSampleBuffer & input, juce::AudioSampleBuffer & output, const int numChannels )
+{
+    jassert( numChannels <= m_numChannels );
+    jassert( numChannels <= input.getNumChannels() && numChannels <= output.getNumChannels() );
+    jassert( input.getNumSamples() <= output.getNumSamples() );
+
+    for ( int firstChannel = 0 ; firstChannel < numChannels ; firstChannel += m_kernelLanes )
+    {
+        const int laneChannels = juce::jmin( m_kernelLanes, numChannels - firstChannel );
+
+        if ( m_denormalProtection && isSilentAndDecayed( input, firstChannel, laneChannels ) )
+        {
+            // filters have decayed and input is silent: output is silent
+            for ( int ch = firstChannel ; ch < firstChannel + laneChannels ; ++ch )
+                output.clear( ch, 0, input.getNumSamples() );
+            continue;
+        }
+
+        m_kernel( m_shelf, m_highPass, m_states[ firstChannel / stateChannels ], firstChannel % stateChannels, 
+                  input.getArrayOfReadPointers() + firstChannel, output.getArrayOfWritePointers() + firstChannel, laneChannels, input.getNumSamples() );
+
+        if ( m_denormalProtection )
+            flushState( firstChannel, laneChannels );
+    }
+}
+
+void AudioProcessing::KWeightingFilterBank::reset()
+{
+    memset( m_states, 0, (size_t)juce::jmax( 1, m_numStates ) * sizeof( State ) );
+}
+
+bool AudioProcessing::KWeightingFilterBank::isSilentAndDecayed( const juce::AudioSampleBuffer & input, const int firstChannel, const int numChannels ) const
+{
+    const State & state = m_states[ firstChannel / stateChannels ];
+    const int stateFirstChannel = firstChannel % stateChannels;
+
+    // flushed state is exactly zero
+    for ( int ch = stateFirstChannel ; ch < stateFirstChannel + numChannels ; ++ch )
+    {
+        if ( state.m_x1[ ch ] != 0.f || state.m_x2[ ch ] != 0.f || state.m_s1[ ch ] != 0.f 
+            || state.m_s2[ ch ] != 0.f || state.m_y1[ ch ] != 0.f || state.m_y2[ ch ] != 0.f )
+            return false;
+    }
+
+    for ( int ch = firstChannel ; ch < firstChannel + numChannels ; ++ch )
+    {
+        if ( input.getMagnitude( ch, 0, input.getNumSamples() ) >= silenceThreshold )
+            return false;
+    }
+
+    return true;
+}
+
+void AudioProcessing::KWeightingFilterBank::flushState( const int firstChannel, const int numChannels )
+{
+    State & state = m_states[ firstChannel / stateChannels ];
+    const int stateFirstChannel = firstChannel % stateChannels;
+    float * const values[ 6 ] = { state.m_x1, state.m_x2, state.m_s1, state.m_s2, state.m_y1, state.m_y2 };
+
+    for ( int i = 0 ; i < 6 ; ++i )
+    {
+        for ( int ch = stateFirstChannel ; ch < stateFirstChannel + numChannels ; ++ch )
+        {
+            if ( fabs( values[ i ][ ch ] ) < silenceThreshold )
+                values[ i ][ ch ] = 0.f;
+        }
+    }
+}
+
+
+AudioProcessing::ScopedNoDenormals::ScopedNoDenormals( const bool enabled )
+    : m_previousMode( 0 )
+    , m_enabled( enabled )
+{
+    if ( !m_enabled )
+        return;
+
+#if JUCE_INTEL
+    // flush to zero (bit 15) and denormals are zero (bit 6)
+    m_previousMode = _mm_getcsr();
+    _mm_setcsr( (unsigned int)m_previousMode | 0x8040 );
+#elif defined ( __aarch64__ )
+    // flush to zero (bit 24)
+    __asm__ __volatile__ ( "mrs %0, fpcr" : "=r" ( m_previousMode ) );
+    __asm__ __volatile__ ( "msr fpcr, %0" : : "r" ( m_previousMode | ( 1 << 24 ) ) );
+#elif LUFS_NEON
+    // flush to zero (bit 24), NEON always flushes denormals
+    juce::uint32 mode;
+    __asm__ __volatile__ ( "vmrs %0, fpscr" : "=r" ( mode ) );
+    __asm__ __volatile__ ( "vmsr fpscr, %0" : : "r" ( mode | ( 1 << 24 ) ) );
+    m_previousMode = mode;
+#endif
+}
+
+AudioProcessing::ScopedNoDenormals::~ScopedNoDenormals()
+{
+    if ( !m_enabled )
+        return;
+
+#if JUCE_INTEL
+    _mm_setcsr( (unsigned int)m_previousMode );
+#elif defined ( __aarch64__ )
+    __asm__ __volatile__ ( "msr fpcr, %0" : : "r" ( m_previousMode ) );
+#elif LUFS_NEON
+    __asm__ __volatile__ ( "vmsr fpscr, %0" : : "r" ( (juce::uint32)m_previousMode ) );
+#endif
 }
 
 /**
@@ -338,15 +1309,6 @@ void AudioProcessing::TestSimpleConvolution( const juce::File & input )
 
     if ( reader != nullptr )
     {
-        // read file
-        juce::AudioSampleBuffer origin( (int)reader->numChannels, (int)reader->lengthInSamples );
-        reader->read( &origin, 0, (int)reader->lengthInSamples, 0, true, true );
-
-        // Convolve
-        juce::AudioSampleBuffer output;
-        convolution( origin, convolutionFilter, output );
-        output.applyGain(0.25f); // filter values use sample with 3 zeros per valid sample (1 / 4)
-
         juce::String outputName = input.getFullPathName().substring(0, input.getFullPathName().length() - 4);
         juce::File outputFile( outputName + "_convolution.wav" );
         juce::FileOutputStream * outputStream = new juce::FileOutputStream( outputFile );
@@ -359,7 +1321,35 @@ void AudioProcessing::TestSimpleConvolution( const juce::File & input )
 
         if ( writer != nullptr )
         {
-            writer->writeFromAudioSampleBuffer( output, 0, output.getNumSamples() );
+            // read file by chunks, convolutionSize - 1 previous samples are processed again with each chunk,
+            // a last chunk of zeros writes the end of the convolution
+            AudioStreamReader streamReader( *reader );
+            juce::AudioSampleBuffer history( (int)reader->numChannels, convolutionSize - 1 );
+            history.clear();
+
+            juce::AudioSampleBuffer tail( (int)reader->numChannels, convolutionSize );
+            tail.clear();
+
+            juce::AudioSampleBuffer origin;
+            juce::AudioSampleBuffer output;
+
+            for ( bool end = false ; !end ; )
+            {
+                const juce::AudioSampleBuffer * chunk = streamReader.readNextChunk();
+                if ( chunk == nullptr )
+                {
+                    chunk = &tail;
+                    end = true;
+                }
+
+                prependHistory( history, *chunk, origin );
+
+                // Convolve
+                convolution( origin, convolutionFilter, output );
+                output.applyGain(0.25f); // filter values use sample with 3 zeros per valid sample (1 / 4)
+
+                writer->writeFromAudioSampleBuffer( output, history.getNumSamples(), chunk->getNumSamples() );
+            }
 
             delete writer;
         }
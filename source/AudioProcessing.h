@@ -21,6 +21,14 @@
 
 #pragma once 
 
+// NEON kernels: AArch64 compilers define __ARM_NEON only, and this JUCE version sets JUCE_ARM 
+// for __arm__ and Apple __arm64__ only, not for Linux __aarch64__
+#if ( JUCE_ARM || defined ( __aarch64__ ) ) && ( defined ( __ARM_NEON ) || defined ( __ARM_NEON__ ) )
+ #define LUFS_NEON 1
+#else
+ #define LUFS_NEON 0
+#endif
+
 class AudioProcessing
 {
 public:
@@ -37,23 +45,60 @@ public:
     // applies simple convolution with polyphase params and saves new file to disk
     static void TestSimpleConvolution( const juce::File & input );
 
+    // compares every available polyphase4 abs max kernel with polyphase4ComputeSum on random signals,
+    // returns false if a kernel result differs by more than float rounding error
+    static bool TestPolyphase4Kernels();
+
+    // computes max( |polyphase4 output| ) of numSamples input samples, starting from currentMax.
+    // Kernels don't check bounds: input[ -11 ] to input[ -1 ] must be readable (history or zero padding)
+    typedef float (*Polyphase4AbsMaxKernel)( const float * input, int numSamples, float currentMax );
+
+    // returns fastest kernel available on this CPU (AVX, SSE2, NEON or scalar)
+    static Polyphase4AbsMaxKernel getPolyphase4AbsMaxKernel();
+
+    // sets flush to zero and denormals are zero modes in its scope (SSE on Intel, FZ on ARM), and restores 
+    // previous modes when destroyed: recursive filters decaying into silence don't produce denormals, 
+    // which are 10 to 100 times slower on x86
+    class ScopedNoDenormals
+    {
+    public:
+        ScopedNoDenormals( const bool enabled = true );
+        ~ScopedNoDenormals();
+
+    private:
+        juce::uint64 m_previousMode;
+        bool m_enabled;
+
+        JUCE_DECLARE_NON_COPYABLE( ScopedNoDenormals )
+    };
+
+    // biquad coefficients, output is y = b0 * x + b1 * x1 + b2 * x2 + a1 * y1 + a2 * y2
+    struct BiquadCoefficients
+    {
+        float m_b0, m_b1, m_b2, m_a1, m_a2;
+    };
+
+    // compares every available K-weighting kernel with two BiquadProcessor like passes on random 
+    // multichannel signals, returns false if a kernel result differs by more than float rounding error
+    static bool TestKWeightingKernels( const BiquadCoefficients & shelf, const BiquadCoefficients & highPass );
+
     // TruePeak class calculates True Peak linear volume for buffer
 
     class TruePeak
     {
     public:
+        // linear value per channel, storage is allocated by prepare for the number of channels processed
         struct LinearValue
         {
-            LinearValue()
-            {
-                for (int i = 0 ; i < LUFS_TP_MAX_NB_CHANNELS ; ++i)
-                    m_channelArray[i] = 0;
-            }
-            float m_channelArray[ LUFS_TP_MAX_NB_CHANNELS ];
+            LinearValue() : m_numChannels( 0 ) {}
+
+            juce::HeapBlock<float> m_channelArray;
+            int m_numChannels;
+
             float getMax() const
             {
                 float value = 0;
-                for (int i = 0 ; i < LUFS_TP_MAX_NB_CHANNELS ; ++i)
+                for (int i = 0 ; i < m_numChannels ; ++i)
                 {
                     if (value < m_channelArray[i])
                         value = m_channelArray[i];
@@ -64,20 +109,107 @@ public:
 
         TruePeak();
 
+        // allocates history and value for numChannels channels, so that processing as many channels 
+        // doesn't allocate on the audio thread; storage also grows when more channels are processed
+        void prepare( const int numChannels );
+
         // process: since this method needs numCoeffs values more than buffer size, 
-        // numCoeffs values from previous process call are used at beginning of buffer
-        LinearValue process( const juce::AudioSampleBuffer & buffer );
+        // numCoeffs values from previous process call are kept in m_history and used 
+        // before buffer samples; buffer is read in place, it is never copied 
+        const LinearValue & process( const juce::AudioSampleBuffer & buffer );
 
-        // resets internal buffers 
+        // same as process, for a value computed over several consecutive buffers: 
+        // beginValue() then addToValue() for each buffer, value is then returned by getValue()
+        void beginValue( const int numChannels );
+        void addToValue( const juce::AudioSampleBuffer & buffer );
+        inline const LinearValue & getValue() const { return m_value; }
+
+        // resets internal buffers, without freeing them
         void reset();
 
+        // number of previous samples kept per channel between calls
+        enum { historySize = 12 };
+
+        // single channel versions working on any history storage of historySize samples, so that 
+        // callers keeping the history of many channels themselves get the same values as process:
+        // processHistoryAbsMax is the abs max of history samples, as done by beginValue, and 
+        // processChannelAbsMax is the abs max of input samples following history, history is then updated
+        static float processHistoryAbsMax( const float * history, Polyphase4AbsMaxKernel kernel );
+        static float processChannelAbsMax( float * history, const float * input, const int sampleSize, float maxValue, Polyphase4AbsMaxKernel kernel );
+
     private:
 
-        LinearValue processPolyphase4AbsMax( const juce::AudioSampleBuffer & buffer );
+        juce::AudioSampleBuffer m_history; // last numCoeffs samples of previous process calls, per channel
+        LinearValue m_value; // value being computed by addToValue
+        Polyphase4AbsMaxKernel m_polyphase4AbsMaxKernel;
+    };
+
+    // KWeightingFilterBank applies the K-weighting pre-filter (high shelf then high pass) to every channel
+    // in a single pass: channels are processed in SIMD lanes, so that each lane runs its own recursion 
+    // and several channels cost about as much as one. Channels are grouped by stateChannels, the 
+    // state of each group being allocated for the number of channels of the bank
+
+    class KWeightingFilterBank
+    {
+    public:
+        enum { stateChannels = 8 }; // channels of a State, and max lanes of a kernel
+
+        // delayed samples of each channel: input, shelf output (high pass input), high pass output
+        struct State
+        {
+            float m_x1[ stateChannels ];
+            float m_x2[ stateChannels ];
+            float m_s1[ stateChannels ];
+            float m_s2[ stateChannels ];
+            float m_y1[ stateChannels ];
+            float m_y2[ stateChannels ];
+        };
+
+        // filters numSamples samples of numChannels channels (at most the kernel lanes), using state 
+        // of channels firstChannel and next ones; output pointers may be the input pointers
+        typedef void (*Kernel)( const BiquadCoefficients & shelf, const BiquadCoefficients & highPass, State & state, const int firstChannel, 
+                                const float * const * input, float * const * output, const int numChannels, const int numSamples );
+
+        KWeightingFilterBank( const int numChannels = stateChannels );
 
-        juce::AudioSampleBuffer m_inputs; // getPolyphase4AbsMax processes this buffer  
+        // sets coefficients of both stages, same for all channels, and resets state
+        void setCoefficients( const BiquadCoefficients & shelf, const BiquadCoefficients & highPass );
+
+        // filters first numChannels channels of input into output, output may be input
+        void process( const juce::AudioSampleBuffer & input, juce::AudioSampleBuffer & output, const int numChannels );
+
+        void reset();
+
+        // reallocates state for numChannels channels and resets it, coefficients are kept
+        void setNumChannels( const int numChannels );
+        inline int getNumChannels() const { return m_numChannels; }
+
+        // when enabled (default), state values below silenceThreshold are flushed to zero after each 
+        // kernel call, and silent input with flushed state is written as silence without filtering
+        void setDenormalProtection( const bool enabled ) { m_denormalProtection = enabled; }
+
+    private:
+
+        // about -300 dBFS, far below what the meter can show
+        static const float silenceThreshold;
+
+        // numChannels channels from firstChannel are in the same state
+        bool isSilentAndDecayed( const juce::AudioSampleBuffer & input, const int firstChannel, const int numChannels ) const;
+        void flushState( const int firstChannel, const int numChannels );
+
+        BiquadCoefficients m_shelf;
+        BiquadCoefficients m_highPass;
+        juce::HeapBlock<State> m_states; // state of channels [ stateChannels * i, stateChannels * ( i + 1 ) [
+        int m_numChannels;
+        int m_numStates;
+        Kernel m_kernel;
+        int m_kernelLanes; // channels per kernel call
+        bool m_denormalProtection;
     };
 
+    // returns fastest K-weighting kernel available on this CPU (AVX, SSE2, NEON or scalar), and its number of lanes
+    static KWeightingFilterBank::Kernel getKWeightingKernel( int & lanes );
+
 private:
 
     // signal b must be mono
@@ -86,5 +218,27 @@ private:
     static void polyphase4( const juce::AudioSampleBuffer & source, juce::AudioSampleBuffer & result );
     static float polyphase4ComputeSum( const float * input, int offset, int maxOffset, const float* coefficients, int numCoeff );
 
+    static float polyphase4AbsMaxScalar( const float * input, int numSamples, float currentMax );
+#if JUCE_INTEL
+    static float polyphase4AbsMaxSse2( const float * input, int numSamples, float currentMax );
+    static float polyphase4AbsMaxAvx( const float * input, int numSamples, float currentMax );
+#endif
+#if LUFS_NEON
+    static float polyphase4AbsMaxNeon( const float * input, int numSamples, float currentMax );
+#endif
+
+    static void kWeightingScalar( const BiquadCoefficients & shelf, const BiquadCoefficients & highPass, KWeightingFilterBank::State & state, const int firstChannel, 
+                                  const float * const * input, float * const * output, const int numChannels, const int numSamples );
+#if JUCE_INTEL
+    static void kWeightingSse2( const BiquadCoefficients & shelf, const BiquadCoefficients & highPass, KWeightingFilterBank::State & state, const int firstChannel, 
+                                const float * const * input, float * const * output, const int numChannels, const int numSamples );
+    static void kWeightingAvx( const BiquadCoefficients & shelf, const BiquadCoefficients & highPass, KWeightingFilterBank::State & state, const int firstChannel, 
+                               const float * const * input, float * const * output, const int numChannels, const int numSamples );
+#endif
+#if LUFS_NEON
+    static void kWeightingNeon( const BiquadCoefficients & shelf, const BiquadCoefficients & highPass, KWeightingFilterBank::State & state, const int firstChannel, 
+                                const float * const * input, float * const * output, const int numChannels, const int numSamples );
+#endif
+
 };
 
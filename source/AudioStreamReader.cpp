@@ -0,0 +1,208 @@
+/*
+  =================================================================
+
+  This file is part of the LUFS-TruePeak program.
+  Copyright (c) 2015 - Mathieu Pavageau - contact@repetito.com
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  Details of these licenses can be found at: www.gnu.org/licenses
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  =================================================================
+*/
+
+#include "AppIncsAndDefs.h"
+
+#include "AudioStreamReader.h"
+
+bool AudioStreamReader::testChunks()
+{
+    bool success = true;
+
+    const int numChannels = 3;
+    const int lengthInSamples = 100000;
+
+    // 24 bits wav file in memory, with a different signal on each channel
+    juce::MemoryBlock fileData;
+    {
+        juce::AudioSampleBuffer signal( numChannels, lengthInSamples );
+        juce::Random random( 0x1770 );
+        for ( int ch = 0 ; ch < numChannels ; ++ch )
+        {
+            for ( int i = 0 ; i < lengthInSamples ; ++i )
+                signal.getWritePointer( ch )[ i ] = ( 2.f * random.nextFloat() - 1.f ) / (float)( ch + 1 );
+        }
+
+        juce::WavAudioFormat wavAudioFormat;
+        juce::StringPairArray emptyArray;
+        juce::ScopedPointer<juce::AudioFormatWriter> writer( wavAudioFormat.createWriterFor( 
+            new juce::MemoryOutputStream( fileData, false ), 48000.0, numChannels, 24, emptyArray, 0 ) );
+
+        if ( writer == nullptr )
+            return false;
+
+        writer->writeFromAudioSampleBuffer( signal, 0, lengthInSamples );
+    }
+
+    juce::WavAudioFormat wavAudioFormat;
+    juce::ScopedPointer<juce::AudioFormatReader> referenceReader( wavAudioFormat.createReaderFor( new juce::MemoryInputStream( fileData, false ), true ) );
+    if ( referenceReader == nullptr )
+        return false;
+
+    juce::AudioSampleBuffer reference( numChannels, lengthInSamples );
+    referenceReader->read( &reference, 0, lengthInSamples, 0, true, true );
+
+    const int chunkSizeArray[] = { 1, 1000, 4096, lengthInSamples, 2 * lengthInSamples };
+
+    for ( int doubleBuffering = 0 ; doubleBuffering < 2 ; ++doubleBuffering )
+    {
+        for ( int c = 0 ; c < (int)( sizeof( chunkSizeArray ) / sizeof( int ) ) ; ++c )
+        {
+            const int chunkSize = chunkSizeArray[ c ];
+
+            juce::ScopedPointer<juce::AudioFormatReader> reader( wavAudioFormat.createReaderFor( new juce::MemoryInputStream( fileData, false ), true ) );
+            AudioStreamReader streamReader( *reader, chunkSize, doubleBuffering != 0 );
+
+            juce::int64 expectedPosition = 0;
+            while ( const juce::AudioSampleBuffer * chunk = streamReader.readNextChunk() )
+            {
+                if ( streamReader.getChunkPosition() != expectedPosition 
+                    || chunk->getNumChannels() != numChannels 
+                    || ( chunk->getNumSamples() != chunkSize && expectedPosition + chunk->getNumSamples() != lengthInSamples ) )
+                {
+                    DBG( juce::String( "AudioStreamReader::testChunks invalid chunk at " ) + juce::String( expectedPosition ) + ", chunk size " + juce::String( chunkSize ) );
+                    success = false;
+                    break;
+                }
+
+                for ( int ch = 0 ; ch < numChannels ; ++ch )
+                {
+                    if ( memcmp( chunk->getReadPointer( ch ), reference.getReadPointer( ch, (int)expectedPosition ), sizeof( float ) * (size_t)chunk->getNumSamples() ) != 0 )
+                    {
+                        DBG( juce::String( "AudioStreamReader::testChunks samples differ at " ) + juce::String( expectedPosition ) + ", chunk size " + juce::String( chunkSize ) );
+                        success = false;
+                    }
+                }
+
+                expectedPosition += chunk->getNumSamples();
+            }
+
+            if ( expectedPosition != lengthInSamples || streamReader.readNextChunk() != nullptr )
+            {
+                DBG( juce::String( "AudioStreamReader::testChunks read " ) + juce::String( expectedPosition ) + " samples, chunk size " + juce::String( chunkSize ) );
+                success = false;
+            }
+        }
+    }
+
+    return success;
+}
+
+AudioStreamReader::AudioStreamReader( juce::AudioFormatReader & reader, const int chunkSize, const bool doubleBuffering )
+    : juce::Thread( "AudioStreamReader" )
+    , m_reader( reader )
+    , m_chunkSize( juce::jmax( 1, chunkSize ) )
+    , m_doubleBuffering( doubleBuffering )
+    , m_nextReadPosition( 0 )
+    , m_currentSlot( -1 )
+    , m_finished( false )
+{
+    for ( int slot = 0 ; slot < nbSlots ; ++slot )
+    {
+        // allocated once, last chunk only changes buffer size
+        m_bufferArray[ slot ].setSize( getNumChannels(), (int)juce::jmin( (juce::int64)m_chunkSize, juce::jmax( (juce::int64)1, getLengthInSamples() ) ) );
+        m_positionArray[ slot ] = 0;
+        m_freeEventArray[ slot ].signal();
+    }
+
+    if ( m_doubleBuffering )
+        startThread();
+}
+
+AudioStreamReader::~AudioStreamReader()
+{
+    signalThreadShouldExit();
+
+    // wakes reading thread up if it waits for a slot
+    for ( int slot = 0 ; slot < nbSlots ; ++slot )
+        m_freeEventArray[ slot ].signal();
+
+    stopThread( 10000 );
+}
+
+juce::AudioSampleBuffer * AudioStreamReader::readNextChunk()
+{
+    if ( m_finished )
+        return nullptr;
+
+    const int slot = ( m_currentSlot + 1 ) % nbSlots;
+
+    if ( m_doubleBuffering )
+    {
+        // previous chunk can be overwritten now
+        if ( m_currentSlot >= 0 )
+            m_freeEventArray[ m_currentSlot ].signal();
+
+        m_readyEventArray[ slot ].wait();
+    }
+    else
+    {
+        readChunk( slot );
+    }
+
+    m_currentSlot = slot;
+
+    if ( m_bufferArray[ slot ].getNumSamples() == 0 )
+    {
+        m_finished = true;
+        return nullptr;
+    }
+
+    return &m_bufferArray[ slot ];
+}
+
+void AudioStreamReader::run()
+{
+    for ( int slot = 0 ; ; slot = ( slot + 1 ) % nbSlots )
+    {
+        m_freeEventArray[ slot ].wait();
+
+        if ( threadShouldExit() )
+            return;
+
+        // slot belongs to the reading caller once signaled
+        readChunk( slot );
+        const bool lastChunk = m_bufferArray[ slot ].getNumSamples() == 0;
+        m_readyEventArray[ slot ].signal();
+
+        if ( lastChunk )
+            return;
+    }
+}
+
+void AudioStreamReader::readChunk( const int slot )
+{
+    juce::AudioSampleBuffer & buffer = m_bufferArray[ slot ];
+
+    const int numSamples = (int)juce::jmax( (juce::int64)0, juce::jmin( (juce::int64)m_chunkSize, getLengthInSamples() - m_nextReadPosition ) );
+
+    // only last chunks are shorter, allocated memory is kept
+    if ( numSamples != buffer.getNumSamples() )
+        buffer.setSize( getNumChannels(), numSamples, false, false, true );
+
+    m_positionArray[ slot ] = m_nextReadPosition;
+
+    if ( numSamples > 0 )
+    {
+        m_reader.read( &buffer, 0, numSamples, m_nextReadPosition, true, true );
+        m_nextReadPosition += numSamples;
+    }
+}
@@ -0,0 +1,81 @@
+/*
+  =================================================================
+
+  This file is part of the LUFS-TruePeak program.
+  Copyright (c) 2015 - Mathieu Pavageau - contact@repetito.com
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  Details of these licenses can be found at: www.gnu.org/licenses
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  =================================================================
+*/
+
+#pragma once 
+
+// Reads an audio file by fixed size chunks, so that memory used doesn't depend on file length.
+// With double buffering, a background thread reads the next chunk while the current one is 
+// being processed: readNextChunk then usually returns without waiting for the disk or decoder
+class AudioStreamReader : private juce::Thread
+{
+public:
+
+    // reads an in-memory wav file with several chunk sizes, with and without double buffering, 
+    // and compares chunks with samples read directly
+    static bool testChunks();
+
+    enum
+    {
+        defaultChunkSize = 65536
+    };
+
+    // reader must stay valid while this object exists, and mustn't be used by anything else
+    AudioStreamReader( juce::AudioFormatReader & reader, const int chunkSize = defaultChunkSize, const bool doubleBuffering = true );
+    ~AudioStreamReader();
+
+    // returns next chunk, or nullptr after the last one; chunk stays valid until next call and may 
+    // be modified in place. All chunks have chunkSize samples except the last one
+    juce::AudioSampleBuffer * readNextChunk();
+
+    // position in file of first sample of chunk returned by last readNextChunk call
+    inline juce::int64 getChunkPosition() const { return m_currentSlot >= 0 ? m_positionArray[ m_currentSlot ] : 0; }
+
+    inline juce::int64 getLengthInSamples() const { return m_reader.lengthInSamples; }
+    inline int getNumChannels() const { return (int)m_reader.numChannels; }
+
+    // juce::Thread
+    void run() override;
+
+private:
+
+    enum
+    {
+        nbSlots = 2
+    };
+
+    // reads chunk at m_nextReadPosition into slot buffer, an empty buffer means end of file
+    void readChunk( const int slot );
+
+    juce::AudioFormatReader & m_reader;
+    const int m_chunkSize;
+    const bool m_doubleBuffering;
+
+    juce::AudioSampleBuffer m_bufferArray[ nbSlots ];
+    juce::int64 m_positionArray[ nbSlots ];
+    juce::WaitableEvent m_readyEventArray[ nbSlots ]; // slot was filled by reading thread
+    juce::WaitableEvent m_freeEventArray[ nbSlots ]; // slot was released by readNextChunk
+
+    juce::int64 m_nextReadPosition; // only used by reading thread when double buffering
+    int m_currentSlot; // slot returned by last readNextChunk call, -1 before first call
+    bool m_finished;
+
+    JUCE_DECLARE_NON_COPYABLE( AudioStreamReader )
+};
@@ -24,6 +24,7 @@
 #include "Chart.h"
 
 #include "LufsAudioProcessor.h"
+#include "LufsHistoryIndex.h"
 #include "LufsTruePeakPluginEditor.h"
 
 int Chart::getVolumeY( const int height, const float decibels )
@@ -34,12 +35,27 @@ int Chart::getVolumeY( const int height, const float decibels )
     if ( decibels < m_minChartVolume )
         return height;
 
+    if ( height != m_volumeYTableHeight )
+        fillVolumeYTable( height );
+
+    return m_volumeYTable.getUnchecked( juce::roundToInt( ( decibels - m_minChartVolume ) * (float)volumeYTableSteps ) );
+}
+
+void Chart::fillVolumeYTable( const int height )
+{
     const float offset = 25.f; // offset to avoid being too close to 0 in log function 
-    float value = logf( offset - decibels );
-    static const float valueMin = logf( offset - m_minChartVolume );
-    static const float valueMax = logf( offset - m_maxChartVolume );
+    const float valueMin = logf( offset - m_minChartVolume );
+    const float valueMax = logf( offset - m_maxChartVolume );
 
-    return int( ( value - valueMax ) * (float) ( height ) / ( valueMin - valueMax ) );
+    const int size = juce::roundToInt( ( m_maxChartVolume - m_minChartVolume ) * (float)volumeYTableSteps ) + 1;
+    m_volumeYTable.resize( size );
+    for ( int i = 0 ; i < size ; ++i )
+    {
+        const float decibels = juce::jmin( m_maxChartVolume, m_minChartVolume + (float)i / (float)volumeYTableSteps );
+        const float value = logf( offset - decibels );
+        m_volumeYTable.setUnchecked( i, int( ( value - valueMax ) * (float) ( height ) / ( valueMin - valueMax ) ) );
+    }
+    m_volumeYTableHeight = height;
 }
 
 Chart::Chart( float _minChartVolume, float _maxChartVolume ) 
@@ -48,32 +64,168 @@ Chart::Chart( float _minChartVolume, float _maxChartVolume )
     , m_minChartVolume( _minChartVolume )
     , m_maxChartVolume( _maxChartVolume )
     , m_truePeakThreshold( DEFAULT_ACCEPTABLE_MAX_TRUE_PEAK ) 
-    , m_validSize( 0 )
+    , m_numPixels( 0 )
+    , m_generation( -1 )
+    , m_integratedVolume( DEFAULT_MIN_VOLUME )
+    , m_rangeMin( DEFAULT_MIN_VOLUME )
+    , m_rangeMax( DEFAULT_MIN_VOLUME )
+    , m_allocatedBytes( 0 )
+    , m_zoomLevel( 0 )
+    , m_firstColumn( 0 )
+    , m_followLastValues( true )
+    , m_paused( false )
+    , m_volumeYTableHeight( -1 )
+    , m_tileHeight( 0 )
+    , m_tileScale( 0 )
+    , m_tileZoomLevel( 0 )
+    , m_tileRangeMaxY( 0 )
+    , m_tileRangeMinY( 0 )
+    , m_tileIntegratedY( 0 )
+    , m_tileTruePeakThreshold( 0.f )
 {
 }
 
 void Chart::update()
 {
-    bool cursorIsAtMaxRight = false;
-    if ( m_chartView != nullptr )
+    LufsProcessor & processor = m_processor->m_lufsProcessor;
+
+    // what was painted by last update
+    const int imageHeight = getHeight();
+    const int previousNumColumns = getNumColumns();
+    const int previousFirstColumn = m_firstColumn;
+    const int previousRangeMaxY = getVolumeY( imageHeight, m_rangeMax );
+    const int previousRangeMinY = getVolumeY( imageHeight, m_rangeMin );
+    const int previousIntegratedY = getVolumeY( imageHeight, m_integratedVolume );
+    const bool previousPaused = m_paused;
+    bool repaintAll = false;
     {
-        const int viewPositionX = m_chartView->getViewPositionX();
-        const int viewWidth = m_chartView->getViewWidth();
-        cursorIsAtMaxRight = ( viewPositionX + viewWidth ) >= ( m_validSize - 2 );
+        // paint reads pyramids of the history index with the lock held, up to the pixels of this update
+        const juce::ScopedLock historyLock( processor.getHistoryLock() );
+        const LufsProcessor::Snapshot snapshot = processor.getSnapshot();
+
+        // history was reset, or replaced by a session log
+        if ( processor.getGeneration() != m_generation )
+        {
+            m_generation = processor.getGeneration();
+            m_tiles.clear();
+            m_firstColumn = 0;
+            m_followLastValues = true;
+            repaintAll = true;
+        }
+
+        m_numPixels = processor.getHistoryIndex().getPyramid( processor.getMomentaryVolumeArray() ).getNumPixels();
+
+        m_integratedVolume = snapshot.m_integratedVolume;
+        m_rangeMin = snapshot.m_rangeMin;
+        m_rangeMax = snapshot.m_rangeMax;
+        m_allocatedBytes = snapshot.m_allocatedBytes;
     }
- 
-    m_validSize = m_processor->m_lufsProcessor.getValidSize();
-    if ( m_validSize > getWidth() )
-        setSize( m_validSize, getHeight() );
+    m_paused = processor.isPaused();
+
+    if ( m_followLastValues )
+        m_firstColumn = juce::jmax( 0, getNumColumns() - getWidth() );
 
-    if ( cursorIsAtMaxRight )
+    if ( m_chartView != nullptr )
+        m_chartView->updateScrollBar();
+
+    // tiles are painted again when range or integrated lines move
+    repaintAll = repaintAll
+        || m_firstColumn != previousFirstColumn
+        || m_paused != previousPaused
+        || getVolumeY( imageHeight, m_rangeMax ) != previousRangeMaxY
+        || getVolumeY( imageHeight, m_rangeMin ) != previousRangeMinY
+        || getVolumeY( imageHeight, m_integratedVolume ) != previousIntegratedY;
+
+    if ( repaintAll )
     {
-        m_chartView->setViewPositionProportionately( 1.0, 1.0 );
+        repaint();
+        return;
     }
 
+    // new columns, last column which may have been partial, and lines of values over previous columns
+    const int x = juce::jmax( 0, previousNumColumns - tileMargin - m_firstColumn );
+    if ( x < getWidth() && getNumColumns() != previousNumColumns )
+        repaint( x, 0, getWidth() - x, imageHeight );
+
+    // memory
+    repaint( getWidth() - 155, imageHeight - 15, 150, 10 );
+}
+
+void Chart::resized()
+{
+    scrollTo( m_followLastValues ? getNumColumns() : m_firstColumn );
+}
+
+void Chart::setZoomLevel( const int zoomLevel, const int x )
+{
+    const int level = juce::jlimit( 0, (int)LufsHistoryPyramid::numLevels - 1, zoomLevel );
+    if ( level == m_zoomLevel )
+        return;
+
+    // pixel of 100 ms at x stays at x
+    const int pixel = ( m_firstColumn + x ) << m_zoomLevel;
+    const bool followLastValues = m_followLastValues;
+    m_zoomLevel = level;
+    scrollTo( followLastValues ? getNumColumns() : ( pixel >> m_zoomLevel ) - x );
+}
+
+void Chart::scrollTo( const int firstColumn )
+{
+    const int maxFirstColumn = juce::jmax( 0, getNumColumns() - getWidth() );
+    m_firstColumn = juce::jlimit( 0, maxFirstColumn, firstColumn );
+    m_followLastValues = m_firstColumn == maxFirstColumn;
+
+    if ( m_chartView != nullptr )
+        m_chartView->updateScrollBar();
+
     repaint();
 }
 
+void Chart::resetScrolling()
+{
+    m_firstColumn = 0;
+    m_followLastValues = true;
+
+    if ( m_chartView != nullptr )
+        m_chartView->updateScrollBar();
+
+    repaint();
+}
+
+void Chart::mouseDoubleClick( const juce::MouseEvent & event )
+{
+    // whole history, or back to 100 ms per column
+    if ( m_zoomLevel > 0 )
+    {
+        setZoomLevel( 0, event.x );
+        return;
+    }
+
+    int level = 0;
+    while ( level < LufsHistoryPyramid::numLevels - 1 && getNumColumns( level ) > getWidth() )
+        ++level;
+    setZoomLevel( level, event.x );
+}
+
+int Chart::getTimeLinePixels() const
+{
+    // 10 s, 20 s, 30 s, 1 min, 2 min, 5 min, 10 min, 20 min, 30 min, 1 h, 2 h, 3 h, 6 h, 12 h, 1 day
+    static const int pixelsArray[] = { 100, 200, 300, 600, 1200, 3000, 6000, 12000, 18000, 36000, 72000, 108000, 216000, 432000, 864000 };
+
+    const int minPixels = 100 << m_zoomLevel;
+    for ( int i = 0 ; i < juce::numElementsInArray( pixelsArray ) ; ++i )
+    {
+        if ( pixelsArray[ i ] >= minPixels )
+            return pixelsArray[ i ];
+    }
+
+    // days
+    int pixels = 864000;
+    while ( pixels < minPixels )
+        pixels *= 2;
+    return pixels;
+}
+
 void Chart::paint(juce::Graphics& g)
 {
     juce::Font lufsFont( 12.f );
@@ -86,84 +238,49 @@ void Chart::paint(juce::Graphics& g)
     const int imageHeight = getHeight();
     const int beginning = clipBounds.getX();
 
-    g.setColour( COLOR_BACKGROUND_GRAPH );
-    g.fillRect( beginning, 0, imageWidth, imageHeight );
-
-    if ( m_validSize && clipBounds.getX() < ( m_validSize - 2 ) )
+    if ( getNumColumns() > 0 )
     {
-        int size = imageWidth;
-        if ( beginning + size > m_validSize - 2 )
-            size = m_validSize - 2 - beginning;
-
-        // range 
-        g.setColour( COLOR_RANGE );
-        int yRange = getVolumeY( imageHeight, m_processor->m_lufsProcessor.getRangeMaxVolume() );
-        int hRange = getVolumeY( imageHeight, m_processor->m_lufsProcessor.getRangeMinVolume() ) - yRange;
-        g.fillRect( clipBounds.getX(), yRange, clipBounds.getWidth(), hRange );
+        updateTiles( g.getInternalContext().getPhysicalPixelScaleFactor() );
 
-        // time lines
-        g.setColour( juce::Colours::black );
-        for ( int i = beginning - 100 ; i < ( beginning + imageWidth ) ; ++i )
+        // pyramids hold at least the pixels of last update, unless history was reset since then: 
+        // next update paints it again
+        const LufsProcessor & processor = m_processor->m_lufsProcessor;
+        const juce::ScopedLock historyLock( processor.getHistoryLock() );
+        if ( processor.getGeneration() == m_generation )
         {
-            if ( !( i % 100 ) )
+            // tiles of clip, painted up to last values
+            const int firstIndex = ( m_firstColumn + beginning ) / tileWidth;
+            const int lastIndex = ( m_firstColumn + beginning + imageWidth - 1 ) / tileWidth;
+            for ( int index = firstIndex ; index <= lastIndex ; ++index )
             {
-                g.fillRect( i, 0, 1, imageHeight );
+                Tile & tile = getTile( index );
+                paintTile( tile, processor.getHistoryIndex() );
+                g.drawImage( tile.m_image, index * tileWidth - m_firstColumn, 0, tileWidth, imageHeight, 0, 0, tile.m_image.getWidth(), tile.m_image.getHeight() );
             }
         }
-
-        // true peak vertical lines
-        paintTruePeakLines( g, m_processor->m_lufsProcessor.getTruePeakArray(), beginning, size );
-
-        // volume lines 
-        g.setColour( juce::Colours::black );
-        for ( float v = -3.f ; v > -70.f ; v -= 3.f )
+        else
         {
-            if ( ( v >= m_minChartVolume ) && ( v <= ( m_maxChartVolume ) ) )
-            {
-                int y = getVolumeY( imageHeight, v );
-                g.fillRect( clipBounds.getX(), y, clipBounds.getWidth(), 1 );
-            }
+            g.setColour( COLOR_BACKGROUND_GRAPH );
+            g.fillRect( beginning, 0, imageWidth, imageHeight );
         }
 
-        g.setColour( COLOR_INTEGRATED );
-        //g.fillRect( 0, getVolumeY( imageHeight, m_processor->m_lufsProcessor.getIntegratedVolume() ), imageWidth, 3 );
-        g.fillRect( clipBounds.getX(), getVolumeY( imageHeight, m_processor->m_lufsProcessor.getIntegratedVolume() ), clipBounds.getWidth(), 3 );
-
+        // tiles out of view
+        const int firstVisibleIndex = m_firstColumn / tileWidth;
+        const int lastVisibleIndex = ( m_firstColumn + getWidth() - 1 ) / tileWidth;
+        for ( int i = m_tiles.size() - 1 ; i >= 0 ; --i )
         {
-            const int factor = 1;
-            paintValues( g, COLOR_MOMENTARY, m_processor->m_lufsProcessor.getMomentaryVolumeArray(), factor, beginning, size / factor );
-            paintValues( g, COLOR_SHORTTERM, m_processor->m_lufsProcessor.getShortTermVolumeArray(), factor, beginning, size / factor );
+            if ( m_tiles[ i ]->m_index < firstVisibleIndex || m_tiles[ i ]->m_index > lastVisibleIndex )
+                m_tiles.remove( i );
         }
 
         // time text
-        g.setColour( juce::Colours::black );
-        // don't show time text at far left and far right to make space for "Min vol" and Memory
-        for ( int i = beginning + 40 ; i < ( beginning + imageWidth - 120) ; ++i )
-        {
-            if ( !( i % 100 ) )
-            {
-                const int seconds = ( i / 10 ) % 60;
-                const int minutes = ( i / 600 ) % 60;
-                const int hours = ( i / 36000 );
-                juce::String text;
-                if ( hours )
-                {
-                    text += juce::String( hours );
-                    text += ":";
-                }
-                if ( minutes < 10 ) text += "0";
-                text += juce::String( minutes );
-                text += ":";
-                if ( seconds < 10 ) text += "0";
-                text += juce::String( seconds );
-
-                g.drawFittedText( text, i + 5, imageHeight - 12, 60, 10, juce::Justification::centredLeft, 1, 0.01f );
-            }
-        }
-
+        paintTime( g, m_firstColumn, beginning, imageWidth, true );
     }
     else
     {
+        g.setColour( COLOR_BACKGROUND_GRAPH );
+        g.fillRect( beginning, 0, imageWidth, imageHeight );
+
         g.setColour( juce::Colours::black );
         for ( float v = -3.f ; v > -70.f ; v -= 3.f )
         {
@@ -189,17 +306,14 @@ void Chart::paint(juce::Graphics& g)
     g.drawFittedText( "Min vol", clipBounds.getX() + 5, imageHeight - 15, 40, 10, juce::Justification::centredLeft, 1, 0.01f );
 
     // memory
-    float memoryPercent = 100.f * (float)m_processor->m_lufsProcessor.getValidSize() / (float)m_processor->m_lufsProcessor.getMaxSize();
-
-    if ( memoryPercent > 80.f )
-        g.setColour( juce::Colours::red );
+    const double memoryMegabytes = (double)m_allocatedBytes / ( 1024.0 * 1024.0 );
 
     juce::String memory( "Memory: ");
-    memory << juce::String( memoryPercent, 2 );
-    memory << " %";
+    memory << juce::String( memoryMegabytes, 2 );
+    memory << " MB";
     g.drawFittedText( memory, clipBounds.getX() + clipBounds.getWidth() - 155, imageHeight - 15, 150, 10, juce::Justification::centredRight, 1, 0.01f );
     
-    if ( m_processor->m_lufsProcessor.isPaused() )
+    if ( m_paused )
     {
         juce::Font pausedFont( 36.f );
         pausedFont.setBold(true);
@@ -219,76 +333,193 @@ void Chart::paint(juce::Graphics& g)
 
 }
 
-void Chart::paintValues( juce::Graphics& g, const juce::Colour _color, const float * _data, const int _itemsPerPixel, const int _offset, const int _pixels )
+void Chart::updateTiles( const float scale )
 {
-    g.setColour( _color );
-
+    // tiles are drawn at an integer scale of physical pixels
+    const int tileScale = juce::jmax( 1, (int)ceilf( scale ) );
     const int imageHeight = getHeight();
-    const int max = _offset + _pixels * _itemsPerPixel;
+    const int rangeMaxY = getVolumeY( imageHeight, m_rangeMax );
+    const int rangeMinY = getVolumeY( imageHeight, m_rangeMin );
+    const int integratedY = getVolumeY( imageHeight, m_integratedVolume );
+
+    if ( imageHeight == m_tileHeight
+        && tileScale == m_tileScale
+        && m_zoomLevel == m_tileZoomLevel
+        && rangeMaxY == m_tileRangeMaxY
+        && rangeMinY == m_tileRangeMinY
+        && integratedY == m_tileIntegratedY
+        && m_truePeakThreshold == m_tileTruePeakThreshold )
+        return;
+
+    m_tiles.clear();
+    m_tileHeight = imageHeight;
+    m_tileScale = tileScale;
+    m_tileZoomLevel = m_zoomLevel;
+    m_tileRangeMaxY = rangeMaxY;
+    m_tileRangeMinY = rangeMinY;
+    m_tileIntegratedY = integratedY;
+    m_tileTruePeakThreshold = m_truePeakThreshold;
+}
+
+Chart::Tile & Chart::getTile( const int index )
+{
+    for ( int i = 0 ; i < m_tiles.size() ; ++i )
+    {
+        if ( m_tiles[ i ]->m_index == index )
+            return *m_tiles[ i ];
+    }
 
-    jassert( _offset < m_validSize );
-    jassert( max < m_validSize );
+    Tile * tile = new Tile();
+    tile->m_index = index;
+    tile->m_numColumns = 0;
+    tile->m_image = juce::Image( juce::Image::RGB, tileWidth * m_tileScale, m_tileHeight * m_tileScale, false );
+    return *m_tiles.add( tile );
+}
 
-    _data += _offset;
+void Chart::paintTile( Tile & tile, const LufsHistoryIndex & index )
+{
+    const int numColumns = getNumColumns();
+    const int firstColumn = tile.m_index * tileWidth;
 
-    if ( _itemsPerPixel == 1 )
-    {
-        float vol1 = *_data++;
-        float vol2 = *_data++;
+    // painted since last values, except last column which may have been partial, and lines of values 
+    // of new columns, over previous columns
+    const int x = juce::jmax( 0, tile.m_numColumns - tileMargin - firstColumn );
+    if ( tile.m_numColumns == numColumns || x >= tileWidth )
+        return;
 
-        for ( int i = _offset ; i < _offset + _pixels - 2 ; ++i )
+    tile.m_numColumns = numColumns;
+
+    const int width = tileWidth - x;
+    const int imageHeight = m_tileHeight;
+    const int size = juce::jlimit( 0, width, numColumns - firstColumn - x );
+
+    juce::Graphics g( tile.m_image );
+    g.addTransform( juce::AffineTransform::scale( (float)m_tileScale ) );
+    g.reduceClipRegion( x, 0, width, imageHeight );
+
+    g.setColour( COLOR_BACKGROUND_GRAPH );
+    g.fillRect( x, 0, width, imageHeight );
+
+    // range 
+    g.setColour( COLOR_RANGE );
+    g.fillRect( x, m_tileRangeMaxY, width, m_tileRangeMinY - m_tileRangeMaxY );
+
+    // time lines
+    paintTime( g, firstColumn, x, width, false );
+
+    // true peak vertical lines
+    const LufsProcessor & processor = m_processor->m_lufsProcessor;
+    paintTruePeakLines( g, index.getPyramid( processor.getTruePeakArray() ), firstColumn, x, size );
+
+    // volume lines 
+    g.setColour( juce::Colours::black );
+    for ( float v = -3.f ; v > -70.f ; v -= 3.f )
+    {
+        if ( ( v >= m_minChartVolume ) && ( v <= ( m_maxChartVolume ) ) )
         {
-            g.drawLine( (float)( i ), (float)getVolumeY( imageHeight, vol1 ), (float)( i + 1 ), (float)getVolumeY( imageHeight, vol2 ), 3.f );
-            vol1 = vol2;
-            vol2 = *_data++;
-        }   
+            int y = getVolumeY( imageHeight, v );
+            g.fillRect( x, y, width, 1 );
+        }
     }
-    else
+
+    g.setColour( COLOR_INTEGRATED );
+    g.fillRect( x, m_tileIntegratedY, width, 3 );
+
+    if ( size > 0 )
+    {
+        paintValues( g, COLOR_MOMENTARY, index.getPyramid( processor.getMomentaryVolumeArray() ), firstColumn, x, size );
+        paintValues( g, COLOR_SHORTTERM, index.getPyramid( processor.getShortTermVolumeArray() ), firstColumn, x, size );
+    }
+}
+
+void Chart::paintTime( juce::Graphics& g, const int _firstColumn, const int _x, const int _width, const bool _text )
+{
+    g.setColour( juce::Colours::black );
+
+    const int imageHeight = getHeight();
+    const juce::int64 linePixels = getTimeLinePixels();
+
+    // lines from one line before x, texts are 100 columns wide at most
+    const juce::int64 firstPixel = (juce::int64)juce::jmax( 0, _firstColumn + _x - 100 ) << m_zoomLevel;
+    for ( juce::int64 pixel = ( firstPixel + linePixels - 1 ) / linePixels * linePixels ; ; pixel += linePixels )
     {
-        float min1 = *_data++;;
-        float max1 = min1;
-        for ( int j = 1 ; j < _itemsPerPixel ; ++j )
+        const int x = (int)( pixel >> m_zoomLevel ) - _firstColumn;
+        if ( x >= _x + _width )
+            break;
+
+        if ( !_text )
         {
-            float val = *_data++;
-            if ( val > max1 ) max1 = val;
-            if ( val < min1 ) min1 = val;
+            g.fillRect( x, 0, 1, imageHeight );
+            continue;
         }
 
-        for ( int i = 0 ; i < _pixels - 2; ++i )
+        // don't show time text at far left and far right to make space for "Min vol" and Memory
+        if ( x < 40 || x >= getWidth() - 120 )
+            continue;
+
+        const int seconds = (int)( ( pixel / 10 ) % 60 );
+        const int minutes = (int)( ( pixel / 600 ) % 60 );
+        const int hours = (int)( pixel / 36000 );
+        juce::String text;
+        if ( hours )
         {
-            float min2 = *_data++;;
-            float max2 = min2;
-            for ( int j = 1 ; j < _itemsPerPixel ; ++j )
-            {
-                float val = *_data++;
-                if ( val > max2 ) max2 = val;
-                if ( val < min2 ) min2 = val;
-            }
-
-            g.drawLine( (float)( i ), (float)getVolumeY( imageHeight, max1 ), (float)( i + 1 ), (float)getVolumeY( imageHeight, max2 ), 3.f );
-            max1 = max2;
+            text += juce::String( hours );
+            text += ":";
         }
+        if ( minutes < 10 ) text += "0";
+        text += juce::String( minutes );
+        text += ":";
+        if ( seconds < 10 ) text += "0";
+        text += juce::String( seconds );
+
+        g.drawFittedText( text, x + 5, imageHeight - 12, 60, 10, juce::Justification::centredLeft, 1, 0.01f );
     }
 }
 
-void Chart::paintTruePeakLines( juce::Graphics& g, const float * _data, const int _offset, const int _pixels )
+void Chart::paintValues( juce::Graphics& g, const juce::Colour _color, const LufsHistoryPyramid & _pyramid, const int _firstColumn, const int _x, const int _width )
 {
-    const int imageHeight = getHeight();
-    const int max = _offset + _pixels;
+    const int imageHeight = m_tileHeight;
+    const int level = m_zoomLevel;
+    const int end = _x + _width;
 
-    jassert( _offset < m_validSize );
-    jassert( max < m_validSize );
+    jassert( _firstColumn + end <= _pyramid.getLevelSize( level ) );
 
-    _data += _offset;
-
-    for ( int i = _offset ; i < _offset + _pixels - 2 ; ++i )
+    // band from min to max values of columns holding several pixels
+    if ( level > 0 )
     {
-        const float decibelTruePeak = *_data++;
-        if ( decibelTruePeak >= m_truePeakThreshold )
+        g.setColour( _color.withAlpha( 0.35f ) );
+        for ( int x = _x ; x < end ; ++x )
         {
-            g.setColour( juce::Colours::red );
-            g.fillRect( i, 0, 1, imageHeight ); // drawLine( (float)( i ), 0, (float)( i + 1 ), (float)getVolumeY( imageHeight, vol2 ), 3.f );
+            const int yMax = getVolumeY( imageHeight, _pyramid.getMax( level, _firstColumn + x ) );
+            const int yMin = getVolumeY( imageHeight, _pyramid.getMin( level, _firstColumn + x ) );
+            g.fillRect( x, yMax, 1, yMin - yMax + 1 );
         }
+    }
+
+    // line of max values, from columns before x whose lines are 3 pixels wide
+    g.setColour( _color );
+
+    const int begin = juce::jmax( -_firstColumn, _x - tileMargin + 1 );
+    float vol1 = _pyramid.getMax( level, _firstColumn + begin );
+
+    for ( int x = begin ; x < end - 1 ; ++x )
+    {
+        const float vol2 = _pyramid.getMax( level, _firstColumn + x + 1 );
+        g.drawLine( (float)( x ), (float)getVolumeY( imageHeight, vol1 ), (float)( x + 1 ), (float)getVolumeY( imageHeight, vol2 ), 3.f );
+        vol1 = vol2;
+    }   
+}
+
+void Chart::paintTruePeakLines( juce::Graphics& g, const LufsHistoryPyramid & _pyramid, const int _firstColumn, const int _x, const int _width )
+{
+    const int imageHeight = m_tileHeight;
+
+    g.setColour( juce::Colours::red );
+    for ( int x = _x ; x < _x + _width ; ++x )
+    {
+        const float decibelTruePeak = _pyramid.getMax( m_zoomLevel, _firstColumn + x );
+        if ( decibelTruePeak >= m_truePeakThreshold )
+            g.fillRect( x, 0, 1, imageHeight );
     }   
 }
 
@@ -302,52 +533,59 @@ void Chart::setTruePeakThreshold( float truePeakThreshold )
 
 ChartView::ChartView( float _minChartVolume, float _maxChartVolume ) 
     : m_chart (_minChartVolume, _maxChartVolume )
+    , m_scrollBar( false )
 {
-    resetScrolling();
-
     m_chart.setChartView( this );
+    addAndMakeVisible( &m_chart );
 
-    setViewedComponent( &m_chart, false );
+    m_scrollBar.setAutoHide( false );
+    m_scrollBar.addListener( this );
+    addAndMakeVisible( &m_scrollBar );
 }
 
 void ChartView::resized()
 {
-    m_chart.setSize( 1 + getWidth(), getHeight() - 35 );
+    m_chart.setBounds( 0, 0, getWidth(), getHeight() - 35 );
+
+    const int scrollBarHeight = getLookAndFeel().getDefaultScrollbarWidth();
+    m_scrollBar.setBounds( 0, getHeight() - scrollBarHeight, getWidth(), scrollBarHeight );
 }
 
 void ChartView::resetScrolling()
 {
-    m_chart.setSize( 1 + getWidth(), getHeight() - 35 );
+    m_chart.resetScrolling();
 }
 
-void ChartView::mouseWheelMove( const juce::MouseEvent& /*event*/, const juce::MouseWheelDetails & wheel ) 
+void ChartView::mouseWheelMove( const juce::MouseEvent& event, const juce::MouseWheelDetails & wheel ) 
 {
-    juce::String text( wheel.deltaX );
-    text += " y: ";
-    text += juce::String( wheel.deltaY );
-    DBG(text);
-
-    const int viewPositionX = getViewPositionX();
-    const int width = m_chart.getWidth() - getWidth();
-    const float pos = (float)viewPositionX / (float)width;
-    const float page = (float)getWidth() / (float)width;
-
-    if ( wheel.deltaY > 0.f )
+    if ( event.mods.isCommandDown() )
     {
-        float newPositionX = pos + page / 2.f;
-        if ( newPositionX > 1.f )
-            newPositionX = 1.f;
-        
-        setViewPositionProportionately( newPositionX, 1.f );
+        // wheel up zooms in
+        const int x = event.getEventRelativeTo( &m_chart ).x;
+        if ( wheel.deltaY > 0.f )
+            m_chart.setZoomLevel( m_chart.getZoomLevel() - 1, x );
+        else if ( wheel.deltaY < 0.f )
+            m_chart.setZoomLevel( m_chart.getZoomLevel() + 1, x );
+        return;
     }
+
+    const int halfPage = m_chart.getWidth() / 2;
+    if ( wheel.deltaY > 0.f )
+        m_chart.scrollTo( m_chart.getFirstColumn() + halfPage );
     else if ( wheel.deltaY < 0.f )
-    {
-        float newPositionX = pos - page / 2.f;
-        if ( newPositionX < 0.f )
-            newPositionX = 0.f;
-        
-        setViewPositionProportionately( newPositionX, 1.f );
-    }
+        m_chart.scrollTo( m_chart.getFirstColumn() - halfPage );
+}
+
+void ChartView::scrollBarMoved( juce::ScrollBar * /*scrollBar*/, double newRangeStart )
+{
+    m_chart.scrollTo( juce::roundToInt( newRangeStart ) );
+}
+
+void ChartView::updateScrollBar()
+{
+    const int width = m_chart.getWidth();
+    m_scrollBar.setRangeLimits( 0.0, (double)juce::jmax( width, m_chart.getNumColumns() ), juce::dontSendNotification );
+    m_scrollBar.setCurrentRange( (double)m_chart.getFirstColumn(), (double)width, juce::dontSendNotification );
 }
 
 void ChartView::update()
@@ -21,20 +21,34 @@
 
 #pragma once 
 
+#include "LufsHistoryPyramid.h"
+
 class LufsAudioProcessor;
+class LufsHistoryIndex;
 class ChartView;
 
+// Timeline of momentary and short term volumes and true peaks, zoomable from 100 ms to 2^24 times 
+// 100 ms per column. Min and max values of columns are read from the pyramids of the history index of 
+// the processor, so that paint cost only depends on the number of visible columns; the component is 
+// as wide as the view.
+// Columns are painted in cached tiles as values arrive, tiles are only painted again when the range, 
+// integrated volume or true peak threshold move
 class Chart : public juce::Component
 {
 public:
     Chart( float _minChartVolume, float _maxChartVolume );
 
+    // shows new history values, follows last values unless scrolled back
     void update();
 
     // juce::Component
     virtual void paint( juce::Graphics& g );
+    virtual void resized() override;
+    // zooms to show all history, or back to 100 ms per column
+    virtual void mouseDoubleClick( const juce::MouseEvent & event ) override;
 
     inline void setProcessor( LufsAudioProcessor * processor ) { m_processor = processor; }
+    // y of volume, from a table of volumes by hundredths of decibels
     int getVolumeY( const int height, const float decibels );
 
     inline void setChartView( ChartView * _chartView ) { m_chartView = _chartView; }
@@ -44,40 +58,116 @@ public:
 
     void setTruePeakThreshold( float truePeakThreshold );
 
+    // columns hold 2^zoomLevel pixels of 100 ms
+    inline int getZoomLevel() const { return m_zoomLevel; }
+    inline int getNumColumns() const { return getNumColumns( m_zoomLevel ); }
+    inline int getFirstColumn() const { return m_firstColumn; }
+
+    // zooms keeping the time at x in place
+    void setZoomLevel( const int zoomLevel, const int x );
+
+    // shows columns from firstColumn, last values are followed when they are shown
+    void scrollTo( const int firstColumn );
+
+    // shows last values at current zoom level
+    void resetScrolling();
+
 private:
 
-    void paintValues( juce::Graphics& g, const juce::Colour _color, const float * _data, const int _itemsPerPixel, const int _offset, const int _pixels );
-    void paintTruePeakLines( juce::Graphics& g, const float * _data, const int _offset, const int _pixels );
+    enum 
+    { 
+        volumeYTableSteps = 100, // table values per decibel
+        tileWidth = 256, // columns per tile
+        tileMargin = 4 // columns painted again before new columns: last column and lines 3 pixels wide
+    };
+
+    // image of columns from m_index * tileWidth
+    struct Tile
+    {
+        int m_index;
+        int m_numColumns; // number of chart columns when tile was painted
+        juce::Image m_image;
+    };
+
+    void fillVolumeYTable( const int height );
+
+    // tiles are cleared when what they show besides values changes
+    void updateTiles( const float scale );
+    Tile & getTile( const int index );
+    // paints columns of tile added since it was painted, from pyramids of the history index
+    void paintTile( Tile & tile, const LufsHistoryIndex & index );
+
+    // columns of history as of last update at zoom level
+    inline int getNumColumns( const int level ) const { return ( m_numPixels + ( 1 << level ) - 1 ) >> level; }
+
+    // momentary or short term volumes: line of max values, and band from min to max values when zoomed out
+    // x is from _firstColumn in tiles, from m_firstColumn in component
+    void paintValues( juce::Graphics& g, const juce::Colour _color, const LufsHistoryPyramid & _pyramid, const int _firstColumn, const int _x, const int _width );
+    void paintTruePeakLines( juce::Graphics& g, const LufsHistoryPyramid & _pyramid, const int _firstColumn, const int _x, const int _width );
+    void paintTime( juce::Graphics& g, const int _firstColumn, const int _x, const int _width, const bool _text );
+
+    // time between time lines, in pixels of 100 ms, so that they are at least 100 columns apart
+    int getTimeLinePixels() const;
 
     LufsAudioProcessor * m_processor;
     ChartView * m_chartView;
     float m_minChartVolume;
     float m_maxChartVolume;
     float m_truePeakThreshold;
-    int m_validSize;
+
+    // history as of last update
+    int m_numPixels;
+    int m_generation; // reset generation of history
+    float m_integratedVolume;
+    float m_rangeMin;
+    float m_rangeMax;
+    size_t m_allocatedBytes;
+
+    int m_zoomLevel;
+    int m_firstColumn;
+    bool m_followLastValues; // last column is kept visible by update
+    bool m_paused;
+
+    juce::Array<int> m_volumeYTable;
+    int m_volumeYTableHeight;
+
+    // visible tiles, and what they were painted with
+    juce::OwnedArray<Tile> m_tiles;
+    int m_tileHeight;
+    int m_tileScale;
+    int m_tileZoomLevel;
+    int m_tileRangeMaxY;
+    int m_tileRangeMinY;
+    int m_tileIntegratedY;
+    float m_tileTruePeakThreshold;
 };
 
-class ChartView : public juce::Viewport
+class ChartView 
+    : public juce::Component
+    , public juce::ScrollBar::Listener
 {
 public:
     ChartView( float _minChartVolume, float _maxChartVolume );
 
     // juce::Component
     virtual void resized();
+    // scrolls by half a page, or zooms in and out around the mouse with command key down
     virtual void mouseWheelMove( const juce::MouseEvent& event, const juce::MouseWheelDetails & wheel ) override;
 
-    void resetScrolling();
+    // juce::ScrollBar::Listener
+    virtual void scrollBarMoved( juce::ScrollBar * scrollBar, double newRangeStart ) override;
 
-    // juce::Viewport
-    // virtual void visibleAreaChanged( const juce::Rectangle<int>& newVisibleArea );
+    void resetScrolling();
 
     inline void setProcessor( LufsAudioProcessor * processor ) { m_chart.setProcessor( processor ); }
 
     void update();
 
+    // range of scroll bar from columns of chart
+    void updateScrollBar();
+
     void setTruePeakThreshold( float truePeakThreshold ) { m_chart.setTruePeakThreshold( truePeakThreshold ); }
 
     Chart m_chart;
+    juce::ScrollBar m_scrollBar;
 };
-
-
@@ -27,8 +27,10 @@ ExportSettingsComponent::ExportSettingsComponent( juce::ApplicationProperties &
     : m_settings( _settings )
     , m_useCommasString( "useCommasForDecimalMarkForDataExport" )
     , m_exportTruePeakString( "exportTruePeakValuesInDataExport" )
+    , m_formatString( "formatOfDataExport" )
     , m_useCommas( true )
     , m_exportTruePeak( false )
+    , m_format( LufsTextExporter::tsv )
 {
     setSize( 700, 200 );
 
@@ -64,10 +66,25 @@ ExportSettingsComponent::ExportSettingsComponent( juce::ApplicationProperties &
     m_dontExportTruePeakButton.addListener( this );
     m_dontExportTruePeakButton.setClickingTogglesState( true );
     addAndMakeVisible( &m_dontExportTruePeakButton );
+
+    for ( int format = 0 ; format < LufsTextExporter::numFormats ; ++format )
+    {
+        m_formatButtons[ format ].setBounds( 660, 21 + 40 * format, 20, 20 );
+        m_formatButtons[ format ].setRadioGroupId( 3 );
+        m_formatButtons[ format ].addListener( this );
+        m_formatButtons[ format ].setClickingTogglesState( true );
+        addAndMakeVisible( &m_formatButtons[ format ] );
+    }
     
     m_useCommas = m_settings.getUserSettings()->getBoolValue( m_useCommasString, "true" );
 
     m_exportTruePeak = m_settings.getUserSettings()->getBoolValue( m_exportTruePeakString, "false" );
+
+    const int format = m_settings.getUserSettings()->getIntValue( m_formatString, LufsTextExporter::tsv );
+    if ( format >= 0 && format < LufsTextExporter::numFormats )
+        m_format = (LufsTextExporter::Format)format;
+
+    m_formatButtons[ m_format ].setToggleState( true, juce::dontSendNotification );
     
     if ( m_useCommas )
     {
@@ -106,6 +123,9 @@ void ExportSettingsComponent::paint( juce::Graphics & g )
     
     g.drawFittedText( "Export True Peak values", 20, 120, 210, 20, juce::Justification::centredRight, 1, 0.01f );
     g.drawFittedText( "Dont export True Peak values", 20, 160, 210, 20, juce::Justification::centredRight, 1, 0.01f );
+
+    for ( int format = 0 ; format < LufsTextExporter::numFormats ; ++format )
+        g.drawFittedText( LufsTextExporter::getFormatName( (LufsTextExporter::Format)format ), 440, 20 + 40 * format, 210, 20, juce::Justification::centredRight, 1, 0.01f );
 }
 
 void ExportSettingsComponent::buttonClicked( juce::Button * _button ) 
@@ -127,4 +147,15 @@ void ExportSettingsComponent::buttonClicked( juce::Button * _button )
         m_exportTruePeak = m_exportTruePeakButton.getToggleState();
         m_settings.getUserSettings()->setValue( m_exportTruePeakString, m_exportTruePeak ? 1 : 0 );
     }
+    else
+    {
+        for ( int format = 0 ; format < LufsTextExporter::numFormats ; ++format )
+        {
+            if ( _button == &m_formatButtons[ format ] && _button->getToggleState() )
+            {
+                m_format = (LufsTextExporter::Format)format;
+                m_settings.getUserSettings()->setValue( m_formatString, format );
+            }
+        }
+    }
 }
@@ -21,6 +21,8 @@
 
 #pragma once 
 
+#include "LufsTextExporter.h"
+
 class ExportSettingsComponent
     : public juce::Component
     , public juce::Button::Listener
@@ -38,19 +40,23 @@ public:
 
     bool useCommas() const { return m_useCommas; }
     bool exportTruePeak() const { return m_exportTruePeak; }
+    LufsTextExporter::Format getFormat() const { return m_format; }
 
 private:
 
     juce::ApplicationProperties & m_settings;
     juce::String m_useCommasString;
     juce::String m_exportTruePeakString;
+    juce::String m_formatString;
     juce::ToggleButton m_commaButton;
     juce::ToggleButton m_pointButton;
     juce::ToggleButton m_exportTruePeakButton;
     juce::ToggleButton m_dontExportTruePeakButton;
+    juce::ToggleButton m_formatButtons[ LufsTextExporter::numFormats ];
     juce::TextButton m_okButton;
     bool m_useCommas;
     bool m_exportTruePeak;
+    LufsTextExporter::Format m_format;
 };
 
 
@@ -0,0 +1,235 @@
+/*
+  =================================================================
+
+  This file is part of the LUFS-TruePeak program.
+  Copyright (c) 2015 - Mathieu Pavageau - contact@repetito.com
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  Details of these licenses can be found at: www.gnu.org/licenses
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  =================================================================
+*/
+
+#include <thread>
+
+#include "AppIncsAndDefs.h"
+
+#include "LufsAnalysisThread.h"
+#include "LufsProcessor.h"
+
+void DEBUGPLUGIN_output( const char * _text, ...);
+
+static bool isSameHistory( const LufsHistoryArray & a, const LufsHistoryArray & b, const int size )
+{
+    for ( int i = 0 ; i < size ; ++i )
+    {
+        if ( a[ i ] != b[ i ] )
+            return false;
+    }
+
+    return true;
+}
+
+bool LufsAnalysisThread::testSnapshots()
+{
+    bool success = true;
+
+    const double sampleRate = 48000.0;
+    const int bufferSize = 480;
+
+    juce::AudioSampleBuffer block( 2, bufferSize );
+    juce::Random random( 0x1770 );
+    for ( int ch = 0 ; ch < block.getNumChannels() ; ++ch )
+    {
+        for ( int i = 0 ; i < bufferSize ; ++i )
+            block.getWritePointer( ch )[ i ] = 0.25f * ( 2.f * random.nextFloat() - 1.f );
+    }
+
+    LufsAnalysisThread analysisThread;
+    LufsProcessor processor( LUFS_TP_MAX_NB_CHANNELS );
+    processor.prepareToPlay( sampleRate, bufferSize );
+    analysisThread.addProcessor( &processor );
+
+    // read as the UI does, while measuring; nothing but the thread updates the processor
+    const int numFirstBlocks = 20000;
+    {
+        std::atomic<bool> processing( true );
+        std::thread audioThread( [&]()
+        {
+            for ( int i = 0 ; i < numFirstBlocks ; ++i )
+                processor.processBlock( block );
+
+            processing = false;
+        } );
+
+        int previousSize = 0;
+        bool advanced = false;
+        for ( int i = 0 ; processing ; ++i )
+        {
+            {
+                const juce::ScopedLock historyLock( processor.getHistoryLock() );
+                const LufsProcessor::Snapshot snapshot = processor.getSnapshot();
+
+                if ( snapshot.m_validSize && processor.getMomentaryVolumeArray()[ snapshot.m_validSize - 1 ] > 0.f )
+                {
+                    DBG( "LufsAnalysisThread::testSnapshots invalid momentary volume" );
+                    success = false;
+                }
+
+                advanced = advanced || snapshot.m_validSize > previousSize;
+                previousSize = snapshot.m_validSize;
+            }
+
+            if ( i % 100 == 99 )
+            {
+                processor.reset();
+                previousSize = 0;
+            }
+
+            juce::Thread::sleep( 1 );
+        }
+
+        audioThread.join();
+
+        if ( !advanced )
+        {
+            DBG( "LufsAnalysisThread::testSnapshots snapshots didn't advance while measuring" );
+            success = false;
+        }
+    }
+
+    // after a reset, all records are received without calling update, and published values are those 
+    // of a processor updated synchronously with the same input
+    processor.reset();
+
+    const int numBlocks = 1000;
+    juce::AudioSampleBuffer signal( 2, numBlocks * bufferSize );
+    juce::AudioSampleBuffer signalBlock( 2, bufferSize );
+    for ( int ch = 0 ; ch < signal.getNumChannels() ; ++ch )
+    {
+        for ( int i = 0 ; i < signal.getNumSamples() ; ++i )
+        {
+            // level changing every second, for a loudness range
+            const float gain = 0.05f + 0.1f * (float)( i / (int)sampleRate % 5 );
+            signal.getWritePointer( ch )[ i ] = gain * ( 2.f * random.nextFloat() - 1.f );
+        }
+    }
+
+    std::thread( [&]()
+    {
+        for ( int i = 0 ; i < numBlocks ; ++i )
+        {
+            for ( int ch = 0 ; ch < signalBlock.getNumChannels() ; ++ch )
+                signalBlock.copyFrom( ch, 0, signal, ch, i * bufferSize, bufferSize );
+            processor.processBlock( signalBlock );
+        }
+    } ).join();
+
+    const int expectedSize = numBlocks * bufferSize / (int)( sampleRate / 10.0 );
+    for ( int i = 0 ; i < 100 && processor.getValidSize() < expectedSize ; ++i )
+        juce::Thread::sleep( updatePeriodMs );
+
+    if ( processor.getValidSize() != expectedSize )
+    {
+        DBG( juce::String( "LufsAnalysisThread::testSnapshots " ) + juce::String( processor.getValidSize() ) + " values instead of " + juce::String( expectedSize ) );
+        success = false;
+    }
+
+    // same input since prepareToPlay, as filters aren't reset with history
+    LufsProcessor reference( LUFS_TP_MAX_NB_CHANNELS );
+    reference.prepareToPlay( sampleRate, bufferSize );
+    for ( int i = 0 ; i < numFirstBlocks ; ++i )
+        reference.processBlock( block );
+    reference.reset();
+    for ( int i = 0 ; i < numBlocks ; ++i )
+    {
+        for ( int ch = 0 ; ch < signalBlock.getNumChannels() ; ++ch )
+            signalBlock.copyFrom( ch, 0, signal, ch, i * bufferSize, bufferSize );
+        reference.processBlock( signalBlock );
+    }
+    reference.update();
+
+    {
+        const juce::ScopedLock historyLock( processor.getHistoryLock() );
+        const LufsProcessor::Snapshot snapshot = processor.getSnapshot();
+        const LufsProcessor::Snapshot referenceSnapshot = reference.getSnapshot();
+        const int size = referenceSnapshot.m_validSize;
+
+        bool same = snapshot.m_validSize == size && snapshot.m_hopsPer100ms == referenceSnapshot.m_hopsPer100ms
+            && snapshot.m_integratedVolume == referenceSnapshot.m_integratedVolume && snapshot.m_maxTruePeak == referenceSnapshot.m_maxTruePeak
+            && snapshot.m_rangeMin == referenceSnapshot.m_rangeMin && snapshot.m_rangeMax == referenceSnapshot.m_rangeMax
+            && isSameHistory( processor.getMomentaryVolumeArray(), reference.getMomentaryVolumeArray(), size )
+            && isSameHistory( processor.getShortTermVolumeArray(), reference.getShortTermVolumeArray(), size )
+            && isSameHistory( processor.getIntegratedVolumeArray(), reference.getIntegratedVolumeArray(), size )
+            && isSameHistory( processor.getTruePeakArray(), reference.getTruePeakArray(), size );
+
+        for ( int ch = 0 ; ch < processor.getNumChannels() ; ++ch )
+            same = same && processor.getTruePeakChannelMax( ch ) == reference.getTruePeakChannelMax( ch );
+
+        // a loudness range, as the signal level changes
+        if ( !same || referenceSnapshot.m_rangeMax - referenceSnapshot.m_rangeMin < 1.f )
+        {
+            DBG( "LufsAnalysisThread::testSnapshots published values differ from a synchronous update" );
+            success = false;
+        }
+    }
+
+    analysisThread.removeProcessor( &processor );
+
+    return success;
+}
+
+LufsAnalysisThread::LufsAnalysisThread()
+    : juce::Thread( "LufsAnalysisThread" )
+{
+    DEBUGPLUGIN_output("LufsAnalysisThread::LufsAnalysisThread");
+
+    startThread();
+}
+
+LufsAnalysisThread::~LufsAnalysisThread()
+{
+    DEBUGPLUGIN_output("LufsAnalysisThread::~LufsAnalysisThread");
+
+    jassert( m_processors.size() == 0 );
+
+    stopThread( 1000 );
+}
+
+void LufsAnalysisThread::addProcessor( LufsProcessor * processor )
+{
+    const juce::ScopedLock scopedLock( m_processorsLock );
+
+    m_processors.addIfNotAlreadyThere( processor );
+}
+
+void LufsAnalysisThread::removeProcessor( LufsProcessor * processor )
+{
+    const juce::ScopedLock scopedLock( m_processorsLock );
+
+    m_processors.removeFirstMatchingValue( processor );
+}
+
+void LufsAnalysisThread::run()
+{
+    while ( !threadShouldExit() )
+    {
+        {
+            const juce::ScopedLock scopedLock( m_processorsLock );
+
+            for ( int i = 0 ; i < m_processors.size() ; ++i )
+                m_processors.getUnchecked( i )->update();
+        }
+
+        wait( updatePeriodMs );
+    }
+}
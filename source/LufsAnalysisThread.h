@@ -0,0 +1,62 @@
+/*
+  =================================================================
+
+  This file is part of the LUFS-TruePeak program.
+  Copyright (c) 2015 - Mathieu Pavageau - contact@repetito.com
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  Details of these licenses can be found at: www.gnu.org/licenses
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  =================================================================
+*/
+
+#pragma once 
+
+class LufsProcessor;
+
+// Background thread calling LufsProcessor::update for all registered processors, so that 
+// measurement goes on when no editor is open, whatever the UI frame rate. 
+// Meant to be used through a juce::SharedResourcePointer: one thread is shared by all 
+// plugin instances of a host process
+class LufsAnalysisThread : public juce::Thread
+{
+public:
+
+    // processes blocks on an audio thread while this thread updates the processor, and 
+    // the calling thread reads snapshots and history and resets; checks that snapshots advance, 
+    // and that published values are those of a processor updated synchronously with the same 
+    // input. Meant to be run with ThreadSanitizer too
+    static bool testSnapshots();
+
+    LufsAnalysisThread();
+    ~LufsAnalysisThread();
+
+    void addProcessor( LufsProcessor * processor );
+
+    // when this returns, processor isn't being updated anymore
+    void removeProcessor( LufsProcessor * processor );
+
+    // juce::Thread
+    void run() override;
+
+    enum
+    {
+        updatePeriodMs = 20 // records are 100 ms long
+    };
+
+private:
+
+    juce::CriticalSection m_processorsLock;
+    juce::Array<LufsProcessor *> m_processors;
+
+    JUCE_DECLARE_NON_COPYABLE( LufsAnalysisThread )
+};
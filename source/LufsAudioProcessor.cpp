@@ -40,7 +40,7 @@ juce::String LufsAudioProcessor::makeAppNameWithVersion()
 
 //==============================================================================
 LufsAudioProcessor::LufsAudioProcessor()
-    : m_lufsProcessor( 6 )
+    : m_lufsProcessor( LUFS_TP_DEFAULT_NB_CHANNELS )
 {
     DEBUGPLUGIN_output("LufsAudioProcessor::LufsAudioProcessor");
 
@@ -53,11 +53,26 @@ LufsAudioProcessor::LufsAudioProcessor()
     storageParameters.doNotSave = false;
     m_settings.setStorageParameters( storageParameters );
 
+    m_hopMilliseconds = new JuceDoubleValue( m_settings.getUserSettings(), "HopMilliseconds", 100.0 );
+    m_hopMilliseconds->addListener( this );
+
+    m_analysisThread->addProcessor( &m_lufsProcessor );
+
+    if ( m_settings.getUserSettings()->getBoolValue( "WriteSessionLog", false ) )
+        setSessionLogEnabled( true );
 }
 
 LufsAudioProcessor::~LufsAudioProcessor()
 {
     DEBUGPLUGIN_output("LufsAudioProcessor::~LufsAudioProcessor");
+
+    m_analysisThread->removeProcessor( &m_lufsProcessor );
+
+    // last values are written when the log is deleted
+    m_lufsProcessor.setSessionLog( nullptr );
+    m_sessionLog = nullptr;
+
+    m_hopMilliseconds->removeListener( this );
 }
 
 //==============================================================================
@@ -93,7 +108,21 @@ const juce::String LufsAudioProcessor::getParameterText (int /*index*/)
 //==============================================================================
 void LufsAudioProcessor::prepareToPlay (double sampleRate, int samplesPerBlock )
 {
-    DEBUGPLUGIN_output("LufsAudioProcessor::prepareToPlay");
+    DEBUGPLUGIN_output("LufsAudioProcessor::prepareToPlay %d input channels", getNumInputChannels());
+
+    // channels of the input bus, weighted as the usual layout of their count
+    const int numChannels = juce::jlimit( 1, LUFS_TP_MAX_NB_CHANNELS, getNumInputChannels() );
+    if ( numChannels != m_lufsProcessor.getNumChannels() )
+    {
+        // a session log has the channels of its processor: current log ends, next one has the new channels
+        const bool sessionLogEnabled = isSessionLogEnabled();
+        setSessionLogEnabled( false );
+
+        m_lufsProcessor.setChannelLayout( LufsChannelLayout::getDefault( numChannels ) );
+
+        setSessionLogEnabled( sessionLogEnabled );
+    }
+
     m_lufsProcessor.prepareToPlay( sampleRate, samplesPerBlock );
 }
 
@@ -131,19 +160,51 @@ void LufsAudioProcessor::setStateInformation (const void* /*data*/, int /*sizeIn
     DEBUGPLUGIN_output("LufsAudioProcessor::setStateInformation");
 }
 
-const juce::String LufsAudioProcessor::getInputChannelName (const int channelIndex) const
+void LufsAudioProcessor::juceValueHasChanged( double value )
 {
-    DEBUGPLUGIN_output("LufsAudioProcessor::getInputChannelName");
-    switch( channelIndex )
+    // changing the hop restarts the measurement, ignore values that aren't supported
+    const int hopMilliseconds = juce::roundToInt( value );
+    if ( hopMilliseconds != 10 && hopMilliseconds != 25 && hopMilliseconds != 100 )
+        return;
+
+    if ( hopMilliseconds != m_lufsProcessor.getHopMilliseconds() )
+        m_lufsProcessor.setHopMilliseconds( hopMilliseconds );
+}
+
+void LufsAudioProcessor::setSessionLogEnabled( const bool enabled )
+{
+    m_settings.getUserSettings()->setValue( "WriteSessionLog", enabled );
+
+    if ( enabled == isSessionLogEnabled() )
+        return;
+
+    if ( enabled )
+    {
+        // values measured so far are written too
+        m_sessionLog = new LufsSessionLog( m_lufsProcessor, getSessionLogDirectory() );
+        m_lufsProcessor.setSessionLog( m_sessionLog );
+    }
+    else
     {
-        // VST kSpeakerArr51 is L R C Lfe Ls Rs  
-    case 0: return "Left";
-    case 1: return "Right";
-    case 2: return "Center";
-    case 3: return "Low frequency effects";
-    case 4: return "Left surround (rear left)";
-    case 5: return "Right surround (rear right)";
+        m_lufsProcessor.setSessionLog( nullptr );
+        m_sessionLog = nullptr;
     }
+}
+
+juce::File LufsAudioProcessor::getSessionLogDirectory()
+{
+    return juce::File::getSpecialLocation( juce::File::userDocumentsDirectory ).getChildFile( "LUFS-TruePeak Sessions" );
+}
+
+const juce::String LufsAudioProcessor::getInputChannelName (const int channelIndex) const
+{
+    DEBUGPLUGIN_output("LufsAudioProcessor::getInputChannelName");
+
+    // channels of the layout, in VST speaker arrangement order (kSpeakerArr51 is L R C Lfe Ls Rs)
+    const LufsChannelLayout & layout = m_lufsProcessor.getChannelLayout();
+    if ( channelIndex >= 0 && channelIndex < layout.getNumChannels() )
+        return layout.getChannelName( channelIndex );
+
     return juce::String (channelIndex + 1);
 }
 
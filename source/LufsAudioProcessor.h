@@ -22,11 +22,16 @@
 #pragma once 
 
 #include "LufsProcessor.h"
+#include "LufsAnalysisThread.h"
+#include "LufsSessionLog.h"
+#include "JuceDoubleValue.h"
 
 //==============================================================================
 /**
 */
-class LufsAudioProcessor  : public juce::AudioProcessor
+class LufsAudioProcessor  
+    : public juce::AudioProcessor
+    , public JuceDoubleValue::Listener
 {
 public:
 
@@ -77,8 +82,19 @@ public:
     void getStateInformation (juce::MemoryBlock& destData);
     void setStateInformation (const void* data, int sizeInBytes);
 
+    // JuceDoubleValue::Listener 
+    void juceValueHasChanged(double value) override;
+
+    // session logs of measurements are written to getSessionLogDirectory(), setting is saved
+    void setSessionLogEnabled( const bool enabled );
+    inline bool isSessionLogEnabled() const { return m_sessionLog != nullptr; }
+    static juce::File getSessionLogDirectory();
+
     LufsProcessor m_lufsProcessor;
+    juce::SharedResourcePointer<LufsAnalysisThread> m_analysisThread; // updates m_lufsProcessor
     juce::ApplicationProperties m_settings;
+    juce::ScopedPointer<JuceDoubleValue> m_hopMilliseconds; // 10, 25 or 100, created once m_settings is set up
+    juce::ScopedPointer<LufsSessionLog> m_sessionLog; // copied by m_analysisThread after updates and written by its own thread, when enabled
 
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (LufsAudioProcessor)
 };
@@ -0,0 +1,453 @@
+/*
+  =================================================================
+
+  This file is part of the LUFS-TruePeak program.
+  Copyright (c) 2015 - Mathieu Pavageau - contact@repetito.com
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  Details of these licenses can be found at: www.gnu.org/licenses
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  =================================================================
+*/
+
+#include "AppIncsAndDefs.h"
+
+#if defined ( LUFS_TRUEPEAK_CLI )
+
+#include <cstdio>
+
+#include "AudioProcessing.h"
+#include "LufsProcessor.h"
+#include "LufsTextExporter.h"
+
+/**
+    Benchmark of each processing stage, on synthetic signals, without UI or audio device.
+
+    Usage: LUFSTruePeak_Benchmark [--json] [--channels 2,6] [--sample-rate 44100,48000] [--block-size 64,512] 
+                                  [--hop 10|25|100] [--seconds 10] [--repeat 3]
+
+    Every combination of channel counts, sample rates and block sizes is run. Each stage processes seconds of 
+    signal repeat times, the fastest run is kept. Samples are channel samples (frames * channels): history 
+    stages (gating, export) are measured against the audio they stand for, so that all stages compare.
+    Output is CSV, or JSON with --json, one row per stage and combination.
+*/
+
+struct BenchmarkParameters
+{
+    int m_numChannels;
+    double m_sampleRate;
+    int m_blockSize;
+    int m_hopMilliseconds;
+    int m_seconds;
+    int m_repeat;
+};
+
+struct BenchmarkResult
+{
+    const char * m_stage;
+    BenchmarkParameters m_parameters;
+    juce::int64 m_numSamples; // channel samples processed by each run
+    double m_seconds; // fastest run
+};
+
+// keeps results alive, so that measured loops aren't optimized away
+static volatile double g_sink = 0.0;
+
+static void printUsage()
+{
+    printf( "%s benchmark\n", JucePlugin_Name " V" JucePlugin_VersionString );
+    printf( "Usage: LUFSTruePeak_Benchmark [--json] [--channels 2,6] [--sample-rate 44100,48000] [--block-size 64,512] [--hop 10|25|100] [--seconds 10] [--repeat 3]\n" );
+    printf( "Measures biquad, kweighting, truepeak, energy, gating, export and processblock stages.\n" );
+}
+
+// comma separated positive integers, empty array if one is invalid
+static juce::Array<int> parseList( const char * text )
+{
+    juce::StringArray tokens;
+    tokens.addTokens( juce::String( text ), ",", "" );
+
+    juce::Array<int> values;
+    for ( int i = 0 ; i < tokens.size() ; ++i )
+    {
+        const int value = tokens[ i ].trim().getIntValue();
+        if ( value < 1 )
+            return juce::Array<int>();
+        values.add( value );
+    }
+
+    return values;
+}
+
+static void fillNoise( juce::AudioSampleBuffer & signal )
+{
+    juce::Random random( 0x1770 );
+    for ( int ch = 0 ; ch < signal.getNumChannels() ; ++ch )
+    {
+        float * data = signal.getWritePointer( ch );
+        for ( int i = 0 ; i < signal.getNumSamples() ; ++i )
+            data[ i ] = 0.5f * ( 2.f * random.nextFloat() - 1.f );
+    }
+}
+
+static double getSeconds( const juce::int64 startTicks )
+{
+    return juce::Time::highResolutionTicksToSeconds( juce::Time::getHighResolutionTicks() - startTicks );
+}
+
+// shelf then high pass BiquadProcessor passes per channel, as K-weighting was done before the filter bank
+static double runBiquad( const BenchmarkParameters & parameters, juce::AudioSampleBuffer & signal )
+{
+    juce::OwnedArray<BiquadProcessor> filters;
+    for ( int ch = 0 ; ch < parameters.m_numChannels ; ++ch )
+    {
+        filters.add( new BiquadProcessor() )->setFilterParams( (float)parameters.m_sampleRate, BiquadProcessor::HighShelf, 1500.f, 0.5f, 4.f );
+        filters.add( new BiquadProcessor() )->setFilterParams( (float)parameters.m_sampleRate, BiquadProcessor::HighPass, 60.f, 0.5f, 0.f );
+    }
+
+    const juce::int64 ticks = juce::Time::getHighResolutionTicks();
+
+    for ( int offset = 0 ; offset < signal.getNumSamples() ; offset += parameters.m_blockSize )
+    {
+        const int size = juce::jmin( parameters.m_blockSize, signal.getNumSamples() - offset );
+        for ( int ch = 0 ; ch < parameters.m_numChannels ; ++ch )
+        {
+            filters[ 2 * ch ]->process( signal.getWritePointer( ch, offset ), size );
+            filters[ 2 * ch + 1 ]->process( signal.getWritePointer( ch, offset ), size );
+        }
+    }
+
+    const double seconds = getSeconds( ticks );
+    g_sink = g_sink + signal.getSample( 0, signal.getNumSamples() - 1 );
+    return seconds;
+}
+
+static double runKWeighting( const BenchmarkParameters & parameters, juce::AudioSampleBuffer & signal )
+{
+    BiquadProcessor shelf;
+    shelf.setFilterParams( (float)parameters.m_sampleRate, BiquadProcessor::HighShelf, 1500.f, 0.5f, 4.f );
+    BiquadProcessor highPass;
+    highPass.setFilterParams( (float)parameters.m_sampleRate, BiquadProcessor::HighPass, 60.f, 0.5f, 0.f );
+
+    AudioProcessing::KWeightingFilterBank filterBank( parameters.m_numChannels );
+    filterBank.setCoefficients( shelf.getCoefficients(), highPass.getCoefficients() );
+
+    const juce::int64 ticks = juce::Time::getHighResolutionTicks();
+
+    for ( int offset = 0 ; offset < signal.getNumSamples() ; offset += parameters.m_blockSize )
+    {
+        const int size = juce::jmin( parameters.m_blockSize, signal.getNumSamples() - offset );
+        juce::AudioSampleBuffer block( signal.getArrayOfWritePointers(), parameters.m_numChannels, offset, size );
+        filterBank.process( block, block, parameters.m_numChannels );
+    }
+
+    const double seconds = getSeconds( ticks );
+    g_sink = g_sink + signal.getSample( 0, signal.getNumSamples() - 1 );
+    return seconds;
+}
+
+static double runTruePeak( const BenchmarkParameters & parameters, juce::AudioSampleBuffer & signal )
+{
+    AudioProcessing::TruePeak truePeak;
+    truePeak.prepare( parameters.m_numChannels );
+    float maxValue = 0.f;
+
+    const juce::int64 ticks = juce::Time::getHighResolutionTicks();
+
+    for ( int offset = 0 ; offset < signal.getNumSamples() ; offset += parameters.m_blockSize )
+    {
+        const int size = juce::jmin( parameters.m_blockSize, signal.getNumSamples() - offset );
+        const juce::AudioSampleBuffer block( signal.getArrayOfWritePointers(), parameters.m_numChannels, offset, size );
+        maxValue = juce::jmax( maxValue, truePeak.process( block ).getMax() );
+    }
+
+    const double seconds = getSeconds( ticks );
+    g_sink = g_sink + maxValue;
+    return seconds;
+}
+
+// weighted squared sums of the hops
+static double runEnergy( const BenchmarkParameters & parameters, juce::AudioSampleBuffer & signal )
+{
+    double squaredSum = 0.0;
+    const LufsChannelLayout layout = LufsChannelLayout::getDefault( parameters.m_numChannels );
+
+    const juce::int64 ticks = juce::Time::getHighResolutionTicks();
+
+    for ( int offset = 0 ; offset < signal.getNumSamples() ; offset += parameters.m_blockSize )
+    {
+        const int size = juce::jmin( parameters.m_blockSize, signal.getNumSamples() - offset );
+        LufsProcessor::addWeightedSquaredSum( signal, offset, size, parameters.m_numChannels, layout.getWeights(), squaredSum );
+    }
+
+    const double seconds = getSeconds( ticks );
+    g_sink = g_sink + squaredSum;
+    return seconds;
+}
+
+// records of signal duration, with a level changing every few seconds, and their channel true peaks
+static void fillRecords( const BenchmarkParameters & parameters, juce::Array<LufsRecord> & records, juce::Array<float> & truePeaks )
+{
+    const int numRecords = parameters.m_seconds * 1000 / parameters.m_hopMilliseconds;
+    juce::Random random( 0x1770 );
+
+    LufsRecord record;
+    memset( &record, 0, sizeof( record ) );
+    record.m_numChannels = parameters.m_numChannels;
+
+    records.ensureStorageAllocated( numRecords );
+    truePeaks.ensureStorageAllocated( numRecords * record.m_numChannels );
+    for ( int i = 0 ; i < numRecords ; ++i )
+    {
+        if ( i % ( 3000 / parameters.m_hopMilliseconds ) == 0 )
+            record.m_squaredInput = juce::Decibels::decibelsToGain( -60.f + 60.f * random.nextFloat(), -100.f );
+
+        for ( int ch = 0 ; ch < record.m_numChannels ; ++ch )
+            truePeaks.add( std::sqrt( record.m_squaredInput ) * ( 1.f + random.nextFloat() ) );
+
+        records.add( record );
+    }
+}
+
+// history, windows and gating (update), records of a block added at once as when analyzing files
+static double runGating( const BenchmarkParameters & parameters, LufsProcessor & processor, const juce::Array<LufsRecord> & records, const juce::Array<float> & truePeaks )
+{
+    processor.setHopMilliseconds( parameters.m_hopMilliseconds );
+
+    const int hopSize = (int)( parameters.m_sampleRate / 10.0 ) * parameters.m_hopMilliseconds / 100;
+    const int recordsPerUpdate = juce::jmax( 1, parameters.m_blockSize / hopSize );
+
+    const juce::int64 ticks = juce::Time::getHighResolutionTicks();
+
+    for ( int i = 0 ; i < records.size() ; i += recordsPerUpdate )
+        processor.update( records.begin() + i, truePeaks.begin() + i * processor.getNumChannels(), juce::jmin( recordsPerUpdate, records.size() - i ) );
+
+    const double seconds = getSeconds( ticks );
+    g_sink = g_sink + processor.getIntegratedVolume();
+    return seconds;
+}
+
+// text export of history computed by runGating
+static double runExport( const LufsProcessor & processor )
+{
+    juce::MemoryOutputStream outputStream;
+
+    const juce::int64 ticks = juce::Time::getHighResolutionTicks();
+
+    LufsTextExporter::write( processor, outputStream, false, true );
+
+    const double seconds = getSeconds( ticks );
+    g_sink = g_sink + (double)outputStream.getDataSize();
+    return seconds;
+}
+
+// whole LufsProcessor pipeline, as when analyzing a file
+static double runProcessBlock( const BenchmarkParameters & parameters, juce::AudioSampleBuffer & signal )
+{
+    LufsProcessor processor( parameters.m_numChannels );
+    processor.prepareToPlay( parameters.m_sampleRate, parameters.m_blockSize );
+    processor.setHopMilliseconds( parameters.m_hopMilliseconds );
+
+    const juce::int64 ticks = juce::Time::getHighResolutionTicks();
+
+    for ( int offset = 0 ; offset < signal.getNumSamples() ; offset += parameters.m_blockSize )
+    {
+        const int size = juce::jmin( parameters.m_blockSize, signal.getNumSamples() - offset );
+        juce::AudioSampleBuffer block( signal.getArrayOfWritePointers(), parameters.m_numChannels, offset, size );
+        processor.processBlock( block );
+        processor.update();
+    }
+
+    const double seconds = getSeconds( ticks );
+    g_sink = g_sink + processor.getIntegratedVolume();
+    return seconds;
+}
+
+static void runBenchmarks( const BenchmarkParameters & parameters, juce::Array<BenchmarkResult> & results )
+{
+    const int numSamples = (int)parameters.m_sampleRate * parameters.m_seconds;
+
+    juce::AudioSampleBuffer noise( parameters.m_numChannels, numSamples );
+    fillNoise( noise );
+    juce::AudioSampleBuffer signal( parameters.m_numChannels, numSamples );
+
+    juce::Array<LufsRecord> records;
+    juce::Array<float> truePeaks;
+    fillRecords( parameters, records, truePeaks );
+    LufsProcessor processor( parameters.m_numChannels );
+    processor.prepareToPlay( parameters.m_sampleRate, parameters.m_blockSize );
+
+    enum { biquad = 0, kWeighting, truePeak, energy, gating, exportText, processBlock, numStages };
+    static const char * const stageNames[ numStages ] = { "biquad", "kweighting", "truepeak", "energy", "gating", "export", "processblock" };
+
+    for ( int stage = 0 ; stage < numStages ; ++stage )
+    {
+        double bestSeconds = 0.0;
+
+        for ( int run = 0 ; run < parameters.m_repeat ; ++run )
+        {
+            // in place stages get the same signal for every run
+            for ( int ch = 0 ; ch < parameters.m_numChannels ; ++ch )
+                signal.copyFrom( ch, 0, noise, ch, 0, numSamples );
+
+            double seconds = 0.0;
+            switch ( stage )
+            {
+            case biquad:        seconds = runBiquad( parameters, signal ); break;
+            case kWeighting:    seconds = runKWeighting( parameters, signal ); break;
+            case truePeak:      seconds = runTruePeak( parameters, signal ); break;
+            case energy:        seconds = runEnergy( parameters, signal ); break;
+            case gating:        seconds = runGating( parameters, processor, records, truePeaks ); break;
+            case exportText:    seconds = runExport( processor ); break;
+            case processBlock:  seconds = runProcessBlock( parameters, signal ); break;
+            }
+
+            if ( run == 0 || seconds < bestSeconds )
+                bestSeconds = seconds;
+        }
+
+        BenchmarkResult result;
+        result.m_stage = stageNames[ stage ];
+        result.m_parameters = parameters;
+        result.m_numSamples = (juce::int64)numSamples * parameters.m_numChannels;
+        result.m_seconds = juce::jmax( bestSeconds, 1e-9 );
+        results.add( result );
+    }
+}
+
+static juce::String getCsv( const juce::Array<BenchmarkResult> & results )
+{
+    juce::String text( "version,stage,channels,sampleRate,blockSize,hopMs,samples,seconds,samplesPerSecond,nsPerSample,realtime\n" );
+
+    for ( int i = 0 ; i < results.size() ; ++i )
+    {
+        const BenchmarkResult & result = results.getReference( i );
+        const BenchmarkParameters & parameters = result.m_parameters;
+
+        text << JucePlugin_VersionString << "," << result.m_stage << "," << parameters.m_numChannels << "," << (int)parameters.m_sampleRate << "," 
+             << parameters.m_blockSize << "," << parameters.m_hopMilliseconds << "," << result.m_numSamples << "," 
+             << juce::String( result.m_seconds, 6 ) << "," 
+             << juce::String( (juce::int64)( (double)result.m_numSamples / result.m_seconds ) ) << "," 
+             << juce::String( 1e9 * result.m_seconds / (double)result.m_numSamples, 3 ) << "," 
+             << juce::String( (double)parameters.m_seconds / result.m_seconds, 1 ) << "\n";
+    }
+
+    return text;
+}
+
+static juce::String getJson( const juce::Array<BenchmarkResult> & results )
+{
+    // array of results, written as [] when there are none
+    juce::var rows;
+    rows.resize( 0 );
+
+    for ( int i = 0 ; i < results.size() ; ++i )
+    {
+        const BenchmarkResult & result = results.getReference( i );
+        const BenchmarkParameters & parameters = result.m_parameters;
+
+        juce::DynamicObject * object = new juce::DynamicObject();
+        object->setProperty( "version", JucePlugin_VersionString );
+        object->setProperty( "stage", result.m_stage );
+        object->setProperty( "channels", parameters.m_numChannels );
+        object->setProperty( "sampleRate", parameters.m_sampleRate );
+        object->setProperty( "blockSize", parameters.m_blockSize );
+        object->setProperty( "hopMs", parameters.m_hopMilliseconds );
+        object->setProperty( "samples", result.m_numSamples );
+        object->setProperty( "seconds", result.m_seconds );
+        object->setProperty( "samplesPerSecond", (double)result.m_numSamples / result.m_seconds );
+        object->setProperty( "nsPerSample", 1e9 * result.m_seconds / (double)result.m_numSamples );
+        object->setProperty( "realtime", (double)parameters.m_seconds / result.m_seconds );
+        rows.append( juce::var( object ) );
+    }
+
+    return juce::JSON::toString( rows );
+}
+
+int main( int argc, char * argv[] )
+{
+    bool json = false;
+    juce::Array<int> channelCounts( parseList( "2,6" ) );
+    juce::Array<int> sampleRates( parseList( "48000" ) );
+    juce::Array<int> blockSizes( parseList( "64,512,4096" ) );
+
+    BenchmarkParameters parameters;
+    parameters.m_numChannels = 0;
+    parameters.m_sampleRate = 0.0;
+    parameters.m_blockSize = 0;
+    parameters.m_hopMilliseconds = 100;
+    parameters.m_seconds = 10;
+    parameters.m_repeat = 3;
+
+    for ( int i = 1 ; i < argc ; ++i )
+    {
+        const juce::String argument( juce::CharPointer_UTF8( argv[ i ] ) );
+        const bool hasValue = i + 1 < argc;
+
+        if ( argument == "--json" )
+            json = true;
+        else if ( argument == "--channels" && hasValue )
+            channelCounts = parseList( argv[ ++i ] );
+        else if ( argument == "--sample-rate" && hasValue )
+            sampleRates = parseList( argv[ ++i ] );
+        else if ( argument == "--block-size" && hasValue )
+            blockSizes = parseList( argv[ ++i ] );
+        else if ( argument == "--hop" && hasValue )
+            parameters.m_hopMilliseconds = juce::String( argv[ ++i ] ).getIntValue();
+        else if ( argument == "--seconds" && hasValue )
+            parameters.m_seconds = juce::String( argv[ ++i ] ).getIntValue();
+        else if ( argument == "--repeat" && hasValue )
+            parameters.m_repeat = juce::String( argv[ ++i ] ).getIntValue();
+        else
+        {
+            printUsage();
+            return 2;
+        }
+    }
+
+    bool validChannels = channelCounts.size() > 0;
+    for ( int i = 0 ; i < channelCounts.size() ; ++i )
+        validChannels = validChannels && channelCounts[ i ] >= 1;
+
+    bool validSampleRates = sampleRates.size() > 0;
+    for ( int i = 0 ; i < sampleRates.size() ; ++i )
+        validSampleRates = validSampleRates && sampleRates[ i ] >= 8000;
+
+    if ( !validChannels || !validSampleRates || blockSizes.size() == 0 || parameters.m_seconds < 1 || parameters.m_repeat < 1 
+        || ( parameters.m_hopMilliseconds != 10 && parameters.m_hopMilliseconds != 25 && parameters.m_hopMilliseconds != 100 ) )
+    {
+        printUsage();
+        return 2;
+    }
+
+    juce::Array<BenchmarkResult> results;
+
+    for ( int c = 0 ; c < channelCounts.size() ; ++c )
+    {
+        for ( int r = 0 ; r < sampleRates.size() ; ++r )
+        {
+            for ( int b = 0 ; b < blockSizes.size() ; ++b )
+            {
+                parameters.m_numChannels = channelCounts[ c ];
+                parameters.m_sampleRate = (double)sampleRates[ r ];
+                parameters.m_blockSize = blockSizes[ b ];
+
+                runBenchmarks( parameters, results );
+            }
+        }
+    }
+
+    printf( "%s\n", ( json ? getJson( results ) : getCsv( results ) ).trimEnd().toRawUTF8() );
+
+    return 0;
+}
+
+#endif // defined ( LUFS_TRUEPEAK_CLI )
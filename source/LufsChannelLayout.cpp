@@ -0,0 +1,139 @@
+/*
+  =================================================================
+
+  This file is part of the LUFS-TruePeak program.
+  Copyright (c) 2015 - Mathieu Pavageau - contact@repetito.com
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  Details of these licenses can be found at: www.gnu.org/licenses
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  =================================================================
+*/
+
+#include "AppIncsAndDefs.h"
+
+#include "LufsChannelLayout.h"
+
+namespace
+{
+    const float surround = 1.414213f; // 1.41 (~ +1.5 dB)
+
+    struct ChannelDescription
+    {
+        const char * m_name;
+        float m_weight;
+    };
+
+    struct LayoutDescription
+    {
+        const char * m_name;
+        const ChannelDescription * m_channels;
+        int m_numChannels;
+    };
+
+    // channel order of VST speaker arrangements and SMPTE 2036-2: L R C Lfe, then surrounds 
+    // (Ls Rs around 110 degrees, side surrounds Lss Rss at 90, rear surrounds Lrs Rrs around 
+    // 135 to 150, wides Lw Rw at 60), then top front, top middle and top rear channels
+    const ChannelDescription monoChannels[] = { { "C", 1.f } };
+    const ChannelDescription stereoChannels[] = { { "L", 1.f }, { "R", 1.f } };
+    const ChannelDescription lrcChannels[] = { { "L", 1.f }, { "R", 1.f }, { "C", 1.f } };
+    const ChannelDescription quadChannels[] = { { "L", 1.f }, { "R", 1.f }, { "Ls", surround }, { "Rs", surround } };
+    const ChannelDescription surround50Channels[] = { { "L", 1.f }, { "R", 1.f }, { "C", 1.f }, { "Ls", surround }, { "Rs", surround } };
+    const ChannelDescription surround51Channels[] = { { "L", 1.f }, { "R", 1.f }, { "C", 1.f }, { "Lfe", 0.f }, { "Ls", surround }, { "Rs", surround } };
+    const ChannelDescription surround71Channels[] = { { "L", 1.f }, { "R", 1.f }, { "C", 1.f }, { "Lfe", 0.f }, 
+                                                      { "Lss", surround }, { "Rss", surround }, { "Lrs", 1.f }, { "Rrs", 1.f } };
+    const ChannelDescription surround714Channels[] = { { "L", 1.f }, { "R", 1.f }, { "C", 1.f }, { "Lfe", 0.f }, 
+                                                       { "Lss", surround }, { "Rss", surround }, { "Lrs", 1.f }, { "Rrs", 1.f }, 
+                                                       { "Ltf", 1.f }, { "Rtf", 1.f }, { "Ltr", 1.f }, { "Rtr", 1.f } };
+    const ChannelDescription surround916Channels[] = { { "L", 1.f }, { "R", 1.f }, { "C", 1.f }, { "Lfe", 0.f }, 
+                                                       { "Lss", surround }, { "Rss", surround }, { "Lrs", 1.f }, { "Rrs", 1.f }, 
+                                                       { "Lw", surround }, { "Rw", surround }, { "Ltf", 1.f }, { "Rtf", 1.f }, 
+                                                       { "Ltm", 1.f }, { "Rtm", 1.f }, { "Ltr", 1.f }, { "Rtr", 1.f } };
+
+#define LUFS_LAYOUT( name, channels ) { name, channels, (int)( sizeof( channels ) / sizeof( ChannelDescription ) ) }
+
+    const LayoutDescription layouts[] = 
+    {
+        LUFS_LAYOUT( "mono", monoChannels ),
+        LUFS_LAYOUT( "stereo", stereoChannels ),
+        LUFS_LAYOUT( "3.0", lrcChannels ),
+        LUFS_LAYOUT( "quad", quadChannels ),
+        LUFS_LAYOUT( "5.0", surround50Channels ),
+        LUFS_LAYOUT( "5.1", surround51Channels ),
+        LUFS_LAYOUT( "7.1", surround71Channels ),
+        LUFS_LAYOUT( "7.1.4", surround714Channels ),
+        LUFS_LAYOUT( "9.1.6", surround916Channels ),
+    };
+
+#undef LUFS_LAYOUT
+
+    const int numLayouts = (int)( sizeof( layouts ) / sizeof( LayoutDescription ) );
+}
+
+LufsChannelLayout::LufsChannelLayout()
+{
+}
+
+LufsChannelLayout LufsChannelLayout::getDefault( const int numChannels )
+{
+    LufsChannelLayout layout;
+
+    // layouts have different channel counts, first one with numChannels is the usual one
+    for ( int i = 0 ; i < numLayouts ; ++i )
+    {
+        if ( layouts[ i ].m_numChannels == numChannels )
+        {
+            getNamed( layouts[ i ].m_name, layout );
+            return layout;
+        }
+    }
+
+    layout.m_name = juce::String( numChannels ) + " channels";
+    for ( int ch = 0 ; ch < numChannels ; ++ch )
+    {
+        layout.m_channelNames.add( juce::String( ch + 1 ) );
+        layout.m_weights.add( 1.f );
+    }
+
+    return layout;
+}
+
+bool LufsChannelLayout::getNamed( const juce::String & name, LufsChannelLayout & layout )
+{
+    for ( int i = 0 ; i < numLayouts ; ++i )
+    {
+        if ( name.equalsIgnoreCase( layouts[ i ].m_name ) )
+        {
+            layout.m_name = layouts[ i ].m_name;
+            layout.m_channelNames.clear();
+            layout.m_weights.clear();
+
+            for ( int ch = 0 ; ch < layouts[ i ].m_numChannels ; ++ch )
+            {
+                const ChannelDescription & channel = layouts[ i ].m_channels[ ch ];
+                layout.m_channelNames.add( channel.m_name );
+                layout.m_weights.add( channel.m_weight );
+            }
+            return true;
+        }
+    }
+
+    return false;
+}
+
+juce::StringArray LufsChannelLayout::getNames()
+{
+    juce::StringArray names;
+    for ( int i = 0 ; i < numLayouts ; ++i )
+        names.add( layouts[ i ].m_name );
+    return names;
+}
@@ -0,0 +1,52 @@
+/*
+  =================================================================
+
+  This file is part of the LUFS-TruePeak program.
+  Copyright (c) 2015 - Mathieu Pavageau - contact@repetito.com
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  Details of these licenses can be found at: www.gnu.org/licenses
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  =================================================================
+*/
+
+#pragma once 
+
+// Channels of a measured signal: name and BS.1770-4 weight of each channel, in buffer order.
+// Weight is 1.41 (+1.5 dB) for channels below 30 degrees of elevation and between 60 and 120 
+// degrees of azimuth (surround and side surround channels), 0 for Lfe channels, 1 for others
+class LufsChannelLayout
+{
+public:
+
+    LufsChannelLayout();
+
+    // usual layout of numChannels channels: mono, stereo, 3.0, quad, 5.0, 5.1, 7.1, 7.1.4 or 9.1.6; 
+    // for other counts, channels named by their number, all weighted 1
+    static LufsChannelLayout getDefault( const int numChannels );
+
+    // layout of one of getNames(), returns false if name is unknown
+    static bool getNamed( const juce::String & name, LufsChannelLayout & layout );
+    static juce::StringArray getNames();
+
+    inline const juce::String & getName() const { return m_name; }
+    inline int getNumChannels() const { return m_weights.size(); }
+    inline float getWeight( const int channel ) const { return m_weights[ channel ]; }
+    inline const float * getWeights() const { return m_weights.begin(); }
+    inline const juce::String & getChannelName( const int channel ) const { return m_channelNames[ channel ]; }
+
+private:
+
+    juce::String m_name;
+    juce::StringArray m_channelNames;
+    juce::Array<float> m_weights;
+};
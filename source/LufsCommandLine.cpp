@@ -0,0 +1,301 @@
+/*
+  =================================================================
+
+  This file is part of the LUFS-TruePeak program.
+  Copyright (c) 2015 - Mathieu Pavageau - contact@repetito.com
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  Details of these licenses can be found at: www.gnu.org/licenses
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  =================================================================
+*/
+
+#include "AppIncsAndDefs.h"
+
+#if defined ( LUFS_TRUEPEAK_CLI )
+
+#include <cstdio>
+
+#include "AudioProcessing.h"
+#include "AudioStreamReader.h"
+#include "LufsAnalysisThread.h"
+#include "LufsFileAnalyzer.h"
+#include "LufsHistoryIndex.h"
+#include "LufsHistoryPyramid.h"
+#include "LufsSessionLog.h"
+
+/**
+    Headless analyzer: measures files and prints results as text or JSON.
+
+    Usage: LUFSTruePeak_Cli [--json] [--buffer-size samples] [--hop 10|25|100] [--threads count] [--layout name] files...
+           LUFSTruePeak_Cli --self-test
+
+    Files longer than a few minutes are split into segments analyzed in parallel, by as many threads as CPUs by default.
+    Channels are weighted by the usual layout of their count (see LufsChannelLayout), or by the layout given with --layout.
+
+    --self-test runs the tests of the analyzer sources, as the -test option of the application does, so that 
+    they run on Linux, and under ThreadSanitizer with the ThreadSanitizer configuration of the gmake project.
+
+    Exit code is 0 when every file was measured (or every test passed), 1 when a file couldn't be read 
+    (or a test failed), 2 for usage errors.
+*/
+
+static void printUsage()
+{
+    printf( "%s command line analyzer\n", JucePlugin_Name " V" JucePlugin_VersionString );
+    printf( "Usage: LUFSTruePeak_Cli [--json] [--buffer-size samples] [--hop 10|25|100] [--threads count] [--layout name] files...\n" );
+    printf( "       LUFSTruePeak_Cli --self-test\n" );
+    printf( "Prints integrated volume, loudness range, max momentary and short term volumes, and true peaks.\n" );
+    printf( "Layouts: %s\n", LufsChannelLayout::getNames().joinIntoString( ", " ).toRawUTF8() );
+}
+
+#if defined ( __SANITIZE_THREAD__ )
+ #define LUFS_THREAD_SANITIZER 1
+#elif defined ( __has_feature )
+ #if __has_feature( thread_sanitizer )
+  #define LUFS_THREAD_SANITIZER 1
+ #endif
+#endif
+
+#if defined ( LUFS_THREAD_SANITIZER )
+// threads of this JUCE version keep their handle and exit flag in plain members, and stopThread polls 
+// them instead of joining: races whose top frame is in these JUCE internals aren't reported, nor 
+// destruction of events a stopped thread waited on
+extern "C" const char * __tsan_default_suppressions()
+{
+    return "race:juce::WaitableEvent::~WaitableEvent\n"
+           "race_top:juce::Thread::\n"
+           "race_top:juce::WaitableEvent::\n"
+           "race_top:juce::ThreadLocalValue\n"
+           "race_top:juce::Atomic\n"
+           "race_top:juce::ThreadPool::ThreadPoolThread::~ThreadPoolThread\n";
+}
+#endif
+
+static int runSelfTests()
+{
+    struct Test
+    {
+        const char * m_name;
+        bool (*m_function)();
+    };
+
+    const Test tests[] =
+    {
+        { "AudioProcessing::TestPolyphase4Kernels", AudioProcessing::TestPolyphase4Kernels },
+        { "LufsProcessor::testGating", LufsProcessor::testGating },
+        { "LufsProcessor::testLoudnessRange", LufsProcessor::testLoudnessRange },
+        { "LufsProcessor::testWindowMeans", LufsProcessor::testWindowMeans },
+        { "LufsProcessor::testRecordFifo", LufsProcessor::testRecordFifo },
+        { "LufsProcessor::testHops", LufsProcessor::testHops },
+        { "LufsProcessor::testChannelLayouts", LufsProcessor::testChannelLayouts },
+        { "LufsProcessor::testKWeighting", LufsProcessor::testKWeighting },
+        { "LufsAnalysisThread::testSnapshots", LufsAnalysisThread::testSnapshots },
+        { "AudioStreamReader::testChunks", AudioStreamReader::testChunks },
+        { "LufsFileAnalyzer::testSegments", LufsFileAnalyzer::testSegments },
+        { "LufsFileAnalyzer::testMemoryMapped", LufsFileAnalyzer::testMemoryMapped },
+        { "LufsSessionLog::testReload", LufsSessionLog::testReload },
+        { "LufsHistoryPyramid::testRanges", LufsHistoryPyramid::testRanges },
+        { "LufsHistoryIndex::testQueries", LufsHistoryIndex::testQueries },
+    };
+
+    bool success = true;
+    for ( int i = 0 ; i < (int)( sizeof( tests ) / sizeof( tests[ 0 ] ) ) ; ++i )
+    {
+        const bool passed = tests[ i ].m_function();
+        printf( "%s %s\n", tests[ i ].m_name, passed ? "OK" : "FAILED" );
+        fflush( stdout );
+
+        success = success && passed;
+    }
+
+    return success ? 0 : 1;
+}
+
+static juce::String formatDuration( const double seconds )
+{
+    const int totalSeconds = (int)seconds;
+    const int hours = totalSeconds / 3600;
+    const int minutes = ( totalSeconds / 60 ) % 60;
+
+    return juce::String( hours ) + ":" + juce::String( minutes ).paddedLeft( '0', 2 ) + ":" + juce::String( totalSeconds % 60 ).paddedLeft( '0', 2 );
+}
+
+static juce::String getText( const juce::File & file, const LufsFileAnalyzer::Result & result )
+{
+    juce::String text( file.getFullPathName() );
+    text << "\n";
+
+    if ( !result.m_success )
+    {
+        text << "  Error: " << result.m_error << "\n";
+        return text;
+    }
+
+    text << "  Integrated:        " << juce::String( result.m_integratedVolume, 1 ) << " LUFS\n";
+    text << "  Loudness range:    " << juce::String( result.getLoudnessRange(), 1 ) << " LU\n";
+    text << "  Max momentary:     " << juce::String( result.m_maxMomentaryVolume, 1 ) << " LUFS\n";
+    text << "  Max short term:    " << juce::String( result.m_maxShortTermVolume, 1 ) << " LUFS\n";
+    text << "  True peak:         " << juce::String( result.m_truePeak, 1 ) << " dBTP (";
+
+    for ( int ch = 0 ; ch < result.m_numChannels ; ++ch )
+    {
+        if ( ch )
+            text << ", ";
+        text << result.m_channelLayout.getChannelName( ch ) << " " << juce::String( result.m_truePeakPerChannelArray[ ch ], 1 );
+    }
+    text << ")\n";
+
+    text << "  Duration:          " << formatDuration( result.getSeconds() ) << ", " << result.m_formatName << ", " 
+         << juce::String( (int)result.m_sampleRate ) << " Hz, " << juce::String( result.m_numChannels ) << " channels (" << result.m_channelLayout.getName() << ")\n";
+
+    if ( result.m_analysisSeconds > 0.0 )
+        text << "  Analysis speed:    " << juce::String( result.getSeconds() / result.m_analysisSeconds, 1 ) << " x realtime\n";
+
+    return text;
+}
+
+static juce::var getJson( const juce::File & file, const LufsFileAnalyzer::Result & result )
+{
+    juce::DynamicObject * object = new juce::DynamicObject();
+    object->setProperty( "file", file.getFullPathName() );
+    object->setProperty( "success", result.m_success );
+
+    if ( !result.m_success )
+    {
+        object->setProperty( "error", result.m_error );
+        return juce::var( object );
+    }
+
+    object->setProperty( "integrated", result.m_integratedVolume );
+    object->setProperty( "loudnessRange", result.getLoudnessRange() );
+    object->setProperty( "loudnessRangeLow", result.m_rangeMin );
+    object->setProperty( "loudnessRangeHigh", result.m_rangeMax );
+    object->setProperty( "maxMomentary", result.m_maxMomentaryVolume );
+    object->setProperty( "maxShortTerm", result.m_maxShortTermVolume );
+    object->setProperty( "truePeak", result.m_truePeak );
+
+    juce::DynamicObject * truePeaks = new juce::DynamicObject();
+    for ( int ch = 0 ; ch < result.m_numChannels ; ++ch )
+        truePeaks->setProperty( result.m_channelLayout.getChannelName( ch ), result.m_truePeakPerChannelArray[ ch ] );
+    object->setProperty( "truePeakPerChannel", juce::var( truePeaks ) );
+
+    object->setProperty( "format", result.m_formatName );
+    object->setProperty( "sampleRate", result.m_sampleRate );
+    object->setProperty( "channels", result.m_numChannels );
+    object->setProperty( "layout", result.m_channelLayout.getName() );
+    object->setProperty( "seconds", result.getSeconds() );
+    object->setProperty( "analysisSeconds", result.m_analysisSeconds );
+    object->setProperty( "memoryMapped", result.m_memoryMapped );
+
+    return juce::var( object );
+}
+
+int main( int argc, char * argv[] )
+{
+    bool json = false;
+    int bufferSize = LufsFileAnalyzer::defaultBufferSize;
+    int hopMilliseconds = 100;
+    int numThreads = juce::SystemStats::getNumCpus();
+    juce::String layoutName;
+    juce::StringArray files; // full paths: juce::Array would move juce::File objects with realloc
+
+    for ( int i = 1 ; i < argc ; ++i )
+    {
+        const juce::String argument( juce::CharPointer_UTF8( argv[ i ] ) );
+
+        if ( argument == "--self-test" && argc == 2 )
+        {
+            return runSelfTests();
+        }
+        else if ( argument == "--json" )
+        {
+            json = true;
+        }
+        else if ( argument == "--buffer-size" && i + 1 < argc )
+        {
+            bufferSize = juce::String( argv[ ++i ] ).getIntValue();
+            if ( bufferSize < 1 )
+            {
+                printUsage();
+                return 2;
+            }
+        }
+        else if ( argument == "--hop" && i + 1 < argc )
+        {
+            hopMilliseconds = juce::String( argv[ ++i ] ).getIntValue();
+            if ( hopMilliseconds != 10 && hopMilliseconds != 25 && hopMilliseconds != 100 )
+            {
+                printUsage();
+                return 2;
+            }
+        }
+        else if ( argument == "--threads" && i + 1 < argc )
+        {
+            numThreads = juce::String( argv[ ++i ] ).getIntValue();
+            if ( numThreads < 1 )
+            {
+                printUsage();
+                return 2;
+            }
+        }
+        else if ( argument == "--layout" && i + 1 < argc )
+        {
+            layoutName = juce::String( argv[ ++i ] );
+            LufsChannelLayout layout;
+            if ( !LufsChannelLayout::getNamed( layoutName, layout ) )
+            {
+                printUsage();
+                return 2;
+            }
+        }
+        else if ( argument == "--help" || argument == "-h" || argument.startsWith( "--" ) )
+        {
+            printUsage();
+            return 2;
+        }
+        else
+        {
+            files.add( juce::File::getCurrentWorkingDirectory().getChildFile( argument ).getFullPathName() );
+        }
+    }
+
+    if ( files.size() == 0 )
+    {
+        printUsage();
+        return 2;
+    }
+
+    bool success = true;
+    juce::var jsonResults; // array of results
+
+    for ( int i = 0 ; i < files.size() ; ++i )
+    {
+        const juce::File file( files[ i ] );
+        const LufsFileAnalyzer::Result result = LufsFileAnalyzer::analyzeFile( file, bufferSize, hopMilliseconds, numThreads, layoutName );
+        success = success && result.m_success;
+
+        if ( json )
+            jsonResults.append( getJson( file, result ) );
+        else
+            printf( "%s", getText( file, result ).toRawUTF8() );
+
+        fflush( stdout );
+    }
+
+    if ( json )
+        printf( "%s\n", juce::JSON::toString( jsonResults ).toRawUTF8() );
+
+    return success ? 0 : 1;
+}
+
+#endif // defined ( LUFS_TRUEPEAK_CLI )
@@ -0,0 +1,435 @@
+/*
+  =================================================================
+
+  This file is part of the LUFS-TruePeak program.
+  Copyright (c) 2015 - Mathieu Pavageau - contact@repetito.com
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  Details of these licenses can be found at: www.gnu.org/licenses
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  =================================================================
+*/
+
+#include "AppIncsAndDefs.h"
+
+#include "LufsFileAnalyzer.h"
+#include "AudioStreamReader.h"
+#include "LufsProcessor.h"
+
+LufsFileAnalyzer::Result::Result()
+    : m_success( false )
+    , m_sampleRate( 0.0 )
+    , m_numChannels( 0 )
+    , m_lengthInSamples( 0 )
+    , m_memoryMapped( false )
+    , m_integratedVolume( DEFAULT_MIN_VOLUME )
+    , m_rangeMin( 0.f )
+    , m_rangeMax( 0.f )
+    , m_maxMomentaryVolume( DEFAULT_MIN_VOLUME )
+    , m_maxShortTermVolume( DEFAULT_MIN_VOLUME )
+    , m_truePeak( DEFAULT_MIN_VOLUME )
+    , m_analysisSeconds( 0.0 )
+{
+}
+
+// Measures hops of one segment of a file, warm-up hops excluded, with its own reader and processor
+class LufsSegmentJob : public juce::ThreadPoolJob
+{
+public:
+
+    LufsSegmentJob( juce::AudioFormatReader * reader, const LufsChannelLayout & layout, const juce::int64 warmUpStart, const juce::int64 start, 
+                    const juce::int64 end, const int bufferSize, const int hopMilliseconds )
+        : juce::ThreadPoolJob( "LufsSegmentJob" )
+        , m_reader( reader )
+        , m_channelLayout( layout )
+        , m_warmUpStart( warmUpStart )
+        , m_start( start )
+        , m_end( end )
+        , m_bufferSize( bufferSize )
+        , m_hopMilliseconds( hopMilliseconds )
+        , m_numWarmUpRecords( 0 )
+    {
+    }
+
+    JobStatus runJob() override
+    {
+        LufsProcessor processor( m_channelLayout );
+        processor.prepareToPlay( m_reader->sampleRate, m_bufferSize );
+        processor.setHopMilliseconds( m_hopMilliseconds );
+
+        // segment and warm-up start at 100 ms block boundaries: hops are those of a single processor
+        const int sampleSize100ms = (int)( m_reader->sampleRate / 10.0 );
+        m_numWarmUpRecords = (int)( ( m_start - m_warmUpStart ) / sampleSize100ms ) * ( 100 / m_hopMilliseconds );
+
+        // every pool thread is busy processing, segments are read on their own thread
+        juce::AudioSubsectionReader segmentReader( m_reader, m_warmUpStart, m_end - m_warmUpStart, false );
+        AudioStreamReader streamReader( segmentReader, m_bufferSize, false );
+
+        while ( juce::AudioSampleBuffer * block = streamReader.readNextChunk() )
+        {
+            processor.processBlock( *block );
+            processor.takeRecords( m_records, m_truePeaks );
+
+            if ( shouldExit() )
+                break;
+        }
+
+        return jobHasFinished;
+    }
+
+    inline const LufsRecord * getRecords() const { return m_records.begin() + getFirstRecord(); }
+    inline const float * getTruePeaks() const { return m_truePeaks.begin() + getFirstRecord() * m_channelLayout.getNumChannels(); }
+    inline int getNumRecords() const { return juce::jmax( 0, m_records.size() - m_numWarmUpRecords ); }
+
+private:
+
+    inline int getFirstRecord() const { return juce::jmin( m_numWarmUpRecords, m_records.size() ); }
+
+    juce::ScopedPointer<juce::AudioFormatReader> m_reader;
+    const LufsChannelLayout m_channelLayout;
+    const juce::int64 m_warmUpStart;
+    const juce::int64 m_start;
+    const juce::int64 m_end;
+    const int m_bufferSize;
+    const int m_hopMilliseconds;
+    int m_numWarmUpRecords;
+    juce::Array<LufsRecord> m_records;
+    juce::Array<float> m_truePeaks; // true peaks of the channels of each record
+
+    JUCE_DECLARE_NON_COPYABLE( LufsSegmentJob )
+};
+
+bool LufsFileAnalyzer::writeNoiseFile( const juce::File & file, juce::AudioFormat & format, const double sampleRate, const int numChannels, 
+                                       const int bitsPerSample, const int seconds, const float minDecibels, const float maxDecibels, const int seed )
+{
+    juce::StringPairArray emptyArray;
+    juce::ScopedPointer<juce::AudioFormatWriter> writer( format.createWriterFor( 
+        new juce::FileOutputStream( file ), sampleRate, numChannels, bitsPerSample, emptyArray, 0 ) );
+
+    if ( writer == nullptr )
+        return false;
+
+    juce::AudioSampleBuffer signal( numChannels, (int)sampleRate );
+    juce::Random random( seed );
+    for ( int second = 0 ; second < seconds ; ++second )
+    {
+        const float gain = juce::Decibels::decibelsToGain( minDecibels + ( maxDecibels - minDecibels ) * random.nextFloat() );
+        for ( int ch = 0 ; ch < numChannels ; ++ch )
+        {
+            for ( int i = 0 ; i < signal.getNumSamples() ; ++i )
+                signal.getWritePointer( ch )[ i ] = gain * ( 2.f * random.nextFloat() - 1.f );
+        }
+
+        writer->writeFromAudioSampleBuffer( signal, 0, signal.getNumSamples() );
+    }
+
+    return true;
+}
+
+bool LufsFileAnalyzer::testSegments()
+{
+    bool success = true;
+
+    const double sampleRate = 44100.0;
+    const int numChannels = 6;
+    const int seconds = 300;
+
+    // noise loud enough for some samples to be over full scale, float WAV file
+    juce::File file( juce::File::createTempFile( ".wav" ) );
+    juce::WavAudioFormat wavAudioFormat;
+    if ( !writeNoiseFile( file, wavAudioFormat, sampleRate, numChannels, 32, seconds, -40.f, 2.f, 0x1770 ) )
+        return false;
+
+    const int hopArray[] = { 100, 10 };
+    const int numThreadsArray[] = { 2, 7 };
+
+    for ( int h = 0 ; h < 2 ; ++h )
+    {
+        const Result reference = analyzeFile( file, defaultBufferSize, hopArray[ h ], 1 );
+
+        for ( int t = 0 ; t < 2 ; ++t )
+        {
+            const Result result = analyzeFile( file, defaultBufferSize, hopArray[ h ], numThreadsArray[ t ] );
+
+            bool same = result.m_success && reference.m_success 
+                && fabs( result.m_integratedVolume - reference.m_integratedVolume ) < 0.01f
+                && fabs( result.m_rangeMin - reference.m_rangeMin ) < 0.01f
+                && fabs( result.m_rangeMax - reference.m_rangeMax ) < 0.01f
+                && fabs( result.m_maxMomentaryVolume - reference.m_maxMomentaryVolume ) < 0.01f
+                && fabs( result.m_maxShortTermVolume - reference.m_maxShortTermVolume ) < 0.01f;
+
+            for ( int ch = 0 ; ch < numChannels ; ++ch )
+                same = same && fabs( result.m_truePeakPerChannelArray[ ch ] - reference.m_truePeakPerChannelArray[ ch ] ) < 0.01f;
+
+            if ( !same )
+            {
+                DBG( juce::String( "LufsFileAnalyzer::testSegments differs with " ) + juce::String( numThreadsArray[ t ] ) + " threads, hop " + juce::String( hopArray[ h ] ) 
+                    + ", integrated " + juce::String( result.m_integratedVolume, 3 ) + " instead of " + juce::String( reference.m_integratedVolume, 3 ) );
+                success = false;
+            }
+        }
+    }
+
+    file.deleteFile();
+
+    return success;
+}
+
+bool LufsFileAnalyzer::testMemoryMapped()
+{
+    bool success = true;
+
+    const double sampleRate = 48000.0;
+    const int numChannels = 2;
+    const int seconds = 20;
+
+    juce::AudioFormatManager audioFormatManager;
+    audioFormatManager.registerBasicFormats();
+
+    const char * const extensions[] = { ".wav", ".wav", ".wav", ".aif", ".aif" };
+    const int bitsPerSamples[] = { 16, 24, 32, 16, 24 };
+
+    for ( int f = 0 ; f < 5 ; ++f )
+    {
+        // noise below full scale, 32 bits WAV files are float
+        juce::File file( juce::File::createTempFile( extensions[ f ] ) );
+        juce::AudioFormat * format = audioFormatManager.findFormatForFileExtension( extensions[ f ] );
+        if ( !writeNoiseFile( file, *format, sampleRate, numChannels, bitsPerSamples[ f ], seconds, -40.f, -1.f, 0x1770 + f ) )
+            return false;
+
+        juce::ScopedPointer<juce::AudioFormatReader> mappedReader( createReader( file, audioFormatManager, juce::Range<juce::int64>(), true ) );
+        juce::ScopedPointer<juce::AudioFormatReader> streamReader( createReader( file, audioFormatManager, juce::Range<juce::int64>(), false ) );
+
+        if ( mappedReader == nullptr || streamReader == nullptr )
+        {
+            file.deleteFile();
+            return false;
+        }
+
+        const Result mapped = analyzeReader( *mappedReader, defaultBufferSize, 100 );
+        const Result reference = analyzeReader( *streamReader, defaultBufferSize, 100 );
+
+        // same samples are converted from the same file data
+        bool same = mapped.m_success && reference.m_success && mapped.m_memoryMapped && !reference.m_memoryMapped
+            && mapped.m_integratedVolume == reference.m_integratedVolume
+            && mapped.m_rangeMin == reference.m_rangeMin
+            && mapped.m_rangeMax == reference.m_rangeMax
+            && mapped.m_maxMomentaryVolume == reference.m_maxMomentaryVolume
+            && mapped.m_maxShortTermVolume == reference.m_maxShortTermVolume
+            && mapped.m_truePeakPerChannelArray == reference.m_truePeakPerChannelArray;
+
+        if ( !same )
+        {
+            DBG( juce::String( "LufsFileAnalyzer::testMemoryMapped differs for " ) + juce::String( bitsPerSamples[ f ] ) + " bits " + extensions[ f ] 
+                + ( mapped.m_memoryMapped ? "" : ", file isn't mapped" ) );
+            success = false;
+        }
+
+        mappedReader = nullptr;
+        file.deleteFile();
+    }
+
+    return success;
+}
+
+LufsFileAnalyzer::Result LufsFileAnalyzer::analyzeFile( const juce::File & file, const int bufferSize, const int hopMilliseconds, const int numThreads, 
+                                                        const juce::String & layoutName )
+{
+    if ( !file.existsAsFile() )
+    {
+        Result result;
+        result.m_error = "file not found";
+        return result;
+    }
+
+    juce::AudioFormatManager audioFormatManager;
+    audioFormatManager.registerBasicFormats();
+
+    juce::ScopedPointer<juce::AudioFormatReader> reader( createReader( file, audioFormatManager, juce::Range<juce::int64>(), true ) );
+    if ( reader == nullptr )
+    {
+        Result result;
+        result.m_error = "unsupported or invalid audio file";
+        return result;
+    }
+
+    const Result formatResult = getFormatResult( *reader, layoutName );
+    if ( formatResult.m_error.isNotEmpty() )
+        return formatResult;
+
+    const juce::int64 numBlocks = formatResult.m_lengthInSamples / (juce::int64)( formatResult.m_sampleRate / 10.0 );
+    const int numSegments = (int)juce::jmin( (juce::int64)numThreads, numBlocks / minSegmentBlocks );
+
+    if ( numSegments > 1 )
+        return analyzeSegments( file, audioFormatManager, formatResult, bufferSize, hopMilliseconds, numSegments );
+
+    return analyzeReader( *reader, bufferSize, hopMilliseconds, layoutName );
+}
+
+LufsFileAnalyzer::Result LufsFileAnalyzer::getFormatResult( const juce::AudioFormatReader & reader, const juce::String & layoutName )
+{
+    Result result;
+    result.m_formatName = reader.getFormatName();
+    result.m_sampleRate = reader.sampleRate;
+    result.m_numChannels = (int)reader.numChannels;
+    result.m_lengthInSamples = reader.lengthInSamples;
+    result.m_memoryMapped = dynamic_cast<const juce::MemoryMappedAudioFormatReader *>( &reader ) != nullptr;
+
+    if ( result.m_numChannels < 1 )
+        result.m_error = "no audio channel";
+    else if ( result.m_sampleRate < 8000.0 )
+        result.m_error = "invalid sample rate";
+    else if ( layoutName.isEmpty() )
+        result.m_channelLayout = LufsChannelLayout::getDefault( result.m_numChannels );
+    else if ( !LufsChannelLayout::getNamed( layoutName, result.m_channelLayout ) )
+        result.m_error = "unknown channel layout " + layoutName;
+    else if ( result.m_channelLayout.getNumChannels() != result.m_numChannels )
+        result.m_error = juce::String( result.m_numChannels ) + " channels, layout " + layoutName + " has " + juce::String( result.m_channelLayout.getNumChannels() );
+
+    return result;
+}
+
+LufsFileAnalyzer::Result LufsFileAnalyzer::analyzeReader( juce::AudioFormatReader & reader, const int bufferSize, const int hopMilliseconds, 
+                                                          const juce::String & layoutName )
+{
+    Result result = getFormatResult( reader, layoutName );
+    if ( result.m_error.isNotEmpty() )
+        return result;
+
+    const juce::int64 ticks = juce::Time::getHighResolutionTicks();
+
+    LufsProcessor processor( result.m_channelLayout );
+    processor.prepareToPlay( result.m_sampleRate, bufferSize );
+    processor.setHopMilliseconds( hopMilliseconds );
+
+    {
+        // next block is read while this one is processed, memory used doesn't depend on file length
+        AudioStreamReader streamReader( reader, bufferSize );
+        while ( juce::AudioSampleBuffer * block = streamReader.readNextChunk() )
+        {
+            processor.processBlock( *block );
+
+            // no analysis thread: records are consumed here, long before the fifo is full
+            processor.update();
+        }
+    }
+
+    setMeasures( processor, result );
+
+    result.m_analysisSeconds = juce::Time::highResolutionTicksToSeconds( juce::Time::getHighResolutionTicks() - ticks );
+    result.m_success = true;
+
+    return result;
+}
+
+LufsFileAnalyzer::Result LufsFileAnalyzer::analyzeSegments( const juce::File & file, juce::AudioFormatManager & audioFormatManager, const Result & formatResult, 
+                                                            const int bufferSize, const int hopMilliseconds, const int numThreads )
+{
+    Result result = formatResult;
+
+    const juce::int64 ticks = juce::Time::getHighResolutionTicks();
+
+    const juce::int64 sampleSize100ms = (juce::int64)( result.m_sampleRate / 10.0 );
+    const juce::int64 numBlocks = result.m_lengthInSamples / sampleSize100ms;
+
+    // readers aren't thread safe, each job has its own
+    juce::OwnedArray<LufsSegmentJob> jobs;
+    for ( int i = 0 ; i < numThreads ; ++i )
+    {
+        const juce::int64 startBlock = numBlocks * i / numThreads;
+        const juce::int64 start = startBlock * sampleSize100ms;
+        const juce::int64 warmUpStart = juce::jmax( (juce::int64)0, startBlock - warmUpBlocks ) * sampleSize100ms;
+
+        // last segment ends with the file, with its last incomplete block
+        const juce::int64 end = ( i == numThreads - 1 ) ? result.m_lengthInSamples : ( numBlocks * ( i + 1 ) / numThreads ) * sampleSize100ms;
+
+        // each job maps the samples it reads
+        juce::AudioFormatReader * reader = createReader( file, audioFormatManager, juce::Range<juce::int64>( warmUpStart, end ), result.m_memoryMapped );
+        if ( reader == nullptr )
+        {
+            result.m_error = "file can't be opened again";
+            return result;
+        }
+
+        jobs.add( new LufsSegmentJob( reader, result.m_channelLayout, warmUpStart, start, end, bufferSize, hopMilliseconds ) );
+    }
+
+    {
+        juce::ThreadPool threadPool( numThreads );
+
+        for ( int i = 0 ; i < jobs.size() ; ++i )
+            threadPool.addJob( jobs[ i ], false );
+
+        for ( int i = 0 ; i < jobs.size() ; ++i )
+            threadPool.waitForJobToFinish( jobs[ i ], -1 );
+    }
+
+    // windows, gating and range over all hops
+    LufsProcessor processor( result.m_channelLayout );
+    processor.prepareToPlay( result.m_sampleRate, bufferSize );
+    processor.setHopMilliseconds( hopMilliseconds );
+
+    for ( int i = 0 ; i < jobs.size() ; ++i )
+    {
+        processor.update( jobs[ i ]->getRecords(), jobs[ i ]->getTruePeaks(), jobs[ i ]->getNumRecords() );
+        jobs.set( i, nullptr ); // records aren't needed anymore
+    }
+
+    setMeasures( processor, result );
+
+    result.m_analysisSeconds = juce::Time::highResolutionTicksToSeconds( juce::Time::getHighResolutionTicks() - ticks );
+    result.m_success = true;
+
+    return result;
+}
+
+juce::AudioFormatReader * LufsFileAnalyzer::createReader( const juce::File & file, juce::AudioFormatManager & audioFormatManager, 
+                                                         const juce::Range<juce::int64> section, const bool memoryMapping )
+{
+    if ( memoryMapping )
+    {
+        if ( juce::AudioFormat * format = audioFormatManager.findFormatForFileExtension( file.getFileExtension() ) )
+        {
+            juce::ScopedPointer<juce::MemoryMappedAudioFormatReader> reader( format->createMemoryMappedReader( file ) );
+
+            // mapping fails when address space is missing, and doesn't cover samples missing from a 
+            // truncated file: file is then read as a stream, missing samples being read as silence
+            if ( reader != nullptr )
+            {
+                const juce::Range<juce::int64> samples = section.isEmpty() ? juce::Range<juce::int64>( 0, reader->lengthInSamples ) : section;
+                if ( reader->mapSectionOfFile( samples ) && reader->getMappedSection().contains( samples ) )
+                    return reader.release();
+            }
+        }
+    }
+
+    return audioFormatManager.createReaderFor( file );
+}
+
+void LufsFileAnalyzer::setMeasures( LufsProcessor & processor, Result & result )
+{
+    const LufsProcessor::Snapshot snapshot = processor.getSnapshot();
+
+    result.m_integratedVolume = snapshot.m_integratedVolume;
+    result.m_rangeMin = snapshot.m_rangeMin;
+    result.m_rangeMax = snapshot.m_rangeMax;
+    result.m_truePeak = snapshot.m_maxTruePeak;
+    result.m_truePeakPerChannelArray.clearQuick();
+    for ( int ch = 0 ; ch < result.m_numChannels ; ++ch )
+        result.m_truePeakPerChannelArray.add( processor.getTruePeakChannelMax( ch ) );
+
+    for ( int i = 0 ; i < snapshot.m_validSize ; ++i )
+    {
+        result.m_maxMomentaryVolume = juce::jmax( result.m_maxMomentaryVolume, processor.getMomentaryVolumeArray()[ i ] );
+        result.m_maxShortTermVolume = juce::jmax( result.m_maxShortTermVolume, processor.getShortTermVolumeArray()[ i ] );
+    }
+}
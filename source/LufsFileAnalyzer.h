@@ -0,0 +1,115 @@
+/*
+  =================================================================
+
+  This file is part of the LUFS-TruePeak program.
+  Copyright (c) 2015 - Mathieu Pavageau - contact@repetito.com
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  Details of these licenses can be found at: www.gnu.org/licenses
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  =================================================================
+*/
+
+#pragma once 
+
+#include "LufsChannelLayout.h"
+
+class LufsProcessor;
+
+// Measures a whole audio file with LufsProcessor, without UI: integrated volume, loudness 
+// range, max momentary and short term volumes, and true peak values of each channel.
+// Used by the command line analyzer
+class LufsFileAnalyzer
+{
+public:
+
+    struct Result
+    {
+        Result();
+
+        bool m_success;
+        juce::String m_error; // set when m_success is false
+
+        juce::String m_formatName;
+        double m_sampleRate;
+        int m_numChannels;
+        LufsChannelLayout m_channelLayout; // names and weights of the m_numChannels channels
+        juce::int64 m_lengthInSamples;
+        bool m_memoryMapped; // samples were converted from the mapped file, without read calls
+
+        float m_integratedVolume;
+        float m_rangeMin;
+        float m_rangeMax;
+        float m_maxMomentaryVolume;
+        float m_maxShortTermVolume;
+        float m_truePeak;
+        juce::Array<float> m_truePeakPerChannelArray; // m_numChannels values
+
+        double m_analysisSeconds; // time spent reading and processing the file
+
+        inline float getLoudnessRange() const { return m_rangeMax - m_rangeMin; }
+        inline double getSeconds() const { return m_sampleRate > 0.0 ? (double)m_lengthInSamples / m_sampleRate : 0.0; }
+    };
+
+    // reads file by bufferSize blocks and processes them; hopMilliseconds is 10, 25 or 100 (see LufsProcessor::setHopMilliseconds).
+    // With numThreads above 1, a long file is split into segments analyzed in parallel (see analyzeSegments).
+    // layoutName is one of LufsChannelLayout::getNames() with the channel count of the file, or empty for
+    // the default layout of the channel count
+    static Result analyzeFile( const juce::File & file, const int bufferSize, const int hopMilliseconds, const int numThreads = 1, 
+                               const juce::String & layoutName = juce::String::empty );
+
+    // processes already opened reader, which isn't deleted; reader is used by a reading thread during the call
+    static Result analyzeReader( juce::AudioFormatReader & reader, const int bufferSize, const int hopMilliseconds, 
+                                const juce::String & layoutName = juce::String::empty );
+
+    // analyzes a file with 1 thread and with several threads, returns false if integrated volume, range, 
+    // max momentary and short term volumes or true peaks differ by 0.01 LU (or dB) or more
+    static bool testSegments();
+
+    // analyzes 16, 24 bits and float WAV files and 16, 24 bits AIFF files with memory mapped and 
+    // stream readers, returns false if a file isn't mapped or if measures differ
+    static bool testMemoryMapped();
+
+    enum
+    {
+        defaultBufferSize = 8192,
+        warmUpBlocks = 10, // 1 s processed before each segment, so that K-weighting filter states converge
+        minSegmentBlocks = 600 // 1 min, shorter files are analyzed by a single thread
+    };
+
+private:
+
+    // result with file format and channel layout, m_error is set if format or layout isn't supported
+    static Result getFormatResult( const juce::AudioFormatReader & reader, const juce::String & layoutName );
+
+    // reader of file, nullptr if format isn't supported. When memoryMapping is true and the format supports 
+    // it (WAV, AIFF), samples [ section ] of the file (whole file if section is empty) are memory mapped: 
+    // chunks are converted from the pages of the OS file cache, without read calls and stream buffers, 
+    // and repeated analyses of the same file don't read the disk again
+    static juce::AudioFormatReader * createReader( const juce::File & file, juce::AudioFormatManager & audioFormatManager, 
+                                                   const juce::Range<juce::int64> section, const bool memoryMapping );
+
+    // test helper: writes seconds of noise to file, with a level drawn every second between minDecibels 
+    // and maxDecibels; returns false if the file can't be written in format
+    static bool writeNoiseFile( const juce::File & file, juce::AudioFormat & format, const double sampleRate, const int numChannels, 
+                                const int bitsPerSample, const int seconds, const float minDecibels, const float maxDecibels, const int seed );
+
+    // sets measures of result from processor measures and history
+    static void setMeasures( LufsProcessor & processor, Result & result );
+
+    // splits file into numThreads segments starting at 100 ms block boundaries, processed by a thread pool 
+    // with a LufsProcessor each, from warmUpBlocks before segment start. Records of the hops of each segment 
+    // are then added in order to a last processor, which computes windows, gating and range once for the whole 
+    // file: results are those of a single processor, up to float rounding
+    static Result analyzeSegments( const juce::File & file, juce::AudioFormatManager & audioFormatManager, const Result & formatResult, 
+                                   const int bufferSize, const int hopMilliseconds, const int numThreads );
+};
@@ -0,0 +1,503 @@
+/*
+  =================================================================
+
+  This file is part of the LUFS-TruePeak program.
+  Copyright (c) 2015 - Mathieu Pavageau - contact@repetito.com
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  Details of these licenses can be found at: www.gnu.org/licenses
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  =================================================================
+*/
+
+#include "AppIncsAndDefs.h"
+
+#include "LufsHistoryIndex.h"
+#include "LufsProcessor.h"
+
+LufsHistoryIndex::LufsHistoryIndex( const LufsHistoryArray & momentaryVolumes, const LufsHistoryArray & shortTermVolumes )
+    : m_momentaryVolumes( momentaryVolumes )
+    , m_shortTermVolumes( shortTermVolumes )
+    , m_validSize( 0 )
+    , m_hopsPer100ms( 1 )
+    , m_numBlocks( 0 )
+{
+    static_jassert( (int)LufsHistogram::numBins <= (int)silentBin );
+}
+
+LufsHistoryIndex::~LufsHistoryIndex()
+{
+}
+
+LufsHistoryIndex::Node::Node()
+    : m_size( 0 )
+    , m_ones( 0 )
+    , m_lowerSum( 0.0 )
+{
+}
+
+LufsHistoryIndex::GatingTree::GatingTree()
+{
+    m_nodes.ensureStorageAllocated( 2 * treeBins );
+    for ( int i = 0 ; i < 2 * treeBins ; ++i )
+        m_nodes.add( nullptr );
+}
+
+void LufsHistoryIndex::addArray( const LufsHistoryArray & array )
+{
+    jassert( m_validSize == 0 );
+
+    Series * series = new Series();
+    series->m_array = &array;
+    m_series.add( series );
+}
+
+void LufsHistoryIndex::clear()
+{
+    for ( int i = 0 ; i < m_series.size() ; ++i )
+        m_series[ i ]->m_pyramid.clear();
+
+    clearTree( m_momentaryTree );
+    clearTree( m_shortTermTree );
+    m_validSize = 0;
+    m_numBlocks = 0;
+}
+
+void LufsHistoryIndex::clearTree( GatingTree & tree )
+{
+    for ( int i = 0 ; i < tree.m_nodes.size() ; ++i )
+        tree.m_nodes.set( i, nullptr );
+}
+
+void LufsHistoryIndex::update( const int validSize, const int hopsPer100ms )
+{
+    jassert( m_validSize == 0 || hopsPer100ms == m_hopsPer100ms );
+
+    m_hopsPer100ms = hopsPer100ms;
+    if ( validSize <= m_validSize )
+        return;
+
+    m_validSize = validSize;
+
+    for ( int i = 0 ; i < m_series.size() ; ++i )
+        m_series[ i ]->m_pyramid.update( *m_series[ i ]->m_array, validSize, hopsPer100ms );
+
+    // blocks of 100 ms boundaries
+    const int numBlocks = ( validSize + hopsPer100ms - 1 ) / hopsPer100ms;
+    for ( int block = m_numBlocks ; block < numBlocks ; ++block )
+    {
+        addBlock( m_momentaryTree, m_momentaryVolumes[ block * hopsPer100ms ] );
+        addBlock( m_shortTermTree, m_shortTermVolumes[ block * hopsPer100ms ] );
+    }
+    m_numBlocks = numBlocks;
+}
+
+void LufsHistoryIndex::addBlock( GatingTree & tree, const float volume )
+{
+    // same blocks and bins as the processor gating histograms
+    const bool gated = volume > -70.f;
+    const int bin = gated ? LufsHistogram::getVolumeBinIndex( volume ) : (int)silentBin;
+    const float energy = gated ? LufsProcessor::getLufsSum( volume ) : 0.f;
+
+    int index = 1;
+    for ( int level = treeDepth - 1 ; level >= 0 ; --level )
+    {
+        if ( tree.m_nodes[ index ] == nullptr )
+            tree.m_nodes.set( index, new Node() );
+
+        Node & node = *tree.m_nodes.getUnchecked( index );
+        const int position = node.m_size++;
+        const int bit = ( bin >> level ) & 1;
+
+        if ( ( position & ( wordSize - 1 ) ) == 0 )
+        {
+            Word word;
+            word.m_bits = 0;
+            word.m_ones = node.m_ones;
+            node.m_words.add( word );
+        }
+        if ( ( position & ( sumSize - 1 ) ) == 0 )
+            node.m_lowerSums.add( node.m_lowerSum );
+
+        if ( bit )
+        {
+            node.m_words.getReference( position >> wordShift ).m_bits |= (juce::uint64)1 << ( position & ( wordSize - 1 ) );
+            ++node.m_ones;
+        }
+        else
+        {
+            node.m_lowerSum += energy;
+        }
+
+        index = 2 * index + bit;
+    }
+
+    if ( tree.m_nodes[ index ] == nullptr )
+        tree.m_nodes.set( index, new Node() );
+
+    Node & leaf = *tree.m_nodes.getUnchecked( index );
+    leaf.m_energies.add( energy );
+    ++leaf.m_size;
+}
+
+int LufsHistoryIndex::getOnes( const Node & node, const int position )
+{
+    const int word = position >> wordShift;
+    if ( word == node.m_words.size() )
+        return node.m_ones; // end of node, at a word boundary
+
+    const Word & bits = node.m_words.getReference( word );
+    const juce::uint64 mask = ( (juce::uint64)1 << ( position & ( wordSize - 1 ) ) ) - 1;
+    return bits.m_ones + juce::countNumberOfBits( bits.m_bits & mask );
+}
+
+double LufsHistoryIndex::getLowerSum( const GatingTree & tree, const int index, const int position )
+{
+    const Node & node = *tree.m_nodes.getUnchecked( index );
+    const int sample = position >> sumShift;
+    if ( sample == node.m_lowerSums.size() )
+        return node.m_lowerSum; // end of node, at a sum boundary
+
+    // blocks of the lower half between the sum and position are consecutive positions of child 2n
+    const int samplePosition = sample << sumShift;
+    const int lowerEnd = position - getOnes( node, position );
+
+    double sum = node.m_lowerSums.getUnchecked( sample );
+    for ( int i = samplePosition - getOnes( node, samplePosition ) ; i < lowerEnd ; ++i )
+        sum += getEnergy( tree, 2 * index, i );
+
+    return sum;
+}
+
+float LufsHistoryIndex::getEnergy( const GatingTree & tree, int index, int position )
+{
+    while ( index < treeBins )
+    {
+        const Node & node = *tree.m_nodes.getUnchecked( index );
+        const int bit = (int)( node.m_words.getReference( position >> wordShift ).m_bits >> ( position & ( wordSize - 1 ) ) ) & 1;
+        const int ones = getOnes( node, position );
+
+        position = bit ? ones : position - ones;
+        index = 2 * index + bit;
+    }
+
+    return tree.m_nodes.getUnchecked( index )->m_energies.getUnchecked( position );
+}
+
+const LufsHistoryIndex::Series * LufsHistoryIndex::findSeries( const LufsHistoryArray & array ) const
+{
+    for ( int i = 0 ; i < m_series.size() ; ++i )
+    {
+        if ( m_series[ i ]->m_array == &array )
+            return m_series[ i ];
+    }
+
+    return nullptr;
+}
+
+const LufsHistoryPyramid & LufsHistoryIndex::getPyramid( const LufsHistoryArray & array ) const
+{
+    const Series * series = findSeries( array );
+    jassert( series != nullptr );
+
+    return series->m_pyramid;
+}
+
+void LufsHistoryIndex::getRange( const LufsHistoryArray & array, const int _begin, const int _end, float & minValue, float & maxValue ) const
+{
+    const int begin = juce::jmax( 0, _begin );
+    const int end = juce::jmin( _end, m_validSize );
+
+    minValue = DEFAULT_MIN_VOLUME;
+    maxValue = DEFAULT_MIN_VOLUME;
+    if ( begin >= end )
+        return;
+
+    minValue = array[ begin ];
+    maxValue = minValue;
+
+    // whole pixels of the range, values before and after them
+    const Series * series = findSeries( array );
+    jassert( series != nullptr );
+
+    const int firstPixel = ( begin + m_hopsPer100ms - 1 ) / m_hopsPer100ms;
+    const int lastPixel = end / m_hopsPer100ms;
+    if ( series == nullptr || firstPixel >= lastPixel )
+    {
+        for ( int i = begin + 1 ; i < end ; ++i )
+        {
+            minValue = juce::jmin( minValue, array[ i ] );
+            maxValue = juce::jmax( maxValue, array[ i ] );
+        }
+        return;
+    }
+
+    for ( int i = begin + 1 ; i < firstPixel * m_hopsPer100ms ; ++i )
+    {
+        minValue = juce::jmin( minValue, array[ i ] );
+        maxValue = juce::jmax( maxValue, array[ i ] );
+    }
+    for ( int i = lastPixel * m_hopsPer100ms ; i < end ; ++i )
+    {
+        minValue = juce::jmin( minValue, array[ i ] );
+        maxValue = juce::jmax( maxValue, array[ i ] );
+    }
+
+    float pixelsMin, pixelsMax;
+    series->m_pyramid.getRange( firstPixel, lastPixel, pixelsMin, pixelsMax );
+    minValue = juce::jmin( minValue, pixelsMin );
+    maxValue = juce::jmax( maxValue, pixelsMax );
+}
+
+float LufsHistoryIndex::getMax( const LufsHistoryArray & array, const int begin, const int end ) const
+{
+    float minValue, maxValue;
+    getRange( array, begin, end, minValue, maxValue );
+    return maxValue;
+}
+
+float LufsHistoryIndex::getMin( const LufsHistoryArray & array, const int begin, const int end ) const
+{
+    float minValue, maxValue;
+    getRange( array, begin, end, minValue, maxValue );
+    return minValue;
+}
+
+LufsHistoryIndex::RangeBins::RangeBins( const GatingTree & tree, const int beginBlock, const int endBlock )
+    : m_tree( tree )
+    , m_beginBlock( beginBlock )
+    , m_endBlock( juce::jmax( beginBlock, endBlock ) )
+    , m_size( 0 )
+    , m_sum( 0.0 )
+{
+    // blocks above the absolute gate
+    getPrefixSum( LufsHistogram::numBins, m_size, m_sum );
+}
+
+void LufsHistoryIndex::RangeBins::getPrefixSum( const int binIndex, int & count, double & sum ) const
+{
+    count = 0;
+    sum = 0.0;
+
+    // positions [begin, end[ of the node are the blocks of the range with the bits of binIndex above the level
+    int begin = m_beginBlock;
+    int end = m_endBlock;
+    int index = 1;
+    for ( int level = treeDepth - 1 ; level >= 0 && begin < end ; --level )
+    {
+        const Node & node = *m_tree.m_nodes.getUnchecked( index );
+        const int beginOnes = getOnes( node, begin );
+        const int endOnes = getOnes( node, end );
+
+        if ( ( binIndex >> level ) & 1 )
+        {
+            // blocks of the lower half are below binIndex
+            count += ( end - begin ) - ( endOnes - beginOnes );
+            sum += getLowerSum( m_tree, index, end ) - getLowerSum( m_tree, index, begin );
+
+            begin = beginOnes;
+            end = endOnes;
+            index = 2 * index + 1;
+        }
+        else
+        {
+            begin -= beginOnes;
+            end -= endOnes;
+            index = 2 * index;
+        }
+    }
+}
+
+int LufsHistoryIndex::RangeBins::findBinIndex( int rank ) const
+{
+    jassert( rank < m_size );
+
+    // rank among the blocks of the range of the node
+    int begin = m_beginBlock;
+    int end = m_endBlock;
+    int index = 1;
+    int binIndex = 0;
+    for ( int level = treeDepth - 1 ; level >= 0 ; --level )
+    {
+        const Node & node = *m_tree.m_nodes.getUnchecked( index );
+        const int beginOnes = getOnes( node, begin );
+        const int endOnes = getOnes( node, end );
+        const int lowerCount = ( end - begin ) - ( endOnes - beginOnes );
+
+        if ( rank < lowerCount )
+        {
+            begin -= beginOnes;
+            end -= endOnes;
+            index = 2 * index;
+        }
+        else
+        {
+            rank -= lowerCount;
+            begin = beginOnes;
+            end = endOnes;
+            index = 2 * index + 1;
+            binIndex |= 1 << level;
+        }
+    }
+
+    return binIndex;
+}
+
+void LufsHistoryIndex::RangeBins::getSumAbove( const float threshold, int & count, double & sum ) const
+{
+    LufsHistogram::getBinsSumAbove( *this, threshold, count, sum );
+}
+
+float LufsHistoryIndex::RangeBins::getPercentileValue( const float threshold, const float percentile ) const
+{
+    return LufsHistogram::getBinsPercentileValue( *this, threshold, percentile );
+}
+
+LufsHistoryIndex::RangeBins LufsHistoryIndex::getRangeBins( const bool momentary, const int _begin, const int _end ) const
+{
+    const int begin = juce::jmax( 0, _begin );
+    const int end = juce::jmin( _end, m_validSize );
+    const int windowBlocks = momentary ? (int)LufsProcessor::momentaryBlocks : (int)LufsProcessor::shortTermBlocks;
+
+    // block b is the value of position b * hopsPer100ms, mean of positions [( b - windowBlocks ) * hopsPer100ms, b * hopsPer100ms[
+    const int beginBlock = ( begin + m_hopsPer100ms - 1 ) / m_hopsPer100ms + windowBlocks;
+    const int endBlock = ( end + m_hopsPer100ms - 1 ) / m_hopsPer100ms;
+
+    return RangeBins( momentary ? m_momentaryTree : m_shortTermTree, beginBlock, endBlock );
+}
+
+float LufsHistoryIndex::getIntegratedVolume( const int begin, const int end ) const
+{
+    const RangeBins bins = getRangeBins( true, begin, end );
+
+    if ( bins.size() == 0 )
+        return DEFAULT_MIN_VOLUME;
+
+    return LufsProcessor::getIntegratedVolume( bins );
+}
+
+void LufsHistoryIndex::getLoudnessRange( const int begin, const int end, float & rangeMin, float & rangeMax ) const
+{
+    const RangeBins bins = getRangeBins( false, begin, end );
+
+    rangeMin = DEFAULT_MIN_VOLUME;
+    rangeMax = DEFAULT_MIN_VOLUME;
+    if ( bins.size() )
+        LufsProcessor::getLoudnessRange( bins, rangeMin, rangeMax );
+}
+
+size_t LufsHistoryIndex::getAllocatedBytes() const
+{
+    size_t bytes = 0;
+
+    for ( int i = 0 ; i < m_series.size() ; ++i )
+        bytes += m_series[ i ]->m_pyramid.getAllocatedBytes();
+
+    const GatingTree * trees[] = { &m_momentaryTree, &m_shortTermTree };
+    for ( int t = 0 ; t < 2 ; ++t )
+    {
+        for ( int i = 0 ; i < trees[ t ]->m_nodes.size() ; ++i )
+        {
+            const Node * node = trees[ t ]->m_nodes.getUnchecked( i );
+            if ( node != nullptr )
+                bytes += sizeof( Node ) + node->m_words.size() * sizeof( Word ) + node->m_lowerSums.size() * sizeof( double ) + node->m_energies.size() * sizeof( float );
+        }
+    }
+
+    return bytes;
+}
+
+bool LufsHistoryIndex::testQueries()
+{
+    bool success = true;
+    juce::Random random( 25 );
+
+    // 100 ms hops for 2 hours and a half, 10 ms hops for 8 minutes
+    const int hopArray[] = { 100, 10 };
+    const int numRecordsArray[] = { 85536, 50000 };
+    for ( int h = 0 ; h < 2 && success ; ++h )
+    {
+        const int hopsPer100ms = 100 / hopArray[ h ];
+        const int numRecords = numRecordsArray[ h ];
+
+        juce::Array<LufsRecord> records;
+        juce::Array<float> truePeaks;
+        LufsProcessor::makeRandomRecords( random, numRecords, 2, hopsPer100ms, records, truePeaks );
+
+        LufsProcessor processor( 2 );
+        processor.prepareToPlay( 48000.0, 512 );
+        processor.setHopMilliseconds( hopArray[ h ] );
+        LufsProcessor::updateInRandomSizes( processor, records, truePeaks, random, 20000 );
+        const LufsHistoryIndex & index = processor.getHistoryIndex();
+
+        // whole history, as measured by the processor
+        float rangeMin, rangeMax;
+        index.getLoudnessRange( 0, numRecords, rangeMin, rangeMax );
+        const float integratedVolume = index.getIntegratedVolume( 0, numRecords );
+        if ( fabs( integratedVolume - processor.getIntegratedVolume() ) >= 0.01f 
+            || fabs( rangeMin - processor.getRangeMinVolume() ) >= 0.01f || fabs( rangeMax - processor.getRangeMaxVolume() ) >= 0.01f )
+        {
+            DBG( juce::String( "LufsHistoryIndex::testQueries whole history, hop " ) + juce::String( hopArray[ h ] ) + " integrated " + juce::String( integratedVolume, 3 ) 
+                + " instead of " + juce::String( processor.getIntegratedVolume(), 3 ) );
+            success = false;
+        }
+
+        // short and long ranges, begins on 100 ms boundaries for reference processors
+        for ( int i = 0 ; i < 12 && success ; ++i )
+        {
+            const int begin = hopsPer100ms * random.nextInt( numRecords / hopsPer100ms );
+            const int end = i < 4 ? numRecords : juce::jmin( numRecords, begin + 1 + random.nextInt( i < 8 ? 500 : numRecords ) );
+
+            // max and min of values
+            const LufsHistoryArray * arrays[] = { &processor.getMomentaryVolumeArray(), &processor.getShortTermVolumeArray(), 
+                &processor.getIntegratedVolumeArray(), &processor.getTruePeakArray(), &processor.getTruePeakChannelArray( 1 ) };
+            for ( int a = 0 ; a < juce::numElementsInArray( arrays ) ; ++a )
+            {
+                const LufsHistoryArray & array = *arrays[ a ];
+                float minValue = array[ begin ];
+                float maxValue = minValue;
+                for ( int position = begin ; position < end ; ++position )
+                {
+                    minValue = juce::jmin( minValue, array[ position ] );
+                    maxValue = juce::jmax( maxValue, array[ position ] );
+                }
+
+                if ( index.getMin( array, begin, end ) != minValue || index.getMax( array, begin, end ) != maxValue )
+                {
+                    DBG( juce::String( "LufsHistoryIndex::testQueries array " ) + juce::String( a ) + " range " + juce::String( begin ) + " " + juce::String( end ) 
+                        + " max " + juce::String( index.getMax( array, begin, end ) ) + " instead of " + juce::String( maxValue ) );
+                    success = false;
+                }
+            }
+
+            // measures of records of the range only
+            LufsProcessor reference( 2 );
+            reference.prepareToPlay( 48000.0, 512 );
+            reference.setHopMilliseconds( hopArray[ h ] );
+            reference.update( records.begin() + begin, truePeaks.begin() + 2 * begin, end - begin );
+
+            index.getLoudnessRange( begin, end, rangeMin, rangeMax );
+            const float rangeVolume = index.getIntegratedVolume( begin, end );
+            if ( fabs( rangeVolume - reference.getIntegratedVolume() ) >= 0.01f 
+                || fabs( rangeMin - reference.getRangeMinVolume() ) >= 0.01f || fabs( rangeMax - reference.getRangeMaxVolume() ) >= 0.01f )
+            {
+                DBG( juce::String( "LufsHistoryIndex::testQueries range " ) + juce::String( begin ) + " " + juce::String( end ) + ", hop " + juce::String( hopArray[ h ] ) 
+                    + " integrated " + juce::String( rangeVolume, 3 ) + " instead of " + juce::String( reference.getIntegratedVolume(), 3 )
+                    + ", range " + juce::String( rangeMin, 3 ) + " " + juce::String( rangeMax, 3 ) 
+                    + " instead of " + juce::String( reference.getRangeMinVolume(), 3 ) + " " + juce::String( reference.getRangeMaxVolume(), 3 ) );
+                success = false;
+            }
+        }
+    }
+
+    return success;
+}
@@ -0,0 +1,180 @@
+/*
+  =================================================================
+
+  This file is part of the LUFS-TruePeak program.
+  Copyright (c) 2015 - Mathieu Pavageau - contact@repetito.com
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  Details of these licenses can be found at: www.gnu.org/licenses
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  =================================================================
+*/
+
+#pragma once 
+
+#include "LufsHistoryPyramid.h"
+
+class LufsHistoryArray;
+
+// Index of history answering measures of any range of positions without reading all its values. 
+// Min and max values of indexed arrays are read from a LufsHistoryPyramid of each array, which the 
+// chart also draws: a range is covered by at most two ranges of each level, and less than two pixels 
+// of values at its ends. Gating blocks (momentary and short term volumes at 100 ms boundaries) are 
+// kept in a wavelet tree of LufsHistogram bins: each node splits its blocks, in block order, between 
+// the lower and upper halves of its bins with one bit per block, and the leaf of a bin holds the 
+// energies of its blocks. Blocks of a range of positions are a range of positions of each node, so 
+// counts and energy sums of blocks of a range below a bin, and the bin of a rank, are found by a 
+// descent from the root, and the range is gated as the processor gates its histograms. 
+// 
+// Max and min queries cost O(log n). Integrated volume and loudness range queries cost a few 
+// descents of treeDepth nodes, each reading less than sumSize energies on each side at each node, 
+// whatever the length of the range or of the history: no bin or block of the range is read. A block 
+// takes a bit and a sixteenth of an energy sum in each node it goes through, and its energy in its 
+// leaf: about 14 bytes. 
+// 
+// Updated by the update thread of the processor, read with its history lock held
+class LufsHistoryIndex
+{
+public:
+
+    enum
+    {
+        treeDepth = 13, // 8192 bins: the LufsHistogram bins, then the bin of blocks below the absolute gate
+        treeBins = 1 << treeDepth,
+        silentBin = treeBins - 1,
+        wordShift = 6, // bits of 64 blocks per word
+        wordSize = 1 << wordShift,
+        sumShift = 4, // energy sums of nodes every 16 blocks
+        sumSize = 1 << sumShift
+    };
+
+    // gating blocks are read from momentary and short term volumes
+    LufsHistoryIndex( const LufsHistoryArray & momentaryVolumes, const LufsHistoryArray & shortTermVolumes );
+    ~LufsHistoryIndex();
+
+    // min and max values of array are indexed, before first update
+    void addArray( const LufsHistoryArray & array );
+
+    // removes all positions, after a reset of history
+    void clear();
+
+    // indexes positions published since last call; history lock must be held
+    void update( const int validSize, const int hopsPer100ms );
+
+    // max and min values of positions [begin, end[ of an indexed array, DEFAULT_MIN_VOLUME if range is empty
+    float getMax( const LufsHistoryArray & array, const int begin, const int end ) const;
+    float getMin( const LufsHistoryArray & array, const int begin, const int end ) const;
+
+    // pixels of 100 ms of an indexed array, as drawn by the chart
+    const LufsHistoryPyramid & getPyramid( const LufsHistoryArray & array ) const;
+
+    // integrated volume and loudness range of positions [begin, end[, as if only this range had been 
+    // measured: gating blocks of positions of the range whose windows are in the range. 
+    // DEFAULT_MIN_VOLUME if no block is above -70 LUFS
+    float getIntegratedVolume( const int begin, const int end ) const;
+    void getLoudnessRange( const int begin, const int end, float & rangeMin, float & rangeMax ) const;
+
+    size_t getAllocatedBytes() const;
+
+    // measures records with a processor, and compares measures of ranges of its index with 
+    // measures of processors measuring the records of the ranges only, and with max and min of values
+    static bool testQueries();
+
+private:
+
+    struct Series
+    {
+        const LufsHistoryArray * m_array;
+        LufsHistoryPyramid m_pyramid;
+    };
+
+    // bits of wordSize positions of a node, 1 for blocks going to the upper half of its bins
+    struct Word
+    {
+        juce::uint64 m_bits;
+        int m_ones; // blocks of positions before the word going to the upper half
+    };
+
+    // node n of a gating tree has children 2n and 2n + 1, leaf treeBins + bin holds the blocks of bin
+    struct Node
+    {
+        Node();
+
+        juce::Array<Word> m_words;
+        juce::Array<double> m_lowerSums; // energy sum of blocks going to the lower half before every sumSize positions
+        juce::Array<float> m_energies; // blocks of a leaf
+        int m_size;
+        int m_ones;
+        double m_lowerSum;
+    };
+
+    // gating blocks of momentary or short term volumes; nodes [1, 2 * treeBins[ are created with 
+    // their first block
+    struct GatingTree
+    {
+        GatingTree();
+
+        juce::OwnedArray<Node> m_nodes;
+    };
+
+    // blocks [beginBlock, endBlock[ of a tree, gated by LufsProcessor as a LufsHistogram
+    class RangeBins
+    {
+    public:
+
+        RangeBins( const GatingTree & tree, const int beginBlock, const int endBlock );
+
+        inline int size() const { return m_size; }
+        inline double getSum() const { return m_sum; }
+        void getPrefixSum( const int binIndex, int & count, double & sum ) const;
+        int findBinIndex( int rank ) const;
+        void getSumAbove( const float threshold, int & count, double & sum ) const;
+        float getPercentileValue( const float threshold, const float percentile ) const;
+
+    private:
+
+        const GatingTree & m_tree;
+        int m_beginBlock;
+        int m_endBlock;
+        int m_size;
+        double m_sum;
+    };
+
+    const Series * findSeries( const LufsHistoryArray & array ) const;
+    void getRange( const LufsHistoryArray & array, const int begin, const int end, float & minValue, float & maxValue ) const;
+
+    // gating blocks of momentary or short term volumes of positions [begin, end[ whose windows are in range
+    RangeBins getRangeBins( const bool momentary, const int begin, const int end ) const;
+
+    // adds block of volume to the leaf of its bin, and to the nodes above it
+    static void addBlock( GatingTree & tree, const float volume );
+    static void clearTree( GatingTree & tree );
+
+    // blocks of positions [0, position[ of node going to the upper half of its bins
+    static int getOnes( const Node & node, const int position );
+    // energy sum of blocks of positions [0, position[ of node going to the lower half of its bins
+    static double getLowerSum( const GatingTree & tree, const int node, const int position );
+    // energy of block at position of node, read from its leaf
+    static float getEnergy( const GatingTree & tree, int node, int position );
+
+    const LufsHistoryArray & m_momentaryVolumes;
+    const LufsHistoryArray & m_shortTermVolumes;
+
+    juce::OwnedArray<Series> m_series;
+    GatingTree m_momentaryTree;
+    GatingTree m_shortTermTree;
+    int m_validSize;
+    int m_hopsPer100ms;
+    int m_numBlocks; // blocks of positions [0, m_validSize[
+
+    JUCE_DECLARE_NON_COPYABLE( LufsHistoryIndex )
+};
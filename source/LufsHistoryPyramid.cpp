@@ -0,0 +1,274 @@
+/*
+  =================================================================
+
+  This file is part of the LUFS-TruePeak program.
+  Copyright (c) 2015 - Mathieu Pavageau - contact@repetito.com
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  Details of these licenses can be found at: www.gnu.org/licenses
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  =================================================================
+*/
+
+#include "AppIncsAndDefs.h"
+
+#include "LufsHistoryPyramid.h"
+#include "LufsProcessor.h"
+
+LufsHistoryPyramid::LufsHistoryPyramid()
+    : m_history( nullptr )
+    , m_hopsPer100ms( 1 )
+    , m_numPixels( 0 )
+{
+}
+
+void LufsHistoryPyramid::clear()
+{
+    for ( int level = firstStoredLevel ; level < numLevels ; ++level )
+    {
+        m_levels[ level ].m_min.clearQuick();
+        m_levels[ level ].m_max.clearQuick();
+    }
+
+    m_numPixels = 0;
+}
+
+void LufsHistoryPyramid::update( const LufsHistoryArray & history, const int validSize, const int hopsPer100ms )
+{
+    jassert( m_numPixels == 0 || ( &history == m_history && hopsPer100ms == m_hopsPer100ms ) );
+
+    m_history = &history;
+    m_hopsPer100ms = hopsPer100ms;
+
+    const int numPixels = validSize / hopsPer100ms;
+    if ( numPixels <= m_numPixels )
+        return;
+
+    // ranges of the new pixels in each level; the last range of a level may have been 
+    // incomplete, it is computed again
+    int begin = m_numPixels >> firstStoredLevel;
+    m_numPixels = numPixels;
+
+    Level & stored = m_levels[ firstStoredLevel ];
+    for ( int index = begin ; index < getLevelSize( firstStoredLevel ) ; ++index )
+    {
+        float minValue, maxValue;
+        getValuesRange( index << firstStoredLevel, juce::jmin( numPixels, ( index + 1 ) << firstStoredLevel ), minValue, maxValue );
+        stored.m_min.set( index, minValue );
+        stored.m_max.set( index, maxValue );
+    }
+
+    for ( int level = firstStoredLevel + 1 ; level < numLevels ; ++level )
+    {
+        const Level & lower = m_levels[ level - 1 ];
+        Level & upper = m_levels[ level ];
+
+        begin >>= 1;
+        const int size = getLevelSize( level );
+        const int lastLower = lower.m_min.size() - 1;
+        for ( int index = begin ; index < size ; ++index )
+        {
+            const int first = 2 * index;
+            const int second = juce::jmin( first + 1, lastLower );
+            upper.m_min.set( index, juce::jmin( lower.m_min.getUnchecked( first ), lower.m_min.getUnchecked( second ) ) );
+            upper.m_max.set( index, juce::jmax( lower.m_max.getUnchecked( first ), lower.m_max.getUnchecked( second ) ) );
+        }
+    }
+}
+
+void LufsHistoryPyramid::getValuesRange( const int begin, const int end, float & minValue, float & maxValue ) const
+{
+    const LufsHistoryArray & history = *m_history;
+    const int endValue = end * m_hopsPer100ms;
+
+    minValue = history[ begin * m_hopsPer100ms ];
+    maxValue = minValue;
+    for ( int i = begin * m_hopsPer100ms + 1 ; i < endValue ; ++i )
+    {
+        minValue = juce::jmin( minValue, history[ i ] );
+        maxValue = juce::jmax( maxValue, history[ i ] );
+    }
+}
+
+void LufsHistoryPyramid::getLevelRange( const int level, const int index, float & minValue, float & maxValue ) const
+{
+    jassert( index < getLevelSize( level ) );
+
+    if ( level < firstStoredLevel )
+    {
+        getValuesRange( index << level, juce::jmin( m_numPixels, ( index + 1 ) << level ), minValue, maxValue );
+        return;
+    }
+
+    minValue = m_levels[ level ].m_min.getUnchecked( index );
+    maxValue = m_levels[ level ].m_max.getUnchecked( index );
+}
+
+float LufsHistoryPyramid::getMin( const int level, const int index ) const
+{
+    float minValue, maxValue;
+    getLevelRange( level, index, minValue, maxValue );
+    return minValue;
+}
+
+float LufsHistoryPyramid::getMax( const int level, const int index ) const
+{
+    float minValue, maxValue;
+    getLevelRange( level, index, minValue, maxValue );
+    return maxValue;
+}
+
+void LufsHistoryPyramid::getRange( const int _begin, const int _end, float & minValue, float & maxValue ) const
+{
+    jassert( _begin < _end && _end <= m_numPixels );
+
+    // whole ranges of the first stored level, pixels before and after them
+    int begin = ( _begin + ( 1 << firstStoredLevel ) - 1 ) >> firstStoredLevel;
+    int end = _end >> firstStoredLevel;
+    if ( begin >= end )
+    {
+        getValuesRange( _begin, _end, minValue, maxValue );
+        return;
+    }
+
+    getLevelRange( firstStoredLevel, begin, minValue, maxValue );
+
+    float rangeMin, rangeMax;
+    if ( _begin < ( begin << firstStoredLevel ) )
+    {
+        getValuesRange( _begin, begin << firstStoredLevel, rangeMin, rangeMax );
+        minValue = juce::jmin( minValue, rangeMin );
+        maxValue = juce::jmax( maxValue, rangeMax );
+    }
+    if ( ( end << firstStoredLevel ) < _end )
+    {
+        getValuesRange( end << firstStoredLevel, _end, rangeMin, rangeMax );
+        minValue = juce::jmin( minValue, rangeMin );
+        maxValue = juce::jmax( maxValue, rangeMax );
+    }
+
+    // ranges [begin, end[ of each level: at most one range on each side of each level
+    int level = firstStoredLevel;
+    for ( ; level + 1 < numLevels && begin < end ; ++level, begin >>= 1, end >>= 1 )
+    {
+        if ( begin & 1 )
+        {
+            minValue = juce::jmin( minValue, m_levels[ level ].m_min.getUnchecked( begin ) );
+            maxValue = juce::jmax( maxValue, m_levels[ level ].m_max.getUnchecked( begin ) );
+            ++begin;
+        }
+        if ( end & 1 )
+        {
+            --end;
+            minValue = juce::jmin( minValue, m_levels[ level ].m_min.getUnchecked( end ) );
+            maxValue = juce::jmax( maxValue, m_levels[ level ].m_max.getUnchecked( end ) );
+        }
+    }
+
+    // ranges left at last level, after 19 days of history
+    for ( ; begin < end ; ++begin )
+    {
+        minValue = juce::jmin( minValue, m_levels[ level ].m_min.getUnchecked( begin ) );
+        maxValue = juce::jmax( maxValue, m_levels[ level ].m_max.getUnchecked( begin ) );
+    }
+}
+
+size_t LufsHistoryPyramid::getAllocatedBytes() const
+{
+    size_t bytes = 0;
+    for ( int level = firstStoredLevel ; level < numLevels ; ++level )
+        bytes += ( m_levels[ level ].m_min.size() + m_levels[ level ].m_max.size() ) * sizeof( float );
+
+    return bytes;
+}
+
+bool LufsHistoryPyramid::testRanges()
+{
+    bool success = true;
+
+    juce::Random random( 0x1770 );
+    const int hopsPer100msArray[] = { 1, 10 };
+
+    for ( int h = 0 ; h < 2 ; ++h )
+    {
+        const int hopsPer100ms = hopsPer100msArray[ h ];
+        const int validSize = 100003 * hopsPer100ms + hopsPer100ms / 2;
+
+        LufsHistoryArray history;
+        for ( int i = 0 ; i < validSize ; ++i )
+            history.set( i, -70.f + 70.f * random.nextFloat() );
+
+        // updates of 1 to a few thousand values, as history is published
+        LufsHistoryPyramid pyramid;
+        for ( int size = 0 ; size < validSize ; )
+        {
+            size = juce::jmin( validSize, size + 1 + random.nextInt( random.nextBool() ? 20 : 5000 ) );
+            pyramid.update( history, size, hopsPer100ms );
+        }
+
+        if ( pyramid.getNumPixels() != validSize / hopsPer100ms )
+        {
+            DBG( "LufsHistoryPyramid::testRanges wrong number of pixels" );
+            success = false;
+            continue;
+        }
+
+        for ( int level = 0 ; level < numLevels && success ; ++level )
+        {
+            for ( int index = 0 ; index < pyramid.getLevelSize( level ) ; ++index )
+            {
+                const int begin = ( index << level ) * hopsPer100ms;
+                const int end = juce::jmin( pyramid.getNumPixels(), ( index + 1 ) << level ) * hopsPer100ms;
+
+                float minValue = history[ begin ];
+                float maxValue = minValue;
+                for ( int i = begin + 1 ; i < end ; ++i )
+                {
+                    minValue = juce::jmin( minValue, history[ i ] );
+                    maxValue = juce::jmax( maxValue, history[ i ] );
+                }
+
+                if ( pyramid.getMin( level, index ) != minValue || pyramid.getMax( level, index ) != maxValue )
+                {
+                    DBG( juce::String( "LufsHistoryPyramid::testRanges range " ) + juce::String( index ) + " of level " + juce::String( level ) + " differs" );
+                    success = false;
+                    break;
+                }
+            }
+        }
+
+        // ranges of any pixels
+        for ( int i = 0 ; i < 100 && success ; ++i )
+        {
+            const int begin = random.nextInt( pyramid.getNumPixels() );
+            const int end = begin + 1 + random.nextInt( juce::jmin( pyramid.getNumPixels() - begin, i < 50 ? 100 : pyramid.getNumPixels() ) );
+
+            float minValue = history[ begin * hopsPer100ms ];
+            float maxValue = minValue;
+            for ( int j = begin * hopsPer100ms ; j < end * hopsPer100ms ; ++j )
+            {
+                minValue = juce::jmin( minValue, history[ j ] );
+                maxValue = juce::jmax( maxValue, history[ j ] );
+            }
+
+            float rangeMin, rangeMax;
+            pyramid.getRange( begin, end, rangeMin, rangeMax );
+            if ( rangeMin != minValue || rangeMax != maxValue )
+            {
+                DBG( juce::String( "LufsHistoryPyramid::testRanges pixels " ) + juce::String( begin ) + " " + juce::String( end ) + " differ" );
+                success = false;
+            }
+        }
+    }
+
+    return success;
+}
@@ -0,0 +1,90 @@
+/*
+  =================================================================
+
+  This file is part of the LUFS-TruePeak program.
+  Copyright (c) 2015 - Mathieu Pavageau - contact@repetito.com
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  Details of these licenses can be found at: www.gnu.org/licenses
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  =================================================================
+*/
+
+#pragma once 
+
+class LufsHistoryArray;
+
+// Min and max values of a history array over ranges of 1, 2, 4... pixels of 100 ms: level l holds 
+// ranges of 2^l pixels, so that a chart showing 2^l pixels per column reads one range per column, 
+// whatever the zoom, and min and max of any pixels are found from at most two ranges of each level. 
+// Ranges of less than 2^firstStoredLevel pixels are read from history values when asked, the other 
+// levels are stored: about 1 byte per pixel. Pixels are added as history grows, and only the ranges 
+// including them are updated. Pyramids of history arrays are kept by LufsHistoryIndex, updated by 
+// the update thread of the processor and read with its history lock held
+class LufsHistoryPyramid
+{
+public:
+
+    enum
+    {
+        numLevels = 25, // 2^24 pixels per range at last level: 19 days
+        firstStoredLevel = 4 // 16 pixels per range
+    };
+
+    LufsHistoryPyramid();
+
+    // removes all pixels, after a reset of history
+    void clear();
+
+    // adds pixels of history values published since last call, hopsPer100ms values per pixel; 
+    // history lock must be held
+    void update( const LufsHistoryArray & history, const int validSize, const int hopsPer100ms );
+
+    // number of complete pixels of 100 ms
+    inline int getNumPixels() const { return m_numPixels; }
+
+    // number of ranges of level, last one can hold less than 2^level pixels
+    inline int getLevelSize( const int level ) const { return ( m_numPixels + ( 1 << level ) - 1 ) >> level; }
+
+    // min and max of pixels [index * 2^level, ( index + 1 ) * 2^level[, for index < getLevelSize( level )
+    float getMin( const int level, const int index ) const;
+    float getMax( const int level, const int index ) const;
+
+    // min and max of pixels [begin, end[, for begin < end <= getNumPixels()
+    void getRange( const int begin, const int end, float & minValue, float & maxValue ) const;
+
+    size_t getAllocatedBytes() const;
+
+    // adds history by updates of various sizes, with 100 and 10 ms hops, and compares ranges of 
+    // all levels and random ranges of pixels with min and max of history values
+    static bool testRanges();
+
+private:
+
+    struct Level
+    {
+        juce::Array<float> m_min;
+        juce::Array<float> m_max;
+    };
+
+    // min and max of history values of pixels [begin, end[
+    void getValuesRange( const int begin, const int end, float & minValue, float & maxValue ) const;
+    // min and max of range of a level, stored or read from history
+    void getLevelRange( const int level, const int index, float & minValue, float & maxValue ) const;
+
+    Level m_levels[ numLevels ]; // from firstStoredLevel
+    const LufsHistoryArray * m_history;
+    int m_hopsPer100ms;
+    int m_numPixels;
+
+    JUCE_DECLARE_NON_COPYABLE( LufsHistoryPyramid )
+};
@@ -0,0 +1,213 @@
+/*
+  =================================================================
+
+  This file is part of the LUFS-TruePeak program.
+  Copyright (c) 2015 - Mathieu Pavageau - contact@repetito.com
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  Details of these licenses can be found at: www.gnu.org/licenses
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  =================================================================
+*/
+
+#include "AppIncsAndDefs.h"
+
+#if defined ( LUFS_TRUEPEAK_CLI )
+
+#include "LufsMeter.h"
+#include "LufsProcessor.h"
+#include "LufsHistoryIndex.h"
+
+// meter behind the C interface: processor updated after each block, as when analyzing files
+struct LufsMeter
+{
+    LufsMeter( const LufsChannelLayout & layout, const double sampleRate, const int maxBlockSize )
+        : m_processor( layout )
+        , m_interleavedBuffer( layout.getNumChannels(), maxBlockSize )
+        , m_numChannels( layout.getNumChannels() )
+        , m_maxBlockSize( maxBlockSize )
+    {
+        m_processor.prepareToPlay( sampleRate, maxBlockSize );
+        resetMaxValues();
+    }
+
+    void resetMaxValues()
+    {
+        m_scannedSize = 0;
+        m_maxMomentary = DEFAULT_MIN_VOLUME;
+        m_maxShortTerm = DEFAULT_MIN_VOLUME;
+    }
+
+    void process( juce::AudioSampleBuffer & block )
+    {
+        m_processor.processBlock( block );
+        m_processor.update();
+    }
+
+    LufsProcessor m_processor;
+    juce::AudioSampleBuffer m_interleavedBuffer; // deinterleaved samples of a block
+    const int m_numChannels;
+    const int m_maxBlockSize;
+
+    int m_scannedSize; // history values already included in max values
+    float m_maxMomentary;
+    float m_maxShortTerm;
+
+    JUCE_DECLARE_NON_COPYABLE( LufsMeter )
+};
+
+LufsMeter * lufsMeterCreate( int numChannels, double sampleRate, int maxBlockSize )
+{
+    if ( numChannels < 1 || numChannels > LUFS_METER_MAX_CHANNELS || sampleRate < 8000.0 || maxBlockSize < 1 )
+        return nullptr;
+
+    return new LufsMeter( LufsChannelLayout::getDefault( numChannels ), sampleRate, maxBlockSize );
+}
+
+LufsMeter * lufsMeterCreateWithLayout( const char * layoutName, double sampleRate, int maxBlockSize )
+{
+    LufsChannelLayout layout;
+    if ( layoutName == nullptr || !LufsChannelLayout::getNamed( juce::String( juce::CharPointer_UTF8( layoutName ) ), layout ) )
+        return nullptr;
+
+    if ( layout.getNumChannels() > LUFS_METER_MAX_CHANNELS || sampleRate < 8000.0 || maxBlockSize < 1 )
+        return nullptr;
+
+    return new LufsMeter( layout, sampleRate, maxBlockSize );
+}
+
+void lufsMeterDestroy( LufsMeter * meter )
+{
+    delete meter;
+}
+
+void lufsMeterReset( LufsMeter * meter )
+{
+    if ( meter == nullptr )
+        return;
+
+    meter->m_processor.reset();
+    meter->resetMaxValues();
+}
+
+int lufsMeterSetHop( LufsMeter * meter, int hopMilliseconds )
+{
+    if ( meter == nullptr || ( hopMilliseconds != 10 && hopMilliseconds != 25 && hopMilliseconds != 100 ) )
+        return LUFS_METER_INVALID_ARGUMENT;
+
+    meter->m_processor.setHopMilliseconds( hopMilliseconds );
+    meter->resetMaxValues();
+    return LUFS_METER_OK;
+}
+
+int lufsMeterProcessPlanar( LufsMeter * meter, const float * const * channels, int numFrames )
+{
+    if ( meter == nullptr || channels == nullptr || numFrames < 0 )
+        return LUFS_METER_INVALID_ARGUMENT;
+
+    for ( int offset = 0 ; offset < numFrames ; offset += meter->m_maxBlockSize )
+    {
+        const int size = juce::jmin( meter->m_maxBlockSize, numFrames - offset );
+
+        // processBlock doesn't write to its buffer (plugin output is its input)
+        juce::AudioSampleBuffer block( const_cast<float * const *>( channels ), meter->m_numChannels, offset, size );
+        meter->process( block );
+    }
+
+    return LUFS_METER_OK;
+}
+
+int lufsMeterProcessInterleaved( LufsMeter * meter, const float * samples, int numFrames )
+{
+    if ( meter == nullptr || samples == nullptr || numFrames < 0 )
+        return LUFS_METER_INVALID_ARGUMENT;
+
+    juce::AudioSampleBuffer & block = meter->m_interleavedBuffer;
+
+    for ( int offset = 0 ; offset < numFrames ; offset += meter->m_maxBlockSize )
+    {
+        const int size = juce::jmin( meter->m_maxBlockSize, numFrames - offset );
+
+        // last block may be shorter, allocated memory is kept
+        block.setSize( meter->m_numChannels, size, false, false, true );
+        juce::AudioDataConverters::deinterleaveSamples( samples + (size_t)offset * (size_t)meter->m_numChannels, 
+                                                        block.getArrayOfWritePointers(), size, meter->m_numChannels );
+        meter->process( block );
+    }
+
+    return LUFS_METER_OK;
+}
+
+int lufsMeterGetResults( LufsMeter * meter, LufsMeterResults * results )
+{
+    if ( meter == nullptr || results == nullptr )
+        return LUFS_METER_INVALID_ARGUMENT;
+
+    LufsProcessor & processor = meter->m_processor;
+    const LufsProcessor::Snapshot snapshot = processor.getSnapshot();
+
+    results->m_seconds = (double)snapshot.m_validSize / (double)( 10 * snapshot.m_hopsPer100ms );
+    results->m_integrated = snapshot.m_integratedVolume;
+    results->m_loudnessRangeLow = snapshot.m_rangeMin;
+    results->m_loudnessRangeHigh = snapshot.m_rangeMax;
+    results->m_truePeak = snapshot.m_maxTruePeak;
+    for ( int ch = 0 ; ch < LUFS_METER_MAX_CHANNELS ; ++ch )
+        results->m_truePeakPerChannel[ ch ] = ch < meter->m_numChannels ? processor.getTruePeakChannelMax( ch ) : DEFAULT_MIN_VOLUME;
+
+    // max values of history values computed since last call
+    for ( ; meter->m_scannedSize < snapshot.m_validSize ; ++meter->m_scannedSize )
+    {
+        meter->m_maxMomentary = juce::jmax( meter->m_maxMomentary, processor.getMomentaryVolumeArray()[ meter->m_scannedSize ] );
+        meter->m_maxShortTerm = juce::jmax( meter->m_maxShortTerm, processor.getShortTermVolumeArray()[ meter->m_scannedSize ] );
+    }
+
+    results->m_maxMomentary = meter->m_maxMomentary;
+    results->m_maxShortTerm = meter->m_maxShortTerm;
+
+    const bool measured = snapshot.m_validSize > 0;
+    results->m_momentary = measured ? processor.getMomentaryVolumeArray()[ snapshot.m_validSize - 1 ] : DEFAULT_MIN_VOLUME;
+    results->m_shortTerm = measured ? processor.getShortTermVolumeArray()[ snapshot.m_validSize - 1 ] : DEFAULT_MIN_VOLUME;
+
+    return LUFS_METER_OK;
+}
+
+int lufsMeterGetRangeResults( LufsMeter * meter, double beginSeconds, double endSeconds, LufsMeterRangeResults * results )
+{
+    if ( meter == nullptr || results == nullptr || !( beginSeconds <= endSeconds ) )
+        return LUFS_METER_INVALID_ARGUMENT;
+
+    const LufsProcessor & processor = meter->m_processor;
+    const juce::ScopedLock historyLock( processor.getHistoryLock() );
+    const LufsProcessor::Snapshot snapshot = processor.getSnapshot();
+    const LufsHistoryIndex & index = processor.getHistoryIndex();
+
+    // positions of the range within the measurement
+    const double positionsPerSecond = 10.0 * snapshot.m_hopsPer100ms;
+    const int begin = (int)juce::jlimit( 0.0, (double)snapshot.m_validSize, std::floor( beginSeconds * positionsPerSecond + 0.5 ) );
+    const int end = (int)juce::jlimit( (double)begin, (double)snapshot.m_validSize, std::floor( endSeconds * positionsPerSecond + 0.5 ) );
+
+    results->m_seconds = (double)( end - begin ) / positionsPerSecond;
+    results->m_integrated = index.getIntegratedVolume( begin, end );
+    index.getLoudnessRange( begin, end, results->m_loudnessRangeLow, results->m_loudnessRangeHigh );
+    results->m_maxMomentary = index.getMax( processor.getMomentaryVolumeArray(), begin, end );
+    results->m_maxShortTerm = index.getMax( processor.getShortTermVolumeArray(), begin, end );
+    results->m_truePeak = index.getMax( processor.getTruePeakArray(), begin, end );
+
+    return LUFS_METER_OK;
+}
+
+const char * lufsMeterGetVersion( void )
+{
+    return JucePlugin_VersionString;
+}
+
+#endif // defined ( LUFS_TRUEPEAK_CLI )
@@ -0,0 +1,127 @@
+/*
+  =================================================================
+
+  This file is part of the LUFS-TruePeak program.
+  Copyright (c) 2015 - Mathieu Pavageau - contact@repetito.com
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  Details of these licenses can be found at: www.gnu.org/licenses
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  =================================================================
+*/
+
+#pragma once 
+
+/**
+    Loudness meter library: C interface to LufsProcessor, to embed measurement in other programs. 
+
+    This header doesn't need JUCE, and the library is built without GUI, audio device or plugin code
+    (LUFSTruePeak_Core static library and LUFSTruePeak_CoreShared shared library, see LUFSTruePeak_Cli.lua).
+    A meter isn't thread safe: calls for the same meter must not overlap, different meters are independent.
+
+    Usage:
+        LufsMeter * meter = lufsMeterCreate( 2, 48000.0, 4096 );
+        lufsMeterProcessInterleaved( meter, samples, numFrames ); // as many times as needed
+        LufsMeterResults results;
+        lufsMeterGetResults( meter, &results );
+        lufsMeterDestroy( meter );
+*/
+
+#if defined ( _WIN32 )
+ #if defined ( LUFS_METER_BUILDING_SHARED )
+  #define LUFS_METER_API __declspec( dllexport )
+ #elif defined ( LUFS_METER_USING_SHARED )
+  #define LUFS_METER_API __declspec( dllimport )
+ #else
+  #define LUFS_METER_API
+ #endif
+#else
+ #define LUFS_METER_API __attribute__(( visibility( "default" ) ))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// channels are weighted as recommended by BS.1770 for the usual layout of their count (L R C Lfe Ls Rs 
+// for 6 channels, 7.1.4 for 12, 9.1.6 for 16, see LufsChannelLayout), or for a named layout
+#define LUFS_METER_MAX_CHANNELS 24
+
+typedef struct LufsMeter LufsMeter;
+
+typedef enum LufsMeterError
+{
+    LUFS_METER_OK = 0,
+    LUFS_METER_INVALID_ARGUMENT = -1
+} LufsMeterError;
+
+// volumes are in LUFS (-100 when not measured yet), true peaks in dBTP
+typedef struct LufsMeterResults
+{
+    double m_seconds; // duration measured since creation or reset
+    float m_momentary; // last momentary volume (400 ms)
+    float m_shortTerm; // last short term volume (3 s)
+    float m_integrated;
+    float m_loudnessRangeLow; // loudness range is high - low, in LU
+    float m_loudnessRangeHigh;
+    float m_maxMomentary;
+    float m_maxShortTerm;
+    float m_truePeak; // max of all channels
+    float m_truePeakPerChannel[ LUFS_METER_MAX_CHANNELS ];
+} LufsMeterResults;
+
+// measures of a part of the measurement, as if only this part had been measured
+typedef struct LufsMeterRangeResults
+{
+    double m_seconds; // duration of the part, within the measurement
+    float m_integrated;
+    float m_loudnessRangeLow;
+    float m_loudnessRangeHigh;
+    float m_maxMomentary;
+    float m_maxShortTerm;
+    float m_truePeak; // max of all channels
+} LufsMeterRangeResults;
+
+// returns nullptr if numChannels isn't 1 to LUFS_METER_MAX_CHANNELS, sample rate is below 8 kHz or maxBlockSize is below 1.
+// Longer blocks can be processed, they are split into maxBlockSize blocks
+LUFS_METER_API LufsMeter * lufsMeterCreate( int numChannels, double sampleRate, int maxBlockSize );
+
+// same as lufsMeterCreate for the channels of a layout: "mono", "stereo", "3.0", "quad", "5.0", "5.1", 
+// "7.1", "7.1.4" or "9.1.6"; returns nullptr if layout name is unknown
+LUFS_METER_API LufsMeter * lufsMeterCreateWithLayout( const char * layoutName, double sampleRate, int maxBlockSize );
+
+LUFS_METER_API void lufsMeterDestroy( LufsMeter * meter );
+
+// measurement starts again
+LUFS_METER_API void lufsMeterReset( LufsMeter * meter );
+
+// hop between momentary and short term values: 10, 25 or 100 ms (default), measurement starts again
+LUFS_METER_API int lufsMeterSetHop( LufsMeter * meter, int hopMilliseconds );
+
+// channels[ ch ][ i ] is sample i of channel ch, samples are read only
+LUFS_METER_API int lufsMeterProcessPlanar( LufsMeter * meter, const float * const * channels, int numFrames );
+
+// samples[ i * numChannels + ch ] is sample i of channel ch
+LUFS_METER_API int lufsMeterProcessInterleaved( LufsMeter * meter, const float * samples, int numFrames );
+
+LUFS_METER_API int lufsMeterGetResults( LufsMeter * meter, LufsMeterResults * results );
+
+// results of the measurement from beginSeconds to endSeconds since creation or reset, read from 
+// an index of the measurement in about the same time whatever its length
+LUFS_METER_API int lufsMeterGetRangeResults( LufsMeter * meter, double beginSeconds, double endSeconds, LufsMeterRangeResults * results );
+
+// version of the program the library was built with, such as "1.1.3"
+LUFS_METER_API const char * lufsMeterGetVersion( void );
+
+#ifdef __cplusplus
+}
+#endif
@@ -19,11 +19,14 @@
   =================================================================
 */
 
+#include <thread>
+
 #include "AppIncsAndDefs.h"
 
 #include "LufsProcessor.h"
-
-#define LUFS_PROCESSOR_NB_MEMORY_VALUES 4
+#include "LufsHistoryIndex.h"
+#include "LufsSessionLog.h"
+#include "AudioStreamReader.h"
 
 void DEBUGPLUGIN_output( const char * _text, ...);
 
@@ -50,25 +53,22 @@ float LufsProcessor::testTruePeak(const juce::File & input , const double sample
 
     if ( reader != nullptr )
     {
-        // read file
-        juce::AudioSampleBuffer buffer( (int)reader->numChannels, (int)reader->lengthInSamples );
-        reader->read( &buffer, 0, (int)reader->lengthInSamples, 0, true, true );
-
         LufsProcessor processor(reader->numChannels);
         processor.prepareToPlay(sampleRate, bufferSize);
 
-        int offset = 0;
-        while (offset + bufferSize < (int)reader->lengthInSamples)
         {
-            juce::AudioSampleBuffer calcBuffer( buffer.getArrayOfWritePointers(), reader->numChannels, offset, bufferSize );
-
-            processor.processBlock(calcBuffer);
-            offset += bufferSize;
-
-            for (int i = 0 ; i < calcBuffer.getNumChannels() ; ++i)
+            // read file by bufferSize chunks
+            AudioStreamReader streamReader( *reader, bufferSize );
+            while ( juce::AudioSampleBuffer * chunk = streamReader.readNextChunk() )
             {
-                if (truePeakDecibelValue < processor.getTruePeakChannelMax(i))
-                    truePeakDecibelValue = processor.getTruePeakChannelMax(i);
+                processor.processBlock( *chunk );
+                processor.update();
+
+                for (int i = 0 ; i < chunk->getNumChannels() ; ++i)
+                {
+                    if (truePeakDecibelValue < processor.getTruePeakChannelMax(i))
+                        truePeakDecibelValue = processor.getTruePeakChannelMax(i);
+                }
             }
         }
 
@@ -78,100 +78,689 @@ float LufsProcessor::testTruePeak(const juce::File & input , const double sample
     return truePeakDecibelValue;
 }
 
-LufsProcessor::LufsProcessor( const int nbChannels )
-    : m_block( nbChannels, 0 )
-    , m_volumeMemory( nbChannels, 0 )
-    , m_truePeakMemory( nbChannels, 0 )
-    , m_sampleRate( 0.0 )
-    , m_nbChannels( nbChannels )
-    , m_maxSize( 0 )
-    , m_processSize( 0 )
-    , m_validSize( 0 )
-    , m_memorySize( 0 )
-    , m_sampleSize100ms( 0 ) 
-    , m_squaredInputArray( NULL )
-    , m_momentaryVolumeArray( NULL )
-    , m_shortTermVolumeArray( NULL )
-    , m_integratedVolumeArray( NULL )
-    , m_truePeakArray( NULL )
-    , m_tempBlock( 1, 4096 )
-    , m_paused( false )
+bool LufsProcessor::testGating()
 {
-    DEBUGPLUGIN_output("LufsProcessor::LufsProcessor %d channels", nbChannels);
+    juce::Random random( 0x1770 );
+    bool success = true;
+
+    for ( int test = 0 ; test < 20 ; ++test )
+    {
+        LufsHistogram histogram;
+        LufsFloatArray sortedArray;
+
+        // program alternating loud and quiet parts, and silence
+        const int numBlocks = 100 + random.nextInt( 20000 );
+        for ( int i = 0 ; i < numBlocks ; ++i )
+        {
+            const float part = ( ( i / 500 ) % 3 == 0 ) ? -40.f : -20.f;
+            const float volume = part + 15.f * random.nextFloat();
+            const float sum = getLufsSum( volume );
+
+            histogram.addLufs( sum );
+            sortedArray.addLufs( sum );
+        }
+
+        // exact integrated volume, summed in double
+        double absoluteSum = 0.0;
+        for ( int i = 0 ; i < sortedArray.size() ; ++i )
+            absoluteSum += sortedArray.getUnchecked( i );
+        absoluteSum /= sortedArray.size();
+
+        const float thresholdSum = getLufsSum( getLufsVolume( (float)absoluteSum ) - 10.f );
+
+        double relativeSum = 0.0;
+        int count = 0;
+        for ( int i = 0 ; i < sortedArray.size() ; ++i )
+        {
+            if ( sortedArray.getUnchecked( i ) > thresholdSum )
+            {
+                relativeSum += sortedArray.getUnchecked( i );
+                ++count;
+            }
+        }
+
+        const float exactVolume = getLufsVolume( float( relativeSum / count ) );
+        const float histogramVolume = getIntegratedVolume( histogram );
+
+        if ( fabs( exactVolume - histogramVolume ) >= 0.01f )
+        {
+            DBG( juce::String( "LufsProcessor::testGating integrated " ) + juce::String( histogramVolume, 4 ) + " instead of " + juce::String( exactVolume, 4 ) );
+            success = false;
+        }
+    }
+
+    return success;
+}
+
+bool LufsProcessor::testLoudnessRange()
+{
+    juce::Random random( 0x3342 );
+    bool success = true;
+
+    for ( int test = 0 ; test < 20 ; ++test )
+    {
+        LufsHistogram histogram;
+        LufsFloatArray sortedArray;
+
+        // short term volumes slowly moving between parts of different levels
+        const int numBlocks = 100 + random.nextInt( 20000 );
+        float volume = -23.f;
+        for ( int i = 0 ; i < numBlocks ; ++i )
+        {
+            const float part = ( ( i / 1000 ) % 4 == 0 ) ? -45.f : -18.f;
+            volume += 0.05f * ( part - volume ) + 0.5f * ( random.nextFloat() - 0.5f );
+            const float sum = getLufsSum( volume );
+
+            histogram.addLufs( sum );
+            sortedArray.addLufs( sum );
+        }
+
+        // exact range, as previously computed from sorted blocks
+        double absoluteSum = 0.0;
+        for ( int i = 0 ; i < sortedArray.size() ; ++i )
+            absoluteSum += sortedArray.getUnchecked( i );
+        absoluteSum /= sortedArray.size();
+
+        const float thresholdSum = getLufsSum( getLufsVolume( (float)absoluteSum ) - 20.f );
+        const int index = sortedArray.findIndexAfterValue( thresholdSum );
+        const float exactMin = getLufsVolume( sortedArray.getPercentileValue( index, 0.1f ) );
+        const float exactMax = getLufsVolume( sortedArray.getPercentileValue( index, 0.95f ) );
+
+        float histogramMin, histogramMax;
+        getLoudnessRange( histogram, histogramMin, histogramMax );
+
+        if ( fabs( exactMin - histogramMin ) >= 0.01f || fabs( exactMax - histogramMax ) >= 0.01f )
+        {
+            DBG( juce::String( "LufsProcessor::testLoudnessRange " ) + juce::String( histogramMin, 4 ) + " " + juce::String( histogramMax, 4 ) 
+                + " instead of " + juce::String( exactMin, 4 ) + " " + juce::String( exactMax, 4 ) );
+            success = false;
+        }
+    }
+
+    return success;
+}
+
+bool LufsProcessor::testRecordFifo()
+{
+    bool success = true;
+
+    // fifo: every record is received once, in order, or counted as dropped
+    {
+        const int numRecords = 200000;
+        const int numChannels = 16;
+        LufsRecordFifo fifo( 64, numChannels );
+        std::atomic<bool> producing( true );
+
+        std::thread producer( [&]()
+        {
+            for ( int i = 0 ; i < numRecords ; ++i )
+            {
+                LufsRecord record;
+                float truePeaks[ numChannels ];
+                record.m_squaredInput = (float)i;
+                for ( int ch = 0 ; ch < numChannels ; ++ch )
+                    truePeaks[ ch ] = (float)( i + ch );
+                record.m_numChannels = numChannels;
+                record.m_generation = i;
+
+                fifo.push( record, truePeaks );
+            }
+
+            producing = false;
+        } );
+
+        int numReceived = 0;
+        int lastIndex = -1;
+        LufsRecord record;
+        float truePeaks[ numChannels ];
+        for ( ;; )
+        {
+            // producer state is read before popping, so that no record is missed after it has finished
+            const bool wasProducing = producing;
+
+            if ( !fifo.pop( record, truePeaks ) )
+            {
+                if ( !wasProducing )
+                    break;
 
-    for ( int i = 0 ; i < nbChannels ; ++i )
+                std::this_thread::yield();
+                continue;
+            }
+
+            bool valid = record.m_generation > lastIndex && record.m_squaredInput == (float)record.m_generation;
+            for ( int ch = 0 ; ch < numChannels ; ++ch )
+                valid = valid && truePeaks[ ch ] == (float)( record.m_generation + ch );
+
+            if ( !valid )
+            {
+                DBG( juce::String( "LufsProcessor::testRecordFifo invalid record " ) + juce::String( record.m_generation ) + " after " + juce::String( lastIndex ) );
+                success = false;
+            }
+
+            lastIndex = record.m_generation;
+            ++numReceived;
+        }
+
+        producer.join();
+
+        if ( numReceived + fifo.getNumDropped() != numRecords )
+        {
+            DBG( juce::String( "LufsProcessor::testRecordFifo " ) + juce::String( numReceived ) + " records received, " 
+                + juce::String( fifo.getNumDropped() ) + " dropped, instead of " + juce::String( numRecords ) );
+            success = false;
+        }
+    }
+
+    // processor: update and reset while audio thread is processing
     {
-        m_shelveFilterArray.add( BiquadProcessor() );
-        m_highPassFilterArray.add( BiquadProcessor() );
+        const double sampleRate = 48000.0;
+        const int bufferSize = 480;
+
+        juce::AudioSampleBuffer block( 2, bufferSize );
+        juce::Random random( 0x1770 );
+        for ( int ch = 0 ; ch < block.getNumChannels() ; ++ch )
+        {
+            for ( int i = 0 ; i < bufferSize ; ++i )
+                block.getWritePointer( ch )[ i ] = 0.25f * ( 2.f * random.nextFloat() - 1.f );
+        }
+
+        LufsProcessor processor( LUFS_TP_MAX_NB_CHANNELS );
+        processor.prepareToPlay( sampleRate, bufferSize );
+
+        std::atomic<bool> processing( true );
+        std::thread audioThread( [&]()
+        {
+            for ( int i = 0 ; i < 20000 ; ++i )
+                processor.processBlock( block );
+
+            processing = false;
+        } );
+
+        for ( int i = 0 ; processing ; ++i )
+        {
+            processor.update();
+            if ( i % 100 == 99 )
+                processor.reset();
+
+            std::this_thread::yield();
+        }
+
+        audioThread.join();
+
+        // after a reset, exactly one record per 100 ms is received
+        processor.update();
+        processor.reset();
+
+        const int numBlocks = 1000;
+        std::thread( [&]()
+        {
+            for ( int i = 0 ; i < numBlocks ; ++i )
+                processor.processBlock( block );
+        } ).join();
+
+        processor.update();
+
+        const int expectedSize = numBlocks * bufferSize / (int)( sampleRate / 10.0 );
+        if ( processor.getValidSize() != expectedSize )
+        {
+            DBG( juce::String( "LufsProcessor::testRecordFifo " ) + juce::String( processor.getValidSize() ) + " values instead of " + juce::String( expectedSize ) );
+            success = false;
+        }
+    }
+
+    return success;
+}
+
+bool LufsProcessor::testWindowMeans()
+{
+    // 10 hours of 100 ms values, alternating loud parts and near silence
+    const int numValues = 360000;
+    LufsHistoryArray values;
+    juce::Random random( 0x3600 );
+    for ( int i = 0 ; i < numValues ; ++i )
+    {
+        const float level = ( ( i / 3000 ) % 2 == 0 ) ? 1.f : 1e-10f;
+        values.set( i, level * ( 0.5f + random.nextFloat() ) );
     }
 
-    m_maxSize = 256 * 1024; // more than 7 hours
-    jassert( m_maxSize * 4 < 0x80000000 );
-    m_squaredInputArray = (float*)malloc( m_maxSize * sizeof( float ) );
-    m_momentaryVolumeArray = (float*)malloc( m_maxSize * sizeof( float ) );
-    m_shortTermVolumeArray = (float*)malloc( m_maxSize * sizeof( float ) );
-    m_integratedVolumeArray = (float*)malloc( m_maxSize * sizeof( float ) );
-    m_truePeakArray = (float*)malloc( m_maxSize * sizeof( float ) );
+    // window means computed by batches of random sizes, as update does
+    juce::HeapBlock<float> means( batchSize );
+    LufsRunningSum runningSum;
+    double maxError = 0.0;
 
-    m_memArray = (float**)malloc( nbChannels * sizeof( float* ) );
+    for ( int begin = 0 ; begin < numValues ; )
+    {
+        const int end = juce::jmin( numValues, begin + 1 + random.nextInt( batchSize ) );
+        getWindowMeans( values, begin, end, shortTermBlocks, runningSum, means );
+
+        for ( int position = juce::jmax( begin, (int)shortTermBlocks ) ; position < end ; ++position )
+        {
+            double exactSum = 0.0;
+            for ( int i = position - shortTermBlocks ; i < position ; ++i )
+                exactSum += values[ i ];
+
+            const double exactMean = exactSum / shortTermBlocks;
+            maxError = juce::jmax( maxError, fabs( means[ position - begin ] - exactMean ) / exactMean );
+        }
+
+        begin = end;
+    }
 
-    for ( int i = 0 ; i < nbChannels ; ++i )
+    // means are floats
+    if ( maxError > 1e-6 )
     {
-        m_memArray[ i ] = (float*)malloc( LUFS_PROCESSOR_NB_MEMORY_VALUES * sizeof( float ) );
-        memset( m_memArray[ i ], 0, LUFS_PROCESSOR_NB_MEMORY_VALUES * sizeof( float ) );
+        DBG( juce::String( "LufsProcessor::testWindowMeans relative error " ) + juce::String( maxError ) );
+        return false;
+    }
+
+    return true;
+}
 
-        m_truePeakPerChannelArray[ i ] = (float*)malloc( m_maxSize * sizeof( float ) );
-        memset( m_truePeakPerChannelArray[ i ], 0, m_maxSize * sizeof( float ) );
+bool LufsProcessor::testHops()
+{
+    // one minute of noise with level changing every 100 ms, 48 kHz so that hops are the same size
+    const double sampleRate = 48000.0;
+    const int numChannels = 2;
+    const int bufferSize = 512;
+    juce::AudioSampleBuffer signal( numChannels, 60 * (int)sampleRate );
+    juce::Random random( 0x4100 );
+    for ( int i = 0 ; i < signal.getNumSamples() ; i += 4800 )
+    {
+        const float level = 0.001f + 0.3f * random.nextFloat();
+        for ( int ch = 0 ; ch < numChannels ; ++ch )
+        {
+            float * data = signal.getWritePointer( ch, i );
+            for ( int j = 0 ; j < 4800 ; ++j )
+                data[ j ] = level * ( 2.f * random.nextFloat() - 1.f );
+        }
     }
-    memset( m_maxLinArray, 0, nbChannels * sizeof( float ) );
 
-    memset( m_truePeakMaxPerChannelArray, 0, nbChannels * sizeof( float ) );
+    const int hopMillisecondsArray[3] = { 100, 25, 10 };
+    juce::OwnedArray<LufsProcessor> processors;
+    for ( int hop = 0 ; hop < 3 ; ++hop )
+    {
+        LufsProcessor * processor = processors.add( new LufsProcessor( numChannels ) );
+        processor->prepareToPlay( sampleRate, bufferSize );
+        processor->setHopMilliseconds( hopMillisecondsArray[ hop ] );
+
+        juce::AudioSampleBuffer block( numChannels, bufferSize );
+        for ( int offset = 0 ; offset + bufferSize <= signal.getNumSamples() ; offset += bufferSize )
+        {
+            for ( int ch = 0 ; ch < numChannels ; ++ch )
+                block.copyFrom( ch, 0, signal, ch, offset, bufferSize );
+            processor->processBlock( block );
 
+            // records are consumed before fifo is full
+            if ( ( offset / bufferSize ) % 100 == 0 )
+                processor->update();
+        }
+        processor->update();
+    }
+
+    bool success = true;
+    const LufsProcessor & reference = *processors[0];
+    for ( int hop = 1 ; hop < 3 ; ++hop )
+    {
+        const LufsProcessor & processor = *processors[ hop ];
+        const int hopsPer100ms = 100 / hopMillisecondsArray[ hop ];
+
+        if ( processor.getValidSize() != reference.getValidSize() * hopsPer100ms 
+            || fabs( processor.getIntegratedVolume() - reference.getIntegratedVolume() ) >= 0.01f
+            || fabs( processor.getRangeMinVolume() - reference.getRangeMinVolume() ) >= 0.01f
+            || fabs( processor.getRangeMaxVolume() - reference.getRangeMaxVolume() ) >= 0.01f )
+        {
+            DBG( juce::String( "LufsProcessor::testHops integrated or range differ for hop " ) + juce::String( hopMillisecondsArray[ hop ] ) );
+            success = false;
+        }
+
+        // windows ending at 100 ms boundaries are the same whatever the hop
+        for ( int position = 0 ; success && position < reference.getValidSize() ; ++position )
+        {
+            const int hopPosition = position * hopsPer100ms;
+            if ( fabs( processor.getMomentaryVolumeArray()[ hopPosition ] - reference.getMomentaryVolumeArray()[ position ] ) >= 0.01f
+                || fabs( processor.getShortTermVolumeArray()[ hopPosition ] - reference.getShortTermVolumeArray()[ position ] ) >= 0.01f )
+            {
+                DBG( juce::String( "LufsProcessor::testHops momentary or short term differ for hop " ) + juce::String( hopMillisecondsArray[ hop ] ) + " at " + juce::String( position ) );
+                success = false;
+            }
+        }
+    }
+
+    return success;
+}
+
+bool LufsProcessor::testChannelLayouts()
+{
+    // stationary noise with a different level per channel: gating keeps every block, so that integrated 
+    // volume is the weighted sum of the integrated volumes of each channel measured alone
+    const double sampleRate = 48000.0;
+    const int bufferSize = 480;
+    const int numBlocks = 500; // 5 s
+
+    // named layouts, then the default layout of a count without name
+    const juce::StringArray names = LufsChannelLayout::getNames();
+
+    bool success = true;
+    juce::Random random( 0x1774 );
+
+    for ( int l = 0 ; l <= names.size() ; ++l )
+    {
+        LufsChannelLayout layout = LufsChannelLayout::getDefault( 24 );
+        if ( l < names.size() )
+            LufsChannelLayout::getNamed( names[ l ], layout );
+        const int numChannels = layout.getNumChannels();
+
+        // odd layouts are set on a stereo processor, as the plugin does for the channels of its bus
+        LufsProcessor processor( ( l % 2 ) == 0 ? layout : LufsChannelLayout::getDefault( 2 ) );
+        if ( ( l % 2 ) != 0 )
+            processor.setChannelLayout( layout );
+        processor.prepareToPlay( sampleRate, bufferSize );
+
+        juce::OwnedArray<LufsProcessor> channelProcessors;
+        for ( int ch = 0 ; ch < numChannels ; ++ch )
+        {
+            LufsProcessor * channelProcessor = channelProcessors.add( new LufsProcessor( 1 ) );
+            channelProcessor->prepareToPlay( sampleRate, bufferSize );
+        }
+
+        juce::AudioSampleBuffer block( numChannels, bufferSize );
+        for ( int b = 0 ; b < numBlocks ; ++b )
+        {
+            for ( int ch = 0 ; ch < numChannels ; ++ch )
+            {
+                const float level = 0.02f + 0.6f * (float)ch / (float)numChannels;
+                float * data = block.getWritePointer( ch );
+                for ( int i = 0 ; i < bufferSize ; ++i )
+                    data[ i ] = level * ( 2.f * random.nextFloat() - 1.f );
+
+                juce::AudioSampleBuffer channelBlock( block.getArrayOfWritePointers() + ch, 1, bufferSize );
+                channelProcessors[ ch ]->processBlock( channelBlock );
+            }
+
+            processor.processBlock( block );
+
+            // records are consumed before fifo is full
+            if ( ( b % 100 ) == 99 )
+            {
+                processor.update();
+                for ( int ch = 0 ; ch < numChannels ; ++ch )
+                    channelProcessors[ ch ]->update();
+            }
+        }
+
+        double weightedSum = 0.0;
+        bool truePeaksDiffer = false;
+        for ( int ch = 0 ; ch < numChannels ; ++ch )
+        {
+            const LufsProcessor & channelProcessor = *channelProcessors[ ch ];
+            weightedSum += layout.getWeight( ch ) * getLufsSum( channelProcessor.getIntegratedVolume() );
+
+            if ( fabs( processor.getTruePeakChannelMax( ch ) - channelProcessor.getTruePeakChannelMax( 0 ) ) >= 0.01f )
+                truePeaksDiffer = true;
+        }
+
+        const float expectedVolume = getLufsVolume( (float)weightedSum );
+        if ( truePeaksDiffer || fabs( processor.getIntegratedVolume() - expectedVolume ) >= 0.01f )
+        {
+            DBG( juce::String( "LufsProcessor::testChannelLayouts " ) + layout.getName() + " integrated " + juce::String( processor.getIntegratedVolume(), 3 ) 
+                + " instead of " + juce::String( expectedVolume, 3 ) + ( truePeaksDiffer ? ", true peaks differ" : "" ) );
+            success = false;
+        }
+    }
+
+    return success;
+}
+
+void LufsProcessor::makeRandomRecords( juce::Random & random, const int numRecords, const int numChannels, const int hopsPer100ms, 
+                                       juce::Array<LufsRecord> & records, juce::Array<float> & truePeaks )
+{
+    for ( int i = 0 ; i < numRecords ; ++i )
+    {
+        const double level = -40.0 + 30.0 * sin( (double)i / ( 3000.0 * hopsPer100ms ) );
+        LufsRecord record;
+        record.m_squaredInput = (float)juce::Decibels::decibelsToGain( level + 20.0 * random.nextDouble() );
+        record.m_numChannels = numChannels;
+        record.m_generation = 0;
+        records.add( record );
+        for ( int ch = 0 ; ch < numChannels ; ++ch )
+            truePeaks.add( juce::Decibels::decibelsToGain( (float)level + 30.f * random.nextFloat() ) );
+    }
+}
+
+void LufsProcessor::updateInRandomSizes( LufsProcessor & processor, const juce::Array<LufsRecord> & records, const juce::Array<float> & truePeaks, 
+                                         juce::Random & random, const int maxUpdateSize )
+{
+    const int numChannels = processor.getNumChannels();
+    for ( int begin = 0 ; begin < records.size() ; )
+    {
+        const int size = juce::jmin( records.size() - begin, 1 + random.nextInt( maxUpdateSize ) );
+        processor.update( records.begin() + begin, truePeaks.begin() + numChannels * begin, size );
+        begin += size;
+    }
+}
+
+bool LufsProcessor::testKWeighting()
+{
+    bool success = true;
+
+    const double sampleRates[] = { 44100.0, 48000.0, 96000.0, 192000.0 };
+    for ( int i = 0 ; i < 4 ; ++i )
+    {
+        BiquadProcessor shelve;
+        shelve.setFilterParams( (float)sampleRates[ i ], BiquadProcessor::HighShelf, 1500.f, 0.5f, 4.f );
+        BiquadProcessor highPass;
+        highPass.setFilterParams( (float)sampleRates[ i ], BiquadProcessor::HighPass, 60.f, 0.5f, 0.f );
+
+        if ( !AudioProcessing::TestKWeightingKernels( shelve.getCoefficients(), highPass.getCoefficients() ) )
+        {
+            DBG( juce::String( "LufsProcessor::testKWeighting failed at " ) + juce::String( sampleRates[ i ] ) );
+            success = false;
+        }
+    }
+
+    return success;
+}
+
+double LufsProcessor::testProcessBlockSpeed( const double sampleRate, const int numChannels, const int bufferSize, const int seconds )
+{
+    // one second of synthetic signal: noise with level changing every 100 ms, then processed as a loop
+    juce::AudioSampleBuffer signal( numChannels, (int)sampleRate );
+    juce::Random random( 0x1770 );
+    for ( int ch = 0 ; ch < numChannels ; ++ch )
+    {
+        float * data = signal.getWritePointer( ch );
+        for ( int i = 0 ; i < signal.getNumSamples() ; ++i )
+        {
+            const float level = 0.1f + 0.08f * (float)( ( i * 10 ) / signal.getNumSamples() );
+            data[ i ] = level * ( 2.f * random.nextFloat() - 1.f );
+        }
+    }
+
+    LufsProcessor processor( numChannels );
+    processor.prepareToPlay( sampleRate, bufferSize );
+
+    juce::AudioSampleBuffer block( numChannels, bufferSize );
+    const juce::int64 numSamples = (juce::int64)seconds * signal.getNumSamples();
+
+    juce::int64 processTicks = 0;
+    for ( juce::int64 offset = 0 ; offset + bufferSize <= numSamples ; offset += bufferSize )
+    {
+        // block copy isn't measured
+        for ( int i = 0 ; i < bufferSize ; ++i )
+        {
+            const int signalIndex = int( ( offset + i ) % signal.getNumSamples() );
+            for ( int ch = 0 ; ch < numChannels ; ++ch )
+                block.getWritePointer( ch )[ i ] = signal.getReadPointer( ch )[ signalIndex ];
+        }
+
+        const juce::int64 ticks = juce::Time::getHighResolutionTicks();
+        processor.processBlock( block );
+        processTicks += juce::Time::getHighResolutionTicks() - ticks;
+    }
+
+    return 1000.0 * juce::Time::highResolutionTicksToSeconds( processTicks ) / (double)seconds;
+}
+
+double LufsProcessor::testSilenceSpeed( const double sampleRate, const int numChannels, const int bufferSize, const int seconds, const bool denormalProtection )
+{
+    LufsProcessor processor( numChannels );
+    processor.prepareToPlay( sampleRate, bufferSize );
+    processor.setDenormalProtection( denormalProtection );
+
+    // noise level decreases by about 1500 dB in one second: samples go through denormal values before being zero
+    const int fadeBegin = (int)sampleRate;
+    const double fadeFactor = pow( 10.0, -1500.0 / 20.0 / sampleRate );
+    double level = 0.3;
+
+    juce::AudioSampleBuffer block( numChannels, bufferSize );
+    juce::Random random( 0x1770 );
+    const juce::int64 numSamples = (juce::int64)seconds * (juce::int64)sampleRate;
+
+    juce::int64 processTicks = 0;
+    for ( juce::int64 offset = 0 ; offset + bufferSize <= numSamples ; offset += bufferSize )
+    {
+        // block computation isn't measured
+        for ( int i = 0 ; i < bufferSize ; ++i )
+        {
+            if ( offset + i >= fadeBegin )
+                level *= fadeFactor;
+
+            for ( int ch = 0 ; ch < numChannels ; ++ch )
+                block.getWritePointer( ch )[ i ] = (float)( level * ( 2.0 * random.nextDouble() - 1.0 ) );
+        }
+
+        const juce::int64 ticks = juce::Time::getHighResolutionTicks();
+        processor.processBlock( block );
+        processTicks += juce::Time::getHighResolutionTicks() - ticks;
+
+        // records are consumed before fifo is full
+        processor.update();
+    }
+
+    return 1000.0 * juce::Time::highResolutionTicksToSeconds( processTicks ) / (double)seconds;
+}
+
+LufsProcessor::LufsProcessor( const int nbChannels )
+    : LufsProcessor( LufsChannelLayout::getDefault( nbChannels ) )
+{
+}
+
+LufsProcessor::LufsProcessor( const LufsChannelLayout & layout )
+    : m_block( layout.getNumChannels(), 0 )
+    , m_sampleRate( 0.0 )
+    , m_channelLayout( layout )
+    , m_nbChannels( layout.getNumChannels() )
+    , m_kWeightingFilterBank( layout.getNumChannels() )
+    , m_processSize( 0 )
+    , m_validSize( 0 )
+    , m_sampleSize100ms( 0 ) 
+    , m_segmentSize( 0 )
+    , m_segmentSquaredSum( 0.0 )
+    , m_hopIndex( 0 )
+    , m_processHopsPer100ms( 1 )
+    , m_hopsPer100ms( 1 )
+    , m_generation( 0 )
+    , m_processGeneration( 0 )
+    , m_hopMilliseconds( 100 )
+    , m_batchBuffer( 4 * batchSize )
+    , m_denormalProtection( true )
+    , m_paused( false )
+    , m_sessionLog( nullptr )
+{
+    DEBUGPLUGIN_output("LufsProcessor::LufsProcessor %d channels", m_nbChannels);
+
+    allocateChannels();
     reset();
 }
 
 LufsProcessor::~LufsProcessor()
 {
     DEBUGPLUGIN_output("LufsProcessor::~LufsProcessor");
+}
+
+void LufsProcessor::allocateChannels()
+{
+    m_truePeakMaxPerChannelArray.malloc( (size_t)m_nbChannels );
+    m_snapshotTruePeakMaxPerChannelArray.malloc( (size_t)m_nbChannels );
+    m_poppedTruePeaks.malloc( (size_t)m_nbChannels );
+    m_recordTruePeakVolumes.malloc( (size_t)m_nbChannels );
+
+    // sized for the shortest hop, as hop changes while processing
+    m_recordFifo = new LufsRecordFifo( recordFifoSeconds * 100, m_nbChannels );
+
+    // the audio thread processes at most m_nbChannels channels
+    m_truePeakProcessor.prepare( m_nbChannels );
+
+    m_truePeakPerChannelArray.clear();
+    for ( int ch = 0 ; ch < m_nbChannels ; ++ch )
+        m_truePeakPerChannelArray.add( new LufsHistoryArray() );
+
+    m_historyIndex = new LufsHistoryIndex( m_momentaryVolumeArray, m_shortTermVolumeArray );
+    m_historyIndex->addArray( m_momentaryVolumeArray );
+    m_historyIndex->addArray( m_shortTermVolumeArray );
+    m_historyIndex->addArray( m_integratedVolumeArray );
+    m_historyIndex->addArray( m_truePeakArray );
+    for ( int ch = 0 ; ch < m_nbChannels ; ++ch )
+        m_historyIndex->addArray( *m_truePeakPerChannelArray[ ch ] );
+}
 
-    free( m_squaredInputArray );
-    free( m_momentaryVolumeArray );
-    free( m_shortTermVolumeArray );
-    free( m_integratedVolumeArray );
-    free( m_truePeakArray );
+void LufsProcessor::setChannelLayout( const LufsChannelLayout & layout )
+{
+    DEBUGPLUGIN_output("LufsProcessor::setChannelLayout %d channels", layout.getNumChannels());
 
-    for ( int i = 0 ; i < m_nbChannels ; ++i )
-    {
-        free( m_memArray[ i ] );
-        free( m_truePeakPerChannelArray[ i ] );
-    }
-    free( m_memArray );
+    jassert( m_sessionLog == nullptr );
+
+    const juce::ScopedLock historyLock( m_historyLock );
+
+    m_channelLayout = layout;
+    m_nbChannels = layout.getNumChannels();
+    m_kWeightingFilterBank.setNumChannels( m_nbChannels );
+    m_block.setSize( m_nbChannels, m_block.getNumSamples() );
+
+    allocateChannels();
+    reset();
 }
 
 void LufsProcessor::reset()
 {
     DEBUGPLUGIN_output("LufsProcessor::reset");
 
-    const juce::SpinLock::ScopedLockType scopedLock( m_locker );
+    const juce::ScopedLock historyLock( m_historyLock );
+
+    // audio thread resets its processing state at next block, 
+    // records still in fifo are dropped by update 
+    m_generation.fetch_add( 1, std::memory_order_release );
 
     m_processSize = 0;
     m_validSize = 0;
-    m_memorySize = 0;
 
     m_integratedVolume = DEFAULT_MIN_VOLUME;
     m_rangeMin = DEFAULT_MIN_VOLUME;
     m_rangeMax = DEFAULT_MIN_VOLUME;
     m_maxTruePeak = DEFAULT_MIN_VOLUME;
-    m_truePeakProcessor.reset();
 
     m_sum400ms70.reset();
     m_sum3s70.reset();
-
-    for ( int i = 0 ; i < m_nbChannels ; ++i )
+    m_momentarySum.reset();
+    m_shortTermSum.reset();
+
+    m_hopsPer100ms = 100 / m_hopMilliseconds.load( std::memory_order_relaxed );
+
+    // history arrays don't map the loaded session log anymore
+    m_squaredInputArray.clear();
+    m_momentaryVolumeArray.clear();
+    m_shortTermVolumeArray.clear();
+    m_integratedVolumeArray.clear();
+    m_truePeakArray.clear();
+    for ( int ch = 0 ; ch < m_nbChannels ; ++ch )
     {
-        m_maxLinArray[ i ]  = 0.f;
-        m_truePeakMaxPerChannelArray[ i ] = DEFAULT_MIN_VOLUME;
+        m_truePeakPerChannelArray[ ch ]->clear();
+        m_truePeakMaxPerChannelArray[ ch ] = DEFAULT_MIN_VOLUME;
     }
+    m_historyIndex->clear();
+    m_sessionLogFile = nullptr;
+
+    publishSnapshot();
 
 #if 0
     // add points at beginning to debug view port
@@ -186,297 +775,450 @@ void LufsProcessor::prepareToPlay(const double sampleRate, int samplesPerBlock)
 {
     DEBUGPLUGIN_output("LufsProcessor::prepareToPlay sampleRate %.1f samplesPerBlock %d", (float)sampleRate, samplesPerBlock);
 
-    for ( int i = 0 ; i < m_nbChannels ; ++i )
-    {
-        m_shelveFilterArray.getReference( i ).setFilterParams( (float)sampleRate, BiquadProcessor::HighShelf, 1500.f, 0.5f, 4.f );
-        m_highPassFilterArray.getReference( i ).setFilterParams( (float)sampleRate, BiquadProcessor::HighPass, 60.f, 0.5f, 0.f );
-    }
+    BiquadProcessor shelve;
+    shelve.setFilterParams( (float)sampleRate, BiquadProcessor::HighShelf, 1500.f, 0.5f, 4.f );
+    BiquadProcessor highPass;
+    highPass.setFilterParams( (float)sampleRate, BiquadProcessor::HighPass, 60.f, 0.5f, 0.f );
+    m_kWeightingFilterBank.setCoefficients( shelve.getCoefficients(), highPass.getCoefficients() );
 
-    m_block.setSize( m_nbChannels, 2 * samplesPerBlock );
-    m_volumeMemory.setSize( m_nbChannels, 2 * (int)sampleRate );
-    m_truePeakMemory.setSize( m_nbChannels, 2 * (int)sampleRate );
+    m_block.setSize( m_nbChannels, samplesPerBlock );
     m_sampleRate = sampleRate;
     m_sampleSize100ms = (int)( m_sampleRate / 10.0 );
     reset();
 }
 
+void LufsProcessor::setHopMilliseconds( const int hopMilliseconds )
+{
+    jassert( hopMilliseconds == 10 || hopMilliseconds == 25 || hopMilliseconds == 100 );
+
+    // hop is read by audio thread after reset generation
+    m_hopMilliseconds.store( hopMilliseconds, std::memory_order_relaxed );
+    reset();
+}
+
+void LufsProcessor::setDenormalProtection( const bool enabled )
+{
+    m_denormalProtection = enabled;
+    m_kWeightingFilterBank.setDenormalProtection( enabled );
+}
+
+int LufsProcessor::getHopSize( const int sampleSize100ms, const int hopsPer100ms, const int hopIndex )
+{
+    // hops of a 100 ms block differ by one sample at most when 100 ms can't be divided exactly, 
+    // so that 100 ms blocks are the same whatever the hop
+    return ( hopIndex + 1 ) * sampleSize100ms / hopsPer100ms - hopIndex * sampleSize100ms / hopsPer100ms;
+}
+
+void LufsProcessor::resetProcessing()
+{
+    m_segmentSize = 0;
+    m_segmentSquaredSum = 0.0;
+    m_hopIndex = 0;
+    m_processHopsPer100ms = 100 / m_hopMilliseconds.load( std::memory_order_relaxed );
+    m_truePeakProcessor.reset();
+}
+
 void LufsProcessor::processBlock( juce::AudioSampleBuffer& buffer )
 {
     jassert( buffer.getNumChannels() <= m_nbChannels );
     //DEBUGPLUGIN_output("LufsProcessor::processBlock buffer size %.d", buffer.getNumSamples());
 
-    if ( m_paused )
+    if ( m_paused.load( std::memory_order_acquire ) || m_sampleSize100ms == 0 )
         return;
 
-    const juce::SpinLock::ScopedLockType scopedLock( m_locker );
+    // filter states decaying into silence would become denormals
+    const AudioProcessing::ScopedNoDenormals noDenormals( m_denormalProtection );
 
-    // copy to internal buffer m_block to apply filters, and then copy at the end of m_volumeMemory
+    // reset processing state if reset was called since last block
+    const int generation = m_generation.load( std::memory_order_acquire );
+    if ( generation != m_processGeneration )
+    {
+        m_processGeneration = generation;
+        resetProcessing();
+    }
+
+    // copy to internal buffer m_block to apply filters (buffer is not modified, plugin output is its input)
     bool keepExistingContent = false;
     bool clearExtraSpace = false;
     bool avoidReallocating = true;
     m_block.setSize( m_nbChannels, buffer.getNumSamples(), keepExistingContent, clearExtraSpace, avoidReallocating );
 
-    for ( int i = 0 ; i < m_nbChannels ; ++i )
+    const int numChannels = juce::jmin( m_nbChannels, buffer.getNumChannels() );
+
+    // apply high shelf and high pass to all channels at once
+    m_kWeightingFilterBank.process( buffer, m_block, numChannels );
+
+    // process block by segments ending at hop boundaries: squared sum is accumulated, 
+    // and true peak is computed directly from buffer
+
+    // squared sums of hops are divided by the nominal hop size, so that means of the hops 
+    // of a 100 ms block sum up to the mean of the block
+    const double nominalHopSize = (double)m_sampleSize100ms / (double)m_processHopsPer100ms;
+
+    int offset = 0;
+    while ( offset < buffer.getNumSamples() )
     {
-        if ( i >= buffer.getNumChannels() )
-            continue;
+        const int hopSize = getHopSize( m_sampleSize100ms, m_processHopsPer100ms, m_hopIndex );
+        const int size = juce::jmin( buffer.getNumSamples() - offset, hopSize - m_segmentSize );
 
-        // copy to internal buffer
-        m_block.copyFrom( i, 0, buffer, i, 0, buffer.getNumSamples() );
+        addWeightedSquaredSum( m_block, offset, size, numChannels, m_channelLayout.getWeights(), m_segmentSquaredSum );
 
-        // apply high shelf
-        m_shelveFilterArray.getReference( i ).process( m_block.getWritePointer( i ), m_block.getNumSamples() );
-        
-        // apply high pass
-        m_highPassFilterArray.getReference( i ).process( m_block.getWritePointer( i ), m_block.getNumSamples() );
+        if ( m_segmentSize == 0 )
+            m_truePeakProcessor.beginValue( numChannels );
 
-        // copy block at the end of m_volumeMemory 
-        m_volumeMemory.copyFrom( i, m_memorySize, m_block, i, 0, m_block.getNumSamples() );
-    }
+        const juce::AudioSampleBuffer segmentBuffer( buffer.getArrayOfWritePointers(), numChannels, offset, size );
+        m_truePeakProcessor.addToValue( segmentBuffer );
+
+        m_segmentSize += size;
+        offset += size;
+
+        if ( m_segmentSize == hopSize )
+        {
+            publishRecord( float( m_segmentSquaredSum / nominalHopSize ), m_truePeakProcessor.getValue(), numChannels );
 
-    // copy buffer to m_truePeakMemory 
+            m_segmentSize = 0;
+            m_segmentSquaredSum = 0.0;
+            m_hopIndex = ( m_hopIndex + 1 ) % m_processHopsPer100ms;
+        }
+    }
+}
 
-    for ( int i = 0 ; i < m_nbChannels ; ++i )
+void LufsProcessor::addWeightedSquaredSum( const juce::AudioSampleBuffer & block, const int offset, const int size, const int numChannels, const float * weights, double & squaredSum )
+{
+    for ( int i = 0 ; i < numChannels ; ++i )
     {
-        if ( i >= buffer.getNumChannels() )
+        const float weightingCoef = weights[ i ];
+        if ( weightingCoef == 0.f )
             continue;
 
-        m_truePeakMemory.copyFrom( i, m_memorySize, buffer, i, 0, buffer.getNumSamples() );
+        const float * data = block.getReadPointer( i, offset );
+
+        float sum = 0.f;
+        for ( int s = 0 ; s < size ; ++s )
+        {
+            sum += data[ s ] * data[ s ];
+        }
+
+        squaredSum += (double)( sum * weightingCoef );
     }
+}
 
-    m_memorySize += buffer.getNumSamples();
+void LufsProcessor::publishRecord( const float squaredInput, const AudioProcessing::TruePeak::LinearValue& value, const int numChannels )
+{
+    jassert( value.m_numChannels == numChannels );
 
-    if ( m_memorySize < m_sampleSize100ms )
+    LufsRecord record;
+    record.m_squaredInput = squaredInput;
+    record.m_numChannels = numChannels;
+    record.m_generation = m_processGeneration;
+
+    m_recordFifo->push( record, value.m_channelArray );
+}
+
+void LufsProcessor::addRecord( const LufsRecord & record, const float * truePeaks )
+{
+    m_squaredInputArray.set( m_processSize, record.m_squaredInput );
+
+    const float decibelTruePeak = addRecordTruePeaks( truePeaks, record.m_numChannels, m_recordTruePeakVolumes, m_truePeakMaxPerChannelArray, m_maxTruePeak );
+    m_truePeakArray.set( m_processSize, decibelTruePeak );
+
+    for ( int ch = 0 ; ch < record.m_numChannels ; ++ch )
     {
-        // we don't have enough data in m_volumeMemory/m_truePeakMemory to process 100 ms
-        return;
+        m_truePeakPerChannelArray[ch]->set( m_processSize, m_recordTruePeakVolumes[ch] );
+    }
+    for ( int ch = record.m_numChannels ; ch < m_nbChannels ; ++ch )
+    {
+        m_truePeakPerChannelArray[ch]->set( m_processSize, DEFAULT_MIN_VOLUME );
     }
 
+    ++m_processSize;
+}
 
-    // process chunks of 100 ms of data 
+float LufsProcessor::addRecordTruePeaks( const float * linearTruePeaks, const int numChannels, float * channelVolumes, float * channelMaxArray, float & maxTruePeak )
+{
+    float linearTruePeak = 0.f;
+    for ( int ch = 0 ; ch < numChannels ; ++ch )
+    {
+        const float channelDecibelTruePeak = getDecibelVolumeFromLinearVolume( linearTruePeaks[ch] ); 
+        if ( channelVolumes != nullptr )
+            channelVolumes[ch] = channelDecibelTruePeak;
 
-    int sizeDone = 0 ;
+        if ( channelDecibelTruePeak > channelMaxArray[ch] )
+            channelMaxArray[ch] = channelDecibelTruePeak;
 
-    int nbChannels = m_nbChannels > 6 ? 6 : m_nbChannels;
-    while ( m_memorySize - sizeDone >= m_sampleSize100ms )
-    {
-        float sum = 0.f;
-        
-        for ( int i = 0 ; i < nbChannels ; ++i )
-        {
-            if ( i >= buffer.getNumChannels() )
-                continue;
+        if ( linearTruePeak < linearTruePeaks[ch] )
+            linearTruePeak = linearTruePeaks[ch];
+    }
 
-            float weightingCoef = 0.f; 
-            
-            // kSpeakerArr51 is "L R C Lfe Ls Rs";
-            switch ( i )
-            {
-            case 0: // L
-            case 1: // R
-            case 2: // C
-                weightingCoef = 1.f;
-                break;
-            case 3: // Lfe
-                weightingCoef = 0.f;
-                break;
-            case 4: // Ls
-            case 5: // Rs
-                weightingCoef = 1.414213f; // 1.41 (~ +1.5 dB) for left and right surround channels 
-                break;
-            }
+    const float decibelTruePeak = getDecibelVolumeFromLinearVolume( linearTruePeak ); 
+    if ( decibelTruePeak > maxTruePeak )
+        maxTruePeak = decibelTruePeak;
 
-            const float * data = &( m_volumeMemory.getReadPointer( i )[ sizeDone ] );
+    return decibelTruePeak;
+}
 
-            for ( int s = 0 ; s < m_sampleSize100ms ; ++s )
-            {
-                const float value = *data;
-                sum += value * value * weightingCoef;
-                ++data;
-            }
-        }
+void LufsProcessor::publishSnapshot()
+{
+    // positions are indexed before being published
+    m_historyIndex->update( m_validSize, m_hopsPer100ms );
 
-        // process peak
-        const juce::AudioSampleBuffer hundredMillisecondBuffer( m_truePeakMemory.getArrayOfWritePointers(), m_truePeakMemory.getNumChannels(), sizeDone, m_sampleSize100ms );
-        AudioProcessing::TruePeak::LinearValue truePeakValue = m_truePeakProcessor.process( hundredMillisecondBuffer );
+    m_snapshot.m_validSize = m_validSize;
+    m_snapshot.m_hopsPer100ms = m_hopsPer100ms;
+    m_snapshot.m_integratedVolume = m_integratedVolume;
+    m_snapshot.m_rangeMin = m_rangeMin;
+    m_snapshot.m_rangeMax = m_rangeMax;
+    m_snapshot.m_maxTruePeak = m_maxTruePeak;
+    memcpy( m_snapshotTruePeakMaxPerChannelArray, m_truePeakMaxPerChannelArray, m_nbChannels * sizeof( float ) );
 
-        addSquaredInputAndTruePeak( sum / m_sampleSize100ms, truePeakValue, buffer.getNumChannels() );
+    size_t bytes = m_squaredInputArray.getAllocatedBytes() 
+        + m_momentaryVolumeArray.getAllocatedBytes() 
+        + m_shortTermVolumeArray.getAllocatedBytes() 
+        + m_integratedVolumeArray.getAllocatedBytes() 
+        + m_truePeakArray.getAllocatedBytes();
 
-        sizeDone += m_sampleSize100ms;
+    for ( int ch = 0 ; ch < m_nbChannels ; ++ch )
+        bytes += m_truePeakPerChannelArray[ ch ]->getAllocatedBytes();
 
-        if ( ( sizeDone + m_sampleSize100ms ) > m_memorySize )
-            break;
-    }
+    bytes += m_historyIndex->getAllocatedBytes();
 
-    // copy remaining samples to beginning of m_volumeMemory 
+    m_snapshot.m_allocatedBytes = bytes;
+}
 
-    const int remaining = m_memorySize - sizeDone;
-    jassert( remaining >= 0 );
+LufsProcessor::Snapshot LufsProcessor::getSnapshot() const
+{
+    const juce::ScopedLock historyLock( m_historyLock );
 
-    for ( int i = 0 ; i < m_nbChannels ; ++i )
-    {
-        float * dest = m_volumeMemory.getWritePointer( i );
-        float * src = &dest[ sizeDone ];
+    return m_snapshot;
+}
 
-        for ( int s = 0 ; s < remaining ; ++s )
-        {
-            *dest++ = *src++;
-        }
-    }
+float LufsProcessor::getTruePeakChannelMax( const int ch ) const
+{
+    jassert( ch >= 0 && ch < m_nbChannels );
+
+    const juce::ScopedLock historyLock( m_historyLock );
 
-    // copy remaining samples to beginning of m_truePeakMemory too
+    return m_snapshotTruePeakMaxPerChannelArray[ ch ];
+}
+
+void LufsProcessor::update()
+{
+    //DEBUGPLUGIN_output("LufsProcessor::update");
 
-    for ( int i = 0 ; i < m_nbChannels ; ++i )
     {
-        float * dest = m_truePeakMemory.getWritePointer( i );
-        float * src = &dest[ sizeDone ];
+        const juce::ScopedLock historyLock( m_historyLock );
+
+        // records computed before last reset are dropped, and all records while a session log is loaded
+        const int generation = m_generation.load( std::memory_order_relaxed );
 
-        for ( int s = 0 ; s < remaining ; ++s )
+        LufsRecord record;
+        while ( m_recordFifo->pop( record, m_poppedTruePeaks ) )
         {
-            *dest++ = *src++;
+            if ( record.m_generation == generation && m_sessionLogFile == nullptr )
+                addRecord( record, m_poppedTruePeaks );
         }
+
+        updatePendingPositions();
+        publishSnapshot();
     }
 
-    m_memorySize = remaining;
+    appendSessionLog();
 }
 
-void LufsProcessor::addSquaredInputAndTruePeak( const float squaredInput, const AudioProcessing::TruePeak::LinearValue& value, const int numChannels )
+void LufsProcessor::update( const LufsRecord * records, const float * truePeaks, const int numRecords )
 {
-    if ( m_processSize < m_maxSize )
     {
-        m_squaredInputArray[ m_processSize ] = squaredInput;
+        const juce::ScopedLock historyLock( m_historyLock );
 
-        float decibelTruePeak = getDecibelVolumeFromLinearVolume( value.getMax() ); 
-        m_truePeakArray[ m_processSize ] = decibelTruePeak;
+        jassert( m_sessionLogFile == nullptr );
+        if ( m_sessionLogFile != nullptr )
+            return;
 
-        if ( decibelTruePeak > m_maxTruePeak )
-            m_maxTruePeak = decibelTruePeak;
+        for ( int i = 0 ; i < numRecords ; ++i )
+            addRecord( records[ i ], truePeaks + i * m_nbChannels );
 
-        for ( int ch = 0 ; ch < numChannels ; ++ch )
-        {
-            float channelLinearTruePeak = value.m_channelArray[ch];
-            float channelDecibelTruePeak = getDecibelVolumeFromLinearVolume( channelLinearTruePeak ); 
+        updatePendingPositions();
+        publishSnapshot();
+    }
 
-            m_truePeakPerChannelArray[ch][ m_processSize ] = channelDecibelTruePeak;
+    appendSessionLog();
+}
 
-            if ( channelDecibelTruePeak > m_truePeakMaxPerChannelArray[ch] )
-                m_truePeakMaxPerChannelArray[ch] = channelDecibelTruePeak;
-        }
-        for ( int ch = numChannels ; ch < LUFS_TP_MAX_NB_CHANNELS ; ++ch )
-        {
-            m_truePeakPerChannelArray[ch][ m_processSize ] = DEFAULT_MIN_VOLUME;
-        }
+void LufsProcessor::setSessionLog( LufsSessionLog * sessionLog )
+{
+    const juce::ScopedLock sessionLogLock( m_sessionLogLock );
 
-        ++m_processSize;
-    }
+    m_sessionLog = sessionLog;
 }
 
-void LufsProcessor::update()
+void LufsProcessor::appendSessionLog()
 {
-    //DEBUGPLUGIN_output("LufsProcessor::update");
-
-    int size = m_processSize;
+    // without history lock, the log copies values with it and writes them on its own thread
+    const juce::ScopedLock sessionLogLock( m_sessionLogLock );
 
-    while ( m_validSize < size )
-    {
-        updatePosition( m_validSize );
-        ++m_validSize;
-    }
+    if ( m_sessionLog != nullptr )
+        m_sessionLog->append();
 }
 
-void LufsProcessor::updatePosition( int position )
+bool LufsProcessor::loadSessionLog( const juce::File & file, juce::String & error )
 {
-    //DEBUGPLUGIN_output("LufsProcessor::updatePosition position %d", position);
+    juce::ScopedPointer<juce::MemoryMappedFile> mappedFile( new juce::MemoryMappedFile( file, juce::MemoryMappedFile::readOnly ) );
+    if ( mappedFile->getData() == nullptr )
+    {
+        error = "Unable to open " + file.getFullPathName();
+        return false;
+    }
 
-    // m_momentaryVolume 
-    m_integratedVolumeArray[ position ] = DEFAULT_MIN_VOLUME;
+    LufsSessionLog::Header header;
+    if ( !LufsSessionLog::readHeader( mappedFile->getData(), mappedFile->getSize(), header, error ) )
+        return false;
 
-    if ( position >= 4 )
+    if ( header.m_numChannels != m_nbChannels )
     {
-        // momentary, abbreviated M (400 ms)
+        error = "Session log has " + juce::String( header.m_numChannels ) + " channels instead of " + juce::String( m_nbChannels );
+        return false;
+    }
 
-        float sum = 0.f;
-        for ( int i = position - 4 ; i < position ; ++i )
-        {
-            sum += m_squaredInputArray[ i ];
-        }
-        sum /= 4;
+    const juce::ScopedLock historyLock( m_historyLock );
 
-        m_momentaryVolumeArray[ position ] = juce::jmax( float(-0.691 + 10.*std::log10( sum ) ), DEFAULT_MIN_VOLUME );
-        
-        if ( m_momentaryVolumeArray[ position ] > -70.f )
+    // audio thread stops, and history starts from scratch with the hop of the log; the configured 
+    // hop is kept for the audio thread, and is the hop of history again at next reset
+    pause();
+    reset();
+    m_hopsPer100ms = 100 / header.m_hopMilliseconds;
+
+    // columns of each block of the file become chunks of history arrays
+    const char * data = (const char *)mappedFile->getData();
+    const int numChunks = ( header.m_numPositions + LufsHistoryArray::chunkMask ) >> LufsHistoryArray::chunkShift;
+    for ( int chunk = 0 ; chunk < numChunks ; ++chunk )
+    {
+        const int position = chunk << LufsHistoryArray::chunkShift;
+        for ( int column = 0 ; column < LufsSessionLog::getNumColumns( m_nbChannels ) ; ++column )
         {
-            //DBG( juce::String( "Adding 1 " ) + juce::String( sum ) );
-            m_sum400ms70.addLufs( sum );
+            LufsHistoryArray & array = column == LufsSessionLog::squaredInputColumn ? m_squaredInputArray
+                : column == LufsSessionLog::momentaryColumn ? m_momentaryVolumeArray
+                : column == LufsSessionLog::shortTermColumn ? m_shortTermVolumeArray
+                : column == LufsSessionLog::integratedColumn ? m_integratedVolumeArray
+                : column == LufsSessionLog::truePeakColumn ? m_truePeakArray
+                : *m_truePeakPerChannelArray[ column - LufsSessionLog::firstChannelColumn ];
+
+            array.setMappedChunk( chunk, (const float *)( data + LufsSessionLog::getOffset( m_nbChannels, column, position ) ) );
         }
+    }
 
-        if ( m_sum400ms70.size() )
-        {
-            const float absoluteSum = m_sum400ms70.getSum() / (float) m_sum400ms70.size();
-            const float absoluteThresholdVolume = getLufsVolume( absoluteSum ) -10.f;
-            const float thresholdSum = getLufsSum( absoluteThresholdVolume );
+    m_processSize = header.m_numPositions;
+    m_validSize = header.m_numPositions;
+    m_integratedVolume = header.m_integratedVolume;
+    m_rangeMin = header.m_rangeMin;
+    m_rangeMax = header.m_rangeMax;
+    m_maxTruePeak = header.m_maxTruePeak;
+    memcpy( m_truePeakMaxPerChannelArray, data + sizeof( LufsSessionLog::Header ), m_nbChannels * sizeof( float ) );
 
-            const int index = m_sum400ms70.findIndexAfterValue( thresholdSum );
+    m_sessionLogFile = mappedFile.release();
 
-            float relativeSum = 0.f;
-            for ( int i = index ; i < m_sum400ms70.size() ; ++i )
-            {
-                //DBG( juce::String( "relativeSum adding " ) + juce::String( m_sum400ms70.getUnchecked( i ) ) );
-                relativeSum += m_sum400ms70.getUnchecked( i );
-            }
+    publishSnapshot();
+    return true;
+}
 
-            if ( m_sum400ms70.size() - index )
-                relativeSum /= ( m_sum400ms70.size() - index );
+void LufsProcessor::takeRecords( juce::Array<LufsRecord> & records, juce::Array<float> & truePeaks )
+{
+    const int generation = m_generation.load( std::memory_order_relaxed );
 
-            //DBG( juce::String( "relativeSum " ) + juce::String( relativeSum ) );
-            
-            m_integratedVolume = getLufsVolume( relativeSum );
-            m_integratedVolumeArray[ position ] = m_integratedVolume;
+    LufsRecord record;
+    while ( m_recordFifo->pop( record, m_poppedTruePeaks ) )
+    {
+        if ( record.m_generation == generation )
+        {
+            records.add( record );
+            truePeaks.addArray( (const float *)m_poppedTruePeaks, m_nbChannels );
         }
     }
-    else
+}
+
+void LufsProcessor::updatePendingPositions()
+{
+    // pending positions are updated by batches, after a stall there can be thousands of them
+    while ( m_validSize < m_processSize )
     {
-        m_momentaryVolumeArray[ position ] = DEFAULT_MIN_VOLUME;
+        const int end = juce::jmin( m_processSize, m_validSize + (int)batchSize );
+        updatePositions( m_validSize, end );
+        m_validSize = end;
     }
+}
 
+void LufsProcessor::getWindowMeans( const LufsHistoryArray & values, const int begin, const int end, const int windowSize, LufsRunningSum & runningSum, float * means )
+{
+    for ( int position = begin ; position < end ; ++position )
+        means[ position - begin ] = getWindowMean( values, position, windowSize, runningSum );
+}
 
-    // short term, abbreviated S (3 s)
+void LufsProcessor::updatePositions( const int begin, const int end )
+{
+    //DEBUGPLUGIN_output("LufsProcessor::updatePositions positions %d to %d", begin, end);
 
-    if ( position >= 30 )
+    jassert( end - begin <= batchSize );
+
+    float * momentarySums = m_batchBuffer;
+    float * shortTermSums = m_batchBuffer + batchSize;
+    float * momentaryVolumes = m_batchBuffer + 2 * batchSize;
+    float * shortTermVolumes = m_batchBuffer + 3 * batchSize;
+    const int size = end - begin;
+
+    const int momentaryWindowSize = momentaryBlocks * m_hopsPer100ms;
+    const int shortTermWindowSize = shortTermBlocks * m_hopsPer100ms;
+
+    getWindowMeans( m_squaredInputArray, begin, end, momentaryWindowSize, m_momentarySum, momentarySums );
+    getWindowMeans( m_squaredInputArray, begin, end, shortTermWindowSize, m_shortTermSum, shortTermSums );
+
+    // volumes: independent iterations
+    for ( int i = 0 ; i < size ; ++i )
     {
-        float sum = 0.f;
-        for ( int i = position - 30 ; i < position ; ++i )
-        {
-            sum += m_squaredInputArray[ i ];
-        }
-        sum /= 30;
-        m_shortTermVolumeArray[ position ] = juce::jmax( float(-0.691 + 10.*std::log10( sum ) ), DEFAULT_MIN_VOLUME );
+        momentaryVolumes[ i ] = getWindowVolume( momentarySums[ i ] );
+        shortTermVolumes[ i ] = getWindowVolume( shortTermSums[ i ] );
+    }
 
-        if ( m_shortTermVolumeArray[ position ] > -70.f )
+    // gating: integrated volume is stored for each position, range is only needed at the end
+    bool rangeChanged = false;
+
+    for ( int i = 0 ; i < size ; ++i )
+    {
+        const int position = begin + i;
+
+        // momentary, abbreviated M (400 ms)
+
+        m_integratedVolumeArray.set( position, DEFAULT_MIN_VOLUME );
+
+        if ( position >= momentaryWindowSize )
         {
-            m_sum3s70.addLufs( sum );
-        }
+            m_momentaryVolumeArray.set( position, momentaryVolumes[ i ] );
+        
+            if ( addGatingWindow( m_sum400ms70, position, m_hopsPer100ms, momentarySums[ i ], momentaryVolumes[ i ] ) )
+                m_integratedVolume = getIntegratedVolume( m_sum400ms70 );
 
-        if ( m_sum3s70.size() )
+            if ( m_sum400ms70.size() )
+                m_integratedVolumeArray.set( position, m_integratedVolume );
+        }
+        else
         {
-            const float absoluteSum = m_sum3s70.getSum() / (float) m_sum3s70.size();
-            const float absoluteThresholdVolume = getLufsVolume( absoluteSum ) -20.f;
-            const float thresholdSum = getLufsSum( absoluteThresholdVolume );
+            m_momentaryVolumeArray.set( position, DEFAULT_MIN_VOLUME );
+        }
 
-            const int index = m_sum3s70.findIndexAfterValue( thresholdSum );
+        // short term, abbreviated S (3 s)
 
-            const float sumPercentile10 = m_sum3s70.getPercentileValue( index, 0.1f );
-            const float sumPercentile95 = m_sum3s70.getPercentileValue( index, 0.95f );
+        if ( position >= shortTermWindowSize )
+        {
+            m_shortTermVolumeArray.set( position, shortTermVolumes[ i ] );
 
-            m_rangeMin = getLufsVolume( sumPercentile10 );
-            m_rangeMax = getLufsVolume( sumPercentile95 );
+            if ( addGatingWindow( m_sum3s70, position, m_hopsPer100ms, shortTermSums[ i ], shortTermVolumes[ i ] ) )
+                rangeChanged = true;
+        }
+        else
+        {
+            m_shortTermVolumeArray.set( position, DEFAULT_MIN_VOLUME );
         }
-
-    }
-    else
-    {
-        m_shortTermVolumeArray[ position ] = DEFAULT_MIN_VOLUME;
     }
+
+    if ( rangeChanged )
+        getLoudnessRange( m_sum3s70, m_rangeMin, m_rangeMax );
 }
 
 
@@ -698,5 +1440,217 @@ void BiquadProcessor::setFilterParams( const float _samplingRate, const FilterTy
     }
 }
 
+AudioProcessing::BiquadCoefficients BiquadProcessor::getCoefficients() const
+{
+    const AudioProcessing::BiquadCoefficients coefficients = { m_B0, m_B1, m_B2, m_A1, m_A2 };
+    return coefficients;
+}
+
 
 
+// LufsHistoryArray implementation 
+
+LufsHistoryArray::LufsHistoryArray()
+    : m_allocatedBytes( 0 )
+    , m_mapped( false )
+{
+    memset( m_pages, 0, sizeof( m_pages ) );
+}
+
+LufsHistoryArray::~LufsHistoryArray()
+{
+    clear();
+}
+
+void LufsHistoryArray::set( const int index, const float value )
+{
+    jassert( index >= 0 && !m_mapped );
+
+    float ** & page = m_pages[ index >> pageShift ];
+    if ( page == nullptr )
+    {
+        page = (float**)calloc( pageMask + 1, sizeof( float* ) );
+        m_allocatedBytes += ( pageMask + 1 ) * sizeof( float* );
+    }
+
+    float * & chunk = page[ ( index >> chunkShift ) & pageMask ];
+    if ( chunk == nullptr )
+    {
+        chunk = (float*)malloc( chunkSize * sizeof( float ) );
+        m_allocatedBytes += chunkSize * sizeof( float );
+    }
+
+    chunk[ index & chunkMask ] = value;
+}
+
+void LufsHistoryArray::setMappedChunk( const int chunkIndex, const float * values )
+{
+    jassert( m_mapped || m_allocatedBytes == 0 );
+    m_mapped = true;
+
+    float ** & page = m_pages[ chunkIndex >> ( pageShift - chunkShift ) ];
+    if ( page == nullptr )
+    {
+        page = (float**)calloc( pageMask + 1, sizeof( float* ) );
+        m_allocatedBytes += ( pageMask + 1 ) * sizeof( float* );
+    }
+
+    // never written, see set
+    page[ chunkIndex & pageMask ] = const_cast<float *>( values );
+}
+
+void LufsHistoryArray::clear()
+{
+    for ( int p = 0 ; p < numPages ; ++p )
+    {
+        if ( m_pages[ p ] == nullptr )
+            continue;
+
+        for ( int c = 0 ; c <= pageMask && !m_mapped ; ++c )
+            free( m_pages[ p ][ c ] );
+
+        free( m_pages[ p ] );
+        m_pages[ p ] = nullptr;
+    }
+
+    m_allocatedBytes = 0;
+    m_mapped = false;
+}
+
+
+
+// LufsRecordFifo implementation 
+
+LufsRecordFifo::LufsRecordFifo( const int capacity, const int numChannels )
+    : m_size( capacity + 1 )
+    , m_numChannels( numChannels )
+    , m_records( capacity + 1 )
+    , m_truePeaks( ( capacity + 1 ) * numChannels )
+    , m_writeIndex( 0 )
+    , m_readIndex( 0 )
+    , m_numDropped( 0 )
+{
+}
+
+bool LufsRecordFifo::push( const LufsRecord & record, const float * truePeaks )
+{
+    jassert( record.m_numChannels <= m_numChannels );
+
+    const int writeIndex = m_writeIndex.load( std::memory_order_relaxed );
+    const int nextIndex = ( writeIndex + 1 == m_size ) ? 0 : writeIndex + 1;
+
+    // full: slot is still being read, or not read yet
+    if ( nextIndex == m_readIndex.load( std::memory_order_acquire ) )
+    {
+        m_numDropped.fetch_add( 1, std::memory_order_relaxed );
+        return false;
+    }
+
+    m_records[ writeIndex ] = record;
+
+    // channels missing from the record are silent
+    float * slotTruePeaks = m_truePeaks + writeIndex * m_numChannels;
+    memcpy( slotTruePeaks, truePeaks, record.m_numChannels * sizeof( float ) );
+    for ( int ch = record.m_numChannels ; ch < m_numChannels ; ++ch )
+        slotTruePeaks[ ch ] = 0.f;
+
+    // publishes the record
+    m_writeIndex.store( nextIndex, std::memory_order_release );
+    return true;
+}
+
+bool LufsRecordFifo::pop( LufsRecord & record, float * truePeaks )
+{
+    const int readIndex = m_readIndex.load( std::memory_order_relaxed );
+
+    // empty
+    if ( readIndex == m_writeIndex.load( std::memory_order_acquire ) )
+        return false;
+
+    record = m_records[ readIndex ];
+    memcpy( truePeaks, m_truePeaks + readIndex * m_numChannels, m_numChannels * sizeof( float ) );
+
+    // releases the slot
+    m_readIndex.store( ( readIndex + 1 == m_size ) ? 0 : readIndex + 1, std::memory_order_release );
+    return true;
+}
+
+
+
+// LufsHistogram implementation 
+
+LufsHistogram::LufsHistogram()
+    : m_countTree( numBins + 1, true )
+    , m_sumTree( numBins + 1, true )
+    , m_size( 0 )
+    , m_sum( 0.0 )
+{
+}
+
+int LufsHistogram::getBinIndex( const float element )
+{
+    return getVolumeBinIndex( float( -0.691 + 10.0 * std::log10( element ) ) );
+}
+
+int LufsHistogram::getVolumeBinIndex( const float volume )
+{
+    const int index = (int)floorf( ( volume - (float)minLufs ) * (float)binsPerLU );
+
+    return juce::jlimit( 0, numBins - 1, index );
+}
+
+void LufsHistogram::addLufs( const float element )
+{
+    ++m_size;
+    m_sum += element;
+
+    // Fenwick tree update, tree indices start at 1
+    for ( int i = getBinIndex( element ) + 1 ; i <= numBins ; i += ( i & -i ) )
+    {
+        ++m_countTree[ i ];
+        m_sumTree[ i ] += element;
+    }
+}
+
+void LufsHistogram::getPrefixSum( const int binIndex, int & count, double & sum ) const
+{
+    count = 0;
+    sum = 0.0;
+
+    for ( int i = binIndex ; i > 0 ; i -= ( i & -i ) )
+    {
+        count += m_countTree[ i ];
+        sum += m_sumTree[ i ];
+    }
+}
+
+int LufsHistogram::findBinIndex( int rank ) const
+{
+    jassert( rank < m_size );
+
+    // Fenwick tree descent: highest tree index with prefix count <= rank
+    int step = 1;
+    while ( step * 2 <= numBins )
+        step *= 2;
+
+    int index = 0;
+    for ( ; step ; step >>= 1 )
+    {
+        if ( index + step <= numBins && m_countTree[ index + step ] <= rank )
+        {
+            index += step;
+            rank -= m_countTree[ index ];
+        }
+    }
+
+    return index; // tree index + 1 - 1
+}
+
+void LufsHistogram::reset()
+{
+    m_countTree.clear( numBins + 1 );
+    m_sumTree.clear( numBins + 1 );
+
+    m_size = 0;
+    m_sum = 0.0;
+}
@@ -21,7 +21,13 @@
 
 #pragma once 
 
+#include <atomic>
+
 #include "AudioProcessing.h"
+#include "LufsChannelLayout.h"
+
+class LufsSessionLog;
+class LufsHistoryIndex;
 
 class BiquadProcessor
 {
@@ -44,6 +50,8 @@ public:
 
     void setFilterParams( const float _samplingRate, const FilterType _filterType, const float _frequency, const float _quality, const float _decibelGain );
 
+    AudioProcessing::BiquadCoefficients getCoefficients() const;
+
 private:
     float m_X_1;
     float m_X_2;
@@ -150,92 +158,586 @@ private:
 };
 
 
+// Histogram of block energies (mean squares, as summed by LufsFloatArray), with 0.01 LU bins 
+// from -70 to +10 LUFS. Number of blocks and energy sum of each bin are kept in Fenwick trees,
+// so that count and sum of all blocks above a threshold are found in O(log(bins)) 
+class LufsHistogram
+{
+public:
+
+    LufsHistogram();
+
+    void addLufs( const float element );
+
+    // number and energy sum of blocks with energy above threshold; blocks of the threshold 
+    // bin are all counted if their mean energy is above threshold 
+    void getSumAbove( const float threshold, int & count, double & sum ) const { getBinsSumAbove( *this, threshold, count, sum ); }
+
+    // energy of block at percentile of blocks above threshold (mean energy of its bin), 
+    // as LufsFloatArray::getPercentileValue does with blocks after threshold index 
+    float getPercentileValue( const float threshold, const float percentile ) const { return getBinsPercentileValue( *this, threshold, percentile ); }
+
+    inline int size() const { return m_size; }
+    inline double getSum() const { return m_sum; }
+
+    // number and energy sum of blocks in bins [0, binIndex[
+    void getPrefixSum( const int binIndex, int & count, double & sum ) const;
+
+    // index of bin containing block number rank (in increasing energies order)
+    int findBinIndex( int rank ) const;
+
+    void reset();
+
+    static int getBinIndex( const float element );
+    // bin of a block of volume in LUFS, as getBinIndex of its energy
+    static int getVolumeBinIndex( const float volume );
+
+    // getSumAbove and getPercentileValue of any bins answering size, getSum, getPrefixSum and 
+    // findBinIndex as a histogram does, such as the bins of a range of history
+    template <typename Bins>
+    static void getBinsSumAbove( const Bins & bins, const float threshold, int & count, double & sum )
+    {
+        const int thresholdBin = getBinIndex( threshold );
+
+        int countBelow, countBelowAndThreshold;
+        double sumBelow, sumBelowAndThreshold;
+        bins.getPrefixSum( thresholdBin, countBelow, sumBelow );
+        bins.getPrefixSum( thresholdBin + 1, countBelowAndThreshold, sumBelowAndThreshold );
+
+        count = bins.size() - countBelowAndThreshold;
+        sum = bins.getSum() - sumBelowAndThreshold;
+
+        // threshold bin 
+        const int thresholdBinCount = countBelowAndThreshold - countBelow;
+        const double thresholdBinSum = sumBelowAndThreshold - sumBelow;
+        if ( thresholdBinCount && ( thresholdBinSum > threshold * (double)thresholdBinCount ) )
+        {
+            count += thresholdBinCount;
+            sum += thresholdBinSum;
+        }
+
+        if ( sum < 0.0 )
+            sum = 0.0; // rounding
+    }
+
+    template <typename Bins>
+    static float getBinsPercentileValue( const Bins & bins, const float threshold, const float percentile )
+    {
+        jassert( percentile >= 0.f );
+        jassert( percentile <= 1.f );
+
+        const int countBelow = getBinsCountBelow( bins, threshold );
+        const int count = bins.size() - countBelow;
+
+        if ( count == 0 )
+            return 0.f;
+
+        const int binIndex = bins.findBinIndex( countBelow + (int)( percentile * (float)( count - 1 ) ) );
+
+        int binCountBelow, binCountBelowAndBin;
+        double binSumBelow, binSumBelowAndBin;
+        bins.getPrefixSum( binIndex, binCountBelow, binSumBelow );
+        bins.getPrefixSum( binIndex + 1, binCountBelowAndBin, binSumBelowAndBin );
+
+        jassert( binCountBelowAndBin > binCountBelow );
+
+        return float( ( binSumBelowAndBin - binSumBelow ) / ( binCountBelowAndBin - binCountBelow ) );
+    }
+
+    enum
+    {
+        binsPerLU = 100,
+        minLufs = -70,
+        maxLufs = 10,
+        numBins = ( maxLufs - minLufs ) * binsPerLU
+    };
+
+private:
+
+    // number of blocks in bins [0, threshold bin], or in bins [0, threshold bin[ if threshold bin is counted above threshold
+    template <typename Bins>
+    static int getBinsCountBelow( const Bins & bins, const float threshold )
+    {
+        const int thresholdBin = getBinIndex( threshold );
+
+        int countBelow, countBelowAndThreshold;
+        double sumBelow, sumBelowAndThreshold;
+        bins.getPrefixSum( thresholdBin, countBelow, sumBelow );
+        bins.getPrefixSum( thresholdBin + 1, countBelowAndThreshold, sumBelowAndThreshold );
+
+        // same threshold bin rule as getBinsSumAbove
+        const int thresholdBinCount = countBelowAndThreshold - countBelow;
+        const double thresholdBinSum = sumBelowAndThreshold - sumBelow;
+        if ( thresholdBinCount && ( thresholdBinSum > threshold * (double)thresholdBinCount ) )
+            return countBelow;
+
+        return countBelowAndThreshold;
+    }
+
+    juce::HeapBlock<int> m_countTree;
+    juce::HeapBlock<double> m_sumTree;
+    int m_size;
+    double m_sum;
+};
+
+// Float array growing by chunks of chunkSize values, allocated when first written: 
+// a short measurement only uses a few kilobytes, and there is no maximum size. 
+// Chunks are never moved, so values already written can be read while new values are set
+class LufsHistoryArray
+{
+public:
+
+    LufsHistoryArray();
+    ~LufsHistoryArray();
+
+    inline float operator[]( const int index ) const 
+    { 
+        jassert( index >= 0 && m_pages[ index >> pageShift ] != nullptr );
+        return m_pages[ index >> pageShift ][ ( index >> chunkShift ) & pageMask ][ index & chunkMask ]; 
+    }
+
+    // allocates chunk of index if needed
+    void set( const int index, const float value );
+
+    // chunk chunkIndex reads chunkSize values of memory that isn't owned (values of a memory mapped 
+    // session log); an array with mapped chunks is read only until clear
+    void setMappedChunk( const int chunkIndex, const float * values );
+
+    // frees all chunks
+    void clear();
+
+    inline size_t getAllocatedBytes() const { return m_allocatedBytes; }
+
+    enum
+    {
+        chunkShift = 12, // 4096 values per chunk, 6.8 minutes of 100 ms values
+        chunkSize = 1 << chunkShift,
+        chunkMask = chunkSize - 1,
+        pageShift = chunkShift + 10, // 1024 chunks per page
+        pageMask = ( 1 << ( pageShift - chunkShift ) ) - 1,
+        numPages = 1 << ( 31 - pageShift ) // int indexes: 6.8 years of 100 ms values
+    };
+
+private:
+
+    float ** m_pages[ numPages ];
+    size_t m_allocatedBytes;
+    bool m_mapped; // chunks aren't owned
+
+    JUCE_DECLARE_NON_COPYABLE( LufsHistoryArray )
+};
+
+// measurement of one hop, published by the audio thread to the thread updating the history. True peak
+// linear volumes of the m_numChannels channels are stored next to the record, by the fifo or by the
+// arrays of records taken from a processor, as the number of channels is only known at run time
+struct LufsRecord
+{
+    float m_squaredInput; // squared input for one hop, summed for all channels, after K weighting filtration
+    int m_numChannels; // number of true peak values of the record
+    int m_generation; // reset generation of the processor when the record was computed
+};
+
+// Wait-free single producer, single consumer queue of records: push is called by the audio 
+// thread only, pop by the update thread only. Each index is written by one thread with release 
+// semantics and read by the other with acquire semantics, so that a record is completely written 
+// before it is read, and read before its slot is reused. When the queue is full, pushed records 
+// are dropped and counted, the audio thread never waits
+class LufsRecordFifo
+{
+public:
+
+    // numChannels true peak values at most are stored with each record
+    LufsRecordFifo( const int capacity, const int numChannels );
+
+    // truePeaks: record.m_numChannels true peak linear volumes
+    bool push( const LufsRecord & record, const float * truePeaks );
+    // truePeaks: receives the numChannels true peak linear volumes of the record
+    bool pop( LufsRecord & record, float * truePeaks );
+
+    inline int getNumChannels() const { return m_numChannels; }
+
+    inline int getNumDropped() const { return m_numDropped.load( std::memory_order_relaxed ); }
+
+private:
+
+    const int m_size; // capacity + 1, an empty slot separates write index from read index
+    const int m_numChannels;
+    juce::HeapBlock<LufsRecord> m_records;
+    juce::HeapBlock<float> m_truePeaks; // numChannels values per slot
+    std::atomic<int> m_writeIndex; // written by producer
+    std::atomic<int> m_readIndex; // written by consumer
+    std::atomic<int> m_numDropped; // written by producer
+
+    JUCE_DECLARE_NON_COPYABLE( LufsRecordFifo )
+};
+
+// Compensated (Kahan) sum in double, for sliding window sums: rounding errors of 
+// values entering and leaving the window are compensated
+class LufsRunningSum
+{
+public:
+
+    LufsRunningSum() : m_sum( 0.0 ), m_compensation( 0.0 ) {}
+
+    inline void add( const double value )
+    {
+        const double compensatedValue = value - m_compensation;
+        const double sum = m_sum + compensatedValue;
+        m_compensation = ( sum - m_sum ) - compensatedValue;
+        m_sum = sum;
+    }
+
+    // a sum of squares, never negative even with a remaining rounding error
+    inline double get() const { return juce::jmax( m_sum, 0.0 ); }
+
+    inline void reset() { m_sum = 0.0; m_compensation = 0.0; }
+
+private:
+
+    double m_sum;
+    double m_compensation;
+};
+
 class LufsProcessor
 {
 public:
 
+    // measures published by update, for the UI
+    struct Snapshot
+    {
+        int m_validSize; // number of values in history arrays
+        int m_hopsPer100ms; // number of history values per 100 ms
+        float m_integratedVolume;
+        float m_rangeMin;
+        float m_rangeMax;
+        float m_maxTruePeak;
+        size_t m_allocatedBytes;
+    };
+
     static float testTruePeak(const juce::File & input , const double sampleRate, int bufferSize);
 
+    // processes seconds of synthetic signal with bufferSize blocks, returns processing time per audio second, in milliseconds 
+    static double testProcessBlockSpeed( const double sampleRate, const int numChannels, const int bufferSize, const int seconds );
+
+    // same as testProcessBlockSpeed with one second of noise fading into silence for another second, 
+    // then digital silence; denormalProtection false shows the cost of denormal filter states
+    static double testSilenceSpeed( const double sampleRate, const int numChannels, const int bufferSize, const int seconds, const bool denormalProtection );
+
+    // compares integrated volume computed with LufsHistogram and with exact sorted LufsFloatArray, 
+    // returns false if difference is 0.01 LU or more
+    static bool testGating();
+
+    // compares loudness range computed with LufsHistogram and with exact sorted LufsFloatArray, 
+    // returns false if difference is 0.01 LU or more
+    static bool testLoudnessRange();
+
+    // compares sliding window means with exact window means over 10 hours of values, 
+    // returns false if relative error is more than 1e-6
+    static bool testWindowMeans();
+
+    // pushes and pops records from two threads with a small fifo, then processes blocks while 
+    // updating and resetting from another thread; meant to be run with ThreadSanitizer too
+    static bool testRecordFifo();
+
+    // processes the same signal with 100, 25 and 10 ms hops, returns false if integrated volume, range,
+    // or momentary and short term volumes at the end of 100 ms blocks differ by 0.01 LU or more
+    static bool testHops();
+
+    // compares K-weighting filter bank kernels with shelf and high pass BiquadProcessor passes at usual sample rates
+    static bool testKWeighting();
+
+    // processes noise with the channel counts and layouts of immersive formats, returns false if 
+    // integrated volume doesn't match the layout weights, or if a channel true peak is wrong
+    static bool testChannelLayouts();
+
+    // test helpers for history tests. makeRandomRecords appends numRecords synthetic records of numChannels 
+    // channels and their true peaks: level changes over minutes so that gating removes quiet parts, with 
+    // 20 dB of noise on squared inputs and 30 dB on true peaks. updateInRandomSizes adds records to processor 
+    // by updates of 1 to maxUpdateSize records, as after stalls of the update thread
+    static void makeRandomRecords( juce::Random & random, const int numRecords, const int numChannels, const int hopsPer100ms, 
+                                   juce::Array<LufsRecord> & records, juce::Array<float> & truePeaks );
+    static void updateInRandomSizes( LufsProcessor & processor, const juce::Array<LufsRecord> & records, const juce::Array<float> & truePeaks, 
+                                     juce::Random & random, const int maxUpdateSize );
+
+    // adds squared samples of K-weighted block from offset to offset + size, weighted by channel 
+    // (BS.1770 weights of the channel layout), to squaredSum: energy sum of the hops
+    static void addWeightedSquaredSum( const juce::AudioSampleBuffer & block, const int offset, const int size, const int numChannels, const float * weights, double & squaredSum );
+
+    // integrated volume and loudness range of gating histograms (blocks above -70 LUFS): LufsHistogram, 
+    // or any bins answering the same queries
+    template <typename Histogram>
+    static float getIntegratedVolume( const Histogram & sum400ms70 )
+    {
+        jassert( sum400ms70.size() );
+
+        const float absoluteSum = float( sum400ms70.getSum() / (double) sum400ms70.size() );
+        const float absoluteThresholdVolume = getLufsVolume( absoluteSum ) -10.f;
+        const float thresholdSum = getLufsSum( absoluteThresholdVolume );
+
+        int count = 0;
+        double relativeSum = 0.0;
+        sum400ms70.getSumAbove( thresholdSum, count, relativeSum );
+
+        if ( count )
+            relativeSum /= count;
+
+        return getLufsVolume( (float)relativeSum );
+    }
+
+    template <typename Histogram>
+    static void getLoudnessRange( const Histogram & sum3s70, float & rangeMin, float & rangeMax )
+    {
+        jassert( sum3s70.size() );
+
+        const float absoluteSum = float( sum3s70.getSum() / (double) sum3s70.size() );
+        const float absoluteThresholdVolume = getLufsVolume( absoluteSum ) -20.f;
+        const float thresholdSum = getLufsSum( absoluteThresholdVolume );
+
+        const float sumPercentile10 = sum3s70.getPercentileValue( thresholdSum, 0.1f );
+        const float sumPercentile95 = sum3s70.getPercentileValue( thresholdSum, 0.95f );
+
+        rangeMin = getLufsVolume( sumPercentile10 );
+        rangeMax = getLufsVolume( sumPercentile95 );
+    }
+
+    // per position update, shared with LufsStreamEngine
+
+    // mean of window of windowSize values ending at position - 1; runningSum is the sum of window of 
+    // position - 1, and is updated to sum of window of position. Values are indexed by position 
+    // (history array, or ring of last values)
+    template <typename Values>
+    static float getWindowMean( const Values & values, const int position, const int windowSize, LufsRunningSum & runningSum )
+    {
+        if ( ( position % windowSumPeriod ) == 0 )
+        {
+            // exact sum from time to time, so that rounding errors don't accumulate
+            runningSum.reset();
+            for ( int i = juce::jmax( 0, position - windowSize ) ; i < position ; ++i )
+                runningSum.add( values[ i ] );
+        }
+        else
+        {
+            // p - 1 enters the window and p - 1 - windowSize leaves it 
+            runningSum.add( values[ position - 1 ] );
+            if ( position > windowSize )
+                runningSum.add( -values[ position - 1 - windowSize ] );
+        }
+
+        return float( runningSum.get() / windowSize );
+    }
+
+    static inline float getWindowVolume( const float mean ) { return juce::jmax( float(-0.691 + 10.*std::log10( mean ) ), DEFAULT_MIN_VOLUME ); }
+
+    // adds a full window to its gating histogram if it ends at a 100 ms boundary and is above the 
+    // absolute gate: gating blocks are 400 ms long with 75 % overlap (BS.1770-4), and short term 
+    // values for loudness range are taken every 100 ms. Returns true if the window was added
+    static inline bool addGatingWindow( LufsHistogram & histogram, const int position, const int hopsPer100ms, const float mean, const float volume )
+    {
+        if ( ( position % hopsPer100ms ) != 0 || volume <= -70.f )
+            return false;
+
+        histogram.addLufs( mean );
+        return true;
+    }
+
+    // true peak of a record, max of the linear true peaks of its numChannels channels, in dB; raises 
+    // maxTruePeak and channelMaxArray, and writes channel volumes to channelVolumes unless null
+    static float addRecordTruePeaks( const float * linearTruePeaks, const int numChannels, float * channelVolumes, float * channelMaxArray, float & maxTruePeak );
+
+    enum
+    {
+        momentaryBlocks = 4, // 400 ms window, in 100 ms blocks
+        shortTermBlocks = 30 // 3 s window, in 100 ms blocks
+    };
+
+    static double ms_log10;
+    static float getLufsVolume( const float sum ) { return float( juce::jmax( float(-0.691 + 10.0 * log( sum ) / ms_log10 ), DEFAULT_MIN_VOLUME ) ); }
+    static float getLufsSum( const float volume ) { return float( exp( ( volume + 0.691 ) * ms_log10 / 10.0 ) ); }
+
+    // size of hop hopIndex of a 100 ms block
+    static int getHopSize( const int sampleSize100ms, const int hopsPer100ms, const int hopIndex );
+
+    // default layout of nbChannels channels (see LufsChannelLayout::getDefault)
     LufsProcessor( const int nbChannels );
+    LufsProcessor( const LufsChannelLayout & layout );
 
     ~LufsProcessor();
 
+    // receives records published by processBlock, updates history and measures, then 
+    // publishes a new snapshot; called by LufsAnalysisThread, or directly when processing offline
     void update();
 
+    // adds records computed by other processors, then updates as update does; used when segments of 
+    // a file are processed in parallel, records of each segment being added in file order
+    // truePeaks holds getNumChannels() true peak values per record
+    void update( const LufsRecord * records, const float * truePeaks, const int numRecords );
+
+    // moves records published by processBlock to records instead of leaving them to update, 
+    // for a processor measuring a segment of a file; getNumChannels() true peak values of
+    // each record are added to truePeaks
+    void takeRecords( juce::Array<LufsRecord> & records, juce::Array<float> & truePeaks );
+
+    inline int getNumChannels() const { return m_nbChannels; }
+    inline const LufsChannelLayout & getChannelLayout() const { return m_channelLayout; }
+
+    // measures the channels of layout from now on, measurement is reset. Channel arrays are 
+    // reallocated under history lock: called while the audio thread doesn't process (before 
+    // prepareToPlay), without session log, as a log has the channels of its processor
+    void setChannelLayout( const LufsChannelLayout & layout );
+
     void reset();
     void prepareToPlay(const double sampleRate, int samplesPerBlock);
     void processBlock( juce::AudioSampleBuffer& buffer );
 
-    inline void pause() { m_paused = true; }
-    inline void resume() { m_paused = false; }
-    inline bool isPaused() { return m_paused; }
+    // hop between history values: 10, 25 or 100 ms, measurement is reset. Momentary and short 
+    // term volumes are computed for each hop; gating blocks and loudness range short term values 
+    // stay on 100 ms boundaries, so that integrated volume and range don't depend on hop
+    void setHopMilliseconds( const int hopMilliseconds );
+    inline int getHopMilliseconds() const { return m_hopMilliseconds.load( std::memory_order_relaxed ); }
+
+    // denormal protection (default): flush to zero mode in processBlock, K-weighting state flushing 
+    // and silence fast path; to be set before processing
+    void setDenormalProtection( const bool enabled );
+
+    // read by the audio thread at each block
+    inline void pause() { m_paused.store( true, std::memory_order_release ); }
+    inline void resume() { m_paused.store( false, std::memory_order_release ); }
+    inline bool isPaused() const { return m_paused.load( std::memory_order_acquire ); }
 
-    inline float * getMomentaryVolumeArray() const { return m_momentaryVolumeArray; } 
-    inline float * getShortTermVolumeArray() const { return m_shortTermVolumeArray; } 
-    inline float * getIntegratedVolumeArray() const { return m_integratedVolumeArray; }
-    inline float * getTruePeakArray() const { return m_truePeakArray; }
-    inline float getTruePeak() const { return m_maxTruePeak; }
-    inline float * getTruePeakChannelArray(int ch) const { return m_truePeakPerChannelArray[ch]; }
-    inline float getTruePeakChannelMax(int ch) const { return m_truePeakMaxPerChannelArray[ch]; }
+    // values are copied to sessionLog after each update, nullptr stops logging; sessionLog isn't owned
+    void setSessionLog( LufsSessionLog * sessionLog );
 
-    inline float getIntegratedVolume() { return m_integratedVolume; }
-    inline float getRangeMinVolume() { return m_rangeMin; }
-    inline float getRangeMaxVolume() { return m_rangeMax; }
+    // replaces history and measures with those of a session log file, which is memory mapped: 
+    // measurement is paused, and records are dropped until reset. Returns false with error set 
+    // if file isn't a session log of getNumChannels() channels
+    bool loadSessionLog( const juce::File & file, juce::String & error );
 
-    inline int getValidSize() const { return m_validSize; }
-    inline int getMaxSize() const { return m_maxSize; }
+    // history lock must be held when called from another thread than the one loading or resetting
+    inline bool isSessionLogLoaded() const { return m_sessionLogFile != nullptr; }
 
-    inline int getSeconds() const { return m_processSize / 10; }
+    inline double getSampleRate() const { return m_sampleRate; }
+
+    // history arrays are written by update, and cleared by reset: history lock must be held 
+    // while reading them from another thread, for indexes below published valid size
+    inline const juce::CriticalSection & getHistoryLock() const { return m_historyLock; }
+
+    inline const LufsHistoryArray & getSquaredInputArray() const { return m_squaredInputArray; } 
+    inline const LufsHistoryArray & getMomentaryVolumeArray() const { return m_momentaryVolumeArray; } 
+    inline const LufsHistoryArray & getShortTermVolumeArray() const { return m_shortTermVolumeArray; } 
+    inline const LufsHistoryArray & getIntegratedVolumeArray() const { return m_integratedVolumeArray; }
+    inline const LufsHistoryArray & getTruePeakArray() const { return m_truePeakArray; }
+    inline const LufsHistoryArray & getTruePeakChannelArray(int ch) const { return *m_truePeakPerChannelArray.getUnchecked(ch); }
+
+    // max and min of any range of history arrays, integrated volume and loudness range of any range 
+    // of positions; updated with history, history lock must be held as for history arrays
+    inline const LufsHistoryIndex & getHistoryIndex() const { return *m_historyIndex; }
+
+    // published measures
+    Snapshot getSnapshot() const;
+
+    inline float getTruePeak() const { return getSnapshot().m_maxTruePeak; }
+    // published true peak max of channel ch, in dB
+    float getTruePeakChannelMax( const int ch ) const;
+
+    inline float getIntegratedVolume() const { return getSnapshot().m_integratedVolume; }
+    inline float getRangeMinVolume() const { return getSnapshot().m_rangeMin; }
+    inline float getRangeMaxVolume() const { return getSnapshot().m_rangeMax; }
+
+    inline int getValidSize() const { return getSnapshot().m_validSize; }
+    inline size_t getAllocatedBytes() const { return getSnapshot().m_allocatedBytes; }
+
+    inline int getSeconds() const { const Snapshot snapshot = getSnapshot(); return snapshot.m_validSize / ( 10 * snapshot.m_hopsPer100ms ); }
+
+    // incremented by reset: history read in several times, with history lock held, 
+    // wasn't reset in between if generation didn't change
+    inline int getGeneration() const { return m_generation.load( std::memory_order_acquire ); }
+
+    // number of hop records lost because update wasn't called often enough
+    inline int getNumDroppedRecords() const { return m_recordFifo->getNumDropped(); }
 
 private:
 
-    void addSquaredInputAndTruePeak( const float squaredInput, const AudioProcessing::TruePeak::LinearValue& value, const int numChannels );
-    void updatePosition( int position );
+    // channel arrays, fifo and history index for the channels of m_channelLayout
+    void allocateChannels();
 
-    static double ms_log10;
-    float getLufsVolume( const float sum ) { return float( juce::jmax( float(-0.691 + 10.0 * log( sum ) / ms_log10 ), DEFAULT_MIN_VOLUME ) ); }
-    float getLufsSum( const float volume ) { return float( exp( ( volume + 0.691 ) * ms_log10 / 10.0 ) ); }
+    // audio thread
+    void resetProcessing();
+    void publishRecord( const float squaredInput, const AudioProcessing::TruePeak::LinearValue& value, const int numChannels );
+
+    // update thread
+    void addRecord( const LufsRecord & record, const float * truePeaks );
+    void updatePendingPositions();
+    void publishSnapshot();
+    void appendSessionLog();
+    // means of windows of windowSize values ending before each position of [begin, end[; runningSum 
+    // is the sum of window of begin - 1, and is then updated to sum of window of end - 1
+    static void getWindowMeans( const LufsHistoryArray & values, const int begin, const int end, const int windowSize, LufsRunningSum & runningSum, float * means );
+
+    // updates positions [begin, end[, at most batchSize positions
+    void updatePositions( const int begin, const int end );
 
     juce::AudioSampleBuffer m_block; // data is copied to this buffer then filtered
-    juce::AudioSampleBuffer m_volumeMemory; // samples not processed from previous callback, filtered for volume 
-    juce::AudioSampleBuffer m_truePeakMemory; // samples not processed from previous callback, not filtered, for true peak 
     double m_sampleRate;
+    LufsChannelLayout m_channelLayout;
     int m_nbChannels;
 
-    juce::Array<BiquadProcessor> m_shelveFilterArray;
-    juce::Array<BiquadProcessor> m_highPassFilterArray;
+    AudioProcessing::KWeightingFilterBank m_kWeightingFilterBank;
 
-    int m_maxSize;
-    volatile int m_processSize;
-    int m_validSize; // process size as seen by client, in main update 
-    int m_memorySize;
+    int m_processSize; // number of records received by update
+    int m_validSize; // number of positions updated
     int m_sampleSize100ms;
-
-    float * m_squaredInputArray; // squared input for 100 ms, summed for all channels, after K weighting filtration
-    float * m_momentaryVolumeArray;
-    float * m_shortTermVolumeArray;
-    float * m_integratedVolumeArray;
-    float * m_truePeakArray; // max true peak linear volume for 100 ms
-    float * m_truePeakPerChannelArray[LUFS_TP_MAX_NB_CHANNELS]; // true peak decibel volume for 100 ms, per channel
-    float m_truePeakMaxPerChannelArray[LUFS_TP_MAX_NB_CHANNELS]; // true peak max decibel volume for 100 ms, per channel
+    int m_segmentSize; // number of samples already processed in current hop
+    double m_segmentSquaredSum; // weighted squared sum of filtered samples in current hop, all channels
+    int m_hopIndex; // index of current hop in its 100 ms block
+    int m_processHopsPer100ms; // hops per 100 ms of the audio thread processing state
+    int m_hopsPer100ms; // hops per 100 ms of history, since last reset
+
+    LufsHistoryArray m_squaredInputArray; // squared input for 100 ms, summed for all channels, after K weighting filtration
+    LufsHistoryArray m_momentaryVolumeArray;
+    LufsHistoryArray m_shortTermVolumeArray;
+    LufsHistoryArray m_integratedVolumeArray;
+    LufsHistoryArray m_truePeakArray; // max true peak linear volume for 100 ms
+    juce::OwnedArray<LufsHistoryArray> m_truePeakPerChannelArray; // true peak decibel volume for 100 ms, per channel
+    juce::HeapBlock<float> m_truePeakMaxPerChannelArray; // true peak max decibel volume for 100 ms, per channel
+    juce::ScopedPointer<LufsHistoryIndex> m_historyIndex; // indexes all history arrays but squared inputs
     float m_maxTruePeak;
     float m_integratedVolume;
     float m_rangeMin;
     float m_rangeMax;
 
-    // 4 samples to calculate min/max, per channel
-    float ** m_memArray;
-    // linear max, per channel 
-    float m_maxLinArray[LUFS_TP_MAX_NB_CHANNELS];
-    juce::AudioSampleBuffer m_tempBlock; // to process min max;
+    juce::CriticalSection m_historyLock; // held by update and reset, and by other threads reading history
+    Snapshot m_snapshot; // measures as published by update, under history lock
+    juce::HeapBlock<float> m_snapshotTruePeakMaxPerChannelArray; // published with m_snapshot
+
+    juce::HeapBlock<float> m_poppedTruePeaks; // true peaks of the record popped by update or takeRecords
+    juce::HeapBlock<float> m_recordTruePeakVolumes; // channel true peaks of the record added by addRecord, in dB
 
-    juce::SpinLock m_locker;
+    juce::ScopedPointer<LufsRecordFifo> m_recordFifo; // records of one hop, from audio thread to update thread
+    std::atomic<int> m_generation; // incremented by reset, records of previous generations are dropped
+    int m_processGeneration; // generation of the audio thread processing state
+    std::atomic<int> m_hopMilliseconds; // applied by reset
 
-    LufsFloatArray m_sum400ms70;
-    LufsFloatArray m_sum3s70;
+    LufsHistogram m_sum400ms70;
+    LufsHistogram m_sum3s70;
+
+    enum 
+    {
+        recordFifoSeconds = 120, // records the fifo holds at 10 ms hops: 5 minutes at 25 ms, 20 at 100 ms
+        batchSize = 4096, // max number of positions updated by updatePositions
+        windowSumPeriod = 1024 // window sums are computed exactly every windowSumPeriod positions
+    };
+
+    LufsRunningSum m_momentarySum; // squared inputs in momentary window of last updated position
+    LufsRunningSum m_shortTermSum; // squared inputs in short term window of last updated position
+    juce::HeapBlock<float> m_batchBuffer; // window sums and volumes of positions being updated
 
     AudioProcessing::TruePeak m_truePeakProcessor;
 
-    bool m_paused;
+    bool m_denormalProtection;
+    std::atomic<bool> m_paused; // written by other threads, read by the audio thread
+
+    juce::CriticalSection m_sessionLogLock; // held while m_sessionLog is set or written
+    LufsSessionLog * m_sessionLog;
+    juce::ScopedPointer<juce::MemoryMappedFile> m_sessionLogFile; // loaded session log, mapped by history arrays
 };
 
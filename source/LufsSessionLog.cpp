@@ -0,0 +1,500 @@
+/*
+  =================================================================
+
+  This file is part of the LUFS-TruePeak program.
+  Copyright (c) 2015 - Mathieu Pavageau - contact@repetito.com
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  Details of these licenses can be found at: www.gnu.org/licenses
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  =================================================================
+*/
+
+#include "AppIncsAndDefs.h"
+
+#include "LufsSessionLog.h"
+
+static const char * const sessionLogMagic = "LUFSLOG";
+
+juce::int64 LufsSessionLog::getOffset( const int numChannels, const int column, const int position )
+{
+    const juce::int64 block = position >> LufsHistoryArray::chunkShift;
+    const juce::int64 columnOffset = ( block * getNumColumns( numChannels ) + column ) * LufsHistoryArray::chunkSize;
+    return headerSize + ( columnOffset + ( position & LufsHistoryArray::chunkMask ) ) * (juce::int64)sizeof( float );
+}
+
+bool LufsSessionLog::readHeader( const void * data, const size_t size, Header & header, juce::String & error )
+{
+    if ( size < (size_t)headerSize )
+    {
+        error = "File is too small to be a session log";
+        return false;
+    }
+
+    memcpy( &header, data, sizeof( Header ) );
+    header.m_layoutName[ layoutNameSize - 1 ] = 0;
+
+    // version is also wrong when byte order differs
+    if ( memcmp( header.m_magic, sessionLogMagic, sizeof( header.m_magic ) ) != 0 || header.m_version != version || header.m_headerSize != headerSize )
+    {
+        error = "File is not a session log, or was written by another version";
+        return false;
+    }
+
+    if ( header.m_numChannels < 1 || header.m_numChannels > maxChannels || header.m_numPositions < 0 
+        || ( header.m_hopMilliseconds != 10 && header.m_hopMilliseconds != 25 && header.m_hopMilliseconds != 100 ) )
+    {
+        error = "Session log header is invalid";
+        return false;
+    }
+
+    // the last column is the last one written
+    if ( header.m_numPositions > 0 && (juce::int64)size < getOffset( header.m_numChannels, getNumColumns( header.m_numChannels ) - 1, header.m_numPositions - 1 ) + (juce::int64)sizeof( float ) )
+    {
+        error = "Session log is truncated";
+        return false;
+    }
+
+    return true;
+}
+
+LufsSessionLogWriter::LufsSessionLogWriter()
+    : juce::TimeSliceThread( "LufsSessionLogWriter" )
+{
+    startThread();
+}
+
+LufsSessionLogWriter::~LufsSessionLogWriter()
+{
+    jassert( getNumClients() == 0 );
+
+    stopThread( 1000 );
+}
+
+LufsSessionLog::LufsSessionLog( const LufsProcessor & processor, const juce::File & directory )
+    : m_processor( processor )
+    , m_directory( directory )
+    , m_numChannels( processor.getNumChannels() )
+    , m_copiedGeneration( -1 )
+    , m_numCopiedPositions( 0 )
+    , m_generation( -1 )
+    , m_numPositions( 0 )
+    , m_failed( false )
+{
+    jassert( m_numChannels <= maxChannels );
+
+    m_writer->addTimeSliceClient( this, writerPeriodMs );
+}
+
+LufsSessionLog::~LufsSessionLog()
+{
+    // when this returns, the writer thread doesn't use the log anymore
+    m_writer->removeTimeSliceClient( this );
+
+    append( true );
+}
+
+juce::File LufsSessionLog::getFile() const
+{
+    const juce::ScopedLock fileLock( m_fileLock );
+
+    return m_file;
+}
+
+void LufsSessionLog::append( const bool force )
+{
+    if ( m_numChannels > maxChannels )
+        return;
+
+    const juce::ScopedLock copyLock( m_copyLock );
+
+    if ( !force )
+    {
+        bool copied = false;
+        while ( copyBatch( false ) )
+            copied = true;
+
+        if ( copied )
+            m_writer->moveToFrontOfQueue( this );
+
+        return;
+    }
+
+    // the queue is emptied as it fills, up to the last value
+    for ( bool copied = true ; copied ; )
+    {
+        copied = false;
+        while ( copyBatch( true ) )
+            copied = true;
+
+        write();
+    }
+}
+
+int LufsSessionLog::useTimeSlice()
+{
+    write();
+
+    return writerPeriodMs;
+}
+
+bool LufsSessionLog::copyBatch( const bool force )
+{
+    // taken before history lock, so that batches are allocated without it
+    juce::ScopedPointer<Batch> batch;
+    {
+        const juce::ScopedLock queueLock( m_queueLock );
+
+        if ( m_pendingBatches.size() >= maxPendingBatches )
+            return false;
+
+        batch = m_freeBatches.removeAndReturn( m_freeBatches.size() - 1 );
+    }
+
+    if ( batch == nullptr )
+    {
+        batch = new Batch();
+        batch->m_values.malloc( getNumColumns( m_numChannels ) * LufsHistoryArray::chunkSize );
+        batch->m_truePeakMaxPerChannel.malloc( m_numChannels );
+    }
+
+    bool copied = false;
+    {
+        const juce::ScopedLock historyLock( m_processor.getHistoryLock() );
+        const LufsProcessor::Snapshot snapshot = m_processor.getSnapshot();
+
+        // a reset ends the measurement logged in current file, next values go to a new file
+        const int generation = m_processor.getGeneration();
+        if ( generation != m_copiedGeneration )
+        {
+            m_copiedGeneration = generation;
+            m_numCopiedPositions = 0;
+        }
+
+        // one block at most, at least one second unless block is complete; a loaded session log is already logged
+        const int begin = m_numCopiedPositions;
+        const int blockEnd = ( begin | LufsHistoryArray::chunkMask ) + 1;
+        const int end = juce::jmin( snapshot.m_validSize, blockEnd );
+        if ( !m_processor.isSessionLogLoaded() && end > begin && ( force || end == blockEnd || end - begin >= 10 * snapshot.m_hopsPer100ms ) )
+        {
+            for ( int column = 0 ; column < getNumColumns( m_numChannels ) ; ++column )
+            {
+                const LufsHistoryArray & array = column == squaredInputColumn ? m_processor.getSquaredInputArray()
+                    : column == momentaryColumn ? m_processor.getMomentaryVolumeArray()
+                    : column == shortTermColumn ? m_processor.getShortTermVolumeArray()
+                    : column == integratedColumn ? m_processor.getIntegratedVolumeArray()
+                    : column == truePeakColumn ? m_processor.getTruePeakArray()
+                    : m_processor.getTruePeakChannelArray( column - firstChannelColumn );
+
+                float * values = batch->m_values + column * LufsHistoryArray::chunkSize;
+                for ( int position = begin ; position < end ; ++position )
+                    values[ position - begin ] = array[ position ];
+            }
+
+            for ( int ch = 0 ; ch < m_numChannels ; ++ch )
+                batch->m_truePeakMaxPerChannel[ ch ] = m_processor.getTruePeakChannelMax( ch );
+
+            batch->m_generation = generation;
+            batch->m_sampleRate = m_processor.getSampleRate();
+            batch->m_hopMilliseconds = 100 / snapshot.m_hopsPer100ms;
+            batch->m_layoutName = m_processor.getChannelLayout().getName();
+            batch->m_snapshot = snapshot;
+            batch->m_begin = begin;
+            batch->m_end = end;
+
+            m_numCopiedPositions = end;
+            copied = true;
+        }
+    }
+
+    const juce::ScopedLock queueLock( m_queueLock );
+
+    if ( copied )
+        m_pendingBatches.add( batch.release() );
+    else
+        m_freeBatches.add( batch.release() );
+
+    return copied;
+}
+
+void LufsSessionLog::write()
+{
+    const juce::ScopedLock writeLock( m_writeLock );
+
+    for ( ;; )
+    {
+        Batch * batch;
+        {
+            const juce::ScopedLock queueLock( m_queueLock );
+
+            if ( m_pendingBatches.size() == 0 )
+                return;
+
+            batch = m_pendingBatches.getUnchecked( 0 );
+        }
+
+        writeBatch( *batch );
+
+        const juce::ScopedLock queueLock( m_queueLock );
+
+        m_freeBatches.add( m_pendingBatches.removeAndReturn( 0 ) );
+    }
+}
+
+void LufsSessionLog::writeBatch( const Batch & batch )
+{
+    // a reset ends the measurement logged in current file, next values go to a new file
+    if ( batch.m_generation != m_generation )
+    {
+        m_stream = nullptr;
+        m_generation = batch.m_generation;
+        m_numPositions = 0;
+        m_failed = false;
+    }
+
+    if ( m_failed )
+        return;
+
+    jassert( batch.m_begin == m_numPositions );
+
+    if ( m_stream == nullptr && !createFile( batch ) )
+    {
+        m_failed = true;
+        m_stream = nullptr;
+        return;
+    }
+
+    // values, then header counting them; measures of the header are those of the snapshot, 
+    // which can be ahead of the written values until last block is written
+    const int numColumns = getNumColumns( m_numChannels );
+    for ( int column = 0 ; column < numColumns && !m_failed ; ++column )
+    {
+        m_failed = !m_stream->setPosition( getOffset( m_numChannels, column, batch.m_begin ) )
+            || !m_stream->write( batch.m_values + column * LufsHistoryArray::chunkSize, (size_t)( batch.m_end - batch.m_begin ) * sizeof( float ) );
+    }
+
+    m_numPositions = batch.m_end;
+    if ( m_failed || !writeHeader( batch, batch.m_snapshot, batch.m_truePeakMaxPerChannel ) )
+    {
+        m_failed = true;
+        m_stream = nullptr;
+    }
+}
+
+bool LufsSessionLog::createFile( const Batch & batch )
+{
+    if ( !m_directory.createDirectory() )
+        return false;
+
+    const juce::String name( "Session " + juce::Time::getCurrentTime().formatted( "%Y-%m-%d %H-%M-%S" ) );
+    const juce::File file( m_directory.getChildFile( name + ".lufslog" ).getNonexistentSibling() );
+    {
+        const juce::ScopedLock fileLock( m_fileLock );
+        m_file = file;
+    }
+
+    m_stream = new juce::FileOutputStream( file );
+    if ( !m_stream->openedOk() )
+        return false;
+
+    // header of an empty log, so that the file is valid from the start
+    LufsProcessor::Snapshot snapshot;
+    snapshot.m_validSize = 0;
+    snapshot.m_integratedVolume = DEFAULT_MIN_VOLUME;
+    snapshot.m_rangeMin = DEFAULT_MIN_VOLUME;
+    snapshot.m_rangeMax = DEFAULT_MIN_VOLUME;
+    snapshot.m_maxTruePeak = DEFAULT_MIN_VOLUME;
+
+    juce::HeapBlock<float> truePeakMaxPerChannel( m_numChannels );
+    for ( int ch = 0 ; ch < m_numChannels ; ++ch )
+        truePeakMaxPerChannel[ ch ] = DEFAULT_MIN_VOLUME;
+
+    return writeHeader( batch, snapshot, truePeakMaxPerChannel );
+}
+
+bool LufsSessionLog::writeHeader( const Batch & batch, const LufsProcessor::Snapshot & snapshot, const float * truePeakMaxPerChannel )
+{
+    Header header;
+    memset( &header, 0, sizeof( Header ) );
+    memcpy( header.m_magic, sessionLogMagic, sizeof( header.m_magic ) );
+    header.m_version = version;
+    header.m_headerSize = headerSize;
+    header.m_sampleRate = batch.m_sampleRate;
+    header.m_hopMilliseconds = batch.m_hopMilliseconds;
+    header.m_numChannels = m_numChannels;
+    header.m_numPositions = m_numPositions;
+    header.m_integratedVolume = snapshot.m_integratedVolume;
+    header.m_rangeMin = snapshot.m_rangeMin;
+    header.m_rangeMax = snapshot.m_rangeMax;
+    header.m_maxTruePeak = snapshot.m_maxTruePeak;
+    batch.m_layoutName.copyToUTF8( header.m_layoutName, layoutNameSize );
+
+    char data[ headerSize ];
+    memset( data, 0, headerSize );
+    memcpy( data, &header, sizeof( Header ) );
+    memcpy( data + sizeof( Header ), truePeakMaxPerChannel, m_numChannels * sizeof( float ) );
+
+    if ( !m_stream->setPosition( 0 ) || !m_stream->write( data, headerSize ) )
+        return false;
+
+    m_stream->flush();
+    return m_stream->getStatus().wasOk();
+}
+
+// adds numRecords synthetic records to processor by updates of various sizes, as after stalls of the update thread
+static void addRandomRecords( LufsProcessor & processor, juce::Random & random, const int numRecords )
+{
+    juce::Array<LufsRecord> records;
+    juce::Array<float> truePeaks;
+    LufsProcessor::makeRandomRecords( random, numRecords, processor.getNumChannels(), 100 / processor.getHopMilliseconds(), records, truePeaks );
+    LufsProcessor::updateInRandomSizes( processor, records, truePeaks, random, 3000 );
+}
+
+static bool isSameHistory( const LufsHistoryArray & a, const LufsHistoryArray & b, const int size )
+{
+    for ( int i = 0 ; i < size ; ++i )
+    {
+        if ( a[ i ] != b[ i ] )
+            return false;
+    }
+
+    return true;
+}
+
+bool LufsSessionLog::testReload()
+{
+    bool success = true;
+
+    const juce::File directory( juce::File::getSpecialLocation( juce::File::tempDirectory ).getNonexistentChildFile( "LufsSessionLog", juce::String::empty, false ) );
+    const int numChannels = 6;
+    juce::Random random( 0x1770 );
+
+    LufsProcessor processor( numChannels );
+    processor.prepareToPlay( 48000.0, 512 );
+    processor.setHopMilliseconds( 25 );
+
+    // 10 minutes of 25 ms values, blocks and last partial block
+    juce::File file;
+    {
+        LufsSessionLog sessionLog( processor, directory );
+        processor.setSessionLog( &sessionLog );
+        addRandomRecords( processor, random, 10 * 60 * 40 + 7 );
+        processor.setSessionLog( nullptr );
+        sessionLog.append( true );
+        file = sessionLog.getFile();
+    }
+
+    LufsProcessor reloaded( numChannels );
+    reloaded.prepareToPlay( 48000.0, 512 );
+    juce::String error;
+    if ( !reloaded.loadSessionLog( file, error ) )
+    {
+        DBG( "LufsSessionLog::testReload " + error );
+        success = false;
+    }
+    else
+    {
+        const LufsProcessor::Snapshot snapshot = processor.getSnapshot();
+        const LufsProcessor::Snapshot reloadedSnapshot = reloaded.getSnapshot();
+        const int size = snapshot.m_validSize;
+
+        bool same = reloaded.isPaused() && reloaded.isSessionLogLoaded() && reloaded.getHopMilliseconds() == 100
+            && reloadedSnapshot.m_validSize == size && reloadedSnapshot.m_hopsPer100ms == snapshot.m_hopsPer100ms
+            && reloadedSnapshot.m_integratedVolume == snapshot.m_integratedVolume && reloadedSnapshot.m_maxTruePeak == snapshot.m_maxTruePeak
+            && reloadedSnapshot.m_rangeMin == snapshot.m_rangeMin && reloadedSnapshot.m_rangeMax == snapshot.m_rangeMax
+            && isSameHistory( reloaded.getSquaredInputArray(), processor.getSquaredInputArray(), size )
+            && isSameHistory( reloaded.getMomentaryVolumeArray(), processor.getMomentaryVolumeArray(), size )
+            && isSameHistory( reloaded.getShortTermVolumeArray(), processor.getShortTermVolumeArray(), size )
+            && isSameHistory( reloaded.getIntegratedVolumeArray(), processor.getIntegratedVolumeArray(), size )
+            && isSameHistory( reloaded.getTruePeakArray(), processor.getTruePeakArray(), size );
+
+        for ( int ch = 0 ; ch < numChannels ; ++ch )
+        {
+            same = same && reloaded.getTruePeakChannelMax( ch ) == processor.getTruePeakChannelMax( ch )
+                && isSameHistory( reloaded.getTruePeakChannelArray( ch ), processor.getTruePeakChannelArray( ch ), size );
+        }
+
+        if ( !same )
+        {
+            DBG( "LufsSessionLog::testReload reloaded history differs" );
+            success = false;
+        }
+
+        // back to measuring after reset, with the configured hop instead of the hop of the log
+        reloaded.reset();
+        if ( reloaded.isSessionLogLoaded() || reloaded.getValidSize() != 0 )
+        {
+            DBG( "LufsSessionLog::testReload session log still loaded after reset" );
+            success = false;
+        }
+
+        // one second of audio
+        reloaded.resume();
+        juce::AudioSampleBuffer block( numChannels, 480 );
+        for ( int i = 0 ; i < 100 ; ++i )
+        {
+            for ( int ch = 0 ; ch < numChannels ; ++ch )
+            {
+                for ( int j = 0 ; j < block.getNumSamples() ; ++j )
+                    block.setSample( ch, j, 0.5f * random.nextFloat() - 0.25f );
+            }
+            reloaded.processBlock( block );
+        }
+        reloaded.update();
+
+        const LufsProcessor::Snapshot measuredSnapshot = reloaded.getSnapshot();
+        if ( reloaded.getHopMilliseconds() != 100 || measuredSnapshot.m_hopsPer100ms != 1 || measuredSnapshot.m_validSize != 10 )
+        {
+            DBG( "LufsSessionLog::testReload hop of the loaded log kept after reset" );
+            success = false;
+        }
+        reloaded.reset();
+    }
+
+    // a truncated file is refused
+    {
+        juce::MemoryBlock data;
+        file.loadFileAsData( data );
+        const juce::File truncatedFile( directory.getChildFile( "truncated.lufslog" ) );
+        truncatedFile.replaceWithData( data.getData(), data.getSize() - 100 );
+        if ( reloaded.loadSessionLog( truncatedFile, error ) )
+        {
+            DBG( "LufsSessionLog::testReload truncated file was loaded" );
+            success = false;
+        }
+    }
+
+    // a reset starts a new file
+    {
+        LufsSessionLog sessionLog( processor, directory );
+        processor.setSessionLog( &sessionLog );
+        processor.reset();
+        addRandomRecords( processor, random, 400 );
+        sessionLog.append( true );
+        const juce::File firstFile = sessionLog.getFile();
+        processor.reset();
+        addRandomRecords( processor, random, 800 );
+        processor.setSessionLog( nullptr );
+        sessionLog.append( true );
+
+        if ( firstFile == sessionLog.getFile() || !reloaded.loadSessionLog( sessionLog.getFile(), error ) || reloaded.getValidSize() != 800 )
+        {
+            DBG( "LufsSessionLog::testReload reset didn't start a new file" );
+            success = false;
+        }
+        reloaded.reset();
+    }
+
+    directory.deleteRecursively();
+
+    return success;
+}
@@ -0,0 +1,180 @@
+/*
+  =================================================================
+
+  This file is part of the LUFS-TruePeak program.
+  Copyright (c) 2015 - Mathieu Pavageau - contact@repetito.com
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  Details of these licenses can be found at: www.gnu.org/licenses
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  =================================================================
+*/
+
+#pragma once 
+
+#include "LufsProcessor.h"
+
+// Thread writing session logs. Meant to be used through a juce::SharedResourcePointer: one 
+// thread is shared by all logs of a host process
+class LufsSessionLogWriter : public juce::TimeSliceThread
+{
+public:
+
+    LufsSessionLogWriter();
+    ~LufsSessionLogWriter();
+
+private:
+
+    JUCE_DECLARE_NON_COPYABLE( LufsSessionLogWriter )
+};
+
+// Binary log of a measurement session: values of all history arrays of a LufsProcessor (squared input, 
+// momentary, short term, integrated, true peak and true peak of each channel), written while measuring 
+// so that multi-day sessions can be reopened, shown and exported without measuring them again.
+// 
+// A header of headerSize bytes (sample rate, hop, layout, measures) is followed by blocks of 
+// LufsHistoryArray::chunkSize positions, each column of a block being stored contiguously: the 
+// reopened file is memory mapped, and its columns become the chunks of the history arrays, without 
+// reading or copying values (see LufsProcessor::loadSessionLog). Values are written in native byte order.
+// 
+// Blocks are only appended and filled; the header is updated after values, so that a file cut 
+// by a crash is valid up to its last written header.
+// 
+// Values are copied from history by the thread updating the processor, and written to the file 
+// by a LufsSessionLogWriter, so that a slow disk doesn't delay measurement of other processors
+class LufsSessionLog : public juce::TimeSliceClient
+{
+public:
+
+    enum Column
+    {
+        squaredInputColumn = 0,
+        momentaryColumn,
+        shortTermColumn,
+        integratedColumn,
+        truePeakColumn,
+        firstChannelColumn // true peak of channel ch is column firstChannelColumn + ch
+    };
+
+    enum
+    {
+        version = 1,
+        headerSize = 4096, // first block is page aligned
+        layoutNameSize = 64,
+        maxPendingBatches = 16, // copying stops while the writer is this late, values stay in history
+        writerPeriodMs = 1000
+    };
+
+    struct Header
+    {
+        char m_magic[ 8 ]; // "LUFSLOG"
+        juce::int32 m_version;
+        juce::int32 m_headerSize;
+        double m_sampleRate;
+        juce::int32 m_hopMilliseconds;
+        juce::int32 m_numChannels;
+        juce::int32 m_numPositions; // number of values of each column
+        float m_integratedVolume;
+        float m_rangeMin;
+        float m_rangeMax;
+        float m_maxTruePeak;
+        char m_layoutName[ layoutNameSize ]; // zero terminated UTF-8
+        // followed by m_numChannels true peak max values
+    };
+
+    enum { maxChannels = ( headerSize - (int)sizeof( Header ) ) / (int)sizeof( float ) };
+
+    inline static int getNumColumns( const int numChannels ) { return firstChannelColumn + numChannels; }
+
+    // offset in file of value of column at position
+    static juce::int64 getOffset( const int numChannels, const int column, const int position );
+
+    // checks header of data of size bytes, returns false with error set if it isn't a valid session log
+    static bool readHeader( const void * data, const size_t size, Header & header, juce::String & error );
+
+    // logs measures of processor in files of directory, a new file being created for the 
+    // first values following each reset; processor must outlive the log
+    LufsSessionLog( const LufsProcessor & processor, const juce::File & directory );
+
+    // writes values not written yet
+    ~LufsSessionLog();
+
+    // copies values published by processor since last call, by batches of at least one second 
+    // unless force is set, for the writer thread; called after update by LufsProcessor, see 
+    // LufsProcessor::setSessionLog. When force is set, copied values are written before returning
+    void append( const bool force = false );
+
+    // juce::TimeSliceClient, writes copied values on the writer thread
+    int useTimeSlice() override;
+
+    // file of the current measurement, or file of the previous one until new values are written
+    juce::File getFile() const;
+
+    // writes a session log of 10 minutes of values by batches of various sizes, reopens it and compares 
+    // history and measures with the processor; also checks that a reset starts a new file
+    static bool testReload();
+
+private:
+
+    // values of positions [m_begin, m_end[ of a block, copied from history with the measures of 
+    // the snapshot, to be written by the writer thread; batches are recycled once written
+    struct Batch
+    {
+        int m_generation;
+        double m_sampleRate;
+        int m_hopMilliseconds;
+        juce::String m_layoutName;
+        LufsProcessor::Snapshot m_snapshot;
+        int m_begin;
+        int m_end;
+        juce::HeapBlock<float> m_values; // column by column
+        juce::HeapBlock<float> m_truePeakMaxPerChannel;
+    };
+
+    // copies next values into a batch queued for the writer, returns false if there is nothing 
+    // to copy yet or too many batches are queued
+    bool copyBatch( const bool force );
+
+    // writes queued batches
+    void write();
+    void writeBatch( const Batch & batch );
+
+    // creates file of a new measurement, returns false if it can't be written
+    bool createFile( const Batch & batch );
+    bool writeHeader( const Batch & batch, const LufsProcessor::Snapshot & snapshot, const float * truePeakMaxPerChannel );
+
+    const LufsProcessor & m_processor;
+    const juce::File m_directory;
+    const int m_numChannels;
+    juce::SharedResourcePointer<LufsSessionLogWriter> m_writer;
+
+    // copy, held by append
+    juce::CriticalSection m_copyLock;
+    int m_copiedGeneration; // reset generation of processor whose values are copied
+    int m_numCopiedPositions;
+
+    // queue, held while batches are moved
+    juce::CriticalSection m_queueLock;
+    juce::OwnedArray<Batch> m_pendingBatches; // oldest first
+    juce::OwnedArray<Batch> m_freeBatches;
+
+    // write, held by write; m_fileLock is only held while m_file is set or read
+    juce::CriticalSection m_writeLock;
+    juce::CriticalSection m_fileLock;
+    juce::File m_file;
+    juce::ScopedPointer<juce::FileOutputStream> m_stream;
+    int m_generation; // reset generation of processor logged in m_file
+    int m_numPositions; // number of positions written in m_file
+    bool m_failed; // file couldn't be created or written, batches are dropped until next reset
+
+    JUCE_DECLARE_NON_COPYABLE( LufsSessionLog )
+};
@@ -0,0 +1,499 @@
+/*
+  =================================================================
+
+  This file is part of the LUFS-TruePeak program.
+  Copyright (c) 2015 - Mathieu Pavageau - contact@repetito.com
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  Details of these licenses can be found at: www.gnu.org/licenses
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  =================================================================
+*/
+
+#include "AppIncsAndDefs.h"
+
+#include "LufsStreamEngine.h"
+
+float getDecibelVolumeFromLinearVolume(float _linearVolume );
+
+LufsStreamEngine::Stream::Stream( const int windowSize, const int historySize, const int numChannels )
+    : m_windowSize( windowSize )
+    , m_historySize( historySize )
+    , m_numChannels( numChannels )
+{
+    m_window.malloc( (size_t)m_windowSize );
+    m_history.malloc( (size_t)m_historySize );
+    m_truePeakMaxPerChannelArray.malloc( (size_t)m_numChannels );
+    reset();
+}
+
+void LufsStreamEngine::Stream::reset()
+{
+    m_sum400ms70.reset();
+    m_sum3s70.reset();
+    m_momentarySum.reset();
+    m_shortTermSum.reset();
+
+    m_skipHop = false;
+
+    m_measures.m_validSize = 0;
+    m_measures.m_momentaryVolume = DEFAULT_MIN_VOLUME;
+    m_measures.m_shortTermVolume = DEFAULT_MIN_VOLUME;
+    m_measures.m_integratedVolume = DEFAULT_MIN_VOLUME;
+    m_measures.m_rangeMin = DEFAULT_MIN_VOLUME;
+    m_measures.m_rangeMax = DEFAULT_MIN_VOLUME;
+    m_measures.m_maxTruePeak = DEFAULT_MIN_VOLUME;
+    for ( int ch = 0 ; ch < m_numChannels ; ++ch )
+        m_truePeakMaxPerChannelArray[ ch ] = DEFAULT_MIN_VOLUME;
+}
+
+LufsStreamEngine::LufsStreamEngine( const int numStreams, const int numChannels, const double sampleRate, const int maxBlockSize, 
+                                    const int hopMilliseconds, const int historySeconds )
+    : LufsStreamEngine( numStreams, LufsChannelLayout::getDefault( numChannels ), sampleRate, maxBlockSize, hopMilliseconds, historySeconds )
+{
+}
+
+LufsStreamEngine::LufsStreamEngine( const int numStreams, const LufsChannelLayout & layout, const double sampleRate, const int maxBlockSize, 
+                                    const int hopMilliseconds, const int historySeconds )
+    : m_numStreams( numStreams )
+    , m_numChannels( layout.getNumChannels() )
+    , m_numLanes( numStreams * m_numChannels )
+    , m_maxBlockSize( maxBlockSize )
+    , m_sampleSize100ms( (int)( sampleRate / 10.0 ) )
+    , m_hopsPer100ms( 100 / hopMilliseconds )
+    , m_polyphase4AbsMaxKernel( AudioProcessing::getPolyphase4AbsMaxKernel() )
+    , m_segmentSize( 0 )
+    , m_hopIndex( 0 )
+{
+    jassert( m_numChannels > 0 );
+    jassert( hopMilliseconds == 10 || hopMilliseconds == 25 || hopMilliseconds == 100 );
+
+    // same filters as LufsProcessor::prepareToPlay
+    BiquadProcessor shelve;
+    shelve.setFilterParams( (float)sampleRate, BiquadProcessor::HighShelf, 1500.f, 0.5f, 4.f );
+    BiquadProcessor highPass;
+    highPass.setFilterParams( (float)sampleRate, BiquadProcessor::HighPass, 60.f, 0.5f, 0.f );
+
+    const int bankLanes = AudioProcessing::KWeightingFilterBank::stateChannels;
+    for ( int firstLane = 0 ; firstLane < m_numLanes ; firstLane += bankLanes )
+    {
+        AudioProcessing::KWeightingFilterBank * filterBank = m_filterBanks.add( new AudioProcessing::KWeightingFilterBank() );
+        filterBank->setCoefficients( shelve.getCoefficients(), highPass.getCoefficients() );
+    }
+    m_filtered.setSize( bankLanes, m_maxBlockSize );
+
+    m_truePeakHistory.calloc( (size_t)( m_numLanes * AudioProcessing::TruePeak::historySize ) );
+    m_truePeakMax.calloc( (size_t)m_numLanes );
+    m_laneWeighting.malloc( (size_t)m_numLanes );
+    for ( int lane = 0 ; lane < m_numLanes ; ++lane )
+        m_laneWeighting[ lane ] = layout.getWeight( lane % m_numChannels );
+    m_squaredSum.calloc( (size_t)m_numStreams );
+
+    // a block has at most one segment per hop, plus one
+    const int minHopSize = juce::jmax( 1, m_sampleSize100ms / m_hopsPer100ms );
+    m_segments.ensureStorageAllocated( m_maxBlockSize / minHopSize + 2 );
+
+    // window of position p ends at p - 1, leaving value is p - 1 - windowSize: one more value than short term window
+    const int windowSize = LufsProcessor::shortTermBlocks * m_hopsPer100ms + 1;
+    const int historySize = juce::jmax( 1, historySeconds * 10 * m_hopsPer100ms );
+    for ( int s = 0 ; s < m_numStreams ; ++s )
+        m_streams.add( new Stream( windowSize, historySize, m_numChannels ) );
+}
+
+void LufsStreamEngine::processBlock( const float * const * channels, const int numSamples )
+{
+    jassert( numSamples <= m_maxBlockSize );
+
+    if ( m_sampleSize100ms == 0 )
+        return;
+
+    // filter states decaying into silence would become denormals
+    const AudioProcessing::ScopedNoDenormals noDenormals( true );
+
+    // hops are the same for all streams: block is split in segments once, as LufsProcessor::processBlock does
+    m_segments.clearQuick();
+    for ( int offset = 0 ; offset < numSamples ; )
+    {
+        const int hopSize = LufsProcessor::getHopSize( m_sampleSize100ms, m_hopsPer100ms, m_hopIndex );
+
+        Segment segment;
+        segment.m_offset = offset;
+        segment.m_size = juce::jmin( numSamples - offset, hopSize - m_segmentSize );
+        segment.m_beginsHop = ( m_segmentSize == 0 );
+        segment.m_endsHop = ( m_segmentSize + segment.m_size == hopSize );
+        m_segments.add( segment );
+
+        m_segmentSize += segment.m_size;
+        offset += segment.m_size;
+
+        if ( segment.m_endsHop )
+        {
+            m_segmentSize = 0;
+            m_hopIndex = ( m_hopIndex + 1 ) % m_hopsPer100ms;
+        }
+    }
+
+    const double nominalHopSize = (double)m_sampleSize100ms / (double)m_hopsPer100ms;
+    const int bankLanes = AudioProcessing::KWeightingFilterBank::stateChannels;
+
+    for ( int i = 0 ; i < m_segments.size() ; ++i )
+    {
+        const Segment & segment = m_segments.getReference( i );
+
+        // lanes of a bank are filtered together, then their filtered and input samples are 
+        // read while still in cache: squared sums are added to their stream, true peaks are per lane
+        for ( int bank = 0 ; bank < m_filterBanks.size() ; ++bank )
+        {
+            const int firstLane = bank * bankLanes;
+            const int numBankLanes = juce::jmin( bankLanes, m_numLanes - firstLane );
+
+            const juce::AudioSampleBuffer input( const_cast<float * const *>( channels + firstLane ), numBankLanes, segment.m_offset, segment.m_size );
+            m_filterBanks.getUnchecked( bank )->process( input, m_filtered, numBankLanes );
+
+            for ( int l = 0 ; l < numBankLanes ; ++l )
+            {
+                const int lane = firstLane + l;
+
+                const float weightingCoef = m_laneWeighting[ lane ];
+                if ( weightingCoef != 0.f )
+                {
+                    const float * data = m_filtered.getReadPointer( l );
+
+                    float sum = 0.f;
+                    for ( int s = 0 ; s < segment.m_size ; ++s )
+                    {
+                        sum += data[ s ] * data[ s ];
+                    }
+
+                    m_squaredSum[ lane / m_numChannels ] += (double)( sum * weightingCoef );
+                }
+
+                float * history = m_truePeakHistory + lane * AudioProcessing::TruePeak::historySize;
+
+                if ( segment.m_beginsHop )
+                    m_truePeakMax[ lane ] = AudioProcessing::TruePeak::processHistoryAbsMax( history, m_polyphase4AbsMaxKernel );
+
+                m_truePeakMax[ lane ] = AudioProcessing::TruePeak::processChannelAbsMax( history, channels[ lane ] + segment.m_offset, segment.m_size, 
+                                                                                         m_truePeakMax[ lane ], m_polyphase4AbsMaxKernel );
+            }
+        }
+
+        if ( segment.m_endsHop )
+        {
+            for ( int s = 0 ; s < m_numStreams ; ++s )
+            {
+                Stream & stream = *m_streams.getUnchecked( s );
+
+                if ( stream.m_skipHop )
+                    stream.m_skipHop = false;
+                else
+                    addRecord( stream, float( m_squaredSum[ s ] / nominalHopSize ), m_truePeakMax + s * m_numChannels );
+
+                m_squaredSum[ s ] = 0.0;
+            }
+        }
+    }
+}
+
+/**
+    Same measures as LufsProcessor::addRecord then LufsProcessor::updatePositions, for the position of the new record,
+    with the per position helpers of LufsProcessor.
+*/
+void LufsStreamEngine::addRecord( Stream & stream, const float squaredInput, const float * linearTruePeaks )
+{
+    Measures & measures = stream.m_measures;
+    const int position = measures.m_validSize;
+    const int momentaryWindowSize = LufsProcessor::momentaryBlocks * m_hopsPer100ms;
+    const int shortTermWindowSize = LufsProcessor::shortTermBlocks * m_hopsPer100ms;
+    const WindowValues window = { stream.m_window, stream.m_windowSize };
+
+    const float momentarySum = LufsProcessor::getWindowMean( window, position, momentaryWindowSize, stream.m_momentarySum );
+    const float shortTermSum = LufsProcessor::getWindowMean( window, position, shortTermWindowSize, stream.m_shortTermSum );
+
+    measures.m_momentaryVolume = DEFAULT_MIN_VOLUME;
+    if ( position >= momentaryWindowSize )
+    {
+        measures.m_momentaryVolume = LufsProcessor::getWindowVolume( momentarySum );
+
+        if ( LufsProcessor::addGatingWindow( stream.m_sum400ms70, position, m_hopsPer100ms, momentarySum, measures.m_momentaryVolume ) )
+            measures.m_integratedVolume = LufsProcessor::getIntegratedVolume( stream.m_sum400ms70 );
+    }
+
+    measures.m_shortTermVolume = DEFAULT_MIN_VOLUME;
+    if ( position >= shortTermWindowSize )
+    {
+        measures.m_shortTermVolume = LufsProcessor::getWindowVolume( shortTermSum );
+
+        if ( LufsProcessor::addGatingWindow( stream.m_sum3s70, position, m_hopsPer100ms, shortTermSum, measures.m_shortTermVolume ) )
+            LufsProcessor::getLoudnessRange( stream.m_sum3s70, measures.m_rangeMin, measures.m_rangeMax );
+    }
+
+    stream.m_window[ position % stream.m_windowSize ] = squaredInput;
+
+    const float decibelTruePeak = LufsProcessor::addRecordTruePeaks( linearTruePeaks, m_numChannels, nullptr, stream.m_truePeakMaxPerChannelArray, measures.m_maxTruePeak );
+
+    HistoryValue & value = stream.m_history[ position % stream.m_historySize ];
+    value.m_momentaryVolume = HistoryValue::encode( measures.m_momentaryVolume );
+    value.m_shortTermVolume = HistoryValue::encode( measures.m_shortTermVolume );
+    value.m_truePeak = HistoryValue::encode( decibelTruePeak );
+
+    ++measures.m_validSize;
+}
+
+void LufsStreamEngine::resetStream( const int stream )
+{
+    jassert( stream >= 0 && stream < m_numStreams );
+
+    m_streams.getUnchecked( stream )->reset();
+
+    // hops are the same for all streams: a hop already started is dropped, measurement restarts with next hop
+    m_streams.getUnchecked( stream )->m_skipHop = ( m_segmentSize != 0 );
+
+    // true peak state of the stream lanes, as LufsProcessor reset; filters keep their state, input is continuous
+    for ( int lane = stream * m_numChannels ; lane < ( stream + 1 ) * m_numChannels ; ++lane )
+    {
+        float * history = m_truePeakHistory + lane * AudioProcessing::TruePeak::historySize;
+        for ( int i = 0 ; i < AudioProcessing::TruePeak::historySize ; ++i )
+            history[ i ] = 0.f;
+        m_truePeakMax[ lane ] = 0.f;
+    }
+
+    m_squaredSum[ stream ] = 0.0;
+}
+
+LufsStreamEngine::Measures LufsStreamEngine::getMeasures( const int stream ) const
+{
+    return m_streams.getUnchecked( stream )->m_measures;
+}
+
+float LufsStreamEngine::getTruePeakChannelMax( const int stream, const int ch ) const
+{
+    jassert( ch >= 0 && ch < m_numChannels );
+    return m_streams.getUnchecked( stream )->m_truePeakMaxPerChannelArray[ ch ];
+}
+
+int LufsStreamEngine::getHistoryBegin( const int stream ) const
+{
+    const Stream & s = *m_streams.getUnchecked( stream );
+    return juce::jmax( 0, s.m_measures.m_validSize - s.m_historySize );
+}
+
+LufsStreamEngine::HistoryValue LufsStreamEngine::getHistoryValue( const int stream, const int hop ) const
+{
+    const Stream & s = *m_streams.getUnchecked( stream );
+    jassert( hop >= getHistoryBegin( stream ) && hop < s.m_measures.m_validSize );
+    return s.m_history[ hop % s.m_historySize ];
+}
+
+size_t LufsStreamEngine::getAllocatedBytesPerStream() const
+{
+    const Stream & s = *m_streams.getFirst();
+
+    const size_t laneBytes = (size_t)m_numChannels * ( AudioProcessing::TruePeak::historySize + 3 ) * sizeof( float );
+    const size_t histogramBytes = 2 * (size_t)( LufsHistogram::numBins + 1 ) * ( sizeof( int ) + sizeof( double ) );
+    const size_t streamBytes = sizeof( Stream ) + (size_t)s.m_windowSize * sizeof( float ) + (size_t)s.m_historySize * sizeof( HistoryValue );
+    const size_t bankBytes = sizeof( AudioProcessing::KWeightingFilterBank ) * (size_t)m_filterBanks.size() / (size_t)m_numStreams;
+
+    return laneBytes + histogramBytes + streamBytes + sizeof( double ) + bankBytes;
+}
+
+bool LufsStreamEngine::testStreams()
+{
+    // stereo streams with banks of 8 lanes partly used, 5.1 streams with channels of a stream in two
+    // banks, hops which can't divide 100 ms exactly at 44.1 kHz, and 7.1.4 streams
+    const int numConfigs = 4;
+    const int numStreamsArray[ numConfigs ] = { 9, 3, 5, 3 };
+    const int numChannelsArray[ numConfigs ] = { 2, 6, 2, 12 };
+    const double sampleRateArray[ numConfigs ] = { 48000.0, 48000.0, 44100.0, 48000.0 };
+    const int hopMillisecondsArray[ numConfigs ] = { 100, 25, 10, 100 };
+    const int bufferSize = 480;
+    const int seconds = 40;
+
+    bool success = true;
+
+    for ( int config = 0 ; config < numConfigs ; ++config )
+    {
+        const int numStreams = numStreamsArray[ config ];
+        const int numChannels = numChannelsArray[ config ];
+        const double sampleRate = sampleRateArray[ config ];
+        const int hopMilliseconds = hopMillisecondsArray[ config ];
+
+        LufsStreamEngine engine( numStreams, numChannels, sampleRate, bufferSize, hopMilliseconds, 10 );
+
+        juce::OwnedArray<LufsProcessor> processors;
+        for ( int s = 0 ; s < numStreams ; ++s )
+        {
+            LufsProcessor * processor = processors.add( new LufsProcessor( numChannels ) );
+            processor->prepareToPlay( sampleRate, bufferSize );
+            processor->setHopMilliseconds( hopMilliseconds );
+        }
+
+        // noise with level changing every 100 ms, different for each stream; 
+        // stream 0 is silent for its third second, stream 1 is reset after 20 seconds
+        juce::AudioSampleBuffer block( numStreams * numChannels, bufferSize );
+        juce::Random random( 0x1801 + config );
+        juce::HeapBlock<float> levels( numStreams );
+        const int numBlocks = seconds * (int)sampleRate / bufferSize;
+
+        // engine keeps hops of a reset stream aligned with other streams, processor restarts them 
+        // with the block: reset is done at a block beginning a 100 ms block, so that both are the same
+        int resetBlock = 20 * (int)sampleRate / bufferSize;
+        while ( ( resetBlock * bufferSize ) % ( (int)sampleRate / 10 ) != 0 )
+            ++resetBlock;
+
+        for ( int b = 0 ; b < numBlocks ; ++b )
+        {
+            const int position = b * bufferSize;
+            for ( int s = 0 ; s < numStreams ; ++s )
+            {
+                if ( b == 0 || ( position % ( (int)sampleRate / 10 ) ) < bufferSize )
+                    levels[ s ] = 0.001f + 0.5f * random.nextFloat() * random.nextFloat();
+
+                const bool silent = ( s == 0 && position >= 2 * (int)sampleRate && position < 3 * (int)sampleRate );
+                for ( int ch = 0 ; ch < numChannels ; ++ch )
+                {
+                    float * data = block.getWritePointer( s * numChannels + ch );
+                    for ( int i = 0 ; i < bufferSize ; ++i )
+                        data[ i ] = silent ? 0.f : levels[ s ] * ( 2.f * random.nextFloat() - 1.f );
+                }
+            }
+
+            if ( b == resetBlock )
+            {
+                engine.resetStream( 1 );
+                processors[ 1 ]->reset();
+            }
+
+            engine.processBlock( block.getArrayOfReadPointers(), bufferSize );
+
+            for ( int s = 0 ; s < numStreams ; ++s )
+            {
+                juce::AudioSampleBuffer streamBlock( block.getArrayOfWritePointers() + s * numChannels, numChannels, bufferSize );
+                processors[ s ]->processBlock( streamBlock );
+
+                // records are consumed before fifo is full
+                if ( ( b % 100 ) == 0 )
+                    processors[ s ]->update();
+            }
+        }
+
+        for ( int s = 0 ; s < numStreams ; ++s )
+        {
+            LufsProcessor & processor = *processors[ s ];
+            processor.update();
+
+            const Measures measures = engine.getMeasures( s );
+            const int lastPosition = processor.getValidSize() - 1;
+
+            bool measuresDiffer = measures.m_validSize != processor.getValidSize()
+                || fabs( measures.m_integratedVolume - processor.getIntegratedVolume() ) >= 0.01f
+                || fabs( measures.m_rangeMin - processor.getRangeMinVolume() ) >= 0.01f
+                || fabs( measures.m_rangeMax - processor.getRangeMaxVolume() ) >= 0.01f
+                || fabs( measures.m_maxTruePeak - processor.getTruePeak() ) >= 0.01f
+                || fabs( measures.m_momentaryVolume - processor.getMomentaryVolumeArray()[ lastPosition ] ) >= 0.01f
+                || fabs( measures.m_shortTermVolume - processor.getShortTermVolumeArray()[ lastPosition ] ) >= 0.01f;
+
+            for ( int ch = 0 ; ch < numChannels ; ++ch )
+            {
+                if ( fabs( engine.getTruePeakChannelMax( s, ch ) - processor.getTruePeakChannelMax( ch ) ) >= 0.01f )
+                    measuresDiffer = true;
+            }
+
+            if ( measuresDiffer )
+            {
+                DBG( juce::String( "LufsStreamEngine::testStreams measures differ for stream " ) + juce::String( s ) + " of config " + juce::String( config ) );
+                success = false;
+            }
+
+            // history values are rounded to 0.01 dB
+            for ( int position = engine.getHistoryBegin( s ) ; success && position <= lastPosition ; ++position )
+            {
+                const HistoryValue value = engine.getHistoryValue( s, position );
+                if ( fabs( HistoryValue::decode( value.m_momentaryVolume ) - processor.getMomentaryVolumeArray()[ position ] ) > 0.01f
+                    || fabs( HistoryValue::decode( value.m_shortTermVolume ) - processor.getShortTermVolumeArray()[ position ] ) > 0.01f
+                    || fabs( HistoryValue::decode( value.m_truePeak ) - processor.getTruePeakArray()[ position ] ) > 0.01f )
+                {
+                    DBG( juce::String( "LufsStreamEngine::testStreams history differs for stream " ) + juce::String( s ) + " of config " + juce::String( config ) + " at " + juce::String( position ) );
+                    success = false;
+                }
+            }
+        }
+    }
+
+    return success;
+}
+
+void LufsStreamEngine::testSpeed( const int numStreams, const int numChannels, const int bufferSize, const int seconds, 
+                                  double & processorsMilliseconds, double & engineMilliseconds )
+{
+    // one second of noise with level changing every 100 ms, read by each stream from a different block
+    const double sampleRate = 48000.0;
+    const int numSignalBlocks = (int)sampleRate / bufferSize;
+    juce::AudioSampleBuffer signal( numChannels, numSignalBlocks * bufferSize );
+    juce::Random random( 0x1802 );
+    for ( int ch = 0 ; ch < numChannels ; ++ch )
+    {
+        float * data = signal.getWritePointer( ch );
+        for ( int i = 0 ; i < signal.getNumSamples() ; ++i )
+        {
+            const float level = 0.1f + 0.08f * (float)( ( i * 10 ) / signal.getNumSamples() );
+            data[ i ] = level * ( 2.f * random.nextFloat() - 1.f );
+        }
+    }
+
+    const int numBlocks = seconds * numSignalBlocks;
+    juce::HeapBlock<float *> channels( numStreams * numChannels );
+
+    // one processor per stream, updated after each block as an embedding program would
+    {
+        juce::OwnedArray<LufsProcessor> processors;
+        for ( int s = 0 ; s < numStreams ; ++s )
+        {
+            LufsProcessor * processor = processors.add( new LufsProcessor( numChannels ) );
+            processor->prepareToPlay( sampleRate, bufferSize );
+        }
+
+        const juce::int64 ticks = juce::Time::getHighResolutionTicks();
+        for ( int b = 0 ; b < numBlocks ; ++b )
+        {
+            for ( int s = 0 ; s < numStreams ; ++s )
+            {
+                const int signalOffset = ( ( b + 7 * s ) % numSignalBlocks ) * bufferSize;
+                for ( int ch = 0 ; ch < numChannels ; ++ch )
+                    channels[ ch ] = signal.getWritePointer( ch, signalOffset );
+
+                juce::AudioSampleBuffer block( channels, numChannels, bufferSize );
+                processors.getUnchecked( s )->processBlock( block );
+                processors.getUnchecked( s )->update();
+            }
+        }
+        processorsMilliseconds = 1000.0 * juce::Time::highResolutionTicksToSeconds( juce::Time::getHighResolutionTicks() - ticks ) / (double)seconds;
+    }
+
+    {
+        LufsStreamEngine engine( numStreams, numChannels, sampleRate, bufferSize );
+
+        const juce::int64 ticks = juce::Time::getHighResolutionTicks();
+        for ( int b = 0 ; b < numBlocks ; ++b )
+        {
+            for ( int s = 0 ; s < numStreams ; ++s )
+            {
+                const int signalOffset = ( ( b + 7 * s ) % numSignalBlocks ) * bufferSize;
+                for ( int ch = 0 ; ch < numChannels ; ++ch )
+                    channels[ s * numChannels + ch ] = signal.getWritePointer( ch, signalOffset );
+            }
+
+            engine.processBlock( channels, bufferSize );
+        }
+        engineMilliseconds = 1000.0 * juce::Time::highResolutionTicksToSeconds( juce::Time::getHighResolutionTicks() - ticks ) / (double)seconds;
+    }
+}
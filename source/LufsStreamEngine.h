@@ -0,0 +1,165 @@
+/*
+  =================================================================
+
+  This file is part of the LUFS-TruePeak program.
+  Copyright (c) 2015 - Mathieu Pavageau - contact@repetito.com
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  Details of these licenses can be found at: www.gnu.org/licenses
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  =================================================================
+*/
+
+#pragma once 
+
+#include "LufsProcessor.h"
+
+// Measures many streams with the same sample rate and number of channels in one pass, for a 
+// server monitoring hundreds of streams: LufsProcessor costs a filter bank with mostly unused 
+// lanes, a true peak processor, a record fifo and a history lock per stream, and megabytes of history.
+// Channels of all streams are the lanes of the engine: K-weighting filter banks run across
+// streams, 8 lanes at a time, and true peak history of every lane is a single array. Each stream
+// only keeps its window sums, gating histograms and a fixed size ring of compact history values.
+// Measures are the same as LufsProcessor ones. Not thread safe: processBlock and measures
+// are called by the same thread, engines can be run by several threads for several cores
+class LufsStreamEngine
+{
+public:
+
+    // measures of a stream, as LufsProcessor::Snapshot and last momentary and short term volumes
+    struct Measures
+    {
+        int m_validSize; // number of hops processed
+        float m_momentaryVolume;
+        float m_shortTermVolume;
+        float m_integratedVolume;
+        float m_rangeMin;
+        float m_rangeMax;
+        float m_maxTruePeak;
+    };
+
+    // history value of a hop, in 0.01 dB: 6 bytes instead of the 44 bytes of LufsProcessor arrays
+    struct HistoryValue
+    {
+        juce::int16 m_momentaryVolume;
+        juce::int16 m_shortTermVolume;
+        juce::int16 m_truePeak; // max of channels
+
+        static inline juce::int16 encode( const float volume ) { return (juce::int16)juce::roundToInt( 100.f * juce::jlimit( -300.f, 300.f, volume ) ); }
+        static inline float decode( const juce::int16 value ) { return 0.01f * (float)value; }
+    };
+
+    // streams of the channels of layout, processed by blocks of at most maxBlockSize samples; 
+    // each stream keeps historySeconds of history values
+    LufsStreamEngine( const int numStreams, const LufsChannelLayout & layout, const double sampleRate, const int maxBlockSize, 
+                      const int hopMilliseconds = 100, const int historySeconds = 600 );
+
+    // streams of the default layout of numChannels channels
+    LufsStreamEngine( const int numStreams, const int numChannels, const double sampleRate, const int maxBlockSize, 
+                      const int hopMilliseconds = 100, const int historySeconds = 600 );
+
+    // processes numSamples samples of every stream: channel ch of stream s is channels[ s * numChannels + ch ]
+    void processBlock( const float * const * channels, const int numSamples );
+
+    // restarts measurement of a stream at next hop boundary, other streams aren't affected
+    void resetStream( const int stream );
+
+    Measures getMeasures( const int stream ) const;
+
+    // true peak max of channel ch of a stream, in dB
+    float getTruePeakChannelMax( const int stream, const int ch ) const;
+
+    // history of hops [ getHistoryBegin, validSize [ is available, older values are overwritten
+    int getHistoryBegin( const int stream ) const;
+    HistoryValue getHistoryValue( const int stream, const int hop ) const;
+
+    inline int getNumStreams() const { return m_numStreams; }
+    inline int getNumChannels() const { return m_numChannels; }
+    inline int getHopsPer100ms() const { return m_hopsPer100ms; }
+
+    // bytes allocated by the engine, per stream
+    size_t getAllocatedBytesPerStream() const;
+
+    // processes the same streams with LufsStreamEngine and with one LufsProcessor per stream, 
+    // returns false if a measure or a history value differs by 0.01 LU or more
+    static bool testStreams();
+
+    // processes seconds of noise of numStreams streams with one LufsProcessor per stream, then with 
+    // LufsStreamEngine; returns processing times per audio second, in milliseconds
+    static void testSpeed( const int numStreams, const int numChannels, const int bufferSize, const int seconds, 
+                           double & processorsMilliseconds, double & engineMilliseconds );
+
+private:
+
+    // measurement state of a stream, updated once per hop
+    struct Stream
+    {
+        Stream( const int windowSize, const int historySize, const int numChannels );
+        void reset();
+
+        LufsHistogram m_sum400ms70;
+        LufsHistogram m_sum3s70;
+        LufsRunningSum m_momentarySum;
+        LufsRunningSum m_shortTermSum;
+        juce::HeapBlock<float> m_window; // last squared inputs, ring of windowSize values
+        juce::HeapBlock<HistoryValue> m_history; // ring of historySize values
+        Measures m_measures;
+        juce::HeapBlock<float> m_truePeakMaxPerChannelArray; // true peak max decibel volume, per channel
+        bool m_skipHop; // reset during current hop, its record is dropped
+        const int m_windowSize;
+        const int m_historySize;
+        const int m_numChannels;
+    };
+
+    // last squared inputs of a stream, indexed by position as LufsProcessor history arrays
+    struct WindowValues
+    {
+        inline float operator[]( const int position ) const { return m_values[ position % m_size ]; }
+
+        const float * m_values;
+        int m_size;
+    };
+
+    // segment of a block ending at a hop boundary or at the end of the block
+    struct Segment
+    {
+        int m_offset;
+        int m_size;
+        bool m_beginsHop;
+        bool m_endsHop;
+    };
+
+    void addRecord( Stream & stream, const float squaredInput, const float * linearTruePeaks );
+
+    const int m_numStreams;
+    const int m_numChannels;
+    const int m_numLanes; // channels of all streams
+    const int m_maxBlockSize;
+    const int m_sampleSize100ms;
+    const int m_hopsPer100ms;
+
+    // audio processing state, structure of arrays: index is lane, or stream for squared sums
+    juce::OwnedArray<AudioProcessing::KWeightingFilterBank> m_filterBanks; // lanes [ 8 * i, 8 * i + 8 [ of bank i
+    juce::AudioSampleBuffer m_filtered; // K-weighted segment of the lanes of a bank
+    juce::HeapBlock<float> m_truePeakHistory; // historySize samples per lane
+    juce::HeapBlock<float> m_truePeakMax; // linear max of current hop, per lane
+    juce::HeapBlock<float> m_laneWeighting; // BS.1770 weight of the channel of each lane
+    juce::HeapBlock<double> m_squaredSum; // weighted squared sum of current hop, per stream
+    AudioProcessing::Polyphase4AbsMaxKernel m_polyphase4AbsMaxKernel;
+    int m_segmentSize; // number of samples already processed in current hop, same for all streams
+    int m_hopIndex; // index of current hop in its 100 ms block
+    juce::Array<Segment> m_segments;
+
+    juce::OwnedArray<Stream> m_streams;
+
+    JUCE_DECLARE_NON_COPYABLE( LufsStreamEngine )
+};
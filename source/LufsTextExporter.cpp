@@ -0,0 +1,483 @@
+/*
+  =================================================================
+
+  This file is part of the LUFS-TruePeak program.
+  Copyright (c) 2015 - Mathieu Pavageau - contact@repetito.com
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  Details of these licenses can be found at: www.gnu.org/licenses
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  =================================================================
+*/
+
+#include "AppIncsAndDefs.h"
+
+#include "LufsTextExporter.h"
+#include "LufsProcessor.h"
+#include "LufsHistoryIndex.h"
+
+// rows whose values are read at once, with history lock held: 10 minutes
+static const int rowsPerBatch = 600;
+
+// chars of formatted rows written at once to the output stream
+static const int textBufferSize = 1 << 16;
+
+// fixed size buffer of formatted text, flushed to an output stream when full
+class LufsTextBuffer
+{
+public:
+
+    LufsTextBuffer( juce::OutputStream & outputStream )
+        : m_outputStream( outputStream )
+        , m_data( textBufferSize )
+        , m_size( 0 )
+        , m_failed( false )
+    {
+    }
+
+    // returns room for count chars, to be followed by commit
+    inline char * reserve( const int count )
+    {
+        jassert( count <= textBufferSize );
+        if ( m_size + count > textBufferSize )
+            flush();
+        return m_data + m_size;
+    }
+
+    inline void commit( const int count ) { m_size += count; }
+
+    inline void append( const char c ) { *reserve( 1 ) = c; commit( 1 ); }
+
+    void append( const char * text, const int length )
+    {
+        if ( length > textBufferSize )
+        {
+            flush();
+            m_failed = m_failed || !m_outputStream.write( text, (size_t)length );
+            return;
+        }
+        memcpy( reserve( length ), text, (size_t)length );
+        commit( length );
+    }
+
+    inline void append( const juce::String & text ) { append( text.toRawUTF8(), (int)text.getNumBytesAsUTF8() ); }
+
+    inline void appendVolume( const float value, const char decimalMark )
+    {
+        commit( LufsTextExporter::formatVolume( value, decimalMark, reserve( LufsTextExporter::maxVolumeChars ) ) );
+    }
+
+    // positive value, with at least two digits if twoDigits
+    void appendInt( int value, const bool twoDigits )
+    {
+        char digits[ 16 ];
+        char * t = digits + 16;
+        do
+        {
+            *--t = (char)( '0' + value % 10 );
+            value /= 10;
+        }
+        while ( value > 0 );
+        if ( twoDigits && t == digits + 15 )
+            *--t = '0';
+        append( t, (int)( digits + 16 - t ) );
+    }
+
+    // returns false if a write to the output stream failed
+    bool flush()
+    {
+        if ( m_size > 0 )
+            m_failed = m_failed || !m_outputStream.write( m_data, (size_t)m_size );
+        m_size = 0;
+        return !m_failed;
+    }
+
+private:
+
+    juce::OutputStream & m_outputStream;
+    juce::HeapBlock<char> m_data;
+    int m_size;
+    bool m_failed;
+
+    JUCE_DECLARE_NON_COPYABLE( LufsTextBuffer )
+};
+
+LufsTextExporter::Result LufsTextExporter::write( const LufsProcessor & processor, juce::OutputStream & outputStream, const bool useCommasForDigitSeparation, 
+    const bool exportTruePeak, const Format format, Progress * progress )
+{
+    // JSON numbers always have a decimal point, csv fields are separated with semicolons when decimal mark is a comma
+    const char decimalMark = ( useCommasForDigitSeparation && format != jsonLines ) ? ',' : '.';
+    const char separator = format == csv ? ( decimalMark == ',' ? ';' : ',' ) : '\t';
+
+    // spreadsheet files end lines with CR LF, as juce::OutputStream::writeText does
+    const char * const lineEnd = format == jsonLines ? "\n" : "\r\n";
+    const int lineEndLength = format == jsonLines ? 1 : 2;
+
+    // channel names of the processor layout, L R C Lfe Ls Rs for 5.1
+    const LufsChannelLayout & layout = processor.getChannelLayout();
+    const int numTruePeaks = exportTruePeak ? layout.getNumChannels() : 0;
+    const int numColumns = 3 + numTruePeaks;
+
+    LufsTextBuffer buffer( outputStream );
+
+    // header line, or JSON keys of true peak values
+    juce::StringArray truePeakKeys;
+    if ( format == jsonLines )
+    {
+        for ( int ch = 0 ; ch < numTruePeaks ; ++ch )
+            truePeakKeys.add( juce::JSON::toString( layout.getChannelName( ch ) ) + ":" );
+    }
+    else
+    {
+        juce::String header = "Time\tMomentary\tShort Term\tIntegrated";
+        for ( int ch = 0 ; ch < numTruePeaks ; ++ch )
+            header += "\tTrue Peak " + layout.getChannelName( ch );
+        buffer.append( header.replaceCharacter( '\t', separator ) );
+        buffer.append( lineEnd, lineEndLength );
+    }
+
+    // seconds published now are exported, unless history is reset meanwhile
+    int generation;
+    int numRows;
+    int ten;
+    {
+        const juce::ScopedLock historyLock( processor.getHistoryLock() );
+        const LufsProcessor::Snapshot snapshot = processor.getSnapshot();
+        generation = processor.getGeneration();
+        ten = 10 * snapshot.m_hopsPer100ms;
+        numRows = juce::jmax( 0, ( snapshot.m_validSize - 1 ) / ten );
+    }
+
+    juce::HeapBlock<float> values( rowsPerBatch * numColumns );
+
+    for ( int firstRow = 0 ; firstRow < numRows ; firstRow += rowsPerBatch )
+    {
+        const int batchRows = juce::jmin( rowsPerBatch, numRows - firstRow );
+
+        // max values of the seconds of the batch, history can't be reset while it is read
+        {
+            const juce::ScopedLock historyLock( processor.getHistoryLock() );
+            if ( processor.getGeneration() != generation )
+                return historyReset;
+
+            const LufsHistoryIndex & index = processor.getHistoryIndex();
+            for ( int row = 0 ; row < batchRows ; ++row )
+            {
+                const int tens = ( firstRow + row ) * ten;
+                float * rowValues = values + row * numColumns;
+                rowValues[ 0 ] = index.getMax( processor.getMomentaryVolumeArray(), tens, tens + ten );
+                rowValues[ 1 ] = index.getMax( processor.getShortTermVolumeArray(), tens, tens + ten );
+                rowValues[ 2 ] = index.getMax( processor.getIntegratedVolumeArray(), tens, tens + ten );
+                for ( int ch = 0 ; ch < numTruePeaks ; ++ch )
+                    rowValues[ 3 + ch ] = index.getMax( processor.getTruePeakChannelArray( ch ), tens, tens + ten );
+            }
+        }
+
+        for ( int row = 0 ; row < batchRows ; ++row )
+        {
+            const int seconds = firstRow + row;
+            const float * rowValues = values + row * numColumns;
+
+            if ( format == jsonLines )
+                buffer.append( "{\"time\":\"", 9 );
+
+            // h:mm:ss
+            buffer.appendInt( seconds / 3600, false );
+            buffer.append( ':' );
+            buffer.appendInt( ( seconds / 60 ) % 60, true );
+            buffer.append( ':' );
+            buffer.appendInt( seconds % 60, true );
+
+            if ( format == jsonLines )
+            {
+                buffer.append( "\",\"momentary\":", 14 );
+                buffer.appendVolume( rowValues[ 0 ], decimalMark );
+                buffer.append( ",\"shortTerm\":", 13 );
+                buffer.appendVolume( rowValues[ 1 ], decimalMark );
+                buffer.append( ",\"integrated\":", 14 );
+                buffer.appendVolume( rowValues[ 2 ], decimalMark );
+                if ( numTruePeaks > 0 )
+                {
+                    buffer.append( ",\"truePeak\":{", 13 );
+                    for ( int ch = 0 ; ch < numTruePeaks ; ++ch )
+                    {
+                        if ( ch > 0 )
+                            buffer.append( ',' );
+                        buffer.append( truePeakKeys[ ch ] );
+                        buffer.appendVolume( rowValues[ 3 + ch ], decimalMark );
+                    }
+                    buffer.append( '}' );
+                }
+                buffer.append( '}' );
+            }
+            else
+            {
+                for ( int column = 0 ; column < numColumns ; ++column )
+                {
+                    buffer.append( separator );
+                    buffer.appendVolume( rowValues[ column ], decimalMark );
+                }
+            }
+            buffer.append( lineEnd, lineEndLength );
+        }
+
+        if ( !buffer.flush() )
+            return writeFailed;
+
+        if ( progress != nullptr && !progress->exportProgress( (double)( firstRow + batchRows ) / (double)numRows ) )
+            return cancelled;
+    }
+
+    if ( !buffer.flush() )
+        return writeFailed;
+
+    outputStream.flush();
+    return exported;
+}
+
+const char * LufsTextExporter::getFormatName( const Format format )
+{
+    switch ( format )
+    {
+    case csv: return "CSV";
+    case jsonLines: return "JSON Lines";
+    default: return "Tab separated text";
+    }
+}
+
+const char * LufsTextExporter::getFileExtension( const Format format )
+{
+    switch ( format )
+    {
+    case csv: return "csv";
+    case jsonLines: return "jsonl";
+    default: return "txt";
+    }
+}
+
+int LufsTextExporter::formatVolume( const float value, const char decimalMark, char * destination )
+{
+    const double n = (double)value;
+
+    // digits of value rounded to tenths, written backwards, as juce::String does for decimal places
+    if ( n > -1.0e15 && n < 1.0e15 )
+    {
+        char digits[ maxVolumeChars ];
+        char * t = digits + maxVolumeChars;
+        juce::int64 v = (juce::int64)( 10.0 * std::abs( n ) + 0.5 );
+
+        *--t = (char)( '0' + v % 10 );
+        v /= 10;
+        *--t = decimalMark;
+        do
+        {
+            *--t = (char)( '0' + v % 10 );
+            v /= 10;
+        }
+        while ( v > 0 );
+
+        if ( n < 0 )
+            *--t = '-';
+
+        const int length = (int)( digits + maxVolumeChars - t );
+        memcpy( destination, t, (size_t)length );
+        return length;
+    }
+
+    // infinite, not a number, or out of range of dB values
+    const juce::String text = juce::String( value, 1 ).replaceCharacter( '.', decimalMark );
+    const int length = juce::jmin( (int)maxVolumeChars, (int)text.getNumBytesAsUTF8() );
+    memcpy( destination, text.toRawUTF8(), (size_t)length );
+    return length;
+}
+
+float LufsTextExporter::getMax( const LufsHistoryArray & array, const int begin, const int count )
+{
+    float maxValue = DEFAULT_MIN_VOLUME;
+    for ( int i = 0 ; i < count ; ++i )
+    {
+        const float value = array[ begin + i ];
+        if ( maxValue < value )
+            maxValue = value;
+    }
+
+    return maxValue;
+}
+
+// lines built with juce::String, as exported before rows were streamed
+static juce::String makeReferenceText( const LufsProcessor & processor, const bool useCommas, const bool exportTruePeak, const LufsTextExporter::Format format )
+{
+    const LufsChannelLayout & layout = processor.getChannelLayout();
+    const bool json = format == LufsTextExporter::jsonLines;
+
+    juce::String text;
+    if ( !json )
+    {
+        text = "Time\tMomentary\tShort Term\tIntegrated";
+        if ( exportTruePeak )
+        {
+            for ( int ch = 0 ; ch < layout.getNumChannels() ; ++ch )
+                text += "\tTrue Peak " + layout.getChannelName( ch );
+        }
+        text += "\n";
+    }
+
+    const LufsProcessor::Snapshot snapshot = processor.getSnapshot();
+    const int ten = 10 * snapshot.m_hopsPer100ms;
+    for ( int tens = 0; tens < snapshot.m_validSize - ten ; tens += ten )
+    {
+        const int seconds = tens / ten;
+        juce::String time( seconds / 3600 );
+        time << ":" << juce::String( ( seconds / 60 ) % 60 ).paddedLeft( '0', 2 ) << ":" << juce::String( seconds % 60 ).paddedLeft( '0', 2 );
+
+        juce::Array<float> values;
+        values.add( LufsTextExporter::getMax( processor.getMomentaryVolumeArray(), tens, ten ) );
+        values.add( LufsTextExporter::getMax( processor.getShortTermVolumeArray(), tens, ten ) );
+        values.add( LufsTextExporter::getMax( processor.getIntegratedVolumeArray(), tens, ten ) );
+        for ( int ch = 0 ; exportTruePeak && ch < layout.getNumChannels() ; ++ch )
+            values.add( LufsTextExporter::getMax( processor.getTruePeakChannelArray( ch ), tens, ten ) );
+
+        juce::String line;
+        if ( json )
+        {
+            line << "{\"time\":\"" << time << "\",\"momentary\":" << juce::String( values[ 0 ], 1 )
+                << ",\"shortTerm\":" << juce::String( values[ 1 ], 1 ) << ",\"integrated\":" << juce::String( values[ 2 ], 1 );
+            if ( exportTruePeak )
+            {
+                line << ",\"truePeak\":{";
+                for ( int ch = 0 ; ch < layout.getNumChannels() ; ++ch )
+                    line << ( ch > 0 ? "," : "" ) << "\"" << layout.getChannelName( ch ) << "\":" << juce::String( values[ 3 + ch ], 1 );
+                line << "}";
+            }
+            line << "}\n";
+        }
+        else
+        {
+            line = time;
+            for ( int i = 0 ; i < values.size() ; ++i )
+                line << "\t" << juce::String( values[ i ], 1 );
+            line << "\n";
+            if ( useCommas )
+                line = line.replaceCharacter( '.', ',' );
+        }
+
+        text << line;
+    }
+
+    if ( format == LufsTextExporter::csv )
+        text = text.replaceCharacter( '\t', useCommas ? ';' : ',' );
+
+    return text;
+}
+
+// cancels export after a number of progress calls
+class LufsCancellingProgress : public LufsTextExporter::Progress
+{
+public:
+
+    LufsCancellingProgress( const int numCallsBeforeCancel ) : m_numCalls( 0 ), m_numCallsBeforeCancel( numCallsBeforeCancel ), m_lastProgress( 0.0 ) {}
+
+    virtual bool exportProgress( const double progress ) override
+    {
+        jassert( progress > m_lastProgress );
+        m_lastProgress = progress;
+        return ++m_numCalls < m_numCallsBeforeCancel;
+    }
+
+    int m_numCalls;
+    int m_numCallsBeforeCancel;
+    double m_lastProgress;
+};
+
+bool LufsTextExporter::testFormats()
+{
+    bool success = true;
+
+    // values of the history range, with ties and values rounded to minus zero
+    juce::Random random( 0x1770 );
+    for ( int i = 0 ; i < 100000 ; ++i )
+    {
+        float value;
+        switch ( i % 4 )
+        {
+        case 0: value = -100.f + 110.f * random.nextFloat(); break;
+        case 1: value = (float)( i / 4 - 12500 ) * 0.05f; break;
+        case 2: value = (float)( i / 4 - 12500 ) * 0.25f; break;
+        default: value = ( random.nextFloat() - 0.5f ) * 0.2f; break;
+        }
+
+        char text[ maxVolumeChars ];
+        const int length = formatVolume( value, '.', text );
+        if ( juce::String( text, (size_t)length ) != juce::String( value, 1 ) )
+        {
+            DBG( juce::String( "LufsTextExporter::testFormats " ) + juce::String( text, (size_t)length ) + " instead of " + juce::String( value, 1 ) );
+            success = false;
+            break;
+        }
+    }
+
+    // 11 minutes of history so that rows are exported in two batches
+    const int hopArray[] = { 100, 25, 10 };
+    for ( int h = 0 ; h < 3 ; ++h )
+    {
+        LufsProcessor processor( 6 );
+        processor.prepareToPlay( 48000.0, 512 );
+        processor.setHopMilliseconds( hopArray[ h ] );
+
+        const int numRecords = 11 * 60 * 1000 / hopArray[ h ] + 3;
+        juce::Array<LufsRecord> records;
+        juce::Array<float> truePeaks;
+        LufsProcessor::makeRandomRecords( random, numRecords, 6, 100 / hopArray[ h ], records, truePeaks );
+        processor.update( records.begin(), truePeaks.begin(), numRecords );
+
+        for ( int format = 0 ; format < numFormats ; ++format )
+        {
+            for ( int options = 0 ; options < 4 ; ++options )
+            {
+                const bool useCommas = ( options & 1 ) != 0;
+                const bool exportTruePeak = ( options & 2 ) != 0;
+
+                juce::MemoryOutputStream outputStream;
+                const Result result = write( processor, outputStream, useCommas, exportTruePeak, (Format)format );
+
+                // text of spreadsheet formats was written with CR LF line ends by writeText
+                juce::MemoryOutputStream referenceStream;
+                const juce::String reference = makeReferenceText( processor, useCommas, exportTruePeak, (Format)format );
+                if ( format == jsonLines )
+                    referenceStream << reference;
+                else
+                    referenceStream.writeText( reference, false, false );
+
+                if ( result != exported || outputStream.getDataSize() != referenceStream.getDataSize() 
+                    || memcmp( outputStream.getData(), referenceStream.getData(), outputStream.getDataSize() ) != 0 )
+                {
+                    DBG( juce::String( "LufsTextExporter::testFormats " ) + getFormatName( (Format)format ) + " differs, hop " + juce::String( hopArray[ h ] ) 
+                        + ", commas " + juce::String( (int)useCommas ) + ", true peak " + juce::String( (int)exportTruePeak ) );
+                    success = false;
+                }
+            }
+        }
+
+        // cancelled after first batch, with only its rows written
+        LufsCancellingProgress progress( 1 );
+        juce::MemoryOutputStream outputStream;
+        const Result result = write( processor, outputStream, false, false, jsonLines, &progress );
+        const juce::String text = outputStream.toUTF8();
+        if ( result != cancelled || progress.m_numCalls != 1 || !text.contains( "\"0:09:59\"" ) || text.contains( "\"0:10:00\"" ) )
+        {
+            DBG( juce::String( "LufsTextExporter::testFormats cancel failed, hop " ) + juce::String( hopArray[ h ] ) );
+            success = false;
+        }
+    }
+
+    return success;
+}
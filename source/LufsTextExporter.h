@@ -0,0 +1,81 @@
+/*
+  =================================================================
+
+  This file is part of the LUFS-TruePeak program.
+  Copyright (c) 2015 - Mathieu Pavageau - contact@repetito.com
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  Details of these licenses can be found at: www.gnu.org/licenses
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  =================================================================
+*/
+
+#pragma once 
+
+class LufsProcessor;
+class LufsHistoryArray;
+
+// Writes measurement history as text, one line per second (max values of the second), to use in 
+// spreadsheets: tab or comma separated values, or JSON Lines. Rows are formatted to a buffer 
+// flushed to the output stream, history lock is only held while values of a batch of rows are read, 
+// so that update isn't blocked by a long export, which can be run from a background thread
+class LufsTextExporter
+{
+public:
+
+    enum Format
+    {
+        tsv = 0,
+        csv, // ';' separated when decimal mark is a comma
+        jsonLines, // one JSON object per line, always with decimal points
+        numFormats
+    };
+
+    enum Result
+    {
+        exported = 0,
+        cancelled,
+        historyReset, // measurement was reset during export, written rows are incomplete
+        writeFailed
+    };
+
+    // receives progress of write, on the writing thread
+    class Progress
+    {
+    public:
+        virtual ~Progress() {}
+
+        // progress from 0 to 1, returns false to cancel export
+        virtual bool exportProgress( const double progress ) = 0;
+    };
+
+    // writes seconds of history published when called, rows added to history during export aren't written
+    static Result write( const LufsProcessor & processor, juce::OutputStream & outputStream, const bool useCommasForDigitSeparation, 
+        const bool exportTruePeak, const Format format = tsv, Progress * progress = nullptr );
+
+    static const char * getFormatName( const Format format );
+    // file extension without dot: txt, csv or jsonl
+    static const char * getFileExtension( const Format format );
+
+    // writes value with one decimal to destination, as juce::String( value, 1 ) does, returns number of chars 
+    // written; destination must hold maxVolumeChars chars
+    static int formatVolume( const float value, const char decimalMark, char * destination );
+
+    enum { maxVolumeChars = 48 };
+
+    // compares formatVolume with juce::String( value, 1 ), and exported tsv, csv and JSON Lines 
+    // with lines built with juce::String, for histories of 10, 25 and 100 ms hops
+    static bool testFormats();
+
+    // max of count values of array from index begin, reading all of them: reference of the history index
+    static float getMax( const LufsHistoryArray & array, const int begin, const int count );
+};
@@ -184,6 +184,8 @@ void LufsTruePeakComponent::audioDeviceAboutToStart( juce::AudioIODevice* device
 {
     m_patch.audioDeviceAboutToStart( device );
 
+    // the processor measures the 5.1 channels of the patch, as a plugin on a 5.1 bus
+    m_processor.setPlayConfigDetails( LUFS_TP_DEFAULT_NB_CHANNELS, 0, device->getCurrentSampleRate(), device->getCurrentBufferSizeSamples() );
     m_processor.prepareToPlay( device->getCurrentSampleRate(), device->getCurrentBufferSizeSamples() );
 }
 
@@ -24,6 +24,7 @@
 #include "LufsAudioProcessor.h"
 #include "LufsTruePeakPluginEditor.h"
 #include "ExportSettingsComponent.h"
+#include "LufsTextExporter.h"
 #include "OptionsComponent.h"
 #include "AboutComponent.h"
 
@@ -97,6 +98,14 @@ LufsTruePeakPluginEditor::LufsTruePeakPluginEditor(LufsAudioProcessor* ownerFilt
     m_optionsButton.setColour( juce::TextButton::textColourOffId, LUFS_COLOR_FONT );
     m_optionsButton.setColour( juce::TextButton::textColourOnId, LUFS_COLOR_BACKGROUND );
     addAndMakeVisible( &m_optionsButton );
+
+    m_sessionButton.setButtonText( juce::String( "Session" ) );
+    m_sessionButton.addListener( this );
+    m_sessionButton.setColour( juce::TextButton::buttonColourId, LUFS_COLOR_BACKGROUND );
+    m_sessionButton.setColour( juce::TextButton::buttonOnColourId, LUFS_COLOR_FONT );
+    m_sessionButton.setColour( juce::TextButton::textColourOffId, LUFS_COLOR_FONT );
+    m_sessionButton.setColour( juce::TextButton::textColourOnId, LUFS_COLOR_BACKGROUND );
+    addAndMakeVisible( &m_sessionButton );
     
     m_chart.setProcessor( getProcessor() );
     addAndMakeVisible( &m_chart );
@@ -184,6 +193,8 @@ void LufsTruePeakPluginEditor::resized()
     x += 10 + width / 2;
     buttonY = 2 * buttonYOffset;
     m_aboutButton.setBounds( x, buttonY, width / 2, buttonHeight );
+    buttonY += ( buttonHeight + buttonYOffset );
+    m_sessionButton.setBounds( x, buttonY, width / 2, buttonHeight );
 
     m_chart.setBounds( imageX, imageY, imageWidth, imageHeight ); 
     m_truePeakComponent.setBounds( imageX + imageWidth, 0, truePeakWidth, imageHeight + imageY);
@@ -199,23 +210,27 @@ void LufsTruePeakPluginEditor::timerCallback()
     //DEBUGPLUGIN_output("LufsTruePeakPluginEditor::timerCallback");
     LufsAudioProcessor* processor = getProcessor();
 
-    processor->m_lufsProcessor.update();
+    // measures are updated by LufsAnalysisThread, only their last published snapshot is read here
+    float momentary = DEFAULT_MIN_VOLUME;
+    float shortTerm = DEFAULT_MIN_VOLUME;
+    LufsProcessor::Snapshot snapshot;
+    {
+        const juce::ScopedLock historyLock( processor->m_lufsProcessor.getHistoryLock() );
 
-    const int validSize = processor->m_lufsProcessor.getValidSize();
+        snapshot = processor->m_lufsProcessor.getSnapshot();
+        if ( snapshot.m_validSize )
+        {
+            momentary = processor->m_lufsProcessor.getMomentaryVolumeArray()[ snapshot.m_validSize - 1 ];
+            shortTerm = processor->m_lufsProcessor.getShortTermVolumeArray()[ snapshot.m_validSize - 1 ];
+        }
+    }
 
-    if ( validSize )
+    if ( snapshot.m_validSize )
     {
-        const float momentary = processor->m_lufsProcessor.getMomentaryVolumeArray()[ validSize - 1 ];
         m_momentaryComponent.setVolume( momentary );
-
-        const float shortTerm = processor->m_lufsProcessor.getShortTermVolumeArray()[ validSize - 1 ];
         m_shortTermComponent.setVolume( shortTerm );
-
-        m_integratedComponent.setVolume( processor->m_lufsProcessor.getIntegratedVolume() );
-
-        const float minRangeVolume = processor->m_lufsProcessor.getRangeMinVolume();
-        const float maxRangeVolume = processor->m_lufsProcessor.getRangeMaxVolume();
-        m_rangeComponent.setVolume( maxRangeVolume - minRangeVolume );
+        m_integratedComponent.setVolume( snapshot.m_integratedVolume );
+        m_rangeComponent.setVolume( snapshot.m_rangeMax - snapshot.m_rangeMin );
     }
     else
     {
@@ -226,7 +241,7 @@ void LufsTruePeakPluginEditor::timerCallback()
         m_truePeakComponent.reset();
     }
 
-    m_timeComponent.setSeconds( processor->m_lufsProcessor.getSeconds() );
+    m_timeComponent.setSeconds( snapshot.m_validSize / ( 10 * snapshot.m_hopsPer100ms ) );
 
     if ( !processor->m_lufsProcessor.isPaused() )
     {
@@ -242,22 +257,16 @@ void LufsTruePeakPluginEditor::buttonClicked (juce::Button* button)
 
     if ( button == &m_resetButton )
     {
-        m_momentaryComponent.resetWarning();
-        m_shortTermComponent.resetWarning();
-        m_integratedComponent.resetWarning();
-        m_rangeComponent.resetWarning();
-
-        m_truePeakComponent.reset();
-        processor->m_lufsProcessor.reset();
-
-        m_chart.resetScrolling();
-        
-        repaint();
+        resetMeasurement();
     }
     else if ( button == &m_pauseButton )
     {
         if ( processor->m_lufsProcessor.isPaused() )
         {
+            // a loaded session log can't be measured further
+            if ( processor->m_lufsProcessor.isSessionLogLoaded() )
+                resetMeasurement();
+
             m_truePeakComponent.resume();
             processor->m_lufsProcessor.resume();
             m_pauseButton.setButtonText( juce::String( "Pause" ) );
@@ -286,10 +295,14 @@ void LufsTruePeakPluginEditor::buttonClicked (juce::Button* button)
         int result = juce::DialogWindow::showModalDialog( "Export volumes to text file (to use in your favorite spreadsheet)", &component, this, LUFS_COLOR_BACKGROUND, true, false, false );
 
         if ( result )
-            exportToText( component.useCommas(), component.exportTruePeak() );
+            exportToText( component.useCommas(), component.exportTruePeak(), component.getFormat() );
         
         m_internallyPaused = false;
     }
+    else if ( button == &m_sessionButton )
+    {
+        showSessionMenu();
+    }
     else if ( button == &m_aboutButton )
     {
         AboutComponent component;
@@ -301,18 +314,61 @@ void LufsTruePeakPluginEditor::buttonClicked (juce::Button* button)
     {
         OptionsComponent component( getProcessor()->m_settings, 
             m_momentaryThreshold, m_shortTermThreshold, m_integratedThreshold, 
-            m_rangeThreshold, m_truePeakThreshold, m_uiUpdateRefreshRateHz);
+            m_rangeThreshold, m_truePeakThreshold, m_uiUpdateRefreshRateHz,
+            *getProcessor()->m_hopMilliseconds);
 
         juce::String about( "Options: threshold volumes for warnings" );
         juce::DialogWindow::showModalDialog( about, &component, this, juce::Colours::grey/*LUFS_COLOR_BACKGROUND*/, true, false, false );
     }
 }
 
-void LufsTruePeakPluginEditor::exportToText( bool useCommasForDigitSeparation, bool exportTruePeak )
+// writes history to a file from its thread, while the progress window is shown
+class LufsExportThread 
+    : public juce::ThreadWithProgressWindow
+    , public LufsTextExporter::Progress
 {
-    LufsAudioProcessor* processor = getProcessor();
+public:
+
+    LufsExportThread( const LufsProcessor & processor, juce::OutputStream & outputStream, const bool useCommasForDigitSeparation, 
+        const bool exportTruePeak, const LufsTextExporter::Format format, juce::Component * parent )
+        : juce::ThreadWithProgressWindow( "Exporting volumes...", true, true, 10000, juce::String::empty, parent )
+        , m_processor( processor )
+        , m_outputStream( outputStream )
+        , m_useCommasForDigitSeparation( useCommasForDigitSeparation )
+        , m_exportTruePeak( exportTruePeak )
+        , m_format( format )
+        , m_result( LufsTextExporter::cancelled )
+    {
+    }
+
+    // juce::Thread
+    virtual void run() override
+    {
+        m_result = LufsTextExporter::write( m_processor, m_outputStream, m_useCommasForDigitSeparation, m_exportTruePeak, m_format, this );
+    }
+
+    // LufsTextExporter::Progress
+    virtual bool exportProgress( const double progress ) override
+    {
+        setProgress( progress );
+        return !threadShouldExit();
+    }
 
-    const int updateSize = processor->m_lufsProcessor.getValidSize();
+    inline LufsTextExporter::Result getResult() const { return m_result; }
+
+private:
+
+    const LufsProcessor & m_processor;
+    juce::OutputStream & m_outputStream;
+    const bool m_useCommasForDigitSeparation;
+    const bool m_exportTruePeak;
+    const LufsTextExporter::Format m_format;
+    LufsTextExporter::Result m_result;
+};
+
+void LufsTruePeakPluginEditor::exportToText( bool useCommasForDigitSeparation, bool exportTruePeak, LufsTextExporter::Format format )
+{
+    LufsAudioProcessor* processor = getProcessor();
 
     const juce::String saveDirString( "saveDirectory" );
     const juce::String saveDir = getProcessor()->m_settings.getUserSettings()->getValue( saveDirString );
@@ -323,105 +379,104 @@ void LufsTruePeakPluginEditor::exportToText( bool useCommasForDigitSeparation, b
     if ( !directory.exists() )
         directory = juce::File::getSpecialLocation( juce::File::userHomeDirectory );
 
-    juce::FileChooser fileChooser( "Select text output file", directory, "*.txt" );
+    const juce::String extension( LufsTextExporter::getFileExtension( format ) );
+    juce::FileChooser fileChooser( "Select " + juce::String( LufsTextExporter::getFormatName( format ) ) + " output file", directory, "*." + extension );
     if ( fileChooser.browseForFileToSave( true ) )
     {
         juce::File file( fileChooser.getResult() );
-        if ( ! file.deleteFile() )
-        {
-            juce::AlertWindow::showMessageBox( juce::AlertWindow::NoIcon, "Unable to delete existing file, not saving.", "" );
-            return;
-        }
+        if ( !file.hasFileExtension( extension ) )
+            file = file.withFileExtension( extension );
 
         // save chosen directory
         getProcessor()->m_settings.getUserSettings()->getValue( saveDirString, file.getParentDirectory().getFullPathName() );
 
-        juce::FileOutputStream outputStream( file );
-
-        juce::String text = "Time\tMomentary\tShort Term\tIntegrated";
-        
-        if (exportTruePeak)
-            text += "\tTrue Peak L\tTrue Peak R\tTrue Peak C\tTrue Peak Lfe\tTrue Peak Ls\tTrue Peak Rs";
-            // kSpeakerArr51 is "L R C Lfe Ls Rs";
-        text += "\n";
-
-        int ten = 10;
-        for ( int tens = 0; tens < updateSize - ten ; tens += ten )
+        // written to a temporary file, that replaces the chosen file once export is complete
+        juce::TemporaryFile temporaryFile( file );
+        LufsTextExporter::Result result = LufsTextExporter::writeFailed;
         {
-            // add time 
-            const int seconds = tens / 10;
-            const int hours = seconds / 3600;
-            const int minutes = ( seconds - hours * 3600 ) / 60;
-            int shownSeconds = seconds - hours * 3600 - minutes * 60;
-            juce::String line( hours );
-            line << ":";
-            if ( minutes < 10 )
-                line << "0";
-            line << minutes;
-            line << ":";
-            if ( shownSeconds < 10 )
-                line << "0";
-            line << shownSeconds;
-            line << "\t";
-
-            // add momentary
-            float momentary = DEFAULT_MIN_VOLUME;
-            for ( int i = 0 ; i < ten ; ++i )
+            juce::FileOutputStream outputStream( temporaryFile.getFile() );
+            if ( outputStream.openedOk() )
             {
-                float val = processor->m_lufsProcessor.getMomentaryVolumeArray()[ tens + i ];
-                if ( momentary < val  )
-                    momentary = val;
+                LufsExportThread exportThread( processor->m_lufsProcessor, outputStream, useCommasForDigitSeparation, exportTruePeak, format, this );
+                exportThread.runThread();
+                result = exportThread.getResult();
             }
-            line << juce::String( momentary, 1 );
-            line << "\t";
+        }
 
-            // add short term
-            float shortTerm = DEFAULT_MIN_VOLUME;
-            for ( int i = 0 ; i < ten ; ++i )
-            {
-                float val = processor->m_lufsProcessor.getShortTermVolumeArray()[ tens + i ];
-                if ( shortTerm < val  )
-                    shortTerm = val;
-            }
-            line << juce::String( shortTerm, 1 );
-            line << "\t";
+        if ( result == LufsTextExporter::exported && !temporaryFile.overwriteTargetFileWithTemporary() )
+            result = LufsTextExporter::writeFailed;
 
-            // add integrated
-            float integrated = DEFAULT_MIN_VOLUME;
-            for ( int i = 0 ; i < ten ; ++i )
-            {
-                float val = processor->m_lufsProcessor.getIntegratedVolumeArray()[ tens + i ];
-                if ( integrated < val  )
-                    integrated = val;
-            }
-            line << juce::String( integrated, 1 );
-            
-            if ( exportTruePeak )
-            {
-                for ( int truePeakCh = 0 ; truePeakCh < LUFS_TP_MAX_NB_CHANNELS ; ++truePeakCh )
-                {
-                    line << "\t";
-                    
-                    float truePeakDecibelVolume = DEFAULT_MIN_VOLUME;
-                    for ( int i = 0 ; i < ten ; ++i )
-                    {
-                        float val = processor->m_lufsProcessor.getTruePeakChannelArray(truePeakCh)[ tens + i ];
-                        if ( truePeakDecibelVolume < val  )
-                            truePeakDecibelVolume = val;
-                    }
-                    line << juce::String( truePeakDecibelVolume, 1 );
-                }
-            }
-            
-            line << "\n";
+        if ( result == LufsTextExporter::historyReset )
+            juce::AlertWindow::showMessageBox( juce::AlertWindow::NoIcon, "Measurement was reset during export, not saving.", "" );
+        else if ( result == LufsTextExporter::writeFailed )
+            juce::AlertWindow::showMessageBox( juce::AlertWindow::NoIcon, "Unable to write file, not saving.", "" );
+    }
+}
+
+void LufsTruePeakPluginEditor::resetMeasurement()
+{
+    m_momentaryComponent.resetWarning();
+    m_shortTermComponent.resetWarning();
+    m_integratedComponent.resetWarning();
+    m_rangeComponent.resetWarning();
+
+    m_truePeakComponent.reset();
+    getProcessor()->m_lufsProcessor.reset();
+
+    m_chart.resetScrolling();
+    
+    repaint();
+}
+
+void LufsTruePeakPluginEditor::showSessionMenu()
+{
+    LufsAudioProcessor* processor = getProcessor();
+
+    enum { writeItem = 1, openItem, showFolderItem };
 
-            if ( useCommasForDigitSeparation )
-                line = line.replaceCharacter( '.', ',' );
+    juce::PopupMenu menu;
+    menu.addItem( writeItem, "Write session logs", true, processor->isSessionLogEnabled() );
+    menu.addItem( openItem, "Open session log..." );
+    menu.addItem( showFolderItem, "Show session logs folder" );
 
-            text << line;
+    const int result = menu.showAt( &m_sessionButton );
+    if ( result == writeItem )
+    {
+        processor->setSessionLogEnabled( !processor->isSessionLogEnabled() );
+    }
+    else if ( result == openItem )
+    {
+        juce::FileChooser fileChooser( "Select session log", LufsAudioProcessor::getSessionLogDirectory(), "*.lufslog" );
+        if ( !fileChooser.browseForFileToOpen() )
+            return;
+
+        // history is replaced by the mapped file, shown as a paused measurement
+        juce::String error;
+        if ( !processor->m_lufsProcessor.loadSessionLog( fileChooser.getResult(), error ) )
+        {
+            juce::AlertWindow::showMessageBox( juce::AlertWindow::NoIcon, "Unable to open session log.", error );
+            return;
         }
 
-        outputStream.writeText( text, false, false );
+        m_momentaryComponent.resetWarning();
+        m_shortTermComponent.resetWarning();
+        m_integratedComponent.resetWarning();
+        m_rangeComponent.resetWarning();
+        m_truePeakComponent.reset();
+        m_truePeakComponent.pause();
+        m_pauseButton.setButtonText( juce::String( "Resume" ) );
+
+        m_chart.resetScrolling();
+        m_chart.update();
+        m_truePeakComponent.update();
+
+        repaint();
+    }
+    else if ( result == showFolderItem )
+    {
+        const juce::File directory( LufsAudioProcessor::getSessionLogDirectory() );
+        directory.createDirectory();
+        directory.revealToUser();
     }
 }
 
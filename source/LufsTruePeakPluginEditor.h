@@ -28,6 +28,7 @@
 #include "TimeComponent.h"
 #include "TruePeakComponent.h"
 #include "Chart.h"
+#include "LufsTextExporter.h"
 
 
 
@@ -62,7 +63,14 @@ public:
 
 private:
 
-    void exportToText( bool useCommasForDigitSeparation, bool exportTruePeak );
+    // writes history from a background thread, showing progress and allowing to cancel
+    void exportToText( bool useCommasForDigitSeparation, bool exportTruePeak, LufsTextExporter::Format format );
+
+    // clears warnings, history and chart, then measures again
+    void resetMeasurement();
+
+    // menu to write session logs, or to show one instead of measuring
+    void showSessionMenu();
 
     CustomLookAndFeel m_customLookAndFeel;
     
@@ -80,6 +88,7 @@ private:
     juce::TextButton m_exportButton;
     juce::TextButton m_optionsButton;
     juce::TextButton m_aboutButton;
+    juce::TextButton m_sessionButton;
 
     juce::ScopedPointer<juce::ResizableCornerComponent> resizer;
     juce::ComponentBoundsConstrainer resizeLimits;
@@ -22,6 +22,13 @@
 #include "AppIncsAndDefs.h"
 
 #include "AudioProcessing.h"
+#include "AudioStreamReader.h"
+#include "LufsFileAnalyzer.h"
+#include "LufsHistoryIndex.h"
+#include "LufsHistoryPyramid.h"
+#include "LufsSessionLog.h"
+#include "LufsStreamEngine.h"
+#include "LufsTextExporter.h"
 #include "LufsTruePeakComponent.h"
 #include "OptionsComponent.h"
 
@@ -102,7 +109,86 @@ public:
 
         if ( tokens.size() > 0 && tokens[0].length() )
         {
-            if ( tokens[0].toLowerCase().endsWith( ".wav" ) )
+            if ( tokens[0] == "-test" )
+            {
+                const bool polyphase4Kernels = AudioProcessing::TestPolyphase4Kernels();
+                DBG(juce::String("AudioProcessing::TestPolyphase4Kernels ") + ( polyphase4Kernels ? "OK" : "FAILED" ));
+
+                const bool gating = LufsProcessor::testGating();
+                DBG(juce::String("LufsProcessor::testGating ") + ( gating ? "OK" : "FAILED" ));
+
+                const bool loudnessRange = LufsProcessor::testLoudnessRange();
+                DBG(juce::String("LufsProcessor::testLoudnessRange ") + ( loudnessRange ? "OK" : "FAILED" ));
+
+                const bool windowMeans = LufsProcessor::testWindowMeans();
+                DBG(juce::String("LufsProcessor::testWindowMeans ") + ( windowMeans ? "OK" : "FAILED" ));
+
+                const bool recordFifo = LufsProcessor::testRecordFifo();
+                DBG(juce::String("LufsProcessor::testRecordFifo ") + ( recordFifo ? "OK" : "FAILED" ));
+
+                const bool hops = LufsProcessor::testHops();
+                DBG(juce::String("LufsProcessor::testHops ") + ( hops ? "OK" : "FAILED" ));
+
+                const bool channelLayouts = LufsProcessor::testChannelLayouts();
+                DBG(juce::String("LufsProcessor::testChannelLayouts ") + ( channelLayouts ? "OK" : "FAILED" ));
+
+                const bool kWeighting = LufsProcessor::testKWeighting();
+                DBG(juce::String("LufsProcessor::testKWeighting ") + ( kWeighting ? "OK" : "FAILED" ));
+
+                const bool snapshots = LufsAnalysisThread::testSnapshots();
+                DBG(juce::String("LufsAnalysisThread::testSnapshots ") + ( snapshots ? "OK" : "FAILED" ));
+
+                const bool streamChunks = AudioStreamReader::testChunks();
+                DBG(juce::String("AudioStreamReader::testChunks ") + ( streamChunks ? "OK" : "FAILED" ));
+
+                const bool fileSegments = LufsFileAnalyzer::testSegments();
+                DBG(juce::String("LufsFileAnalyzer::testSegments ") + ( fileSegments ? "OK" : "FAILED" ));
+
+                const bool memoryMapped = LufsFileAnalyzer::testMemoryMapped();
+                DBG(juce::String("LufsFileAnalyzer::testMemoryMapped ") + ( memoryMapped ? "OK" : "FAILED" ));
+
+                const bool streamEngine = LufsStreamEngine::testStreams();
+                DBG(juce::String("LufsStreamEngine::testStreams ") + ( streamEngine ? "OK" : "FAILED" ));
+
+                const bool exportFormats = LufsTextExporter::testFormats();
+                DBG(juce::String("LufsTextExporter::testFormats ") + ( exportFormats ? "OK" : "FAILED" ));
+
+                const bool sessionLog = LufsSessionLog::testReload();
+                DBG(juce::String("LufsSessionLog::testReload ") + ( sessionLog ? "OK" : "FAILED" ));
+
+                const bool historyPyramid = LufsHistoryPyramid::testRanges();
+                DBG(juce::String("LufsHistoryPyramid::testRanges ") + ( historyPyramid ? "OK" : "FAILED" ));
+
+                const bool historyIndex = LufsHistoryIndex::testQueries();
+                DBG(juce::String("LufsHistoryIndex::testQueries ") + ( historyIndex ? "OK" : "FAILED" ));
+
+                systemRequestedQuit();
+            }
+            else if ( tokens[0] == "-benchmark" )
+            {
+                for ( int bufferSize = 32 ; bufferSize <= 8192 ; bufferSize *= 2 )
+                {
+                    const double milliseconds = LufsProcessor::testProcessBlockSpeed( 48000, 6, bufferSize, 30 );
+                    DBG(juce::String("LufsProcessor::testProcessBlockSpeed 6 channels ") + juce::String(bufferSize) + " samples: " + juce::String(milliseconds, 3) + " ms per second");
+                }
+
+                for ( int protection = 1 ; protection >= 0 ; --protection )
+                {
+                    const double milliseconds = LufsProcessor::testSilenceSpeed( 48000, 6, 512, 30, protection != 0 );
+                    DBG(juce::String("LufsProcessor::testSilenceSpeed 6 channels 512 samples, denormal protection ") + ( protection ? "on: " : "off: " ) + juce::String(milliseconds, 3) + " ms per second");
+                }
+
+                for ( int numStreams = 8 ; numStreams <= 256 ; numStreams *= 4 )
+                {
+                    double processorsMilliseconds, engineMilliseconds;
+                    LufsStreamEngine::testSpeed( numStreams, 2, 480, 10, processorsMilliseconds, engineMilliseconds );
+                    DBG(juce::String("LufsStreamEngine::testSpeed ") + juce::String(numStreams) + " stereo streams 480 samples: processors " + juce::String(processorsMilliseconds, 3) 
+                        + " ms, engine " + juce::String(engineMilliseconds, 3) + " ms per second");
+                }
+
+                systemRequestedQuit();
+            }
+            else if ( tokens[0].toLowerCase().endsWith( ".wav" ) )
             {
                 juce::File file( tokens[0] );
 
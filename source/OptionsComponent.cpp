@@ -66,17 +66,18 @@ OptionsComponent::OptionsComponent( juce::ApplicationProperties & settings,
         juce::Value & integratedThreshold,
         juce::Value & rangeThreshold,
         juce::Value & truePeakThreshold,
-        juce::Value & uiUpdateRefreshRateHz )
+        juce::Value & uiUpdateRefreshRateHz,
+        juce::Value & hopMilliseconds )
     : m_settings( settings )
 {
-    setSize( 1100, 300 );
+    setSize( 1100, 350 );
     
     m_okButton.setButtonText( juce::String( "OK" ) );
     m_okButton.setColour( juce::TextButton::buttonColourId, LUFS_COLOR_BACKGROUND );
     m_okButton.setColour( juce::TextButton::buttonOnColourId, LUFS_COLOR_FONT );
     m_okButton.setColour( juce::TextButton::textColourOffId, LUFS_COLOR_FONT );
     m_okButton.setColour( juce::TextButton::textColourOnId, LUFS_COLOR_BACKGROUND );
-    m_okButton.setBounds( 600, 215, 100, 50 );
+    m_okButton.setBounds( 600, 265, 100, 50 );
     addAndMakeVisible( &m_okButton );
     m_okButton.addListener( this );
     m_okButton.setWantsKeyboardFocus(true); // doesn't get focus :(
@@ -109,9 +110,27 @@ OptionsComponent::OptionsComponent( juce::ApplicationProperties & settings,
     m_propertyPanel.addSection("UI refresh rate", uiComponents);
 
 
+    juce::Array<juce::PropertyComponent*> measureComponents;
+
+    juce::StringArray hopChoices;
+    hopChoices.add( "10 ms" );
+    hopChoices.add( "25 ms" );
+    hopChoices.add( "100 ms" );
+    juce::Array<juce::var> hopValues;
+    hopValues.add( 10.0 );
+    hopValues.add( 25.0 );
+    hopValues.add( 100.0 );
+    juce::ChoicePropertyComponent * hopComponent = new juce::ChoicePropertyComponent(hopMilliseconds, "Momentary and Short Term update step (resets measure)", hopChoices, hopValues);
+    hopComponent->setColour(juce::PropertyComponent::labelTextColourId, LUFS_COLOR_FONT);
+    hopComponent->setColour(juce::PropertyComponent::backgroundColourId, LUFS_COLOR_BACKGROUND);
+    measureComponents.add(hopComponent);
+
+    m_propertyPanel.addSection("Measure", measureComponents);
+
+
     const int offset = 4;
     addAndMakeVisible(m_propertyPanel);
-    m_propertyPanel.setBounds(offset, offset, getWidth() - 2 * offset, 200);
+    m_propertyPanel.setBounds(offset, offset, getWidth() - 2 * offset, 250);
 }
 
 OptionsComponent::~OptionsComponent()
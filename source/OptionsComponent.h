@@ -35,7 +35,8 @@ public:
         juce::Value & integratedThreshold,
         juce::Value & rangeThreshold,
         juce::Value & truePeakThreshold,
-        juce::Value & uiUpdateRefreshRateHz );
+        juce::Value & uiUpdateRefreshRateHz,
+        juce::Value & hopMilliseconds );
 
     virtual ~OptionsComponent();
 
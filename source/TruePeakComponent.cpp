@@ -36,17 +36,30 @@ TruePeakComponent::TruePeakComponent( float minChartVolume, float maxChartVolume
 {
     addAndMakeVisible( &m_valueComponent );
 
+    m_valueComponent.setValueChangedUpdateObject( this );
+}
+
+void TruePeakComponent::setProcessor( LufsAudioProcessor * processor )
+{
+    m_processor = processor;
+
+    // channel names of the layout, kSpeakerArr51 "L R C Lfe Ls Rs" for a 5.1 bus
+    m_channelNames.clear();
+    {
+        // layout is set under history lock
+        const juce::ScopedLock historyLock( m_processor->m_lufsProcessor.getHistoryLock() );
+        const LufsChannelLayout & layout = m_processor->m_lufsProcessor.getChannelLayout();
+        for ( int ch = 0 ; ch < layout.getNumChannels() ; ++ch )
+            m_channelNames.add( layout.getChannelName( ch ) );
+    }
+
+    m_channelInertiaStruct.resize( m_channelNames.size() );
+    m_valueArrayForY.resize( m_channelNames.size() );
     resetVolumeInertia();
-    
-    // kSpeakerArr51 is "L R C Lfe Ls Rs";
-    m_channelNames.add( "L" );
-    m_channelNames.add( "R" );
-    m_channelNames.add( "C" );
-    m_channelNames.add( "Lfe" );
-    m_channelNames.add( "Ls" );
-    m_channelNames.add( "Rs" );
 
-    m_valueComponent.setValueChangedUpdateObject( this );
+    // bar width depends on the number of channels
+    if ( !getBounds().isEmpty() )
+        resized();
 }
 
 void DEBUGoutput( const char * _text, ...)
@@ -86,16 +99,29 @@ void TruePeakComponent::paint( juce::Graphics & g )
     const juce::Colour colorMax = juce::Colours::white;
 
     int x;
-    int valueArrayForY[LUFS_TP_MAX_NB_CHANNELS];
+    int * valueArrayForY = m_valueArrayForY.getRawDataPointer();
+
+    // history can't be reset while it is read, and may have been reset since last update; 
+    // channels may also have changed since last update, bars follow at next update
+    const juce::ScopedLock historyLock( m_processor->m_lufsProcessor.getHistoryLock() );
+    const int numChannels = juce::jmin( m_channelNames.size(), m_processor->m_lufsProcessor.getNumChannels() );
+    const LufsProcessor::Snapshot snapshot = m_processor->m_lufsProcessor.getSnapshot();
+    const int hopsPer100ms = snapshot.m_hopsPer100ms;
+    const int validSize = juce::jmin( m_validSize, snapshot.m_validSize ) / hopsPer100ms; // in 100 ms blocks
     
-    if ( m_validSize )
+    if ( validSize )
     {
-        const int currentIndex = m_validSize - 1;
+        const int currentIndex = validSize - 1;
 
-        for (int ch = 0 ; ch < LUFS_TP_MAX_NB_CHANNELS ; ++ch )
+        for (int ch = 0 ; ch < numChannels ; ++ch )
         {
-            float currentDecibels = m_processor->m_lufsProcessor.getTruePeakChannelArray(ch)[currentIndex];
-            float inertiaVolumeDecibels = m_channelInertiaStruct[ch].getCurrentVolume(currentIndex);
+            // max of the hops of the last 100 ms block
+            const LufsHistoryArray & truePeakArray = m_processor->m_lufsProcessor.getTruePeakChannelArray(ch);
+            float currentDecibels = truePeakArray[currentIndex * hopsPer100ms];
+            for ( int hop = 1 ; hop < hopsPer100ms ; ++hop )
+                currentDecibels = juce::jmax( currentDecibels, truePeakArray[currentIndex * hopsPer100ms + hop] );
+
+            float inertiaVolumeDecibels = m_channelInertiaStruct.getReference(ch).getCurrentVolume(currentIndex);
         
             float uiVolumeDecibels = inertiaVolumeDecibels;
         
@@ -104,8 +130,8 @@ void TruePeakComponent::paint( juce::Graphics & g )
                 uiVolumeDecibels = currentDecibels;
             
                 //store
-                m_channelInertiaStruct[ch].m_index = currentIndex;
-                m_channelInertiaStruct[ch].m_decibelVolume = currentDecibels;
+                m_channelInertiaStruct.getReference(ch).m_index = currentIndex;
+                m_channelInertiaStruct.getReference(ch).m_decibelVolume = currentDecibels;
             }
         
             valueArrayForY[ch] = getVolumeY( uiVolumeDecibels);
@@ -113,12 +139,12 @@ void TruePeakComponent::paint( juce::Graphics & g )
     }
     else
     {
-        for (int ch = 0 ; ch < LUFS_TP_MAX_NB_CHANNELS ; ++ch )
+        for (int ch = 0 ; ch < numChannels ; ++ch )
             valueArrayForY[ch] = m_vumeterHeight;
     }
 
     x = 2 * m_vumeterOffsetX;
-    for (int ch = 0 ; ch < LUFS_TP_MAX_NB_CHANNELS ; ++ch )
+    for (int ch = 0 ; ch < numChannels ; ++ch )
     {
         // use empty image for top
         g.drawImage(m_vumeterImage, x, m_vumeterOffsetY, (int)(m_vumeterImage.getWidth() / 3.f), valueArrayForY[ch], (int)(0.f * m_vumeterImage.getWidth() / 3.f), 0, (int)(m_vumeterImage.getWidth() / 3.f), valueArrayForY[ch]);
@@ -137,7 +163,7 @@ void TruePeakComponent::paint( juce::Graphics & g )
     g.setFont( figureFont );
     
     x = 2 * m_vumeterOffsetX;
-    for (int ch = 0 ; ch < LUFS_TP_MAX_NB_CHANNELS ; ++ch )
+    for (int ch = 0 ; ch < numChannels ; ++ch )
     {
         float maxDecibel = m_processor->m_lufsProcessor.getTruePeakChannelMax(ch);
         int y = getVolumeY( maxDecibel);
@@ -160,7 +186,9 @@ void TruePeakComponent::resized()
     // create image with vumeter colors and vumeter volume indications 
     
     m_vumeterOffsetX = 3;
-    m_vumeterWidth = ( getWidth() - 8 * m_vumeterOffsetX ) / 7;
+    // one bar per channel, and the scale
+    const int numBars = m_channelNames.size() + 1;
+    m_vumeterWidth = ( getWidth() - ( numBars + 1 ) * m_vumeterOffsetX ) / numBars;
     m_vumeterOffsetY = 100;
     m_vumeterHeight = getHeight() - m_vumeterOffsetY - 35;
     m_offsetTextForVolumeY = 21;
@@ -262,6 +290,10 @@ void TruePeakComponent::resized()
 
 void TruePeakComponent::update()
 {
+    // the plugin measures the channels of its bus, which the host can change in prepareToPlay
+    if ( m_processor->m_lufsProcessor.getNumChannels() != m_channelNames.size() )
+        setProcessor( m_processor );
+
     m_validSize = m_processor->m_lufsProcessor.getValidSize();
 
     if ( m_validSize )
@@ -308,10 +340,10 @@ int TruePeakComponent::getVolumeY( const float decibels )
 
 void TruePeakComponent::resetVolumeInertia()
 {
-    for ( int i = 0 ; i < LUFS_TP_MAX_NB_CHANNELS ; ++i )
+    for ( int i = 0 ; i < m_channelInertiaStruct.size() ; ++i )
     {
-        m_channelInertiaStruct[i].m_decibelVolume = DEFAULT_MIN_VOLUME;
-        m_channelInertiaStruct[i].m_index = 0;
+        m_channelInertiaStruct.getReference(i).m_decibelVolume = DEFAULT_MIN_VOLUME;
+        m_channelInertiaStruct.getReference(i).m_index = 0;
     }
 }
 
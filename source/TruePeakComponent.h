@@ -41,7 +41,8 @@ public:
     // TextAndFloatComponent::ValueChangedUpdateObject
     void valueChangeUpdate() override;
     
-    void setProcessor( LufsAudioProcessor * processor ) { m_processor = processor; }
+    // one bar per channel of the processor layout
+    void setProcessor( LufsAudioProcessor * processor );
 
     void update();
 
@@ -68,7 +69,8 @@ private:
         float getCurrentVolume(int index);
     };
     juce::Image m_vumeterImage;
-    InertiaStruct m_channelInertiaStruct[LUFS_TP_MAX_NB_CHANNELS];
+    juce::Array<InertiaStruct> m_channelInertiaStruct;
+    juce::Array<int> m_valueArrayForY; // bar heights of paint, per channel
     juce::StringArray m_channelNames;
     int m_validSize;
     float m_minChartVolume;